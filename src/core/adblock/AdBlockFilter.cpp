@@ -1,6 +1,5 @@
 #include "AdBlockFilter.h"
 #include "Bitfield.h"
-#include "FastHash.h"
 #include "URL.h"
 
 #include <algorithm>
@@ -11,70 +10,67 @@ namespace adblock
 
 Filter::Filter(const QString &rule) :
     m_category(FilterCategory::None),
-    m_ruleString(rule),
-    m_evalString(),
-    m_contentSecurityPolicy(),
     m_exception(false),
     m_important(false),
     m_disabled(false),
     m_redirect(false),
+    m_matchCase(false),
+    m_matchAll(false),
+    m_hitCount(0),
+    m_ruleText(),
+    m_ruleString(rule),
+    m_evalString(),
+    m_contentSecurityPolicy(),
     m_redirectName(),
     m_allowedTypes(ElementType::None),
     m_blockedTypes(ElementType::None),
-    m_matchCase(false),
-    m_matchAll(false),
     m_domainBlacklist(),
     m_domainWhitelist(),
-    m_regExp(nullptr),
-    m_differenceHash(0),
-    m_evalStringHash(0),
-    m_needleWStr()
+    m_regExp(nullptr)
 {
 }
 
 Filter::Filter(const Filter &other) :
     m_category(other.m_category),
-    m_ruleString(other.m_ruleString),
-    m_evalString(other.m_evalString),
-    m_contentSecurityPolicy(other.m_contentSecurityPolicy),
     m_exception(other.m_exception),
     m_important(other.m_important),
     m_disabled(other.m_disabled),
     m_redirect(other.m_redirect),
+    m_matchCase(other.m_matchCase),
+    m_matchAll(other.m_matchAll),
+    m_hitCount(other.m_hitCount.load(std::memory_order_relaxed)),
+    m_ruleText(other.m_ruleText),
+    m_ruleString(other.m_ruleString),
+    m_evalString(other.m_evalString),
+    m_contentSecurityPolicy(other.m_contentSecurityPolicy),
     m_redirectName(other.m_redirectName),
     m_allowedTypes(other.m_allowedTypes),
     m_blockedTypes(other.m_blockedTypes),
-    m_matchCase(other.m_matchCase),
-    m_matchAll(other.m_matchAll),
     m_domainBlacklist(other.m_domainBlacklist),
     m_domainWhitelist(other.m_domainWhitelist),
-    m_regExp(other.m_regExp ? std::make_unique<QRegularExpression>(*other.m_regExp) : nullptr),
-    m_differenceHash(other.m_differenceHash),
-    m_evalStringHash(other.m_evalStringHash),
-    m_needleWStr(other.m_needleWStr)
+    m_regExp(other.m_regExp)
 {
 }
 
 Filter::Filter(Filter &&other) noexcept :
     m_category(other.m_category),
-    m_ruleString(std::move(other.m_ruleString)),
-    m_evalString(std::move(other.m_evalString)),
-    m_contentSecurityPolicy(std::move(other.m_contentSecurityPolicy)),
     m_exception(other.m_exception),
     m_important(other.m_important),
     m_disabled(other.m_disabled),
     m_redirect(other.m_redirect),
+    m_matchCase(other.m_matchCase),
+    m_matchAll(other.m_matchAll),
+    m_hitCount(other.m_hitCount.load(std::memory_order_relaxed)),
+    m_ruleText(other.m_ruleText),
+    m_ruleString(std::move(other.m_ruleString)),
+    m_evalString(std::move(other.m_evalString)),
+    m_contentSecurityPolicy(std::move(other.m_contentSecurityPolicy)),
     m_redirectName(std::move(other.m_redirectName)),
     m_allowedTypes(other.m_allowedTypes),
     m_blockedTypes(other.m_blockedTypes),
-    m_matchCase(other.m_matchCase),
-    m_matchAll(other.m_matchAll),
     m_domainBlacklist(std::move(other.m_domainBlacklist)),
     m_domainWhitelist(std::move(other.m_domainWhitelist)),
-    m_regExp(std::move(other.m_regExp)),
-    m_differenceHash(other.m_differenceHash),
-    m_evalStringHash(other.m_evalStringHash),
-    m_needleWStr(std::move(other.m_needleWStr))
+    m_regExp(std::move(other.m_regExp))
 {
 }
 
@@ -83,24 +79,23 @@ Filter &Filter::operator =(const Filter &other)
     if (this != &other)
     {
         m_category = other.m_category;
-        m_ruleString = other.m_ruleString;
-        m_evalString = other.m_evalString;
-        m_contentSecurityPolicy = other.m_contentSecurityPolicy;
         m_exception = other.m_exception;
         m_important = other.m_important;
         m_disabled = other.m_disabled;
         m_redirect = other.m_redirect;
+        m_matchCase = other.m_matchCase;
+        m_matchAll = other.m_matchAll;
+        m_hitCount.store(other.m_hitCount.load(std::memory_order_relaxed), std::memory_order_relaxed);
+        m_ruleText = other.m_ruleText;
+        m_ruleString = other.m_ruleString;
+        m_evalString = other.m_evalString;
+        m_contentSecurityPolicy = other.m_contentSecurityPolicy;
         m_redirectName = other.m_redirectName;
         m_allowedTypes = other.m_allowedTypes;
         m_blockedTypes = other.m_blockedTypes;
-        m_matchCase = other.m_matchCase;
-        m_matchAll = other.m_matchAll;
         m_domainBlacklist = other.m_domainBlacklist;
         m_domainWhitelist = other.m_domainWhitelist;
-        m_regExp = (other.m_regExp ? std::make_unique<QRegularExpression>(*other.m_regExp) : nullptr);
-        m_differenceHash = other.m_differenceHash;
-        m_evalStringHash = other.m_evalStringHash;
-        m_needleWStr = other.m_needleWStr;
+        m_regExp = other.m_regExp;
     }
 
     return *this;
@@ -111,24 +106,23 @@ Filter &Filter::operator =(Filter &&other) noexcept
     if (this != &other)
     {
         m_category = other.m_category;
-        m_ruleString = other.m_ruleString;
-        m_evalString = other.m_evalString;
-        m_contentSecurityPolicy = other.m_contentSecurityPolicy;
         m_exception = other.m_exception;
         m_important = other.m_important;
         m_disabled = other.m_disabled;
         m_redirect = other.m_redirect;
-        m_redirectName = other.m_redirectName;
-        m_allowedTypes = other.m_allowedTypes;
-        m_blockedTypes = other.m_blockedTypes;
         m_matchCase = other.m_matchCase;
         m_matchAll = other.m_matchAll;
+        m_hitCount.store(other.m_hitCount.load(std::memory_order_relaxed), std::memory_order_relaxed);
+        m_ruleText = other.m_ruleText;
+        m_ruleString = std::move(other.m_ruleString);
+        m_evalString = std::move(other.m_evalString);
+        m_contentSecurityPolicy = std::move(other.m_contentSecurityPolicy);
+        m_redirectName = std::move(other.m_redirectName);
+        m_allowedTypes = other.m_allowedTypes;
+        m_blockedTypes = other.m_blockedTypes;
         m_domainBlacklist = std::move(other.m_domainBlacklist);
         m_domainWhitelist = std::move(other.m_domainWhitelist);
         m_regExp = std::move(other.m_regExp);
-        m_differenceHash = other.m_differenceHash;
-        m_evalStringHash = other.m_evalStringHash;
-        m_needleWStr = other.m_needleWStr;
     }
     return *this;
 }
@@ -144,12 +138,55 @@ FilterCategory Filter::getCategory() const
 
 void Filter::setRule(const QString &rule)
 {
+    m_ruleText = ArenaString();
     m_ruleString = rule;
 }
 
-const QString &Filter::getRule() const
+void Filter::moveRuleToArena(FilterStringArena &arena)
+{
+    if (m_ruleText.isValid())
+        return;
+
+    m_ruleText = arena.append(m_ruleString);
+    m_ruleString = QString();
+}
+
+QString Filter::getRule() const
+{
+    return m_ruleText.isValid() ? m_ruleText.toString() : m_ruleString;
+}
+
+bool Filter::isSameRule(const Filter &other) const
+{
+    if (m_ruleText.isValid() && other.m_ruleText.isValid())
+        return m_ruleText == other.m_ruleText;
+
+    return getRule().compare(other.getRule()) == 0;
+}
+
+uint Filter::getRuleHash() const
+{
+    // FNV-1a over the UTF-16 code units of the rule. Latin-1 code units are the same as their bytes
+    auto hashCodeUnits = [](const auto *data, int size) -> uint {
+        uint hash = 2166136261U;
+        for (int i = 0; i < size; ++i)
+        {
+            hash ^= static_cast<uint>(data[i]);
+            hash *= 16777619U;
+        }
+        return hash;
+    };
+
+    if (m_ruleText.isValid() && m_ruleText.IsLatin1)
+        return hashCodeUnits(reinterpret_cast<const uchar*>(m_ruleText.Data), static_cast<int>(m_ruleText.Size));
+
+    const QString rule = getRule();
+    return hashCodeUnits(rule.utf16(), rule.size());
+}
+
+const ArenaString &Filter::getRuleText() const
 {
-    return m_ruleString;
+    return m_ruleText;
 }
 
 const QString &Filter::getEvalString() const
@@ -189,19 +226,7 @@ const QString &Filter::getRedirectName() const
 
 bool Filter::isMatch(const QString &baseUrl, const QString &requestUrl, const QString &requestDomain, ElementType typeMask) const
 {
-    if (m_disabled)
-        return false;
-
-    // Check for domain restrictions
-    if (hasDomainRules() && !isDomainStyleMatch(baseUrl))
-        return false;
-
-    // Special cases
-    if (typeMask == ElementType::InlineScript && !hasElementType(m_blockedTypes, ElementType::InlineScript))
-        return false;
-    if (hasElementType(m_blockedTypes, ElementType::ThirdParty) && !hasElementType(typeMask, ElementType::ThirdParty))
-        return false;
-    if (hasElementType(m_allowedTypes, ElementType::ThirdParty) && hasElementType(typeMask, ElementType::ThirdParty))
+    if (!isRequestRestrictionMatch(baseUrl, typeMask))
         return false;
 
     bool match = m_matchAll;
@@ -220,7 +245,7 @@ bool Filter::isMatch(const QString &baseUrl, const QString &requestUrl, const QS
                 match = isDomainMatch(requestDomain, m_evalString);
                 break;
             case FilterCategory::DomainStart:
-                match = isDomainStartMatch(requestUrl, URL(requestDomain).getSecondLevelDomain());
+                match = isDomainStartMatch(requestUrl, requestDomain);
                 break;
             case FilterCategory::StringStartMatch:
                 match = requestUrl.startsWith(m_evalString, caseSensitivity);
@@ -232,48 +257,60 @@ bool Filter::isMatch(const QString &baseUrl, const QString &requestUrl, const QS
                 match = (requestUrl.compare(m_evalString, caseSensitivity) == 0);
                 break;
             case FilterCategory::StringContains:
-            {
-                QString haystack = (m_matchCase ? requestUrl : requestUrl.toLower());
-                std::wstring haystackWStr = haystack.toStdWString();
-                match = FastHash::isMatch(m_needleWStr, haystackWStr, m_evalStringHash, m_differenceHash);
+                match = requestUrl.contains(m_evalString, caseSensitivity);
                 break;
-            }
             case FilterCategory::RegExp:
-                match = m_regExp->match(requestUrl).hasMatch();
+                match = m_regExp->isMatch(requestUrl);
                 break;
             default:
                 break;
         }
     }
 
-    if (match)
-    {
-        // Check for element type restrictions (in specific order)
-        static constexpr std::array<ElementType, 13> elemTypes = {  ElementType::XMLHTTPRequest,  ElementType::Document,   ElementType::Object,
-                                                   ElementType::Subdocument,     ElementType::Image,      ElementType::Script,
-                                                   ElementType::Stylesheet,      ElementType::WebSocket,  ElementType::ObjectSubrequest,
-                                                   ElementType::InlineScript,    ElementType::Ping,       ElementType::CSP,
-                                                   ElementType::Other };
-
-        // bool allowForHost = () => { if (m_denyAllowHosts.empty()) { true } else { return domainOf(requestUrl) in m_denyAllowHosts } };
-        for (std::size_t i = 0; i < elemTypes.size(); ++i)
-        {
-            ElementType currentType = elemTypes[i];
-            bool isRequestOfType = hasElementType(typeMask, currentType);
-            if (hasElementType(m_allowedTypes, currentType) && isRequestOfType)
-                return false;
-            if (hasElementType(m_blockedTypes, currentType) && isRequestOfType)
-                return true;
-        }
+    return match && isElementTypeMatch(typeMask);
+}
 
+bool Filter::isOptionMatch(const QString &baseUrl, ElementType typeMask) const
+{
+    return isRequestRestrictionMatch(baseUrl, typeMask) && isElementTypeMatch(typeMask);
+}
 
-        //ElementType::ThirdParty | ElementType::MatchCase | ElementType::Collapse
-        ElementType ignoreTypeMask = static_cast<ElementType>(~0x00038000ULL);
-        if ((m_blockedTypes & ignoreTypeMask) != ElementType::None)
-            return false;
+void Filter::recordHit() const
+{
+    m_hitCount.fetch_add(1, std::memory_order_relaxed);
+}
+
+quint32 Filter::getHitCount() const
+{
+    return m_hitCount.load(std::memory_order_relaxed);
+}
+
+FilterMemoryUsage Filter::getMemoryUsage() const
+{
+    // Approximate size of the heap allocation behind a non-empty QString, including its header
+    auto getStringBytes = [](const QString &str) -> size_t {
+        return str.isEmpty() ? 0 : sizeof(QArrayData) + static_cast<size_t>(str.capacity() + 1) * sizeof(QChar);
+    };
+
+    FilterMemoryUsage usage;
+    usage.NumFilters = 1;
+    usage.FilterBytes = sizeof(Filter);
+    usage.StringBytes = getStringBytes(m_ruleString)
+            + getStringBytes(m_evalString)
+            + getStringBytes(m_contentSecurityPolicy)
+            + getStringBytes(m_redirectName);
+    usage.DomainBytes = (m_domainBlacklist.capacity() + m_domainWhitelist.capacity()) * sizeof(domain_id_t);
+
+    // Regular expressions are shared between the filters with the same pattern, so each filter is given a share of the cost
+    if (m_regExp)
+    {
+        const size_t regExpBytes = sizeof(FilterRegExp)
+                + getStringBytes(m_regExp->getRegularExpression().pattern())
+                + getStringBytes(m_regExp->getRequiredLiteral());
+        usage.RegExpBytes = regExpBytes / static_cast<size_t>(std::max(m_regExp.use_count(), 1L));
     }
 
-    return match;
+    return usage;
 }
 
 bool Filter::isDomainStyleMatch(const QString &domain) const
@@ -284,28 +321,36 @@ bool Filter::isDomainStyleMatch(const QString &domain) const
     if (m_domainBlacklist.empty() && m_domainWhitelist.empty())
         return true;
 
-    for (const QString &d : m_domainWhitelist)
-    {
-        if (isDomainMatch(domain, d))
-            return false;
-    }
-    for (const QString &d : m_domainBlacklist)
-    {
-        if (isDomainMatch(domain, d))
-            return true;
-    }
+    const DomainSuffixIds &suffixIds = DomainTable::instance().getSuffixIds(domain);
 
-    return false;
+    if (suffixIds.intersects(m_domainWhitelist.data(), m_domainWhitelist.data() + m_domainWhitelist.size()))
+        return false;
+
+    return suffixIds.intersects(m_domainBlacklist.data(), m_domainBlacklist.data() + m_domainBlacklist.size());
+}
+
+/// Inserts the identifier into the sorted container, if it is not already present
+static void insertDomainId(std::vector<domain_id_t> &container, domain_id_t id)
+{
+    auto it = std::lower_bound(container.begin(), container.end(), id);
+    if (it == container.end() || *it != id)
+        container.insert(it, id);
 }
 
 void Filter::addDomainToWhitelist(const QString &domainStr)
 {
-    m_domainWhitelist.insert(domainStr);
+    insertDomainId(m_domainWhitelist, DomainTable::instance().intern(domainStr));
 }
 
 void Filter::addDomainToBlacklist(const QString &domainStr)
 {
-    m_domainBlacklist.insert(domainStr);
+    insertDomainId(m_domainBlacklist, DomainTable::instance().intern(domainStr));
+}
+
+void Filter::addDomainIdsToWhitelist(const std::vector<domain_id_t> &domainIds)
+{
+    for (domain_id_t id : domainIds)
+        insertDomainId(m_domainWhitelist, id);
 }
 
 void Filter::setEvalString(const QString &evalString)
@@ -313,23 +358,72 @@ void Filter::setEvalString(const QString &evalString)
     m_evalString = evalString;
 }
 
-bool Filter::isDomainMatch(QString base, const QString &domainStr) const
+bool Filter::isRequestRestrictionMatch(const QString &baseUrl, ElementType typeMask) const
+{
+    if (m_disabled)
+        return false;
+
+    // Check for domain restrictions
+    if (hasDomainRules() && !isDomainStyleMatch(baseUrl))
+        return false;
+
+    // Special cases
+    if (typeMask == ElementType::InlineScript && !hasElementType(m_blockedTypes, ElementType::InlineScript))
+        return false;
+    if (hasElementType(m_blockedTypes, ElementType::ThirdParty) && !hasElementType(typeMask, ElementType::ThirdParty))
+        return false;
+    if (hasElementType(m_allowedTypes, ElementType::ThirdParty) && hasElementType(typeMask, ElementType::ThirdParty))
+        return false;
+
+    return true;
+}
+
+bool Filter::isElementTypeMatch(ElementType typeMask) const
+{
+    // Check for element type restrictions (in specific order)
+    static constexpr std::array<ElementType, 13> elemTypes = {  ElementType::XMLHTTPRequest,  ElementType::Document,   ElementType::Object,
+                                               ElementType::Subdocument,     ElementType::Image,      ElementType::Script,
+                                               ElementType::Stylesheet,      ElementType::WebSocket,  ElementType::ObjectSubrequest,
+                                               ElementType::InlineScript,    ElementType::Ping,       ElementType::CSP,
+                                               ElementType::Other };
+
+    // bool allowForHost = () => { if (m_denyAllowHosts.empty()) { true } else { return domainOf(requestUrl) in m_denyAllowHosts } };
+    for (std::size_t i = 0; i < elemTypes.size(); ++i)
+    {
+        ElementType currentType = elemTypes[i];
+        bool isRequestOfType = hasElementType(typeMask, currentType);
+        if (hasElementType(m_allowedTypes, currentType) && isRequestOfType)
+            return false;
+        if (hasElementType(m_blockedTypes, currentType) && isRequestOfType)
+            return true;
+    }
+
+    //ElementType::ThirdParty | ElementType::MatchCase | ElementType::Collapse
+    ElementType ignoreTypeMask = static_cast<ElementType>(~0x00038000ULL);
+    if ((m_blockedTypes & ignoreTypeMask) != ElementType::None)
+        return false;
+
+    return true;
+}
+
+bool Filter::isDomainMatch(const QString &base, const QString &domainStr) const
 {
     // Check if domain match is being performed on an entity filter
+    QStringRef baseRef(&base);
     if (domainStr.endsWith(QChar('.')))
-        base = base.left(base.lastIndexOf(QChar('.')) + 1);
+        baseRef = base.leftRef(base.lastIndexOf(QChar('.')) + 1);
 
-    if (base.compare(domainStr) == 0)
+    if (baseRef.compare(domainStr) == 0)
         return true;
 
-    if (!base.endsWith(domainStr))
+    if (!baseRef.endsWith(domainStr))
         return false;
 
-    int evalIdx = base.indexOf(domainStr); //domainStr.indexOf(base);
-    return evalIdx == 0 || (evalIdx > 0 && base.at(evalIdx - 1) == QChar('.'));
+    int evalIdx = baseRef.indexOf(domainStr); //domainStr.indexOf(base);
+    return evalIdx == 0 || (evalIdx > 0 && baseRef.at(evalIdx - 1) == QChar('.'));
 }
 
-bool Filter::isDomainStartMatch(const QString &requestUrl, const QString &secondLevelDomain) const
+bool Filter::isDomainStartMatch(const QString &requestUrl, const QString &requestDomain) const
 {
     Qt::CaseSensitivity caseSensitivity = m_matchCase ? Qt::CaseSensitive : Qt::CaseInsensitive;
     int matchIdx = requestUrl.indexOf(m_evalString, 0, caseSensitivity);
@@ -337,24 +431,107 @@ bool Filter::isDomainStartMatch(const QString &requestUrl, const QString &second
     {
         QChar c = requestUrl[matchIdx - 1];
         const bool validChar = c == QChar('.') || c == QChar('/');
-        return validChar || m_evalString.contains(secondLevelDomain, caseSensitivity);
+        return validChar || m_evalString.contains(URL(requestDomain).getSecondLevelDomain(), caseSensitivity);
     }
     return false;
 }
 
-void Filter::hashEvalString()
+void Filter::setContentSecurityPolicy(const QString &csp)
 {
-    if (m_matchAll || m_evalString.isEmpty())
-        return;
+    m_contentSecurityPolicy = csp;
+}
 
-    m_needleWStr = m_evalString.toStdWString();
-    m_differenceHash = FastHash::getDifferenceHash(static_cast<quint64>(m_evalString.size()));
-    m_evalStringHash = FastHash::getNeedleHash(m_needleWStr);
+/// Converts the domain identifiers into the list of domains they represent, which are serialized in place of the identifiers
+static QStringList domainIdsToStrings(const std::vector<domain_id_t> &domainIds)
+{
+    QStringList result;
+    for (domain_id_t id : domainIds)
+        result.append(DomainTable::instance().getDomain(id));
+    return result;
 }
 
-void Filter::setContentSecurityPolicy(const QString &csp)
+QDataStream &operator<<(QDataStream &out, const Filter &filter)
 {
-    m_contentSecurityPolicy = csp;
+    out << static_cast<qint32>(filter.m_category)
+        << filter.getRule()
+        << filter.m_evalString
+        << filter.m_contentSecurityPolicy
+        << filter.m_exception
+        << filter.m_important
+        << filter.m_disabled
+        << filter.m_redirect
+        << filter.m_redirectName
+        << static_cast<quint64>(filter.m_allowedTypes)
+        << static_cast<quint64>(filter.m_blockedTypes)
+        << filter.m_matchCase
+        << filter.m_matchAll
+        << domainIdsToStrings(filter.m_domainBlacklist)
+        << domainIdsToStrings(filter.m_domainWhitelist);
+
+    const bool hasRegExp = filter.m_regExp != nullptr;
+    out << hasRegExp;
+    if (hasRegExp)
+        out << filter.m_regExp->getRegularExpression();
+
+    return out;
+}
+
+QDataStream &operator>>(QDataStream &in, Filter &filter)
+{
+    qint32 category = 0;
+    quint64 allowedTypes = 0, blockedTypes = 0;
+    QString rule;
+    QStringList domainBlacklist, domainWhitelist;
+    bool exception = false, important = false, disabled = false, redirect = false, matchCase = false, matchAll = false;
+    bool hasRegExp = false;
+
+    in >> category
+       >> rule
+       >> filter.m_evalString
+       >> filter.m_contentSecurityPolicy
+       >> exception
+       >> important
+       >> disabled
+       >> redirect
+       >> filter.m_redirectName
+       >> allowedTypes
+       >> blockedTypes
+       >> matchCase
+       >> matchAll
+       >> domainBlacklist
+       >> domainWhitelist
+       >> hasRegExp;
+
+    filter.setRule(rule);
+
+    filter.m_exception = exception;
+    filter.m_important = important;
+    filter.m_disabled = disabled;
+    filter.m_redirect = redirect;
+    filter.m_matchCase = matchCase;
+    filter.m_matchAll = matchAll;
+
+    filter.m_domainBlacklist.clear();
+    for (const QString &domain : domainBlacklist)
+        filter.addDomainToBlacklist(domain);
+
+    filter.m_domainWhitelist.clear();
+    for (const QString &domain : domainWhitelist)
+        filter.addDomainToWhitelist(domain);
+
+    filter.m_category = static_cast<FilterCategory>(category);
+    filter.m_allowedTypes = static_cast<ElementType>(allowedTypes);
+    filter.m_blockedTypes = static_cast<ElementType>(blockedTypes);
+
+    filter.m_regExp.reset();
+    if (hasRegExp)
+    {
+        QRegularExpression regExp;
+        in >> regExp;
+        filter.m_regExp = FilterRegExp::create(regExp.pattern(), regExp.patternOptions());
+    }
+
+    return in;
 }
 
 }
@@ -2,13 +2,19 @@
 #define ADBLOCKFILTER_H
 
 #include "Bitfield.h"
+#include "DomainTable.h"
+#include "FilterRegExp.h"
+#include "FilterStringArena.h"
 
+#include <atomic>
 #include <cstdint>
 #include <memory>
 #include <tuple>
+#include <vector>
+#include <QDataStream>
 #include <QHash>
 #include <QRegularExpression>
-#include <QSet>
+#include <QStringList>
 #include <QString>
 
 /**
@@ -54,11 +60,19 @@ struct EnableBitfield<ElementType>
 namespace adblock
 {
 
+class Filter;
+
+/// Serializes the parsed state of the given filter into the data stream
+QDataStream &operator<<(QDataStream &out, const Filter &filter);
+
+/// Deserializes a filter from the data stream, as written by the corresponding output operator
+QDataStream &operator>>(QDataStream &in, Filter &filter);
+
 /**
  * @ingroup AdBlock
  * @brief Mutually exclusive categories that an AdBlock filter may belong to.
  */
-enum class FilterCategory
+enum class FilterCategory : uint8_t
 {
     None,
     Stylesheet,          /// Block or allow CSS elements
@@ -96,6 +110,47 @@ enum class CosmeticFilter
     Remove               /// Removes any matching nodes from the DOM
 };
 
+/**
+ * @struct FilterMemoryUsage
+ * @ingroup AdBlock
+ * @brief Approximate number of bytes used by one or more filters, by the type of data they hold
+ */
+struct FilterMemoryUsage
+{
+    /// Number of filters
+    size_t NumFilters { 0 };
+
+    /// Size of the filter objects themselves
+    size_t FilterBytes { 0 };
+
+    /// Heap memory used by the rule text, evaluation strings and other strings of the filters
+    size_t StringBytes { 0 };
+
+    /// Heap memory used by the domain restrictions of the filters
+    size_t DomainBytes { 0 };
+
+    /// Heap memory used by the regular expressions of the filters. This is a lower bound, based on the pattern sizes,
+    /// as the compiled form of an expression is not allocated until it is first used
+    size_t RegExpBytes { 0 };
+
+    /// Returns the total number of bytes used
+    size_t getTotal() const
+    {
+        return FilterBytes + StringBytes + DomainBytes + RegExpBytes;
+    }
+
+    /// Adds the memory usage of other filters to this one
+    FilterMemoryUsage &operator+=(const FilterMemoryUsage &other)
+    {
+        NumFilters += other.NumFilters;
+        FilterBytes += other.FilterBytes;
+        StringBytes += other.StringBytes;
+        DomainBytes += other.DomainBytes;
+        RegExpBytes += other.RegExpBytes;
+        return *this;
+    }
+};
+
 /**
  * @class Filter
  * @ingroup AdBlock
@@ -103,8 +158,13 @@ enum class CosmeticFilter
  */
 class Filter
 {
+    friend class DomainFilterIndex;
     friend class FilterContainer;
     friend class FilterParser;
+    friend class FilterTokenIndex;
+    friend class Subscription;
+    friend QDataStream &operator<<(QDataStream &out, const Filter &filter);
+    friend QDataStream &operator>>(QDataStream &in, Filter &filter);
     friend class AdBlockManager;
 
 public:
@@ -130,7 +190,19 @@ class Filter
     FilterCategory getCategory() const;
 
     /// Returns the original filter rule as a QString
-    const QString &getRule() const;
+    QString getRule() const;
+
+    /// Returns true if this filter was created from the same rule as the other filter, false if else.
+    /// Unlike comparing the results of \ref Filter::getRule, this does not decode the rule text
+    bool isSameRule(const Filter &other) const;
+
+    /// Returns a hash of the rule text, which is equal for any two filters where \ref Filter::isSameRule is true.
+    /// Rules that are stored as Latin-1 text are hashed without being decoded
+    uint getRuleHash() const;
+
+    /// Returns the location of the rule text in the string arena of the subscription, which is invalid
+    /// until the rule has been moved into an arena
+    const ArenaString &getRuleText() const;
 
     /// Returns the evaluation string of the rule
     const QString &getEvalString() const;
@@ -163,9 +235,29 @@ class Filter
      */
     bool isMatch(const QString &baseUrl, const QString &requestUrl, const QString &requestDomain, ElementType typeMask) const;
 
+    /**
+     * @brief Determines whether or not the network request satisfies the options of the filter (domain, party and
+     *        element type restrictions), without evaluating the filter's pattern. Used when the pattern has already
+     *        been matched against the request through a multi-pattern search.
+     * @param baseUrl URL of the original network request
+     * @param typeMask Element type(s) associated with the request
+     * @return True if the options of the filter apply to the request, false if else.
+     */
+    bool isOptionMatch(const QString &baseUrl, ElementType typeMask) const;
+
+    /// Records a match of the filter against a network request. Safe to call from any thread
+    void recordHit() const;
+
+    /// Returns the number of network requests that the filter has been applied to
+    quint32 getHitCount() const;
+
     /// Returns true if this rule is of the Stylesheet category and applies to the given domain, returns false if else.
     bool isDomainStyleMatch(const QString &domain) const;
 
+    /// Returns the approximate memory usage of the filter. Rule text that has been moved into a
+    /// \ref FilterStringArena is accounted for by the arena, rather than the filter
+    FilterMemoryUsage getMemoryUsage() const;
+
     /// Returns true if the given ElementType bitfield is set for the bit associated with the target ElementType
     inline bool hasElementType(ElementType subject, ElementType target) const
     {
@@ -179,49 +271,73 @@ class Filter
     /// Adds the given domain to the blacklist
     void addDomainToBlacklist(const QString &domainStr);
 
+    /// Adds each of the given domain identifiers to the whitelist
+    void addDomainIdsToWhitelist(const std::vector<domain_id_t> &domainIds);
+
     /// Sets the evaluation string used to match network requests
     void setEvalString(const QString &evalString);
 
     /// Evaluates the rule, setting the filter to reflect the corresponding value(s)
     void setRule(const QString &rule);
 
-    /// Calculates the hash value of the evaluation string and the difference hash variable, used in Rabin-Karp string matching algorithm
-    void hashEvalString();
+    /// Moves the rule text of the filter into the given arena, which must outlive the filter and any copies of it
+    void moveRuleToArena(FilterStringArena &arena);
 
     /// Sets the content security policy of the filter
     void setContentSecurityPolicy(const QString &csp);
 
 private:
+    /// Returns true if the filter is enabled and its domain and party restrictions allow the request, false if else
+    bool isRequestRestrictionMatch(const QString &baseUrl, ElementType typeMask) const;
+
+    /// Returns true if the allowed and blocked element types of the filter apply to a request of the given type(s), false if else
+    bool isElementTypeMatch(ElementType typeMask) const;
+
     /// Returns true if the given domain matches the base domain string, false if else
-    bool isDomainMatch(QString base, const QString &domainStr) const;
+    bool isDomainMatch(const QString &base, const QString &domainStr) const;
 
-    /// Compares the requested domain the evaluation string, returning true if the filter matches the request, false if else
-    bool isDomainStartMatch(const QString &requestUrl, const QString &secondLevelDomain) const;
+    /// Compares the requested domain the evaluation string, returning true if the filter matches the request, false if else.
+    /// The second level domain of the request is only computed when the position of the match requires it
+    bool isDomainStartMatch(const QString &requestUrl, const QString &requestDomain) const;
 
 protected:
     /// Filter category
     FilterCategory m_category;
 
-    /// Original rule string
-    QString m_ruleString;
-
-    /// Comparison string for evaluating rules (only used if category of filter is not RegExp)
-    QString m_evalString;
-
-    /// Content security policy for filters with blocking type CSP
-    QString m_contentSecurityPolicy;
-
     /// True if the filter is an exception, false if it is a standard blocking rule
-    bool m_exception;
+    bool m_exception : 1;
 
     /// True if the filter has the important option and is not an exception (uBlock standard)
-    bool m_important;
+    bool m_important : 1;
 
     /// True if filter is disabled (will never match network requests), false if enabled (default)
-    bool m_disabled;
+    bool m_disabled : 1;
 
     /// True if the filter redirects any requests it blocks to a different resource, false if else
-    bool m_redirect;
+    bool m_redirect : 1;
+
+    /// If true, the filter only applies to addresses with a matching letter case
+    bool m_matchCase : 1;
+
+    /// Set to true if evaluation string is empty. Requests will still be checked based on domain blacklist/whitelist and allowed/blocked element types, etc
+    bool m_matchAll : 1;
+
+    /// Number of network requests the filter has been applied to. Updated with relaxed atomic operations,
+    /// as it is only used to order filters by hotness when the filter containers are rebuilt
+    mutable std::atomic<quint32> m_hitCount;
+
+    /// Original rule string, once it has been moved into the string arena of the subscription that owns the filter
+    ArenaString m_ruleText;
+
+    /// Original rule string, until it is moved into a string arena
+    QString m_ruleString;
+
+    /// Comparison string for evaluating rules. For RegExp filters that were converted from the ad block
+    /// format, this is the pattern the regular expression was built from, and is only used for indexing
+    QString m_evalString;
+
+    /// Content security policy for filters with blocking type CSP
+    QString m_contentSecurityPolicy;
 
     /// Name of the resource the filter redirects requests to, if m_redirect is true.
     QString m_redirectName;
@@ -232,30 +348,14 @@ class Filter
     /// Bitfield of element types to be filtered
     ElementType m_blockedTypes;
 
-    /// If true, the filter only applies to addresses with a matching letter case
-    bool m_matchCase;
-
-    /// Set to true if evaluation string is empty. Requests will still be checked based on domain blacklist/whitelist and allowed/blocked element types, etc
-    bool m_matchAll;
-
-    /// List of domains that the filter rule applies to. Specified by the domain filter option
-    QSet<QString> m_domainBlacklist;
-
-    /// List of domains that the filter rule does not apply to. Specified by the domain filter option
-    QSet<QString> m_domainWhitelist;
-
-    /// Unique pointer to a regular expression used by the filter, if filter is of the category RegExp
-    std::unique_ptr<QRegularExpression> m_regExp;
-
-private:
-    /// Used for string hash computations in rabin-karp matching algorithm
-    quint64 m_differenceHash;
+    /// Sorted identifiers of the domains that the filter rule applies to. Specified by the domain filter option
+    std::vector<domain_id_t> m_domainBlacklist;
 
-    /// Contains a hash of the evaluation string, used if filter category is StringContains
-    quint64 m_evalStringHash;
+    /// Sorted identifiers of the domains that the filter rule does not apply to. Specified by the domain filter option
+    std::vector<domain_id_t> m_domainWhitelist;
 
-    /// Wide-string used in rabin-karp string matching algorithm
-    std::wstring m_needleWStr;
+    /// Regular expression used by the filter, if filter is of the category RegExp. Shared with other filters that have the same expression
+    std::shared_ptr<FilterRegExp> m_regExp;
 };
 
 }
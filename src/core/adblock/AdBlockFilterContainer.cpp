@@ -11,18 +11,12 @@ Filter *FilterContainer::findImportantBlockingFilter(
         const QString &baseUrl,
         const QString &requestUrl,
         const QString &requestDomain,
-        ElementType typeMask)
+        ElementType typeMask) const
 {
-    for (auto it = m_importantBlockFilters.begin(); it != m_importantBlockFilters.end(); ++it)
+    for (Filter *filter : m_importantBlockFilters)
     {
-        Filter *filter = *it;
         if (filter->isMatch(baseUrl, requestUrl, requestDomain, typeMask))
-        {
-            it = m_importantBlockFilters.erase(it);
-            m_importantBlockFilters.push_front(filter);
-
             return filter;
-        }
     }
 
     return nullptr;
@@ -33,37 +27,54 @@ Filter *FilterContainer::findBlockingRequestFilter(
         const QString &baseUrl,
         const QString &requestUrl,
         const QString &requestDomain,
-        ElementType typeMask)
+        ElementType typeMask) const
 {
-    Filter *matchingBlockFilter = nullptr;
-    auto checkFiltersForMatch = [&](std::deque<Filter*> &filterContainer) {
-        for (auto it = filterContainer.begin(); it != filterContainer.end(); ++it)
+    auto itr = m_blockFiltersByDomain.constFind(requestSecondLevelDomain);
+    if (itr != m_blockFiltersByDomain.constEnd())
+    {
+        for (Filter *filter : *itr)
         {
-            Filter *filter = *it;
             if (filter->isMatch(baseUrl, requestUrl, requestDomain, typeMask))
-            {
-                matchingBlockFilter = filter;
-                it = filterContainer.erase(it);
-                filterContainer.push_front(filter);
-                return;
-            }
+                return filter;
         }
-    };
+    }
 
-    auto itr = m_blockFiltersByDomain.find(requestSecondLevelDomain);
-    if (itr != m_blockFiltersByDomain.end())
-        checkFiltersForMatch(*itr);
+    // Only the filters that share a token with the request URL need to be checked
+    const std::vector<token_hash_t> urlTokens = FilterTokenIndex::tokenize(requestUrl);
+    if (Filter *filter = m_blockFilterIndex.findMatch(urlTokens, baseUrl, requestUrl, requestDomain, typeMask))
+        return filter;
 
-    if (matchingBlockFilter == nullptr)
-        checkFiltersForMatch(m_blockFilters);
+    // Find all pattern filters contained in the request URL in a single pass, then check their options
+    Filter *result = nullptr;
+    if (!m_patternMatcher.isEmpty())
+    {
+        std::string haystack;
+        MultiPatternMatcher::toLowerLatin1(requestUrl, haystack);
+        m_patternMatcher.search(haystack.data(), haystack.size(), [&](uint32_t id) {
+            Filter *filter = m_patternMatcherFilters[id];
+            if (filter->m_matchCase && !requestUrl.contains(filter->m_evalString, Qt::CaseSensitive))
+                return false;
+            if (!filter->isOptionMatch(baseUrl, typeMask))
+                return false;
+
+            result = filter;
+            return true;
+        });
+    }
+
+    if (result != nullptr)
+        return result;
 
-    if (matchingBlockFilter == nullptr)
-        checkFiltersForMatch(m_blockFiltersByPattern);
+    for (Filter *filter : m_unmatchablePatternFilters)
+    {
+        if (filter->isMatch(baseUrl, requestUrl, requestDomain, typeMask))
+            return filter;
+    }
 
-    return matchingBlockFilter;
+    return nullptr;
 }
 
-Filter *FilterContainer::findWhitelistingFilter(const QString &baseUrl, const QString &requestUrl, const QString &requestDomain, ElementType typeMask)
+Filter *FilterContainer::findWhitelistingFilter(const QString &baseUrl, const QString &requestUrl, const QString &requestDomain, ElementType typeMask) const
 {
     for (Filter *filter : m_allowFilters)
     {
@@ -94,58 +105,44 @@ const QString &FilterContainer::getCombinedFilterStylesheet() const
 
 std::vector<Filter*> FilterContainer::getDomainBasedHidingFilters(const QString &domain) const
 {
-    std::vector<Filter*> result;
-    std::vector<Filter*> matches;
-    QHash<QString, bool> whitelistedFilters;
-    for (Filter *filter : m_domainStyleFilters)
-    {
-        if (filter->isDomainStyleMatch(domain))
-        {
-            if (filter->isException())
-                whitelistedFilters.insert(filter->getEvalString(), true);
-            else
-                matches.push_back(filter);
-        }
-    }
-    for (Filter *filter : matches)
-    {
-        if (whitelistedFilters.constFind(filter->getEvalString()) == whitelistedFilters.constEnd())
-            result.push_back(filter);
-    }
-    return result;
+    // Stylesheet exceptions are applied to the domain whitelists of the blocking rules when the container is
+    // built, so the index only holds blocking rules
+    return m_domainStyleFilters.findMatches(domain);
 }
 
 std::vector<Filter*> FilterContainer::getDomainBasedCustomHidingFilters(const QString &domain) const
 {
-    std::vector<Filter*> result;
-    for (Filter *filter : m_customStyleFilters)
-    {
-        if (filter->isDomainStyleMatch(domain))
-            result.push_back(filter);
-    }
-    return result;
+    return m_customStyleFilters.findMatches(domain);
 }
 
 std::vector<Filter*> FilterContainer::getDomainBasedScriptInjectionFilters(const QString &domain) const
 {
-    std::vector<Filter*> result;
-    for (Filter *filter : m_domainJSFilters)
-    {
-        if (filter->isDomainStyleMatch(domain))
-            result.push_back(filter);
-    }
-    return result;
+    return m_domainJSFilters.findMatches(domain);
 }
 
 std::vector<Filter*> FilterContainer::getDomainBasedCosmeticProceduralFilters(const QString &domain) const
 {
-    std::vector<Filter*> result;
-    for (Filter *filter : m_domainProceduralFilters)
-    {
-        if (filter->isDomainStyleMatch(domain))
-            result.push_back(filter);
-    }
-    return result;
+    return m_domainProceduralFilters.findMatches(domain);
+}
+
+std::vector<QString> FilterContainer::getDomainBasedHidingFragments(const QString &domain, std::string &filterSetKey) const
+{
+    return m_domainStyleFilters.findFragments(domain, filterSetKey);
+}
+
+std::vector<QString> FilterContainer::getDomainBasedCustomHidingFragments(const QString &domain, std::string &filterSetKey) const
+{
+    return m_customStyleFilters.findFragments(domain, filterSetKey);
+}
+
+std::vector<QString> FilterContainer::getDomainBasedScriptInjectionFragments(const QString &domain, std::string &filterSetKey) const
+{
+    return m_domainJSFilters.findFragments(domain, filterSetKey);
+}
+
+std::vector<QString> FilterContainer::getDomainBasedCosmeticProceduralFragments(const QString &domain, std::string &filterSetKey) const
+{
+    return m_domainProceduralFilters.findFragments(domain, filterSetKey);
 }
 
 std::vector<Filter*> FilterContainer::getMatchingCSPFilters(const QString &requestUrl, const QString &domain) const
@@ -206,10 +203,16 @@ const Filter *FilterContainer::findInlineScriptBlockingFilter(const QString &req
 
 void FilterContainer::clearFilters()
 {
+    m_filters.clear();
+    m_stringArenas.clear();
     m_importantBlockFilters.clear();
     m_allowFilters.clear();
     m_blockFilters.clear();
     m_blockFiltersByPattern.clear();
+    m_blockFilterIndex.clear();
+    m_patternMatcher.clear();
+    m_patternMatcherFilters.clear();
+    m_unmatchablePatternFilters.clear();
     m_blockFiltersByDomain.clear();
     m_stylesheet.clear();
     m_domainStyleFilters.clear();
@@ -220,28 +223,76 @@ void FilterContainer::clearFilters()
     m_cspFilters.clear();
 }
 
-void FilterContainer::extractFilters(std::vector<Subscription> &subscriptions)
+/// Filters indexed by the hash of their rule text, so that filters created from the same rule
+/// can be found without decoding the rule of each filter into a QString
+using FilterRuleSet = QMultiHash<uint, const Filter*>;
+
+/// Returns the filter in the set that was created from the same rule as the given filter, or a nullptr if there is none
+static const Filter *findSameRule(const FilterRuleSet &ruleSet, const Filter *filter)
 {
+    if (ruleSet.isEmpty())
+        return nullptr;
+
+    const uint ruleHash = filter->getRuleHash();
+    for (auto it = ruleSet.constFind(ruleHash); it != ruleSet.constEnd() && it.key() == ruleHash; ++it)
+    {
+        if (filter->isSameRule(**it))
+            return *it;
+    }
+    return nullptr;
+}
+
+void FilterContainer::extractFilters(std::vector<Subscription> &subscriptions, const FilterContainer *previous)
+{
+    // Carry over the hit counts of the filters in the container being replaced
+    FilterRuleSet previousHitFilters;
+    if (previous != nullptr)
+    {
+        for (const std::shared_ptr<Filter> &filter : previous->m_filters)
+        {
+            if (filter->getHitCount() > 0)
+                previousHitFilters.insert(filter->getRuleHash(), filter.get());
+        }
+    }
+
     // Used to store css rules for the global stylesheet and domain-specific stylesheets
     QHash<QString, Filter*> stylesheetFilterMap;
     QHash<QString, Filter*> stylesheetExceptionMap;
 
     // Used to remove bad filters (badfilter option from uBlock)
-    QSet<QString> badFilters, badHideFilters;
+    FilterRuleSet badFilters, badHideFilters;
+
+    // Cosmetic filters, which are placed into their domain indices once all subscriptions have been read
+    std::vector<Filter*> domainStyleFilters, domainJSFilters, domainProceduralFilters, customStyleFilters;
 
     // Setup global stylesheet string
     m_stylesheet = QLatin1String("<style>");
 
     auto isDuplicate = [](const Filter *filter, const std::deque<Filter*> &container) -> bool {
-        const QString &filterText = filter->getRule();
-        const auto match = std::find_if(std::begin(container), std::end(container), [&filterText](const Filter *f) {
-            return filterText.compare(f->getRule()) == 0;
+        const auto match = std::find_if(std::begin(container), std::end(container), [filter](const Filter *f) {
+            return filter->isSameRule(*f);
         });
         return match != std::end(container);
     };
 
     for (Subscription &sub : subscriptions)
     {
+        if (sub.isEnabled())
+        {
+            m_filters.insert(m_filters.end(), sub.m_filters.begin(), sub.m_filters.end());
+            if (sub.m_stringArena)
+                m_stringArenas.push_back(sub.m_stringArena);
+        }
+
+        if (!previousHitFilters.isEmpty())
+        {
+            for (const std::shared_ptr<Filter> &filter : sub.m_filters)
+            {
+                if (const Filter *previousFilter = findSameRule(previousHitFilters, filter.get()))
+                    filter->m_hitCount.store(previousFilter->getHitCount(), std::memory_order_relaxed);
+            }
+        }
+
         // Add filters to appropriate containers
         const size_t numFilters = sub.getNumFilters();
         for (size_t i = 0; i < numFilters; ++i)
@@ -259,19 +310,19 @@ void FilterContainer::extractFilters(std::vector<Subscription> &subscriptions)
             }
             else if (filter->getCategory() == FilterCategory::StylesheetJS)
             {
-                m_domainProceduralFilters.push_back(filter);
+                domainProceduralFilters.push_back(filter);
             }
             else if (filter->getCategory() == FilterCategory::Scriptlet)
             {
-                m_domainJSFilters.push_back(filter);
+                domainJSFilters.push_back(filter);
             }
             else if (filter->getCategory() == FilterCategory::StylesheetCustom)
             {
-                m_customStyleFilters.push_back(filter);
+                customStyleFilters.push_back(filter);
             }
             else if (filter->hasElementType(filter->m_blockedTypes, ElementType::BadFilter))
             {
-                badFilters.insert(filter->getRule());
+                badFilters.insert(filter->getRuleHash(), filter);
             }
             else if (filter->hasElementType(filter->m_blockedTypes, ElementType::CSP))
             {
@@ -290,7 +341,7 @@ void FilterContainer::extractFilters(std::vector<Subscription> &subscriptions)
                 else if (filter->isImportant())
                 {
                     if (filter->hasElementType(filter->m_blockedTypes, ElementType::GenericHide))
-                        badHideFilters.insert(filter->getRule());
+                        badHideFilters.insert(filter->getRuleHash(), filter);
                     else
                         m_importantBlockFilters.push_back(filter);
                 }
@@ -328,7 +379,7 @@ void FilterContainer::extractFilters(std::vector<Subscription> &subscriptions)
     auto removeBadFiltersFromVector = [&badFilters](std::vector<Filter*> &filterContainer) {
         for (auto it = filterContainer.begin(); it != filterContainer.end();)
         {
-            if (badFilters.contains((*it)->getRule()))
+            if (findSameRule(badFilters, *it) != nullptr)
                 it = filterContainer.erase(it);
             else
                 ++it;
@@ -337,7 +388,7 @@ void FilterContainer::extractFilters(std::vector<Subscription> &subscriptions)
     auto removeBadFiltersFromDeque = [&badFilters](std::deque<Filter*> &filterContainer) {
         for (auto it = filterContainer.begin(); it != filterContainer.end();)
         {
-            if (badFilters.contains((*it)->getRule()))
+            if (findSameRule(badFilters, *it) != nullptr)
                 it = filterContainer.erase(it);
             else
                 ++it;
@@ -357,6 +408,41 @@ void FilterContainer::extractFilters(std::vector<Subscription> &subscriptions)
     removeBadFiltersFromVector(m_cspFilters);
     removeBadFiltersFromVector(m_genericHideFilters);
 
+    // Check the most frequently applied filters first. The containers are not reordered after this point
+    if (!previousHitFilters.isEmpty())
+    {
+        auto isHotter = [](const Filter *a, const Filter *b) {
+            return a->getHitCount() > b->getHitCount();
+        };
+        std::stable_sort(m_importantBlockFilters.begin(), m_importantBlockFilters.end(), isHotter);
+        std::stable_sort(m_blockFilters.begin(), m_blockFilters.end(), isHotter);
+        std::stable_sort(m_blockFiltersByPattern.begin(), m_blockFiltersByPattern.end(), isHotter);
+        std::stable_sort(m_allowFilters.begin(), m_allowFilters.end(), isHotter);
+        for (std::deque<Filter*> &queue : m_blockFiltersByDomain)
+            std::stable_sort(queue.begin(), queue.end(), isHotter);
+    }
+
+    // Build the token index of blocking filters
+    m_blockFilterIndex.build(m_blockFilters);
+
+    // Build the multi-pattern matcher from the needles of the pattern-based blocking filters. Needles with
+    // characters outside of the ASCII range are not lowercased consistently with the request URL, so those
+    // filters are kept aside
+    for (Filter *filter : m_blockFiltersByPattern)
+    {
+        const QString needle = filter->m_evalString.toLower();
+        const bool isAscii = std::all_of(needle.cbegin(), needle.cend(), [](const QChar &c) { return c.unicode() < 0x80; });
+        if (filter->m_matchAll || needle.isEmpty() || !isAscii)
+        {
+            m_unmatchablePatternFilters.push_back(filter);
+            continue;
+        }
+
+        m_patternMatcher.addPattern(needle.toStdString(), static_cast<uint32_t>(m_patternMatcherFilters.size()));
+        m_patternMatcherFilters.push_back(filter);
+    }
+    m_patternMatcher.build();
+
     // Parse stylesheet exceptions
     QHashIterator<QString, Filter*> it(stylesheetExceptionMap);
     while (it.hasNext())
@@ -368,7 +454,7 @@ void FilterContainer::extractFilters(std::vector<Subscription> &subscriptions)
             continue;
 
         Filter *filter = it.value();
-        stylesheetFilterMap.value(it.key())->m_domainWhitelist.unite(filter->m_domainBlacklist);
+        stylesheetFilterMap.value(it.key())->addDomainIdsToWhitelist(filter->m_domainBlacklist);
     }
 
     // Parse stylesheet blocking rules
@@ -381,7 +467,7 @@ void FilterContainer::extractFilters(std::vector<Subscription> &subscriptions)
 
         if (filter->hasDomainRules())
         {
-            m_domainStyleFilters.push_back(filter);
+            domainStyleFilters.push_back(filter);
             continue;
         }
 
@@ -403,6 +489,25 @@ void FilterContainer::extractFilters(std::vector<Subscription> &subscriptions)
         m_stylesheet.append(QLatin1String("{ display: none !important; } "));
     }
     m_stylesheet.append(QLatin1String("</style>"));
+
+    // Prepare the script fragments of the cosmetic filters, so that the scripts of each page are assembled without escaping the filters again
+    auto getEvalString = [](const Filter *filter) -> QString {
+        return filter->getEvalString();
+    };
+    auto getQuotedSelector = [](const Filter *filter) -> QString {
+        QString selector = filter->getEvalString();
+        selector.replace(QLatin1String("'"), QLatin1String("\\'"));
+        return QChar('\'') + selector + QChar('\'');
+    };
+    auto getEscapedStylesheet = [](const Filter *filter) -> QString {
+        QString stylesheet = filter->getEvalString();
+        return stylesheet.replace(QLatin1String("'"), QLatin1String("\\'"));
+    };
+
+    m_domainStyleFilters.build(std::move(domainStyleFilters), getQuotedSelector);
+    m_domainJSFilters.build(std::move(domainJSFilters), getEvalString);
+    m_domainProceduralFilters.build(std::move(domainProceduralFilters), getEvalString);
+    m_customStyleFilters.build(std::move(customStyleFilters), getEscapedStylesheet);
 }
 
 }
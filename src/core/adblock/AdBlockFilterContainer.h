@@ -3,26 +3,36 @@
 
 #include "AdBlockFilter.h"
 #include "AdBlockSubscription.h"
+#include "DomainFilterIndex.h"
+#include "FilterTokenIndex.h"
+#include "MultiPatternMatcher.h"
 
 #include <deque>
 #include <functional>
+#include <memory>
+#include <string>
 #include <vector>
 
 #include <QHash>
 #include <QObject>
 #include <QString>
 
+class AdBlockBenchmark;
+
 namespace adblock
 {
 
 /**
  * @class FilterContainer
  * @brief Stores filter rules in various containers, optimized for fastest lookup time.
+ *        The containers are not modified after they have been built, so that network
+ *        requests can be matched from multiple threads at once.
  * @ingroup AdBlock
  */
 class FilterContainer
 {
     friend class AdBlockManager;
+    friend class ::AdBlockBenchmark;
 
 public:
     /// Default constructor
@@ -36,7 +46,7 @@ class FilterContainer
      * @param typeMask Element type(s) associated with the request.
      * @return A pointer to the first matching filter rule, or a nullptr if not found
      */
-    Filter *findImportantBlockingFilter(const QString &baseUrl, const QString &requestUrl, const QString &requestDomain, ElementType typeMask);
+    Filter *findImportantBlockingFilter(const QString &baseUrl, const QString &requestUrl, const QString &requestDomain, ElementType typeMask) const;
 
     /**
      * @brief Searches the blocking filter containers (excluding the important blocking filter container) for the first network request match
@@ -48,7 +58,7 @@ class FilterContainer
      * @return A pointer to the first matching filter rule, or a nullptr if not found
      */
     Filter *findBlockingRequestFilter(const QString &requestSecondLevelDomain, const QString &baseUrl,
-                                             const QString &requestUrl, const QString &requestDomain, ElementType typeMask);
+                                             const QString &requestUrl, const QString &requestDomain, ElementType typeMask) const;
 
     /**
      * @brief Searches the whitelisting filter container for the first match
@@ -58,7 +68,7 @@ class FilterContainer
      * @param typeMask Element type(s) associated with the request.
      * @return A pointer to the first matching filter rule, or a nullptr if not found
      */
-    Filter *findWhitelistingFilter(const QString &baseUrl, const QString &requestUrl, const QString &requestDomain, ElementType typeMask);
+    Filter *findWhitelistingFilter(const QString &baseUrl, const QString &requestUrl, const QString &requestDomain, ElementType typeMask) const;
 
     /// Searches for a matching domain-specific filters of which the generic element hiding rules do not apply.
     /// Returns true if a matching filter was found, or false otherwise.
@@ -79,6 +89,24 @@ class FilterContainer
     /// Returns a vector containing any filters that have use a dynamic method of hiding one or more elements on the given domain
     std::vector<Filter*> getDomainBasedCosmeticProceduralFilters(const QString &domain) const;
 
+    /**
+     * @brief Returns the precompiled script fragments of the filters that hide elements on the given domain.
+     *        Each fragment is a quoted and escaped selector, to be used as an element of a JavaScript array.
+     * @param domain Lowercase host name
+     * @param filterSetKey Key to which the identity of the matching filters is appended
+     */
+    std::vector<QString> getDomainBasedHidingFragments(const QString &domain, std::string &filterSetKey) const;
+
+    /// Returns the precompiled script fragments of the filters that have specific CSS rules to be applied on the given domain.
+    /// Each fragment is a stylesheet rule, escaped for use within a single-quoted JavaScript string
+    std::vector<QString> getDomainBasedCustomHidingFragments(const QString &domain, std::string &filterSetKey) const;
+
+    /// Returns the javascript code of the filters that are to be injected on the given domain
+    std::vector<QString> getDomainBasedScriptInjectionFragments(const QString &domain, std::string &filterSetKey) const;
+
+    /// Returns the javascript code of the filters that use a dynamic method of hiding elements on the given domain
+    std::vector<QString> getDomainBasedCosmeticProceduralFragments(const QString &domain, std::string &filterSetKey) const;
+
     /// Returns a vector containing any filters that have a CSP rule to be applied to the given request
     std::vector<Filter*> getMatchingCSPFilters(const QString &requestUrl, const QString &domain) const;
 
@@ -94,10 +122,23 @@ class FilterContainer
     /// Clears current filter data
     void clearFilters();
 
-    /// Extracts ad blocking filter rules from the given container of filter list subscriptions.
-    void extractFilters(std::vector<Subscription> &subscriptions);
+    /**
+     * @brief Extracts ad blocking filter rules from the given container of filter list subscriptions.
+     *        The container shares ownership of the extracted filters with the subscriptions.
+     * @param subscriptions Filter list subscriptions, with their filters already loaded
+     * @param previous Optional container that is being replaced. The hit counts of its filters are carried over
+     *                 to the matching new filters, and the most frequently applied filters are checked first.
+     */
+    void extractFilters(std::vector<Subscription> &subscriptions, const FilterContainer *previous = nullptr);
 
 private:
+    /// Shared references to every filter extracted from the subscriptions. Keeps the filters alive for as long as the
+    /// container is in use, even if the subscriptions they came from have since been reloaded or removed
+    std::vector< std::shared_ptr<Filter> > m_filters;
+
+    /// Shared references to the string arenas that hold the rule text of the extracted filters
+    std::vector< std::shared_ptr<FilterStringArena> > m_stringArenas;
+
     /// Global adblock stylesheet
     QString m_stylesheet;
 
@@ -110,23 +151,35 @@ class FilterContainer
     /// Container of filters that block content based on a partial string match (needle in haystack)
     std::deque<Filter*> m_blockFiltersByPattern;
 
+    /// Token index of the filters in m_blockFilters, used for request matching
+    FilterTokenIndex m_blockFilterIndex;
+
+    /// Aho-Corasick automaton of the lowercase patterns in m_blockFiltersByPattern, used for request matching
+    MultiPatternMatcher m_patternMatcher;
+
+    /// Filters of the pattern matcher, where the index of each filter is the identifier of its pattern
+    std::vector<Filter*> m_patternMatcherFilters;
+
+    /// Filters of m_blockFiltersByPattern that cannot be represented in the pattern matcher, and are checked individually
+    std::vector<Filter*> m_unmatchablePatternFilters;
+
     /// Hashmap of filters that are of the Domain category (||some.domain.com^ style filter rules)
     QHash<QString, std::deque<Filter*>> m_blockFiltersByDomain;
 
     /// Container of filters that whitelist content
     std::vector<Filter*> m_allowFilters;
 
-    /// Container of filters that have domain-specific stylesheet rules
-    std::vector<Filter*> m_domainStyleFilters;
+    /// Domain index of filters that have domain-specific stylesheet rules
+    DomainFilterIndex m_domainStyleFilters;
 
-    /// Container of filters that have domain-specific javascript rules
-    std::vector<Filter*> m_domainJSFilters;
+    /// Domain index of filters that have domain-specific javascript rules
+    DomainFilterIndex m_domainJSFilters;
 
-    /// Container of filters that have domain-specific procedural filter rules
-    std::vector<Filter*> m_domainProceduralFilters;
+    /// Domain index of filters that have domain-specific procedural filter rules
+    DomainFilterIndex m_domainProceduralFilters;
 
-    /// Container of filters that have custom stylesheet values (:style filter option)
-    std::vector<Filter*> m_customStyleFilters;
+    /// Domain index of filters that have custom stylesheet values (:style filter option)
+    DomainFilterIndex m_customStyleFilters;
 
     /// Container of domain-specific filters for which the generic element hiding rules do not apply
     std::vector<Filter*> m_genericHideFilters;
@@ -33,22 +33,25 @@ FilterParser::FilterParser(AdBlockManager *adBlockManager) :
 {
 }
 
-std::unique_ptr<Filter> FilterParser::makeFilter(QString rule) const
+std::unique_ptr<Filter> FilterParser::makeFilter(const QString &ruleString) const
 {
-    auto filter = std::make_unique<Filter>(rule);
+    auto filter = std::make_unique<Filter>(ruleString);
 
     // Make sure filter is able to be parsed
-    if (rule.isEmpty() || rule.startsWith(QLatin1Char('!')))
+    if (ruleString.isEmpty() || ruleString.startsWith(QLatin1Char('!')))
         return filter;
 
     Filter *filterPtr = filter.get();
 
-    // Check if CSS rule
-    if (isStylesheetRule(rule, filterPtr))
+    // Check if CSS rule. Every cosmetic rule separates its domains from its selector with a '#'
+    if (ruleString.indexOf(QLatin1Char('#')) >= 0 && isStylesheetRule(ruleString, filterPtr))
         return filter;
 
+    // The rule is narrowed down without being copied, until the strings that the filter keeps are known
+    QStringRef rule(&ruleString);
+
     // Check if the rule is an exception
-    if (rule.startsWith(QStringLiteral("@@")))
+    if (rule.startsWith(QLatin1String("@@")))
     {
         filterPtr->m_exception = true;
         rule = rule.mid(2);
@@ -58,7 +61,7 @@ std::unique_ptr<Filter> FilterParser::makeFilter(QString rule) const
     int pos = rule.indexOf(QLatin1Char('$'));
     if (pos >= 0 && pos + 1 < rule.size() && rule.at(pos + 1).isLetter())
     {
-        parseOptions(rule.mid(pos + 1), filterPtr);
+        parseOptions(rule.mid(pos + 1).toString(), filterPtr);
         rule = rule.left(pos);
     }
 
@@ -75,12 +78,11 @@ std::unique_ptr<Filter> FilterParser::makeFilter(QString rule) const
     {
         filterPtr->m_category = FilterCategory::RegExp;
 
-        rule = rule.mid(1);
-        rule = rule.left(rule.size() - 1);
+        rule = rule.mid(1, rule.size() - 2);
 
         QRegularExpression::PatternOptions options =
                 (filterPtr->m_matchCase ? QRegularExpression::NoPatternOption : QRegularExpression::CaseInsensitiveOption);
-        filterPtr->m_regExp = std::make_unique<QRegularExpression>(rule, options);
+        filterPtr->m_regExp = FilterRegExp::create(rule.toString(), options);
         return filter;
     }
 
@@ -93,22 +95,21 @@ std::unique_ptr<Filter> FilterParser::makeFilter(QString rule) const
         rule = rule.left(rule.size() - 1);
 
     // Check for domain matching rule
-    if (rule.startsWith(QStringLiteral("||")) && rule.endsWith(QLatin1Char('^')) && isDomainRule(rule))
+    if (rule.startsWith(QLatin1String("||")) && rule.endsWith(QLatin1Char('^')) && isDomainRule(rule))
     {
-        rule = rule.mid(2);
-        filterPtr->m_evalString = rule.left(rule.size() - 1);
+        filterPtr->m_evalString = rule.mid(2, rule.size() - 3).toString();
         filterPtr->m_category = FilterCategory::Domain;
         return filter;
     }
 
     // Check if a regular expression might be needed
-    const bool maybeRegExp = rule.contains('*') || rule.contains('^');
+    const bool maybeRegExp = rule.contains(QLatin1Char('*')) || rule.contains(QLatin1Char('^'));
 
     // Domain start match
-    if (rule.startsWith(QStringLiteral("||")) && !maybeRegExp)
+    if (rule.startsWith(QLatin1String("||")) && !maybeRegExp)
     {
         filterPtr->m_category = FilterCategory::DomainStart;
-        filterPtr->m_evalString = rule.mid(2);
+        filterPtr->m_evalString = rule.mid(2).toString();
 
         if (!filterPtr->m_matchCase)
             filterPtr->m_evalString = filterPtr->m_evalString.toLower();
@@ -116,14 +117,14 @@ std::unique_ptr<Filter> FilterParser::makeFilter(QString rule) const
     }
 
     // String start match
-    if (rule.startsWith('|') && rule.at(1) != '|' && !maybeRegExp)
+    if (rule.startsWith(QLatin1Char('|')) && (rule.size() < 2 || rule.at(1) != QLatin1Char('|')) && !maybeRegExp)
     {
         filterPtr->m_category = FilterCategory::StringStartMatch;
         rule = rule.mid(1);
     }
 
     // String end match (or exact match)
-    if (rule.endsWith('|') && !maybeRegExp)
+    if (rule.endsWith(QLatin1Char('|')) && !maybeRegExp)
     {
         if (filterPtr->getCategory() == FilterCategory::StringStartMatch)
             filterPtr->m_category = FilterCategory::StringExactMatch;
@@ -134,40 +135,35 @@ std::unique_ptr<Filter> FilterParser::makeFilter(QString rule) const
     }
 
     // Ad block format -> regular expression conversion
-    if (maybeRegExp || rule.contains(QChar('|')))
+    if (maybeRegExp || rule.contains(QLatin1Char('|')))
     {
         QRegularExpression::PatternOptions options =
                 (filterPtr->m_matchCase ? QRegularExpression::NoPatternOption : QRegularExpression::CaseInsensitiveOption);
-        filterPtr->m_regExp = std::make_unique<QRegularExpression>(parseRegExp(rule), options);
+        filterPtr->m_regExp = FilterRegExp::create(parseRegExp(rule.toString()), options);
         filterPtr->m_category = FilterCategory::RegExp;
+
+        // The pattern is kept in the ad block format, which the token index takes its keys from
+        filterPtr->m_evalString = filterPtr->m_matchCase ? rule.toString() : rule.toString().toLower();
         return filter;
     }
 
     // Set evaluation string based on the processed rule string
-    filterPtr->setEvalString(rule);
+    filterPtr->setEvalString(filterPtr->m_matchCase ? rule.toString() : rule.toString().toLower());
 
     if (filterPtr->m_evalString.isEmpty())
         filterPtr->m_matchAll = true;
 
-    if (!filterPtr->m_matchCase)
-        filterPtr->m_evalString = filterPtr->m_evalString.toLower();
-
     // Check for blob: and data: filters
     parseForCSP(filterPtr);
 
     // If no category set by now, it is a string contains type
     if (filterPtr->getCategory() == FilterCategory::None)
-    {
         filterPtr->m_category = FilterCategory::StringContains;
 
-        // Pre-calculate hash of evaluation string for Rabin-Karp string matching
-        filterPtr->hashEvalString();
-    }
-
     return filter;
 }
 
-bool FilterParser::isDomainRule(const QString &rule) const
+bool FilterParser::isDomainRule(const QStringRef &rule) const
 {
     // looping through string of format: "||inner_rule_text^", indices 0,1, and len-1 ignored
     for (int i = 2; i < rule.size() - 1; ++i)
@@ -691,8 +687,8 @@ void FilterParser::parseOptions(const QString &optionString, Filter *filter) con
         const bool optionException = (option.at(0) == QChar('~'));
         QString name = optionException ? option.mid(1) : option;
 
-        auto it = eOptionMap.find(name);
-        if (it != eOptionMap.end())
+        auto it = eOptionMap.constFind(name);
+        if (it != eOptionMap.constEnd())
         {
             ElementType elemType = it.value();
             if (elemType == ElementType::MatchCase)
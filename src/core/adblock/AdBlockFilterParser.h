@@ -66,13 +66,13 @@ class FilterParser
     FilterParser(AdBlockManager *adBlockManager);
 
     /// Instantiates and returns an Filter given a filter rule
-    std::unique_ptr<Filter> makeFilter(QString rule) const;
+    std::unique_ptr<Filter> makeFilter(const QString &ruleString) const;
 
 private:
     /// Returns true if the given rule string is able to be interpreted as a domain anchor rule with no regular expressions.
     /// Example [will return true]: ||my.adserver.com^
     /// Example [will return false]: ||ads.*.host.com^
-    bool isDomainRule(const QString &rule) const;
+    bool isDomainRule(const QStringRef &rule) const;
 
     /// Returns true if, while parsing the filter rule, its category is determined to be of type Stylesheet or StylesheetJS. Otherwise returns false.
     bool isStylesheetRule(const QString &rule, Filter *filter) const;
@@ -1,82 +1,220 @@
 #include "AdBlockLog.h"
 
-#include <algorithm>
-
 namespace adblock
 {
 
-AdBlockLog::AdBlockLog(QObject *parent) :
+/// Returns the smallest power of two that is greater than or equal to the given capacity
+static quint64 roundUpCapacity(quint32 capacity)
+{
+    quint64 result = 1;
+    while (result < capacity)
+        result <<= 1;
+    return result;
+}
+
+size_t LogWindow::size() const
+{
+    return m_filtered ? m_sequences.size() : static_cast<size_t>(m_end - m_begin);
+}
+
+quint64 LogWindow::getSequence(size_t index) const
+{
+    return m_filtered ? m_sequences.at(index) : m_begin + index;
+}
+
+AdBlockLog::AdBlockLog(QObject *parent, quint32 capacity) :
     QObject(parent),
-    m_entries(),
-    m_timerId(0)
+    m_slots(roundUpCapacity(capacity)),
+    m_mask(roundUpCapacity(capacity) - 1),
+    m_nextSequence(0),
+    m_urls(capacity * 8),
+    m_rules(capacity * 4),
+    m_startTime(QDateTime::currentDateTime()),
+    m_clock(),
+    m_summaryMutex(),
+    m_pageSummaries()
 {
-    // Prune logs every 30 minutes
-    m_timerId = startTimer(1000 * 60 * 30);
+    m_clock.start();
 }
 
 AdBlockLog::~AdBlockLog()
 {
-    killTimer(m_timerId);
 }
 
 void AdBlockLog::addEntry(FilterAction action, const QUrl &firstPartyUrl, const QUrl &requestUrl,
-              ElementType resourceType, const QString &rule, const QDateTime &timestamp)
+              ElementType resourceType, const QString &rule)
 {
-    auto it = m_entries.find(firstPartyUrl);
-    if (it != m_entries.end())
-        it->push_back({ action, firstPartyUrl, requestUrl, resourceType, rule, timestamp });
-    else
-        m_entries[firstPartyUrl] = { { action, firstPartyUrl, requestUrl, resourceType, rule, timestamp } };
+    addEncodedEntry(action, firstPartyUrl, requestUrl, resourceType, rule.toUtf8(), false);
 }
 
-std::vector<LogEntry> AdBlockLog::getAllEntries() const
+void AdBlockLog::addEntry(FilterAction action, const QUrl &firstPartyUrl, const QUrl &requestUrl,
+              ElementType resourceType, const Filter &filter)
 {
-    // Combine all entries
-    std::vector<LogEntry> entries;
-    for (auto it = m_entries.cbegin(); it != m_entries.cend(); ++it)
+    const ArenaString &ruleText = filter.getRuleText();
+    if (!ruleText.isValid())
     {
-        for (const LogEntry &logEntry : *it)
-            entries.push_back(logEntry);
+        addEntry(action, firstPartyUrl, requestUrl, resourceType, filter.getRule());
+        return;
     }
 
-    // Sort entries from newest to oldest
-    std::sort(entries.begin(), entries.end(), [](const LogEntry &a, const LogEntry &b){
-        return a.Timestamp < b.Timestamp;
-    });
+    // The arena outlives the lookup, and the intern table copies the bytes if the rule has not been seen before
+    const QByteArray rule = QByteArray::fromRawData(ruleText.Data, static_cast<int>(ruleText.Size));
+    addEncodedEntry(action, firstPartyUrl, requestUrl, resourceType, rule, ruleText.IsLatin1);
+}
+
+void AdBlockLog::addEncodedEntry(FilterAction action, const QUrl &firstPartyUrl, const QUrl &requestUrl,
+                                 ElementType resourceType, const QByteArray &rule, bool isLatin1)
+{
+    const quint32 firstPartyId = m_urls.intern(firstPartyUrl);
+    const quint32 requestId = m_urls.intern(requestUrl);
+    const quint32 ruleId = m_rules.intern(rule);
+    const qint64 timestamp = m_clock.elapsed();
+
+    const quint64 sequence = m_nextSequence.fetch_add(1, std::memory_order_relaxed);
+    LogSlot &slot = m_slots[sequence & m_mask];
+
+    // The entry that is about to be overwritten no longer counts towards the summary of its page
+    if (slot.Sequence.load(std::memory_order_relaxed) != 0)
+    {
+        const quint32 previousFirstPartyId = static_cast<quint32>(slot.UrlIds.load(std::memory_order_relaxed) >> 32);
+        const FilterAction previousAction = static_cast<FilterAction>(slot.RuleAndAction.load(std::memory_order_relaxed) & ActionMask);
+
+        QUrl previousFirstPartyUrl;
+        if (m_urls.get(previousFirstPartyId, previousFirstPartyUrl))
+            updateSummary(previousFirstPartyUrl, previousAction, -1);
+    }
+
+    // Mark the slot as being written, so that readers discard whatever they read from it in the meantime
+    slot.Sequence.store(0, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+
+    slot.UrlIds.store((static_cast<quint64>(firstPartyId) << 32) | requestId, std::memory_order_relaxed);
+    const quint64 encoding = isLatin1 ? RuleIsLatin1 : 0;
+    slot.RuleAndAction.store((static_cast<quint64>(ruleId) << 32) | encoding | static_cast<quint32>(action), std::memory_order_relaxed);
+    slot.ResourceType.store(static_cast<quint64>(resourceType), std::memory_order_relaxed);
+    slot.Timestamp.store(timestamp, std::memory_order_relaxed);
+
+    slot.Sequence.store(sequence + 1, std::memory_order_release);
+
+    updateSummary(firstPartyUrl, action, 1);
+}
+
+quint32 AdBlockLog::getCapacity() const
+{
+    return static_cast<quint32>(m_mask + 1);
+}
 
-    return entries;
+LogWindow AdBlockLog::getWindow() const
+{
+    LogWindow window;
+    window.m_begin = getRange(window.m_end);
+    return window;
 }
 
-const std::vector<LogEntry> &AdBlockLog::getEntriesFor(const QUrl &firstPartyUrl)
+LogWindow AdBlockLog::getWindowFor(const QUrl &firstPartyUrl) const
 {
-    auto it = m_entries.find(firstPartyUrl);
-    if (it != m_entries.end())
-        return *it;
+    LogWindow window;
+    window.m_begin = getRange(window.m_end);
+    window.m_filtered = true;
+
+    const quint32 numEntries = getSummaryFor(firstPartyUrl).getTotal();
+    if (numEntries == 0)
+        return window;
+
+    window.m_sequences.reserve(numEntries);
+
+    // The URL may have been given more than one identifier while its entries were added, so the
+    // URL of each identifier is looked up once, the first time the identifier is seen
+    QHash<quint32, bool> matchingIds;
+    for (quint64 sequence = window.m_begin; sequence < window.m_end; ++sequence)
+    {
+        const LogSlot &slot = m_slots[sequence & m_mask];
+        if (slot.Sequence.load(std::memory_order_acquire) != sequence + 1)
+            continue;
 
-    std::vector<LogEntry> entriesForUrl;
-    it = m_entries.insert(firstPartyUrl, entriesForUrl);
-    return *it;
+        const quint32 firstPartyId = static_cast<quint32>(slot.UrlIds.load(std::memory_order_relaxed) >> 32);
+
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (slot.Sequence.load(std::memory_order_relaxed) != sequence + 1)
+            continue;
+
+        auto it = matchingIds.find(firstPartyId);
+        if (it == matchingIds.end())
+        {
+            QUrl url;
+            it = matchingIds.insert(firstPartyId, m_urls.get(firstPartyId, url) && url == firstPartyUrl);
+        }
+
+        if (*it)
+            window.m_sequences.push_back(sequence);
+    }
+
+    return window;
 }
 
-void AdBlockLog::timerEvent(QTimerEvent */*event*/)
+bool AdBlockLog::getEntry(quint64 sequence, LogEntry &entry) const
 {
-    pruneLogs();
+    const LogSlot &slot = m_slots[sequence & m_mask];
+    if (slot.Sequence.load(std::memory_order_acquire) != sequence + 1)
+        return false;
+
+    const quint64 urlIds = slot.UrlIds.load(std::memory_order_relaxed);
+    const quint64 ruleAndAction = slot.RuleAndAction.load(std::memory_order_relaxed);
+    const quint64 resourceType = slot.ResourceType.load(std::memory_order_relaxed);
+    const qint64 timestamp = slot.Timestamp.load(std::memory_order_relaxed);
+
+    std::atomic_thread_fence(std::memory_order_acquire);
+    if (slot.Sequence.load(std::memory_order_relaxed) != sequence + 1)
+        return false;
+
+    entry.Action = static_cast<FilterAction>(ruleAndAction & ActionMask);
+    entry.ResourceType = static_cast<ElementType>(resourceType);
+    entry.Timestamp = m_startTime.addMSecs(timestamp);
+
+    QByteArray rule;
+    if (!m_urls.get(static_cast<quint32>(urlIds >> 32), entry.FirstPartyUrl)
+            || !m_urls.get(static_cast<quint32>(urlIds & 0xFFFFFFFFULL), entry.RequestUrl)
+            || !m_rules.get(static_cast<quint32>(ruleAndAction >> 32), rule))
+        return false;
+
+    entry.Rule = (ruleAndAction & RuleIsLatin1) ? QString::fromLatin1(rule) : QString::fromUtf8(rule);
+    return true;
+}
+
+PageLogSummary AdBlockLog::getSummaryFor(const QUrl &firstPartyUrl) const
+{
+    std::lock_guard<std::mutex> lock(m_summaryMutex);
+    return m_pageSummaries.value(firstPartyUrl);
+}
+
+quint64 AdBlockLog::getRange(quint64 &end) const
+{
+    end = m_nextSequence.load(std::memory_order_acquire);
+
+    const quint64 capacity = m_mask + 1;
+    return end > capacity ? end - capacity : 0;
 }
 
-void AdBlockLog::pruneLogs()
+void AdBlockLog::updateSummary(const QUrl &firstPartyUrl, FilterAction action, int amount)
 {
-    const quint64 pruneThreshold = 1000 * 60 * 30;
-    const QDateTime now = QDateTime::currentDateTime();
-    auto removeCheck = [&](const LogEntry &logEntry) {
-        return static_cast<quint64>(logEntry.Timestamp.msecsTo(now)) >= pruneThreshold;
-    };
+    std::lock_guard<std::mutex> lock(m_summaryMutex);
 
-    for (auto it = m_entries.begin(); it != m_entries.end(); ++it)
+    PageLogSummary &summary = m_pageSummaries[firstPartyUrl];
+    switch (action)
     {
-        std::vector<LogEntry> &entries = *it;
-        auto newEnd = std::remove_if(entries.begin(), entries.end(), removeCheck);
-        entries.erase(newEnd, entries.end());
+        case FilterAction::Allow:
+            summary.NumAllowed += static_cast<quint32>(amount);
+            break;
+        case FilterAction::Block:
+            summary.NumBlocked += static_cast<quint32>(amount);
+            break;
+        case FilterAction::Redirect:
+            summary.NumRedirected += static_cast<quint32>(amount);
+            break;
     }
+
+    if (summary.getTotal() == 0)
+        m_pageSummaries.remove(firstPartyUrl);
 }
 
 }
@@ -2,11 +2,15 @@
 #define ADBLOCKLOG_H
 
 #include "AdBlockFilter.h"
+#include "LogInternTable.h"
 
 #include <QDateTime>
+#include <QElapsedTimer>
 #include <QHash>
 #include <QUrl>
 
+#include <atomic>
+#include <mutex>
 #include <vector>
 
 namespace adblock
@@ -46,10 +50,74 @@ struct LogEntry
     QDateTime Timestamp;
 };
 
+/**
+ * @struct PageLogSummary
+ * @brief Number of log entries of each action that are associated with a first party URL
+ * @ingroup AdBlock
+ */
+struct PageLogSummary
+{
+    /// Number of requests that were allowed by an exception filter
+    quint32 NumAllowed { 0 };
+
+    /// Number of requests that were blocked
+    quint32 NumBlocked { 0 };
+
+    /// Number of requests that were redirected to a resource
+    quint32 NumRedirected { 0 };
+
+    /// Returns the total number of entries
+    quint32 getTotal() const { return NumAllowed + NumBlocked + NumRedirected; }
+};
+
+/**
+ * @class LogWindow
+ * @brief A view of a subset of the entries in the \ref AdBlockLog, as they were when the window was
+ *        created. Entries are referred to by their sequence numbers, and are read from the log on demand.
+ *        An entry may be overwritten by newer entries while the window is in use, in which case it
+ *        can no longer be read from the log.
+ * @ingroup AdBlock
+ */
+class LogWindow
+{
+    friend class AdBlockLog;
+
+public:
+    /// Constructs an empty window
+    LogWindow() = default;
+
+    /// Returns the number of entries in the window
+    size_t size() const;
+
+    /// Returns the sequence number of the entry at the given index of the window, from oldest to newest
+    quint64 getSequence(size_t index) const;
+
+private:
+    /// Sequence number of the oldest entry in the range of the log that the window covers
+    quint64 m_begin { 0 };
+
+    /// Sequence number following the newest entry in the range of the log that the window covers
+    quint64 m_end { 0 };
+
+    /// True if only the entries in the m_sequences container belong to the window, false if every entry in the range does
+    bool m_filtered { false };
+
+    /// Sequence numbers of the entries in the window, if the window is filtered
+    std::vector<quint64> m_sequences;
+};
+
 /**
  * @class AdBlockLog
  * @brief This class stores information about any recent network requests that were affected by
  *        an \ref AdBlockFilter
+ *
+ *        Entries are kept in a fixed-capacity ring buffer, so the newest entry replaces the oldest one once the
+ *        log is full. Entries are added from the thread that intercepts network requests, and may be read from
+ *        any other thread at the same time. Neither adding nor reading an entry takes a lock on the ring buffer.
+ *        Instead, each slot of the ring holds the sequence number of its entry, which a reader checks before and
+ *        after reading the slot to detect entries that were overwritten in the meantime.
+ *
+ *        URLs and filter rules are interned, so that each entry only stores their identifiers.
  * @ingroup AdBlock
  */
 class AdBlockLog : public QObject
@@ -57,8 +125,11 @@ class AdBlockLog : public QObject
     Q_OBJECT
 
 public:
-    /// Constructs the log with a given parent
-    AdBlockLog(QObject *parent = nullptr);
+    /// Default number of entries that are kept in the log
+    static constexpr quint32 DefaultCapacity = 4096;
+
+    /// Constructs the log with a given parent and capacity. The capacity is rounded up to the next power of two
+    explicit AdBlockLog(QObject *parent = nullptr, quint32 capacity = DefaultCapacity);
 
     /// Logging destructor
     ~AdBlockLog();
@@ -70,32 +141,111 @@ class AdBlockLog : public QObject
      * @param requestUrl The resource that was requested
      * @param resourceType The type or types associated with the requested resource
      * @param rule The filter rule that was applied to the request
-     * @param timestamp The time of the network action
      */
     void addEntry(FilterAction action, const QUrl &firstPartyUrl, const QUrl &requestUrl,
-                  ElementType resourceType, const QString &rule, const QDateTime &timestamp);
+                  ElementType resourceType, const QString &rule);
+
+    /**
+     * @brief addEntry Adds a network action performed by the ad block system to the logs. The rule of the
+     *        filter is interned as it is stored in the string arena, and is only decoded when the entry is read
+     * @param action The action that was done to the request
+     * @param firstPartyUrl The source from which the request was made
+     * @param requestUrl The resource that was requested
+     * @param resourceType The type or types associated with the requested resource
+     * @param filter The filter that was applied to the request
+     */
+    void addEntry(FilterAction action, const QUrl &firstPartyUrl, const QUrl &requestUrl,
+                  ElementType resourceType, const Filter &filter);
+
+    /// Returns the maximum number of entries that are kept in the log
+    quint32 getCapacity() const;
 
-    /// Returns all log entries
-    std::vector<LogEntry> getAllEntries() const;
+    /// Returns a window of every entry that is currently in the log
+    LogWindow getWindow() const;
 
-    /// Returns all log entries associated with the given first party request url, or
-    /// an empty container if no entries are found
-    const std::vector<LogEntry> &getEntriesFor(const QUrl &firstPartyUrl);
+    /// Returns a window of the entries that are currently in the log, and are associated with the given
+    /// first party request url. The window is empty if no entries are found
+    LogWindow getWindowFor(const QUrl &firstPartyUrl) const;
 
-protected:
-    /// Called on a regular interval to prune older log entries
-    void timerEvent(QTimerEvent *event) override;
+    /**
+     * @brief Reads the entry with the given sequence number from the log
+     * @param sequence Sequence number of the entry, as given by a \ref LogWindow
+     * @param entry Set to the entry, if it is still in the log
+     * @return True if the entry was read, false if it has been overwritten by a newer entry
+     */
+    bool getEntry(quint64 sequence, LogEntry &entry) const;
 
-private Q_SLOTS:
-    /// Removes any entries from the logs that are more than 30 minutes old
-    void pruneLogs();
+    /// Returns the number of entries of each action that are in the log, and are associated with the given first party url
+    PageLogSummary getSummaryFor(const QUrl &firstPartyUrl) const;
 
 private:
-    /// Hashmap of first party URLs associated with requests, to containers of their associated log entries
-    QHash<QUrl, std::vector<LogEntry>> m_entries;
+    /// The contents of a single log entry. Each field is atomic, so that a reader never races with the writer of the
+    /// same slot. A reader only uses the fields if the sequence number is the same before and after they were read
+    struct LogSlot
+    {
+        /// One more than the sequence number of the entry in the slot, or 0 if the slot is empty or being written
+        std::atomic<quint64> Sequence { 0 };
+
+        /// Identifier of the first party URL in the upper 32 bits, and the identifier of the request URL in the lower 32 bits
+        std::atomic<quint64> UrlIds { 0 };
+
+        /// Identifier of the filter rule in the upper 32 bits, and the action in the lower 32 bits. The
+        /// \ref AdBlockLog::RuleIsLatin1 flag is set in the lower bits if the rule is stored as Latin-1 text
+        std::atomic<quint64> RuleAndAction { 0 };
+
+        /// The type or types associated with the requested resource
+        std::atomic<quint64> ResourceType { 0 };
+
+        /// Number of milliseconds between the creation of the log and the time of the entry
+        std::atomic<qint64> Timestamp { 0 };
+    };
+
+    /// Set in the lower bits of \ref LogSlot::RuleAndAction when the rule is Latin-1 text rather than UTF-8 text
+    static constexpr quint64 RuleIsLatin1 = 0x80000000ULL;
+
+    /// Mask of the action in the lower bits of \ref LogSlot::RuleAndAction
+    static constexpr quint64 ActionMask = 0x7FFFFFFFULL;
+
+    /// Adds an entry whose rule is given as Latin-1 or UTF-8 text
+    void addEncodedEntry(FilterAction action, const QUrl &firstPartyUrl, const QUrl &requestUrl,
+                         ElementType resourceType, const QByteArray &rule, bool isLatin1);
+
+    /// Returns the sequence number of the oldest entry that is still in the log, and sets end to the sequence number
+    /// that will be assigned to the next entry
+    quint64 getRange(quint64 &end) const;
+
+    /// Adds the given amount to the number of entries of the action in the summary of the page with the given url
+    void updateSummary(const QUrl &firstPartyUrl, FilterAction action, int amount);
+
+private:
+    /// Ring buffer of log entries
+    std::vector<LogSlot> m_slots;
+
+    /// Capacity of the ring buffer, minus one
+    quint64 m_mask;
+
+    /// Sequence number of the next log entry
+    std::atomic<quint64> m_nextSequence;
+
+    /// Interned first party and request URLs. Each entry interns up to two URLs, so the table holds eight
+    /// times as many URLs as the log holds entries, in order for the URLs of every entry to remain available
+    LogInternTable<QUrl> m_urls;
+
+    /// Interned filter rules, as Latin-1 or UTF-8 text. Holds four times as many rules as the log holds entries
+    LogInternTable<QByteArray> m_rules;
+
+    /// Time at which the log was created, used to display the time of each entry
+    QDateTime m_startTime;
+
+    /// Monotonic clock started when the log was created, used to timestamp each entry
+    QElapsedTimer m_clock;
+
+    /// Guards the page summaries. Only held while a summary is updated or copied
+    mutable std::mutex m_summaryMutex;
 
-    /// Unique identifier of the log pruning timer
-    int m_timerId;
+    /// Number of entries of each action that are associated with each first party URL in the log. Pages without
+    /// any entries in the log are removed, so the container does not grow beyond the capacity of the log
+    QHash<QUrl, PageLogSummary> m_pageSummaries;
 };
 
 }
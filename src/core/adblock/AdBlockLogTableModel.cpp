@@ -7,7 +7,10 @@ namespace adblock
 
 LogTableModel::LogTableModel(QObject *parent) :
     QAbstractTableModel(parent),
-    m_logEntries()
+    m_log(nullptr),
+    m_window(),
+    m_cachedRow(-1),
+    m_cachedEntry()
 {
 }
 
@@ -37,7 +40,7 @@ int LogTableModel::rowCount(const QModelIndex &parent) const
     if (parent.isValid())
         return 0;
 
-    return static_cast<int>(m_logEntries.size());
+    return static_cast<int>(m_window.size());
 }
 
 int LogTableModel::columnCount(const QModelIndex &parent) const
@@ -51,13 +54,17 @@ int LogTableModel::columnCount(const QModelIndex &parent) const
 
 QVariant LogTableModel::data(const QModelIndex &index, int role) const
 {
-    if (!index.isValid() || index.row() >= static_cast<int>(m_logEntries.size()))
+    if (!index.isValid() || index.row() >= static_cast<int>(m_window.size()))
         return QVariant();
 
     if (role != Qt::DisplayRole)
         return QVariant();
 
-    const LogEntry &entry = m_logEntries.at(index.row());
+    const LogEntry *entryPtr = getEntry(index.row());
+    if (!entryPtr)
+        return QVariant();
+
+    const LogEntry &entry = *entryPtr;
     switch (index.column())
     {
         // Timestamp column
@@ -162,11 +169,28 @@ QString LogTableModel::elementTypeToString(ElementType type) const
     return result;
 }
 
-void LogTableModel::setLogEntries(const std::vector<LogEntry> &entries)
+void LogTableModel::setLogWindow(const AdBlockLog *log, LogWindow window)
 {
     beginResetModel();
-    m_logEntries = entries;
+    m_log = log;
+    m_window = std::move(window);
+    m_cachedRow = -1;
     endResetModel();
 }
 
+const LogEntry *LogTableModel::getEntry(int row) const
+{
+    if (m_cachedRow == row)
+        return &m_cachedEntry;
+
+    if (!m_log || !m_log->getEntry(m_window.getSequence(static_cast<size_t>(row)), m_cachedEntry))
+    {
+        m_cachedRow = -1;
+        return nullptr;
+    }
+
+    m_cachedRow = row;
+    return &m_cachedEntry;
+}
+
 }
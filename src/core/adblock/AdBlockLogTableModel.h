@@ -31,16 +31,29 @@ class LogTableModel : public QAbstractTableModel
     /// Returns the data associated at the index with the given role
     QVariant data(const QModelIndex &index, int role = Qt::DisplayRole) const override;
 
-    /// Sets the log entry data to be shown in the table
-    void setLogEntries(const std::vector<LogEntry> &entries);
+    /// Sets the window of log entries to be shown in the table. Entries are read from the log as they are displayed
+    void setLogWindow(const AdBlockLog *log, LogWindow window);
 
 private:
+    /// Returns the log entry at the given row, or a nullptr if it has been overwritten by a newer entry in the log
+    const LogEntry *getEntry(int row) const;
+
     /// Returns the element typemask as a formatted string ("type1[, type2, ..., typeN]")
     QString elementTypeToString(ElementType type) const;
 
 private:
-    /// Logs stored in the table model
-    std::vector<LogEntry> m_logEntries;
+    /// Log from which the entries are read
+    const AdBlockLog *m_log;
+
+    /// Window of the log entries shown in the table
+    LogWindow m_window;
+
+    /// Row of the most recently read log entry, or -1 if no entry has been read. The data of
+    /// each column of a row is requested separately, so the entry is only read from the log once
+    mutable int m_cachedRow;
+
+    /// The most recently read log entry
+    mutable LogEntry m_cachedEntry;
 };
 
 }
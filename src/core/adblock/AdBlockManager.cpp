@@ -5,15 +5,20 @@
 #include "Bitfield.h"
 #include "InternalDownloadItem.h"
 #include "DownloadManager.h"
+#include "FilterListPatch.h"
 #include "SchemeRegistry.h"
 
+#include <QCryptographicHash>
 #include <QDir>
 #include <QDirIterator>
 #include <QFile>
+#include <QFutureWatcher>
 #include <QJsonDocument>
 #include <QJsonObject>
 #include <QJsonValue>
 #include <QNetworkRequest>
+#include <QSaveFile>
+#include <QtConcurrent>
 #include <QtGlobal>
 
 #include <QDebug>
@@ -23,7 +28,13 @@ namespace adblock
 
 AdBlockManager::AdBlockManager(const ViperServiceLocator &serviceLocator, QObject *parent) :
     QObject(parent),
-    m_filterContainer(),
+    m_filterContainer(std::make_shared<FilterContainer>()),
+    m_filterLoadFuture(),
+    m_filterLoadGeneration(0),
+    m_filterReloadPending(false),
+    m_pendingResourceFiles(),
+    m_numPendingUpdates(0),
+    m_hasUpdatedSubscription(false),
     m_downloadManager(nullptr),
     m_enabled(true),
     m_configFile(),
@@ -81,8 +92,10 @@ AdBlockManager::AdBlockManager(const ViperServiceLocator &serviceLocator, QObjec
     },
     m_resourceMap(),
     m_resourceContentTypeMap(),
+    m_resourceChecksum(),
     m_domainStylesheetCache(24),
     m_jsInjectionCache(24),
+    m_cosmeticScriptCache(48),
     m_emptyStr(),
     m_adBlockModel(nullptr),
     m_log(nullptr),
@@ -119,6 +132,9 @@ AdBlockManager::AdBlockManager(const ViperServiceLocator &serviceLocator, QObjec
 
 AdBlockManager::~AdBlockManager()
 {
+    // The filter parser refers back to the manager, so any load in progress must complete first
+    m_filterLoadFuture.waitForFinished();
+
     save();
 }
 
@@ -142,36 +158,24 @@ void AdBlockManager::updateSubscriptions()
         return;
 
     // Try updating the subscription if its next_update is hit
-    // Check if subscription should be updated
-    for (size_t i = 0; i < m_subscriptions.size(); ++i)
+    const QDateTime now = QDateTime::currentDateTime();
+    for (const Subscription &sub : m_subscriptions)
     {
-        Subscription *subPtr = &(m_subscriptions[i]);
-        if (!subPtr)
+        const QDateTime &updateTime = sub.getNextUpdate();
+        if (updateTime.isNull() || updateTime >= now)
             continue;
-        const QDateTime &updateTime = subPtr->getNextUpdate();
-        QDateTime now = QDateTime::currentDateTime();
-        if (!updateTime.isNull() && updateTime < now)
-        {
-            const QUrl &srcUrl = subPtr->getSourceUrl();
-            if (srcUrl.isValid() && !srcUrl.isLocalFile())
-            {
-                QNetworkRequest request;
-                request.setUrl(srcUrl);
-
-                InternalDownloadItem *item = m_downloadManager->downloadInternal(request, m_subscriptionDir, false, true);
-                connect(item, &InternalDownloadItem::downloadFinished, this, [item, now, subPtr](const QString &filePath) {
-                    if (filePath != subPtr->getFilePath())
-                    {
-                        QFile oldFile(subPtr->getFilePath());
-                        oldFile.remove();
-                        subPtr->setFilePath(filePath);
-                    }
-                    item->deleteLater();
-                    subPtr->setLastUpdate(now);
-                    subPtr->setNextUpdate(now.addDays(7));
-                });
-            }
-        }
+
+        const QUrl &srcUrl = sub.getSourceUrl();
+        if (!srcUrl.isValid() || srcUrl.isLocalFile())
+            continue;
+
+        ++m_numPendingUpdates;
+
+        // Lists that publish differential updates only need to download the changes since their last update
+        if (!sub.getDiffPath().isEmpty())
+            downloadSubscriptionPatch(sub.getFilePath(), srcUrl, sub.getDiffPath(), now);
+        else
+            downloadSubscription(sub.getFilePath(), srcUrl, now);
     }
 }
 
@@ -212,7 +216,6 @@ void AdBlockManager::installSubscription(const QUrl &url)
             m_adBlockModel->endInsertRows();
 
         // Reload filters
-        clearFilters();
         extractFilters();
     });
 }
@@ -269,10 +272,10 @@ const QString &AdBlockManager::getStylesheet(const URL &url) const
     if (secondLevelDomain.isEmpty())
         secondLevelDomain = url.host();
 
-    if (m_filterContainer.hasGenericHideFilter(requestUrl, secondLevelDomain))
+    if (m_filterContainer->hasGenericHideFilter(requestUrl, secondLevelDomain))
         return m_emptyStr;
 
-    return m_filterContainer.getCombinedFilterStylesheet();
+    return m_filterContainer->getCombinedFilterStylesheet();
 }
 
 const QString &AdBlockManager::getDomainStylesheet(const URL &url)
@@ -289,7 +292,7 @@ const QString &AdBlockManager::getDomainStylesheet(const URL &url)
     if (m_domainStylesheetCache.has(domainStdStr))
         return m_domainStylesheetCache.get(domainStdStr);
 
-    const static QString styleScript = QStringLiteral("(function() {\n"
+    const static CosmeticScriptTemplate styleScript(QStringLiteral("(function() {\n"
                                        "var doc = document;\n"
                                        "if (!doc.head) { \n"
                                        " document.onreadystatechange = function(){ \n"
@@ -306,8 +309,8 @@ const QString &AdBlockManager::getDomainStylesheet(const URL &url)
                                        "sheet.type = 'text/css';\n"
                                        "sheet.innerHTML = '%1';\n"
                                        "doc.head.appendChild(sheet);\n"
-                                   "})();");
-    const static QString styleScriptAlt = QStringLiteral("(function() {\n"
+                                   "})();"), { QStringLiteral("%1") });
+    const static CosmeticScriptTemplate styleScriptAlt(QStringLiteral("(function() {\n"
                                           "  const queries = [ %1 ];\n"
                                           "  document.onreadystatechange = function() {\n"
                                           "    if (document.readyState == 'interactive' || document.readyState == 'complete') { \n"
@@ -317,39 +320,31 @@ const QString &AdBlockManager::getDomainStylesheet(const URL &url)
                                           "      });\n"
                                           "    }\n"
                                           "  }\n"
-                                          "})();");
+                                          "})();"), { QStringLiteral("%1") });
 
-    QString stylesheet;
-    QString stylesheetCustom;
-    std::vector<Filter*> domainBasedHidingFilters = m_filterContainer.getDomainBasedHidingFilters(domain);
-    for (Filter *filter : domainBasedHidingFilters)
-    {
-        QString filterArg = filter->getEvalString();
-        stylesheet.append(QString("'%1',").arg(filterArg.replace(QString("'"), QString("\\'"))));
-    }
+    // The fragments of the filters are escaped when the filter container is built. Hosts that are
+    // matched by the same set of filters share a single stylesheet script
+    std::string filterSetKey(1, 'S');
+    const std::vector<QString> selectors = m_filterContainer->getDomainBasedHidingFragments(domain, filterSetKey);
+    const std::vector<QString> customStylesheets = m_filterContainer->getDomainBasedCustomHidingFragments(domain, filterSetKey);
 
-    // Check for custom stylesheet rules
-    domainBasedHidingFilters = m_filterContainer.getDomainBasedCustomHidingFilters(domain);
-    for (Filter *filter : domainBasedHidingFilters)
+    if (!m_cosmeticScriptCache.has(filterSetKey))
     {
-        stylesheetCustom.append(filter->getEvalString());
-    }
+        QString stylesheet;
+        if (!selectors.empty())
+            stylesheet = styleScriptAlt.render({ &selectors }, QStringLiteral(","));
 
-    if (!stylesheet.isEmpty())
-    {
-        stylesheet = stylesheet.left(stylesheet.size() - 1);
-        stylesheet = styleScriptAlt.arg(stylesheet);
-    }
-    if (!stylesheetCustom.isEmpty())
-    {
-        stylesheetCustom = stylesheetCustom.replace(QLatin1String("'"), QLatin1String("\\'"));
-        stylesheetCustom = styleScript.arg(stylesheetCustom);
+        if (!customStylesheets.empty())
+        {
+            stylesheet.append(QChar('\n'));
+            stylesheet.append(styleScript.render({ &customStylesheets }));
+        }
 
-        stylesheet.append(QString("\n%1").arg(stylesheetCustom));
+        m_cosmeticScriptCache.put(filterSetKey, stylesheet);
     }
 
     // Insert the stylesheet into cache
-    m_domainStylesheetCache.put(domainStdStr, stylesheet);
+    m_domainStylesheetCache.put(domainStdStr, m_cosmeticScriptCache.get(filterSetKey));
     return m_domainStylesheetCache.get(domainStdStr);
 }
 
@@ -358,7 +353,7 @@ const QString &AdBlockManager::getDomainJavaScript(const URL &url)
     if (!m_enabled)
         return m_emptyStr;
 
-    const static QString cspScript = QStringLiteral("(function() {\n"
+    const static CosmeticScriptTemplate cspScript(QStringLiteral("(function() {\n"
                                        "var doc = document;\n"
                                        "if (!doc.head) { \n"
                                        " document.onreadystatechange = function(){ \n"
@@ -375,7 +370,7 @@ const QString &AdBlockManager::getDomainJavaScript(const URL &url)
                                        "meta.setAttribute('http-equiv', 'Content-Security-Policy');\n"
                                        "meta.setAttribute('content', \"%1\");\n"
                                        "doc.head.appendChild(meta);\n"
-                                   "})();");
+                                   "})();"), { QStringLiteral("%1") });
 
     QString domain = url.host().toLower();
     if (domain.startsWith(QLatin1String("www.")))
@@ -393,48 +388,54 @@ const QString &AdBlockManager::getDomainJavaScript(const URL &url)
     if (m_jsInjectionCache.has(requestHostStdStr))
         return m_jsInjectionCache.get(requestHostStdStr);
 
-    QString scriptlets;
-    QString proceduralFilters;
-    std::vector<QString> cspDirectives;
-
-    std::vector<Filter*> domainBasedScripts = m_filterContainer.getDomainBasedScriptInjectionFilters(domain);
-    for (Filter *filter : domainBasedScripts)
-        scriptlets.append(filter->getEvalString());
+    std::string filterSetKey(1, 'J');
+    std::vector<QString> scriptlets = m_filterContainer->getDomainBasedScriptInjectionFragments(domain, filterSetKey);
+    const std::vector<QString> proceduralFilters = m_filterContainer->getDomainBasedCosmeticProceduralFragments(domain, filterSetKey);
 
-    std::vector<Filter*> cosmeticProceduralFilters = m_filterContainer.getDomainBasedCosmeticProceduralFilters(domain);
-    for (Filter *filter : cosmeticProceduralFilters)
-        proceduralFilters.append(filter->getEvalString());
+    // The content security policies become part of the script, so their filters are also part of the key
+    auto addFilterToKey = [&filterSetKey](const Filter *filter) {
+        filterSetKey.append(reinterpret_cast<const char*>(&filter), sizeof(const Filter*));
+    };
 
-    const Filter *inlineScriptBlockingRule = m_filterContainer.findInlineScriptBlockingFilter(requestUrl, domain);
-    if (inlineScriptBlockingRule != nullptr)
-        cspDirectives.push_back(QLatin1String("script-src 'unsafe-eval' * blob: data:"));
+    const Filter *inlineScriptBlockingRule = m_filterContainer->findInlineScriptBlockingFilter(requestUrl, domain);
+    addFilterToKey(inlineScriptBlockingRule);
 
-    std::vector<Filter*> cspFilters = m_filterContainer.getMatchingCSPFilters(requestUrl, domain);
-    for (Filter *filter : cspFilters)
-        cspDirectives.push_back(filter->getContentSecurityPolicy());
+    std::vector<Filter*> cspFilters = m_filterContainer->getMatchingCSPFilters(requestUrl, domain);
+    for (const Filter *filter : cspFilters)
+        addFilterToKey(filter);
 
-    QString result;
-    if (!cspDirectives.empty())
+    if (!m_cosmeticScriptCache.has(filterSetKey))
     {
-        QString cspConcatenated;
-        for (size_t i = 0; i < cspDirectives.size(); ++i)
+        std::vector<QString> cspDirectives;
+        if (inlineScriptBlockingRule != nullptr)
+            cspDirectives.push_back(QLatin1String("script-src 'unsafe-eval' * blob: data:"));
+
+        for (const Filter *filter : cspFilters)
+            cspDirectives.push_back(filter->getContentSecurityPolicy());
+
+        if (!cspDirectives.empty())
         {
-            cspConcatenated.append(cspDirectives.at(i));
-            if (i + 1 < cspDirectives.size())
-                cspConcatenated.append(QLatin1String("; "));
+            QString cspConcatenated;
+            for (size_t i = 0; i < cspDirectives.size(); ++i)
+            {
+                cspConcatenated.append(cspDirectives.at(i));
+                if (i + 1 < cspDirectives.size())
+                    cspConcatenated.append(QLatin1String("; "));
+            }
+            cspConcatenated.replace(QLatin1String("\""), QLatin1String("\\\""));
+
+            const std::vector<QString> cspValue { cspConcatenated };
+            scriptlets.push_back(cspScript.render({ &cspValue }));
         }
-        cspConcatenated.replace(QLatin1String("\""), QLatin1String("\\\""));
-        scriptlets.append(cspScript.arg(cspConcatenated));
-    }
 
-    if (!scriptlets.isEmpty() || !proceduralFilters.isEmpty())
-    {
-        result = m_cosmeticJSTemplate;
-        result.replace(QStringLiteral("{{ADBLOCK_INTERNAL_SCRIPTLET}}"), scriptlets);
-        result.replace(QStringLiteral("{{ADBLOCK_INTERNAL_COSMETIC}}"), proceduralFilters);
+        QString result;
+        if (!scriptlets.empty() || !proceduralFilters.empty())
+            result = m_cosmeticJSTemplate.render({ &scriptlets, &proceduralFilters });
+
+        m_cosmeticScriptCache.put(filterSetKey, result);
     }
 
-    m_jsInjectionCache.put(requestHostStdStr, result);
+    m_jsInjectionCache.put(requestHostStdStr, m_cosmeticScriptCache.get(filterSetKey));
     return m_jsInjectionCache.get(requestHostStdStr);
 }
 
@@ -483,6 +484,11 @@ QString AdBlockManager::getResourceContentType(const QString &key) const
     return m_resourceContentTypeMap.value(key);
 }
 
+const QByteArray &AdBlockManager::getResourceChecksum() const
+{
+    return m_resourceChecksum;
+}
+
 int AdBlockManager::getNumSubscriptions() const
 {
     return static_cast<int>(m_subscriptions.size());
@@ -523,6 +529,7 @@ void AdBlockManager::removeSubscription(int index)
         if (!subFile.remove())
             qDebug() << "[Advertisement Blocker]: Could not remove subscription file " << subFile.fileName();
     }
+    QFile::remove(it->getCacheFilePath());
 
     m_subscriptions.erase(it);
 
@@ -531,10 +538,6 @@ void AdBlockManager::removeSubscription(int index)
 
 void AdBlockManager::reloadSubscriptions()
 {
-    m_domainStylesheetCache.clear();
-    m_jsInjectionCache.clear();
-
-    clearFilters();
     extractFilters();
 }
 
@@ -563,7 +566,8 @@ void AdBlockManager::loadDynamicTemplate()
     if (!templateFile.open(QIODevice::ReadOnly))
         return;
 
-    m_cosmeticJSTemplate = templateFile.readAll();
+    m_cosmeticJSTemplate = CosmeticScriptTemplate(QString::fromUtf8(templateFile.readAll()),
+                                                  { QStringLiteral("{{ADBLOCK_INTERNAL_SCRIPTLET}}"), QStringLiteral("{{ADBLOCK_INTERNAL_COSMETIC}}") });
     templateFile.close();
 }
 
@@ -584,8 +588,157 @@ void AdBlockManager::loadUBOResources()
     loadResourceFile(QStringLiteral(":/AdBlockResources.txt"));
 }
 
+Subscription *AdBlockManager::findSubscription(const QString &filePath)
+{
+    for (Subscription &sub : m_subscriptions)
+    {
+        if (sub.getFilePath() == filePath)
+            return &sub;
+    }
+
+    return nullptr;
+}
+
+void AdBlockManager::downloadSubscription(const QString &filePath, const QUrl &sourceUrl, const QDateTime &updateTime)
+{
+    QNetworkRequest request;
+    request.setUrl(sourceUrl);
+
+    InternalDownloadItem *item = m_downloadManager->downloadInternal(request, m_subscriptionDir, false, true);
+    connect(item, &InternalDownloadItem::downloadFinished, this, [this, item, filePath, updateTime](const QString &newFilePath) {
+        item->deleteLater();
+
+        Subscription *sub = findSubscription(filePath);
+        if (!sub)
+        {
+            onSubscriptionUpdateFinished(false);
+            return;
+        }
+
+        if (newFilePath != filePath)
+        {
+            // The filter cache of the previous version is kept, so that its filters can be reused for the rules that did not change
+            const QString oldCachePath = sub->getCacheFilePath();
+            QFile::remove(filePath);
+            sub->setFilePath(newFilePath);
+
+            const QString newCachePath = sub->getCacheFilePath();
+            QFile::remove(newCachePath);
+            QFile::rename(oldCachePath, newCachePath);
+        }
+
+        sub->setLastUpdate(updateTime);
+        sub->setNextUpdate(updateTime.addDays(7));
+
+        onSubscriptionUpdateFinished(true);
+    });
+    connect(item, &InternalDownloadItem::downloadFailed, this, [this, item]() {
+        item->deleteLater();
+        onSubscriptionUpdateFinished(false);
+    });
+}
+
+/// Applies the differential update in the given patch file to a subscription file, returning true on success
+static bool applySubscriptionPatch(const QString &filePath, const QString &patchFilePath, const QString &listName)
+{
+    QFile patchFile(patchFilePath);
+    if (!patchFile.open(QIODevice::ReadOnly))
+        return false;
+
+    const FilterListPatch patch(patchFile.readAll());
+    if (!patch.isValid())
+        return false;
+
+    QFile subFile(filePath);
+    if (!subFile.open(QIODevice::ReadOnly))
+        return false;
+
+    QByteArray result;
+    if (!patch.apply(listName, subFile.readAll(), result))
+        return false;
+    subFile.close();
+
+    // The subscription file is replaced atomically, so that it is never left partially written
+    QSaveFile outputFile(filePath);
+    if (!outputFile.open(QIODevice::WriteOnly) || outputFile.write(result) != result.size())
+        return false;
+
+    return outputFile.commit();
+}
+
+void AdBlockManager::downloadSubscriptionPatch(const QString &filePath, const QUrl &sourceUrl, const QString &diffPath, const QDateTime &updateTime)
+{
+    // The diff path is relative to the source of the list, and its fragment names the list within the patch
+    const int fragmentIdx = diffPath.indexOf(QLatin1Char('#'));
+    const QString listName = fragmentIdx >= 0 ? diffPath.mid(fragmentIdx + 1) : QString();
+    const QUrl patchUrl = sourceUrl.resolved(QUrl(diffPath.left(fragmentIdx)));
+
+    QNetworkRequest request;
+    request.setUrl(patchUrl);
+
+    const QString patchDir = m_subscriptionDir + QDir::separator() + QLatin1String("patches");
+    InternalDownloadItem *item = m_downloadManager->downloadInternal(request, patchDir, false, true);
+    connect(item, &InternalDownloadItem::downloadFinished, this,
+            [this, item, filePath, sourceUrl, listName, updateTime](const QString &patchFilePath) {
+        item->deleteLater();
+
+        const bool applied = applySubscriptionPatch(filePath, patchFilePath, listName);
+        QFile::remove(patchFilePath);
+
+        Subscription *sub = findSubscription(filePath);
+        if (!sub)
+        {
+            onSubscriptionUpdateFinished(false);
+            return;
+        }
+
+        if (!applied)
+        {
+            qDebug() << "[Advertisement Blocker]: Could not apply differential update to " << filePath << ", downloading full list";
+            downloadSubscription(filePath, sourceUrl, updateTime);
+            return;
+        }
+
+        sub->setLastUpdate(updateTime);
+        sub->setNextUpdate(updateTime.addDays(7));
+
+        onSubscriptionUpdateFinished(true);
+    });
+    connect(item, &InternalDownloadItem::downloadFailed, this, [this, item, filePath, sourceUrl, updateTime]() {
+        item->deleteLater();
+
+        if (findSubscription(filePath) != nullptr)
+            downloadSubscription(filePath, sourceUrl, updateTime);
+        else
+            onSubscriptionUpdateFinished(false);
+    });
+}
+
+void AdBlockManager::onSubscriptionUpdateFinished(bool changed)
+{
+    m_hasUpdatedSubscription = m_hasUpdatedSubscription || changed;
+    if (m_numPendingUpdates > 0)
+        --m_numPendingUpdates;
+
+    // Each reload parses every enabled subscription, so the updates that finish close together share a single reload
+    if (m_numPendingUpdates > 0 || !m_hasUpdatedSubscription)
+        return;
+
+    m_hasUpdatedSubscription = false;
+    extractFilters();
+}
+
 void AdBlockManager::loadResourceFile(const QString &path)
 {
+    // Filters that are being parsed in the background may be reading from the resource maps. The file is
+    // loaded once they are done, and the filters are then loaded again to make use of its resources
+    if (m_filterLoadFuture.isRunning())
+    {
+        m_pendingResourceFiles.append(path);
+        m_filterReloadPending = true;
+        return;
+    }
+
     QFile f(path);
     if (!f.exists() || !f.open(QIODevice::ReadOnly))
         return;
@@ -593,8 +746,15 @@ void AdBlockManager::loadResourceFile(const QString &path)
     bool readingValue = false;
     QString currentKey, mimeType;
     QByteArray currentValue;
-    QList<QByteArray> contents = f.readAll().split('\n');
+    const QByteArray fileData = f.readAll();
     f.close();
+
+    QCryptographicHash checksum(QCryptographicHash::Sha1);
+    checksum.addData(m_resourceChecksum);
+    checksum.addData(fileData);
+    m_resourceChecksum = checksum.result();
+
+    QList<QByteArray> contents = fileData.split('\n');
     for (int i = 0; i < contents.size(); ++i)
     {
         const QByteArray &line = contents.at(i);
@@ -700,6 +860,9 @@ void AdBlockManager::loadSubscriptions()
         if (!source.isEmpty())
             subscription.setSourceUrl(QUrl(source));
 
+        // Differential updates can begin before the subscription file has been parsed again
+        subscription.setDiffPath(subscriptionObj.value(QLatin1String("diff_path")).toString());
+
         m_subscriptions.push_back(std::move(subscription));
     }
 
@@ -708,18 +871,95 @@ void AdBlockManager::loadSubscriptions()
 
 void AdBlockManager::clearFilters()
 {
-    m_filterContainer.clearFilters();
+    ++m_filterLoadGeneration;
+    m_filterReloadPending = false;
+
+    publishFilterContainer(std::make_shared<FilterContainer>());
 }
 
 void AdBlockManager::extractFilters()
 {
-    for (Subscription &s : m_subscriptions)
+    ++m_filterLoadGeneration;
+
+    // Only one filter load runs at a time. If one is already in progress, its result will be
+    // discarded and the filters are loaded again once it finishes
+    if (m_filterLoadFuture.isRunning())
+    {
+        m_filterReloadPending = true;
+        return;
+    }
+
+    startFilterLoad();
+}
+
+void AdBlockManager::startFilterLoad()
+{
+    // Filters are loaded into copies of the subscriptions, so the originals remain safe to use from the user interface
+    auto subscriptions = std::make_shared< std::vector<Subscription> >();
+    for (const Subscription &sub : m_subscriptions)
     {
-        // calling load() does nothing if subscription is disabled
-        s.load(this);
+        if (sub.isEnabled())
+            subscriptions->push_back(sub.cloneWithoutFilters());
     }
 
-    m_filterContainer.extractFilters(m_subscriptions);
+    // The current container is only read from while the new one is built, so that the hit counts of its filters carry over
+    std::shared_ptr<FilterContainer> previousContainer = m_filterContainer;
+
+    const quint64 generation = m_filterLoadGeneration;
+    m_filterLoadFuture = QtConcurrent::run([this, subscriptions, previousContainer]() {
+        // Subscription files are independent of one another, and are parsed in parallel
+        QtConcurrent::blockingMap(*subscriptions, [this](Subscription &sub) {
+            sub.load(this);
+        });
+
+        auto filterContainer = std::make_shared<FilterContainer>();
+        filterContainer->extractFilters(*subscriptions, previousContainer.get());
+        return filterContainer;
+    });
+
+    using FilterLoadWatcher = QFutureWatcher< std::shared_ptr<FilterContainer> >;
+    FilterLoadWatcher *watcher = new FilterLoadWatcher(this);
+    connect(watcher, &FilterLoadWatcher::finished, this, [this, watcher, subscriptions, generation]() {
+        watcher->deleteLater();
+
+        const QStringList resourceFiles = m_pendingResourceFiles;
+        m_pendingResourceFiles.clear();
+        for (const QString &resourceFile : resourceFiles)
+            loadResourceFile(resourceFile);
+
+        if (generation == m_filterLoadGeneration)
+        {
+            // Copy the metadata found while parsing (name, expiration) back to the subscriptions
+            for (const Subscription &loadedSub : *subscriptions)
+            {
+                for (Subscription &sub : m_subscriptions)
+                {
+                    if (sub.getFilePath() == loadedSub.getFilePath())
+                        sub.updateMetadata(loadedSub);
+                }
+            }
+
+            publishFilterContainer(watcher->result());
+        }
+
+        if (m_filterReloadPending)
+        {
+            m_filterReloadPending = false;
+            startFilterLoad();
+        }
+    });
+    watcher->setFuture(m_filterLoadFuture);
+}
+
+void AdBlockManager::publishFilterContainer(std::shared_ptr<FilterContainer> filterContainer)
+{
+    // Cached scripts were generated from the previous filters
+    m_domainStylesheetCache.clear();
+    m_jsInjectionCache.clear();
+    m_cosmeticScriptCache.clear();
+
+    m_filterContainer = filterContainer;
+    m_requestHandler->setFilterContainer(std::move(filterContainer));
 }
 
 void AdBlockManager::save()
@@ -736,7 +976,8 @@ void AdBlockManager::save()
     //     "/path/to/subscription2.txt": { subscription object 2 }
     // }
     // Subscription object format: { "enabled": (true|false), "last_update": (timestamp),
-    //                               "next_update": (timestamp), "source": "origin_url" }
+    //                               "next_update": (timestamp), "source": "origin_url",
+    //                               "diff_path": "relative_patch_url" (optional) }
     QJsonObject configObj;
     configObj.insert(QLatin1String("requests_blocked"), QJsonValue(QString::number(m_requestHandler->getTotalNumberOfBlockedRequests())));
     for (auto it = m_subscriptions.cbegin(); it != m_subscriptions.cend(); ++it)
@@ -751,6 +992,8 @@ void AdBlockManager::save()
         subscriptionObj.insert(QLatin1String("next_update"), QJsonValue::fromVariant(QVariant(it->getNextUpdate().toMSecsSinceEpoch() / 1000ULL)));
 #endif
         subscriptionObj.insert(QLatin1String("source"), it->getSourceUrl().toString(QUrl::FullyEncoded));
+        if (!it->getDiffPath().isEmpty())
+            subscriptionObj.insert(QLatin1String("diff_path"), it->getDiffPath());
 
         configObj.insert(it->getFilePath(), QJsonValue(subscriptionObj));
     }
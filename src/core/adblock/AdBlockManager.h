@@ -4,18 +4,22 @@
 #include "AdBlockFilter.h"
 #include "AdBlockFilterContainer.h"
 #include "AdBlockSubscription.h"
+#include "CosmeticScriptTemplate.h"
 #include "LRUCache.h"
 #include "ServiceLocator.h"
 #include "Settings.h"
 #include "ISettingsObserver.h"
 #include "URL.h"
 
+#include <QFuture>
 #include <QHash>
 #include <QObject>
 #include <QString>
+#include <QStringList>
 #include <QWebEngineUrlRequestInfo>
 
 #include <deque>
+#include <memory>
 #include <vector>
 
 class BrowserApplication;
@@ -87,6 +91,9 @@ class AdBlockManager : public QObject, public ISettingsObserver
     /// Returns the content type of the resource with the given key. Returns an empty string if the key is not found
     QString getResourceContentType(const QString &key) const;
 
+    /// Returns a checksum of all loaded resource files. Used to invalidate cached filters that were built from resources
+    const QByteArray &getResourceChecksum() const;
+
 public Q_SLOTS:
     /// Attempt to update ad block subscriptions
     void updateSubscriptions();
@@ -132,7 +139,7 @@ public Q_SLOTS:
     void loadSubscriptions();
 
 private Q_SLOTS:
-    /// Loads the uBlock Origin-style resource file into the resource map
+    /// Loads the uBlock Origin-style resource file into the resource map, once the filter load in progress (if any) has finished
     void loadResourceFile(const QString &path);
 
     /// Listens for any settings changes that affect the advertisement blocking system (ex: enable/disable ad block)
@@ -152,18 +159,71 @@ private Q_SLOTS:
     /// Load uBlock Origin-style resources file(s) from m_subscriptionDir/resources folder
     void loadUBOResources();
 
-    /// Clears current filter data
+    /// Returns a pointer to the subscription with the given file path, or a nullptr if there is no such subscription.
+    /// Subscriptions are looked up by path after a download, since the subscription container may change in the meantime
+    Subscription *findSubscription(const QString &filePath);
+
+    /**
+     * @brief Downloads the latest version of a subscription file in full, replacing the current file
+     * @param filePath Path of the subscription file
+     * @param sourceUrl Source URL of the subscription
+     * @param updateTime Time at which the update of the subscription began
+     */
+    void downloadSubscription(const QString &filePath, const QUrl &sourceUrl, const QDateTime &updateTime);
+
+    /**
+     * @brief Downloads the differential update of a subscription, and applies it to the current subscription file.
+     *        Falls back to a full download of the subscription if the update cannot be downloaded or applied.
+     * @param filePath Path of the subscription file
+     * @param sourceUrl Source URL of the subscription
+     * @param diffPath Location of the differential update, as given by the "Diff-Path" field of the subscription
+     * @param updateTime Time at which the update of the subscription began
+     */
+    void downloadSubscriptionPatch(const QString &filePath, const QUrl &sourceUrl, const QString &diffPath, const QDateTime &updateTime);
+
+    /// Called when the update of a subscription has completed or failed. Once every pending update has finished,
+    /// the filters are reloaded a single time if any of the updates changed a subscription file
+    void onSubscriptionUpdateFinished(bool changed);
+
+    /// Clears current filter data, discarding the result of any filter load that is in progress
     void clearFilters();
 
-    /// Extracts pointers to filters from subscriptions into the appropriate containers
+    /// Begins to load the filters of all enabled subscriptions into a new filter container, on a worker thread.
+    /// The current filter container remains in use until the new one has been built.
     void extractFilters();
 
+    /// Starts parsing the enabled subscriptions in the background, and publishes the resulting filter container
+    /// when done, unless it has been superseded by a more recent call to \ref AdBlockManager::extractFilters
+    void startFilterLoad();
+
+    /// Replaces the filter container used for network requests and cosmetic filtering with the given container
+    void publishFilterContainer(std::shared_ptr<FilterContainer> filterContainer);
+
     /// Saves subscription information to disk, called by destructor
     void save();
 
 private:
-    /// Stores the union of all subscription list filters
-    FilterContainer m_filterContainer;
+    /// Stores the union of all subscription list filters. Replaced as a whole whenever the filters are reloaded
+    std::shared_ptr<FilterContainer> m_filterContainer;
+
+    /// Result of the filter load that is currently in progress, if any
+    QFuture< std::shared_ptr<FilterContainer> > m_filterLoadFuture;
+
+    /// Incremented each time the filters are cleared or reloaded. Results of filter loads that began
+    /// before the most recent increment are stale, and are not published
+    quint64 m_filterLoadGeneration;
+
+    /// True if the filters must be loaded again once the filter load in progress finishes
+    bool m_filterReloadPending;
+
+    /// Resource files that were received while a filter load was in progress, and are loaded once it finishes
+    QStringList m_pendingResourceFiles;
+
+    /// Number of subscription updates that have been started and have not finished yet
+    int m_numPendingUpdates;
+
+    /// True if any of the pending subscription updates has changed a subscription file
+    bool m_hasUpdatedSubscription;
 
     /// Download manager, required to update subscription lists
     DownloadManager *m_downloadManager;
@@ -178,7 +238,7 @@ private Q_SLOTS:
     QString m_subscriptionDir;
 
     /// JavaScript template for uBlock style cosmetic filters
-    QString m_cosmeticJSTemplate;
+    CosmeticScriptTemplate m_cosmeticJSTemplate;
 
     /// Container of content blocking subscriptions
     std::vector<Subscription> m_subscriptions;
@@ -192,12 +252,19 @@ private Q_SLOTS:
     /// Mapping of resource names, from the resource map, to their respective content types
     QHash<QString, QString> m_resourceContentTypeMap;
 
+    /// Checksum of the contents of every resource file that has been loaded
+    QByteArray m_resourceChecksum;
+
     /// A cache of the most recently used domain-specific stylesheets
     LRUCache<std::string, QString> m_domainStylesheetCache;
 
     /// A cache of the most recently used javascript injection scripts for specific URLs
     LRUCache<std::string, QString> m_jsInjectionCache;
 
+    /// A cache of the most recently used stylesheet and javascript injection scripts, keyed by the set of filters
+    /// that each script was generated from. Hosts that are matched by the same filters share the same script
+    LRUCache<std::string, QString> m_cosmeticScriptCache;
+
     /// Empty string, used when getDomainStylesheet returns nothing
     QString m_emptyStr;
 
@@ -4,28 +4,40 @@
 #include "AdBlockRequestHandler.h"
 #include "URL.h"
 
-#include <QDateTime>
 #include <QUrl>
 
 namespace adblock
 {
 
-RequestHandler::RequestHandler(FilterContainer &filterContainer, AdBlockLog *log, QObject *parent) :
+RequestHandler::RequestHandler(std::shared_ptr<FilterContainer> filterContainer, AdBlockLog *log, QObject *parent) :
     QObject(parent),
-    m_filterContainer(filterContainer),
+    m_filterContainer(std::move(filterContainer)),
     m_log(log),
     m_numRequestsBlocked(0),
-    m_pageAdBlockCount()
+    m_pageAdBlockCount(),
+    m_pageAdBlockCountMutex(),
+    m_decisionCache(4096)
 {
 }
 
 void RequestHandler::loadStarted(const QUrl &url)
 {
+    std::lock_guard<std::mutex> lock(m_pageAdBlockCountMutex);
     m_pageAdBlockCount[url] = 0;
 }
 
+void RequestHandler::setFilterContainer(std::shared_ptr<FilterContainer> filterContainer)
+{
+    std::atomic_store(&m_filterContainer, std::move(filterContainer));
+
+    // Decisions are also validated against the filter container they were made with, since a request
+    // that began before the swap may still store a decision after the cache has been cleared
+    m_decisionCache.clear();
+}
+
 int RequestHandler::getNumberAdsBlocked(const QUrl &url) const
 {
+    std::lock_guard<std::mutex> lock(m_pageAdBlockCountMutex);
     auto it = m_pageAdBlockCount.find(url);
     if (it != m_pageAdBlockCount.end())
         return *it;
@@ -35,27 +47,93 @@ int RequestHandler::getNumberAdsBlocked(const QUrl &url) const
 
 quint64 RequestHandler::getTotalNumberOfBlockedRequests() const
 {
-    return m_numRequestsBlocked;
+    return m_numRequestsBlocked.load(std::memory_order_relaxed);
 }
 
 void RequestHandler::setTotalNumberOfBlockedRequests(quint64 count)
 {
-    m_numRequestsBlocked = count;
+    m_numRequestsBlocked.store(count, std::memory_order_relaxed);
 }
 
 bool RequestHandler::shouldBlockRequest(QWebEngineUrlRequestInfo &info, const QUrl &firstPartyUrl)
 {
+    // Hold on to the current filter container for the duration of the request, in case a new one is published
+    std::shared_ptr<FilterContainer> filterContainer = std::atomic_load(&m_filterContainer);
+    if (!filterContainer)
+        return false;
+
     // Get request URL and the originating URL
     const QUrl requestUrl = info.requestUrl();
-    const QString requestUrlStr = info.requestUrl().toString(QUrl::FullyEncoded).toLower();
+    const QString baseUrl = firstPartyUrl.host().toLower();
 
-    //const URL firstPartyUrlWrapper { firstPartyUrl };
-    const URL requestUrlWrapper { requestUrl };
+    RequestDecision decision = getDecision(*filterContainer, info.resourceType(), requestUrl, firstPartyUrl, baseUrl);
+    const ElementType elemType = decision.Type;
 
-    const QString baseUrl = firstPartyUrl.host().toLower();
-    //QString baseUrl = firstPartyUrlWrapper.getSecondLevelDomain().toLower();
-    //if (baseUrl.isEmpty())
-    //    baseUrl = firstPartyUrl.host().toLower();
+    // Stop here if we did not find a blocking filter - let the request proceed
+    if (decision.MatchingFilter == nullptr)
+        return false;
+
+    if (decision.Action == FilterAction::Allow)
+    {
+        decision.MatchingFilter->recordHit();
+        m_log->addEntry(FilterAction::Allow, firstPartyUrl, requestUrl, elemType, *decision.MatchingFilter);
+        return false;
+    }
+
+    // If we reach this point, then the matching block filter is applied to the request
+    recordBlockedRequest(decision.MatchingFilter, firstPartyUrl);
+
+    if (decision.Action == FilterAction::Redirect)
+    {
+        info.redirect(QUrl(QString("blocked:%1").arg(decision.MatchingFilter->getRedirectName())));
+        m_log->addEntry(FilterAction::Redirect, firstPartyUrl, requestUrl, elemType, *decision.MatchingFilter);
+        return false;
+    }
+
+    m_log->addEntry(FilterAction::Block, firstPartyUrl, requestUrl, elemType, *decision.MatchingFilter);
+    return true;
+}
+
+CacheStatistics RequestHandler::getDecisionCacheStatistics() const
+{
+    return m_decisionCache.getStatistics();
+}
+
+RequestHandler::RequestDecision RequestHandler::getDecision(const FilterContainer &filterContainer, QWebEngineUrlRequestInfo::ResourceType resourceType,
+                                                            const QUrl &requestUrl, const QUrl &firstPartyUrl, const QString &baseUrl)
+{
+    const QString requestUrlStr = requestUrl.toString(QUrl::FullyEncoded);
+
+    // Check for a previous decision on the same request, made with the same filters. The element type of the
+    // request, which needs the lowercase URL and the domains of both URLs, is only determined on a cache miss
+    const quint64 decisionKey = getDecisionKey(baseUrl, requestUrlStr, resourceType);
+    RequestDecision decision;
+    if (!m_decisionCache.get(decisionKey, decision)
+            || decision.Container != &filterContainer
+            || decision.ResourceType != resourceType
+            || decision.BaseUrl != baseUrl
+            || decision.RequestUrl != requestUrlStr)
+    {
+        const QString requestUrlLower = requestUrlStr.toLower();
+        const QString secondLevelDomain = URL(requestUrl).getSecondLevelDomain();
+        const ElementType elemType = getRequestType(resourceType, requestUrl, requestUrlLower, secondLevelDomain, firstPartyUrl);
+
+        decision = evaluateRequest(filterContainer, requestUrl, requestUrlLower, secondLevelDomain, baseUrl, elemType);
+        decision.BaseUrl = baseUrl;
+        decision.RequestUrl = requestUrlStr;
+        decision.ResourceType = resourceType;
+        m_decisionCache.put(decisionKey, decision);
+    }
+
+    return decision;
+}
+
+RequestHandler::RequestDecision RequestHandler::evaluateRequest(const FilterContainer &filterContainer, const QUrl &requestUrl,
+                                                                const QString &requestUrlStr, const QString &secondLevelDomain,
+                                                                const QString &baseUrl, ElementType elemType) const
+{
+    RequestDecision decision { &filterContainer, FilterAction::Allow, nullptr, QString(), QString(), elemType,
+                               QWebEngineUrlRequestInfo::ResourceTypeUnknown };
 
     // Get request domain
     QString domain = requestUrl.host().toLower();
@@ -63,64 +141,68 @@ bool RequestHandler::shouldBlockRequest(QWebEngineUrlRequestInfo &info, const QU
         domain = domain.mid(4);
 
     if (domain.isEmpty())
-        domain = requestUrlWrapper.getSecondLevelDomain();
+        domain = secondLevelDomain;
 
-    // Convert QWebEngine request type to AdBlockFilter request type
-    ElementType elemType = getRequestType(info, firstPartyUrl);
+    auto getBlockingAction = [](const Filter *filter) {
+        return filter->isRedirect() ? FilterAction::Redirect : FilterAction::Block;
+    };
 
     // Compare to filters
-    Filter *matchingBlockFilter = m_filterContainer.findImportantBlockingFilter(baseUrl, requestUrlStr, domain, elemType);
-    if (matchingBlockFilter != nullptr)
+    if (Filter *filter = filterContainer.findImportantBlockingFilter(baseUrl, requestUrlStr, domain, elemType))
     {
-        ++m_numRequestsBlocked;
-        ++m_pageAdBlockCount[firstPartyUrl];
-
-        if (matchingBlockFilter->isRedirect())
-        {
-            info.redirect(QUrl(QString("blocked:%1").arg(matchingBlockFilter->getRedirectName())));
-            m_log->addEntry(FilterAction::Redirect, firstPartyUrl, requestUrl, elemType, matchingBlockFilter->getRule(), QDateTime::currentDateTime());
-            return false;
-        }
-
-        m_log->addEntry(FilterAction::Block, firstPartyUrl, requestUrl, elemType, matchingBlockFilter->getRule(), QDateTime::currentDateTime());
-        return true;
+        decision.Action = getBlockingAction(filter);
+        decision.MatchingFilter = filter;
+        return decision;
     }
 
-    matchingBlockFilter = m_filterContainer.findBlockingRequestFilter(requestUrlWrapper.getSecondLevelDomain(), baseUrl, requestUrlStr, domain, elemType);
-
-    // Stop here if we did not find a blocking filter - let the request proceed
+    Filter *matchingBlockFilter = filterContainer.findBlockingRequestFilter(secondLevelDomain, baseUrl, requestUrlStr, domain, elemType);
     if (matchingBlockFilter == nullptr)
-        return false;
+        return decision;
 
-    if (Filter *filter = m_filterContainer.findWhitelistingFilter(baseUrl, requestUrlStr, domain, elemType))
+    if (Filter *filter = filterContainer.findWhitelistingFilter(baseUrl, requestUrlStr, domain, elemType))
     {
-        m_log->addEntry(FilterAction::Allow, firstPartyUrl, requestUrl, elemType, filter->getRule(), QDateTime::currentDateTime());
-        return false;
+        decision.MatchingFilter = filter;
+        return decision;
     }
 
-    // If we reach this point, then the matching block filter is applied to the request
-    ++m_numRequestsBlocked;
-    ++m_pageAdBlockCount[firstPartyUrl];
+    decision.Action = getBlockingAction(matchingBlockFilter);
+    decision.MatchingFilter = matchingBlockFilter;
+    return decision;
+}
 
-    if (matchingBlockFilter->isRedirect())
-    {
-        info.redirect(QUrl(QString("blocked:%1").arg(matchingBlockFilter->getRedirectName())));
-        m_log->addEntry(FilterAction::Redirect, firstPartyUrl, requestUrl, elemType, matchingBlockFilter->getRule(), QDateTime::currentDateTime());
-        return false;
-    }
+quint64 RequestHandler::getDecisionKey(const QString &baseUrl, const QString &requestUrl, QWebEngineUrlRequestInfo::ResourceType resourceType)
+{
+    // 64-bit FNV-1a over the first party host, the request URL and the resource type
+    quint64 hash = 14695981039346656037ULL;
+    auto hashString = [&hash](const QString &str) {
+        const ushort *data = str.utf16();
+        for (int i = 0; i < str.size(); ++i)
+            hash = (hash ^ data[i]) * 1099511628211ULL;
+        hash = (hash ^ 0xFFFFULL) * 1099511628211ULL;
+    };
 
-    m_log->addEntry(FilterAction::Block, firstPartyUrl, requestUrl, elemType, matchingBlockFilter->getRule(), QDateTime::currentDateTime());
-    return true;
+    hashString(baseUrl);
+    hashString(requestUrl);
+    hash = (hash ^ static_cast<quint64>(resourceType)) * 1099511628211ULL;
+    return hash;
+}
+
+void RequestHandler::recordBlockedRequest(const Filter *filter, const QUrl &firstPartyUrl)
+{
+    filter->recordHit();
+    m_numRequestsBlocked.fetch_add(1, std::memory_order_relaxed);
+
+    std::lock_guard<std::mutex> lock(m_pageAdBlockCountMutex);
+    ++m_pageAdBlockCount[firstPartyUrl];
 }
 
-ElementType RequestHandler::getRequestType(const QWebEngineUrlRequestInfo &info, const QUrl &firstPartyUrl) const
+ElementType RequestHandler::getRequestType(QWebEngineUrlRequestInfo::ResourceType resourceType, const QUrl &requestUrl,
+                                           const QString &requestUrlStr, const QString &secondLevelDomain, const QUrl &firstPartyUrl)
 {
     const URL firstPartyUrlWrapper { firstPartyUrl };
-    const URL requestUrl { info.requestUrl() };
-    const QString requestUrlStr = requestUrl.toString(QUrl::FullyEncoded).toLower();
 
     ElementType elemType = ElementType::None;
-    switch (info.resourceType())
+    switch (resourceType)
     {
         case QWebEngineUrlRequestInfo::ResourceTypeMainFrame:
             elemType |= ElementType::Document;
@@ -184,7 +266,7 @@ ElementType RequestHandler::getRequestType(const QWebEngineUrlRequestInfo &info,
     if (firstPartyUrlWrapper.isEmpty()
             || (firstPartyUrlWrapper.toString().compare(QLatin1String(".")) == 0)
             || (firstPartyUrlWrapper.toString().compare(QLatin1String("data;,")) == 0)
-            || (requestUrl.getSecondLevelDomain() != firstPartyUrlWrapper.getSecondLevelDomain()))
+            || (secondLevelDomain != firstPartyUrlWrapper.getSecondLevelDomain()))
         elemType |= ElementType::ThirdParty;
 
     return elemType;
@@ -3,9 +3,14 @@
 
 #include "AdBlockFilter.h"
 #include "AdBlockFilterContainer.h"
+#include "AdBlockLog.h"
 #include "AdBlockSubscription.h"
+#include "ShardedLRUCache.h"
 
+#include <atomic>
 #include <deque>
+#include <memory>
+#include <mutex>
 #include <vector>
 
 #include <QHash>
@@ -13,26 +18,27 @@
 #include <QString>
 #include <QWebEngineUrlRequestInfo>
 
+class AdBlockBenchmark;
+
 namespace adblock
 {
 
-class AdBlockLog;
-
 /**
  * @class RequestHandler
  * @brief Examines network requests to see if they should be blocked, whitelisted or redirected based
- *        on a filter rule
+ *        on a filter rule. Requests may be examined from multiple threads at once.
  * @ingroup AdBlock
  */
 class RequestHandler : public QObject
 {
     friend class AdBlockManager;
+    friend class ::AdBlockBenchmark;
 
     Q_OBJECT
 
 public:
     /// Constructs the request handler with the given parent
-    explicit RequestHandler(FilterContainer &filterContainer, AdBlockLog *log, QObject *parent);
+    explicit RequestHandler(std::shared_ptr<FilterContainer> filterContainer, AdBlockLog *log, QObject *parent);
 
     /// Returns the number of ads that were blocked on the page with the given URL during its last page load
     int getNumberAdsBlocked(const QUrl &url) const;
@@ -43,6 +49,9 @@ class RequestHandler : public QObject
     /// Returns true if the given request should be blocked, false if else
     bool shouldBlockRequest(QWebEngineUrlRequestInfo &info, const QUrl &firstPartyUrl);
 
+    /// Returns the hit and miss counters of the request decision cache
+    CacheStatistics getDecisionCacheStatistics() const;
+
 protected:
     /// Sets the counter that stores the total number of network requests that have been blocked
     void setTotalNumberOfBlockedRequests(quint64 count);
@@ -50,22 +59,94 @@ class RequestHandler : public QObject
     /// Begins to keep track of the number of ads that were blocked on the page with the given url
     void loadStarted(const QUrl &url);
 
+    /// Atomically replaces the filter container that network requests are matched against. Requests that are
+    /// already being examined continue to use the previous container, which is released once they complete
+    void setFilterContainer(std::shared_ptr<FilterContainer> filterContainer);
+
 private:
-    /// Returns the \ref ElementType of the network request, which is used to check for filter option/type matches
-    ElementType getRequestType(const QWebEngineUrlRequestInfo &info, const QUrl &firstPartyUrl) const;
+    /// Outcome of matching a network request against the filters
+    struct RequestDecision
+    {
+        /// Filter container that the decision was made with. Decisions made with any other container are stale
+        const FilterContainer *Container;
+
+        /// Action to take on the request. Only meaningful if MatchingFilter is not null
+        FilterAction Action;
+
+        /// Filter that determined the action, or a nullptr if no blocking filter matched the request
+        Filter *MatchingFilter;
+
+        /// Lowercase host of the first party URL of the request that the decision was made for
+        QString BaseUrl;
+
+        /// Fully encoded URL of the request that the decision was made for
+        QString RequestUrl;
+
+        /// Element type(s) of the request that the decision was made for
+        ElementType Type;
+
+        /// Resource type reported by the web engine for the request that the decision was made for
+        QWebEngineUrlRequestInfo::ResourceType ResourceType;
+    };
+
+    /**
+     * @brief Returns the decision on how the network request should be handled, from the decision cache if
+     *        the same request was recently matched against the given container, or by evaluating it if not
+     * @param filterContainer Filters to match the request against
+     * @param resourceType Resource type of the network request, as reported by the web engine
+     * @param requestUrl URL of the network request
+     * @param firstPartyUrl URL of the page that made the request
+     * @param baseUrl Lowercase host of the first party URL
+     * @return The decision on how the request should be handled, including the element type(s) of the request
+     */
+    RequestDecision getDecision(const FilterContainer &filterContainer, QWebEngineUrlRequestInfo::ResourceType resourceType,
+                                const QUrl &requestUrl, const QUrl &firstPartyUrl, const QString &baseUrl);
+
+    /**
+     * @brief Matches the network request against the filters of the given container
+     * @param filterContainer Filters to match the request against
+     * @param requestUrl URL of the network request
+     * @param requestUrlStr Lowercase, fully encoded form of the request URL
+     * @param secondLevelDomain Second level domain of the request URL
+     * @param baseUrl Lowercase host of the first party URL
+     * @param elemType Element type(s) associated with the request
+     * @return The decision on how the request should be handled
+     */
+    RequestDecision evaluateRequest(const FilterContainer &filterContainer, const QUrl &requestUrl, const QString &requestUrlStr,
+                                    const QString &secondLevelDomain, const QString &baseUrl, ElementType elemType) const;
+
+    /// Returns the decision cache key of a request with the given first party host, fully encoded request URL and resource type
+    static quint64 getDecisionKey(const QString &baseUrl, const QString &requestUrl, QWebEngineUrlRequestInfo::ResourceType resourceType);
+
+    /// Returns the \ref ElementType of the network request, which is used to check for filter option/type matches, given its
+    /// resource type, its URL in lowercase, fully encoded form, the second level domain of the URL and the first party URL
+    static ElementType getRequestType(QWebEngineUrlRequestInfo::ResourceType resourceType, const QUrl &requestUrl,
+                                      const QString &requestUrlStr, const QString &secondLevelDomain, const QUrl &firstPartyUrl);
+
+    /// Updates the blocked request counters and the hit count of the given filter, which was applied to a request on the given page
+    void recordBlockedRequest(const Filter *filter, const QUrl &firstPartyUrl);
 
 private:
-    /// Reference to the filter container
-    FilterContainer &m_filterContainer;
+    /// Current filter container. Only accessed through std::atomic_load and std::atomic_store, since
+    /// network requests are examined on a different thread than the one that publishes new containers
+    std::shared_ptr<FilterContainer> m_filterContainer;
 
     /// Logging instance
     AdBlockLog *m_log;
 
     /// Stores the number of network requests that have been blocked by the ad block system
-    quint64 m_numRequestsBlocked;
+    std::atomic<quint64> m_numRequestsBlocked;
 
     /// Hash map of URLs to the number of requests that were blocked on that given URL
     QHash<QUrl, int> m_pageAdBlockCount;
+
+    /// Guards m_pageAdBlockCount, which is only modified after a request has been blocked
+    mutable std::mutex m_pageAdBlockCountMutex;
+
+    /// Cache of recent request decisions, keyed by a hash of the first party host, request URL and resource type.
+    /// Each decision holds the request it was made for, so that a hash collision is not mistaken for a hit.
+    /// Cleared whenever the filter container is replaced
+    ShardedLRUCache<RequestDecision> m_decisionCache;
 };
 
 }
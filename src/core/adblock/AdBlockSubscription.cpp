@@ -1,14 +1,32 @@
 #include "AdBlockSubscription.h"
 #include "AdBlockFilterParser.h"
+#include "AdBlockManager.h"
 
+#include <algorithm>
+#include <cstring>
+
+#include <QCryptographicHash>
+#include <QDataStream>
 #include <QDir>
 #include <QFile>
-#include <QTextStream>
+#include <QFileInfo>
+#include <QHash>
+#include <QSaveFile>
+#include <QtConcurrent>
 #include <QDebug>
 
 namespace adblock
 {
 
+/// Identifies a file as a binary cache of parsed subscription filters
+static const quint32 FilterCacheMagic = 0x5642464CU;
+
+/// Version of the filter cache format. Must be incremented whenever the serialized layout of a \ref Filter changes
+static const quint32 FilterCacheVersion = 3;
+
+/// Number of rules that are parsed by a single task, when the rules of a subscription are parsed in parallel
+static const size_t FilterParseChunkSize = 4096;
+
 Subscription::Subscription() :
     m_enabled(true),
     m_filePath(),
@@ -16,7 +34,11 @@ Subscription::Subscription() :
     m_sourceUrl(),
     m_lastUpdate(),
     m_nextUpdate(),
-    m_filters()
+    m_diffPath(),
+    m_filters(),
+    m_stringArena(),
+    m_numReusedFilters(0),
+    m_memoryUsage()
 {
 }
 
@@ -27,7 +49,11 @@ Subscription::Subscription(const QString &dataFile) :
     m_sourceUrl(),
     m_lastUpdate(),
     m_nextUpdate(),
-    m_filters()
+    m_diffPath(),
+    m_filters(),
+    m_stringArena(),
+    m_numReusedFilters(0),
+    m_memoryUsage()
 {
 }
 
@@ -38,7 +64,11 @@ Subscription::Subscription(Subscription &&other) noexcept :
     m_sourceUrl(other.m_sourceUrl),
     m_lastUpdate(other.m_lastUpdate),
     m_nextUpdate(other.m_nextUpdate),
-    m_filters(std::move(other.m_filters))
+    m_diffPath(other.m_diffPath),
+    m_filters(std::move(other.m_filters)),
+    m_stringArena(std::move(other.m_stringArena)),
+    m_numReusedFilters(other.m_numReusedFilters),
+    m_memoryUsage(other.m_memoryUsage)
 {
 }
 
@@ -52,7 +82,11 @@ Subscription &Subscription::operator =(Subscription &&other) noexcept
         m_sourceUrl = other.m_sourceUrl;
         m_lastUpdate = other.m_lastUpdate;
         m_nextUpdate = other.m_nextUpdate;
+        m_diffPath = other.m_diffPath;
         m_filters = std::move(other.m_filters);
+        m_stringArena = std::move(other.m_stringArena);
+        m_numReusedFilters = other.m_numReusedFilters;
+        m_memoryUsage = other.m_memoryUsage;
     }
 
     return *this;
@@ -92,6 +126,56 @@ const QDateTime &Subscription::getNextUpdate() const
     return m_nextUpdate;
 }
 
+/// Returns true if the given byte is ASCII whitespace, false if else
+static inline bool isSpaceByte(char c)
+{
+    return c == ' ' || c == '\t' || c == '\r' || c == '\v' || c == '\f';
+}
+
+/// Returns true if the range of bytes [begin, end) starts with the given string, false if else
+static inline bool startsWithBytes(const char *begin, const char *end, const char *prefix, size_t prefixLength)
+{
+    return static_cast<size_t>(end - begin) >= prefixLength && std::memcmp(begin, prefix, prefixLength) == 0;
+}
+
+/// Returns true if the range of bytes [begin, end) contains the given string, false if else
+static inline bool containsBytes(const char *begin, const char *end, const char *needle, size_t needleLength)
+{
+    return std::search(begin, end, needle, needle + needleLength) != end;
+}
+
+/// A rule of a subscription that is yet to be parsed
+struct PendingRule
+{
+    /// Position of the rule's filter within the filters of the subscription
+    size_t Position;
+
+    /// Text of the rule
+    QString Rule;
+};
+
+/// Parses the given rules, placing each filter at its position in the filter container. The rules of a
+/// large subscription are split into chunks that are parsed on several threads. Each filter is written
+/// to its own position, so the order of the filters does not depend on the order the chunks finish in
+static void parseRules(const FilterParser &parser, const std::vector<PendingRule> &rules,
+                       std::vector< std::shared_ptr<Filter> > &filters)
+{
+    using ChunkRange = std::pair<size_t, size_t>;
+    auto parseChunk = [&parser, &rules, &filters](ChunkRange &range) {
+        for (size_t i = range.first; i < range.second; ++i)
+            filters[rules[i].Position] = parser.makeFilter(rules[i].Rule);
+    };
+
+    std::vector<ChunkRange> chunks;
+    for (size_t begin = 0; begin < rules.size(); begin += FilterParseChunkSize)
+        chunks.push_back(ChunkRange(begin, std::min(begin + FilterParseChunkSize, rules.size())));
+
+    if (chunks.size() == 1)
+        parseChunk(chunks.front());
+    else if (chunks.size() > 1)
+        QtConcurrent::blockingMap(chunks, parseChunk);
+}
+
 void Subscription::load(AdBlockManager *adBlockManager)
 {
     if (!m_enabled || m_filePath.isEmpty())
@@ -102,27 +186,119 @@ void Subscription::load(AdBlockManager *adBlockManager)
     if (!subFile.exists() || !subFile.open(QIODevice::ReadOnly))
         return;
 
-    m_filters.clear();
+    // Map the file into memory, so that it can be checksummed and parsed without being copied
+    // into a buffer. Fall back to reading the whole file if it cannot be mapped. The mapping is
+    // released when the file is closed. Subscription files are always replaced with QSaveFile rather
+    // than rewritten in place, so the mapped pages cannot be truncated while they are being read
+    QByteArray fileContents;
+    const char *data = nullptr;
+    size_t dataSize = 0;
+    if (subFile.size() > 0)
+    {
+        if (uchar *mapped = subFile.map(0, subFile.size()))
+        {
+            data = reinterpret_cast<const char*>(mapped);
+            dataSize = static_cast<size_t>(subFile.size());
+        }
+        else
+        {
+            fileContents = subFile.readAll();
+            data = fileContents.constData();
+            dataSize = static_cast<size_t>(fileContents.size());
+        }
+    }
 
-    FilterParser parser(adBlockManager);
+    // Skip parsing entirely if the binary cache was built from the same file contents
+    const QByteArray sourceChecksum = QCryptographicHash::hash(QByteArray::fromRawData(data, static_cast<int>(dataSize)),
+                                                               QCryptographicHash::Sha1);
+    const QByteArray resourceChecksum = adBlockManager != nullptr ? adBlockManager->getResourceChecksum() : QByteArray();
 
-    QString line;
-    QTextStream stream(&subFile);
-    while (stream.readLineInto(&line))
+    m_numReusedFilters = 0;
+    std::vector< std::shared_ptr<Filter> > staleFilters;
+    if (loadCache(sourceChecksum, resourceChecksum, staleFilters))
     {
-        line = line.trimmed();
+        compactFilters();
+        return;
+    }
+
+    m_filters.clear();
+    m_diffPath.clear();
+
+    // After an update, most rules are the same as in the previous version of the file. Their filters
+    // are taken from the outdated cache, so that only the rules that were added or changed are parsed
+    // The filters read from the cache have not been moved into a string arena yet, so getRule()
+    // shares their rule string rather than decoding it
+    QHash<QString, std::shared_ptr<Filter>> previousFilters;
+    previousFilters.reserve(static_cast<int>(staleFilters.size()));
+    for (std::shared_ptr<Filter> &filter : staleFilters)
+        previousFilters.insert(filter->getRule(), std::move(filter));
+    staleFilters.clear();
+
+    // Rules that were not found in the outdated cache. Their filters are left empty until all of the rules
+    // are known, so that they can be parsed in parallel
+    std::vector<PendingRule> pendingRules;
+
+    const char *pos = data, *end = data + dataSize;
+
+    // Skip the UTF-8 byte order mark
+    if (startsWithBytes(pos, end, "\xEF\xBB\xBF", 3))
+        pos += 3;
+
+    // Finds the next line of the file, with the surrounding whitespace removed
+    const char *lineBegin = nullptr, *lineEnd = nullptr;
+    auto nextLine = [&]() -> bool {
+        if (pos >= end)
+            return false;
+
+        const char *newline = static_cast<const char*>(std::memchr(pos, '\n', static_cast<size_t>(end - pos)));
+        lineBegin = pos;
+        lineEnd = newline != nullptr ? newline : end;
+        pos = newline != nullptr ? newline + 1 : end;
+
+        while (lineBegin < lineEnd && isSpaceByte(*lineBegin))
+            ++lineBegin;
+        while (lineEnd > lineBegin && isSpaceByte(*(lineEnd - 1)))
+            --lineEnd;
+        return true;
+    };
+
+    while (nextLine())
+    {
+        const int lineLength = static_cast<int>(lineEnd - lineBegin);
+
+        // Skip empty lines and headers
+        if (lineLength == 0
+                || (lineLength == 1 && *lineBegin == '#')
+                || startsWithBytes(lineBegin, lineEnd, "# ", 2)
+                || startsWithBytes(lineBegin, lineEnd, "[Adblock", 8))
+            continue;
 
-        // Check for metadata
-        if (line.startsWith(QChar('!')))
+        // Check for metadata. Comments are only decoded if they contain a field that is kept
+        if (*lineBegin == '!')
         {
+            const bool hasTitle = m_name.isEmpty() && containsBytes(lineBegin, lineEnd, "Title:", 6);
+            const bool hasExpiry = containsBytes(lineBegin, lineEnd, "! Expires:", 10);
+            const bool hasDiffPath = startsWithBytes(lineBegin, lineEnd, "! Diff-Path:", 12);
+            if (!hasTitle && !hasExpiry && !hasDiffPath)
+                continue;
+
+            const QString line = QString::fromUtf8(lineBegin, lineLength);
+
             // Subscription name
-            if (m_name.isEmpty())
+            if (hasTitle)
             {
                 int titleIdx = line.indexOf(QStringLiteral("Title:"));
                 if (titleIdx > 0)
                     m_name = line.mid(titleIdx + 7);
             }
 
+            // Location of differential updates, in the format "! Diff-Path: [relative path]#[list name]"
+            if (hasDiffPath)
+            {
+                m_diffPath = line.mid(12).trimmed();
+                continue;
+            }
+
             // Check for next update
             int expireIdx = line.indexOf(QStringLiteral("! Expires:")), numDaysIdx = line.indexOf(QStringLiteral(" day"));
             if (expireIdx >= 0 && numDaysIdx > 0)
@@ -141,29 +317,167 @@ void Subscription::load(AdBlockManager *adBlockManager)
 
             continue;
         }
-        else if (line.isEmpty() || line.compare(QStringLiteral("#")) == 0 || line.startsWith(QStringLiteral("# ")) || line.startsWith(QStringLiteral("[Adblock")))
-            continue;
+
+        // The rule is the only part of the line that is decoded into a string
+        QString line = QString::fromUtf8(lineBegin, lineLength);
 
         // uBO compatibility, see https://github.com/gorhill/uBlock/commit/703c525b01aa3fb9dab94d6a9918a0a69c6d18da
         // and https://github.com/gorhill/uBlock/commit/ca80d2826bfd92a3081f20da8ba60138509a183b
         while (line.endsWith(QStringLiteral(" \\")))
         {
-            QString nextLine;
-            if (!stream.readLineInto(&nextLine))
-                break;
-            if (!nextLine.startsWith(QStringLiteral("    ")))
+            // Only consume the next line if it continues the rule
+            if (pos >= end || !startsWithBytes(pos, end, "    ", 4))
                 break;
-            line = line.left(line.size() - 2).append(nextLine.trimmed());
+
+            nextLine();
+            line = line.left(line.size() - 2).append(QString::fromUtf8(lineBegin, static_cast<int>(lineEnd - lineBegin)));
+        }
+
+        auto previousFilter = previousFilters.find(line);
+        if (previousFilter != previousFilters.end())
+        {
+            m_filters.push_back(std::move(previousFilter.value()));
+            previousFilters.erase(previousFilter);
+            ++m_numReusedFilters;
+            continue;
         }
-        m_filters.push_back(parser.makeFilter(line));
+
+        pendingRules.push_back({ m_filters.size(), std::move(line) });
+        m_filters.push_back(nullptr);
     }
 
+    parseRules(FilterParser(adBlockManager), pendingRules, m_filters);
+
     // Set name to filename if it was not specified in data region of file
     if (m_name.isEmpty())
     {
         int sepIdx = m_filePath.lastIndexOf(QDir::separator());
         m_name = m_filePath.mid(sepIdx + 1);
     }
+
+    saveCache(sourceChecksum, resourceChecksum);
+    compactFilters();
+}
+
+bool Subscription::loadCache(const QByteArray &sourceChecksum, const QByteArray &resourceChecksum,
+                             std::vector< std::shared_ptr<Filter> > &staleFilters)
+{
+    QFile cacheFile(getCacheFilePath());
+    if (!cacheFile.exists() || !cacheFile.open(QIODevice::ReadOnly))
+        return false;
+
+    // Read the filters directly from the mapped file, rather than copying its contents into memory first
+    const qint64 cacheSize = cacheFile.size();
+    uchar *cacheData = cacheFile.map(0, cacheSize);
+    if (cacheData == nullptr)
+        return false;
+
+    const QByteArray data = QByteArray::fromRawData(reinterpret_cast<const char*>(cacheData), static_cast<int>(cacheSize));
+    QDataStream stream(data);
+    stream.setVersion(QDataStream::Qt_5_9);
+
+    quint32 magic = 0, version = 0;
+    stream >> magic >> version;
+    if (magic != FilterCacheMagic || version != FilterCacheVersion)
+        return false;
+
+    QByteArray cachedSourceChecksum, cachedResourceChecksum;
+    qint64 lastUpdate = 0;
+    stream >> cachedSourceChecksum >> lastUpdate >> cachedResourceChecksum;
+
+    // Filters built from other resources may differ even if their rules are the same
+    if (cachedResourceChecksum != resourceChecksum)
+        return false;
+
+    const bool isStale = cachedSourceChecksum != sourceChecksum || lastUpdate != m_lastUpdate.toMSecsSinceEpoch();
+
+    QString name, diffPath;
+    qint64 nextUpdate = 0;
+    quint32 numFilters = 0;
+    stream >> name >> diffPath >> nextUpdate >> numFilters;
+
+    std::vector< std::shared_ptr<Filter> > filters;
+    filters.reserve(numFilters);
+    for (quint32 i = 0; i < numFilters && stream.status() == QDataStream::Ok; ++i)
+    {
+        auto filter = std::make_shared<Filter>(QString());
+        stream >> *filter;
+        filters.push_back(std::move(filter));
+    }
+
+    if (stream.status() != QDataStream::Ok)
+    {
+        qDebug() << "[Advertisement Blocker]: Filter cache " << cacheFile.fileName() << " is corrupt, reparsing subscription";
+        return false;
+    }
+
+    if (isStale)
+    {
+        staleFilters = std::move(filters);
+        return false;
+    }
+
+    m_filters = std::move(filters);
+    m_diffPath = diffPath;
+
+    if (m_name.isEmpty())
+        m_name = name;
+
+    if (nextUpdate > 0)
+        m_nextUpdate = QDateTime::fromMSecsSinceEpoch(nextUpdate);
+
+    return true;
+}
+
+void Subscription::saveCache(const QByteArray &sourceChecksum, const QByteArray &resourceChecksum) const
+{
+    const QString cachePath = getCacheFilePath();
+    QDir cacheDir = QFileInfo(cachePath).absoluteDir();
+    if (!cacheDir.exists())
+        cacheDir.mkpath(QStringLiteral("."));
+
+    QSaveFile cacheFile(cachePath);
+    if (!cacheFile.open(QIODevice::WriteOnly))
+        return;
+
+    QDataStream stream(&cacheFile);
+    stream.setVersion(QDataStream::Qt_5_9);
+
+    stream << FilterCacheMagic
+           << FilterCacheVersion
+           << sourceChecksum
+           << m_lastUpdate.toMSecsSinceEpoch()
+           << resourceChecksum
+           << m_name
+           << m_diffPath
+           << (m_nextUpdate.isValid() ? m_nextUpdate.toMSecsSinceEpoch() : qint64(0))
+           << static_cast<quint32>(m_filters.size());
+
+    for (const std::shared_ptr<Filter> &filter : m_filters)
+        stream << *filter;
+
+    if (stream.status() != QDataStream::Ok || !cacheFile.commit())
+        qDebug() << "[Advertisement Blocker]: Could not write filter cache " << cachePath;
+}
+
+void Subscription::compactFilters()
+{
+    m_stringArena = std::make_shared<FilterStringArena>();
+    for (std::shared_ptr<Filter> &filter : m_filters)
+        filter->moveRuleToArena(*m_stringArena);
+
+    // Measured here, while the filters are still held by the subscription that loaded them
+    m_memoryUsage = FilterMemoryUsage();
+    for (const std::shared_ptr<Filter> &filter : m_filters)
+        m_memoryUsage += filter->getMemoryUsage();
+
+    m_memoryUsage.FilterBytes += m_filters.capacity() * sizeof(std::shared_ptr<Filter>);
+    m_memoryUsage.StringBytes += m_stringArena->getCapacity();
+}
+
+const FilterMemoryUsage &Subscription::getMemoryUsage() const
+{
+    return m_memoryUsage;
 }
 
 void Subscription::setLastUpdate(const QDateTime &date)
@@ -210,4 +524,40 @@ void Subscription::setFilePath(const QString &filePath)
     m_filePath = filePath;
 }
 
+QString Subscription::getCacheFilePath() const
+{
+    const QFileInfo fileInfo(m_filePath);
+    return QString("%1%2cache%2%3.bin").arg(fileInfo.absolutePath(), QString(QDir::separator()), fileInfo.fileName());
+}
+
+const QString &Subscription::getDiffPath() const
+{
+    return m_diffPath;
+}
+
+void Subscription::setDiffPath(const QString &diffPath)
+{
+    m_diffPath = diffPath;
+}
+
+Subscription Subscription::cloneWithoutFilters() const
+{
+    Subscription result(m_filePath);
+    result.m_enabled = m_enabled;
+    result.m_name = m_name;
+    result.m_sourceUrl = m_sourceUrl;
+    result.m_lastUpdate = m_lastUpdate;
+    result.m_nextUpdate = m_nextUpdate;
+    result.m_diffPath = m_diffPath;
+    return result;
+}
+
+void Subscription::updateMetadata(const Subscription &other)
+{
+    m_name = other.m_name;
+    m_nextUpdate = other.m_nextUpdate;
+    m_diffPath = other.m_diffPath;
+    m_memoryUsage = other.m_memoryUsage;
+}
+
 }
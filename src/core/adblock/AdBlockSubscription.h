@@ -9,6 +9,9 @@
 #include <QString>
 #include <QUrl>
 
+class AdBlockBenchmark;
+class AdBlockFilterTest;
+
 namespace adblock
 {
 
@@ -26,6 +29,8 @@ class Subscription
     friend class FilterContainer;
     friend class AdBlockManager;
     friend class AdBlockRequestHandler;
+    friend class ::AdBlockBenchmark;
+    friend class ::AdBlockFilterTest;
 
 public:
     /// Constructs the Subscription object
@@ -70,6 +75,11 @@ class Subscription
     /// Returns the time of the next update
     const QDateTime &getNextUpdate() const;
 
+    /// Returns the approximate memory usage of the subscription's filters, including the arena that holds their rule text,
+    /// as measured when the filters were last loaded. Filters are loaded into a copy of the subscription, and the
+    /// measurement is carried back to this instance along with the rest of its metadata
+    const FilterMemoryUsage &getMemoryUsage() const;
+
 protected:
     /// Loads the filters from the subscription file
     void load(AdBlockManager *adBlockManager);
@@ -95,6 +105,44 @@ class Subscription
     /// Updates the path of the subscription file - called after completion of an update if the file name is different
     void setFilePath(const QString &filePath);
 
+    /// Returns the absolute path of the binary cache of the subscription's parsed filters
+    QString getCacheFilePath() const;
+
+    /// Returns the relative location of the differential updates of the subscription, as given by the
+    /// "Diff-Path" field of the subscription file, or an empty string if the subscription has none
+    const QString &getDiffPath() const;
+
+    /// Sets the relative location of the differential updates of the subscription. Used to restore the
+    /// location from the ad block configuration, before the subscription file has been loaded
+    void setDiffPath(const QString &diffPath);
+
+    /// Returns a copy of the subscription's state and metadata, without any of its filters. Used to
+    /// load the filters of a subscription away from the instance that is visible to the user interface
+    Subscription cloneWithoutFilters() const;
+
+    /// Copies the metadata that is discovered when the filters are loaded (name, next update, diff path, memory usage)
+    /// from the given subscription
+    void updateMetadata(const Subscription &other);
+
+private:
+    /**
+     * @brief Attempts to load the parsed filters from the binary cache of the subscription
+     * @param sourceChecksum Checksum of the current subscription file contents
+     * @param resourceChecksum Checksum of the ad block resources that scriptlet filters were built from
+     * @param staleFilters Set to the cached filters if the cache was built from an earlier version of the
+     *                     subscription file, with the same resources. Those filters can be reused for any
+     *                     rules that did not change, rather than parsing each rule again
+     * @return True if the cache is valid for the current subscription file and was loaded, false if else
+     */
+    bool loadCache(const QByteArray &sourceChecksum, const QByteArray &resourceChecksum,
+                   std::vector< std::shared_ptr<Filter> > &staleFilters);
+
+    /// Writes the parsed filters of the subscription into its binary cache
+    void saveCache(const QByteArray &sourceChecksum, const QByteArray &resourceChecksum) const;
+
+    /// Moves the rule text of each filter into a new string arena, once the filters have been loaded
+    void compactFilters();
+
 private:
     /// True if subscription is enabled, false if else
     bool m_enabled;
@@ -114,8 +162,23 @@ class Subscription
     /// Time when the subscription should be updated
     QDateTime m_nextUpdate;
 
-    /// Container of AdBlock Filters that belong to the subscription
-    std::vector< std::unique_ptr<Filter> > m_filters;
+    /// Location of the differential updates of the subscription, relative to its source URL
+    QString m_diffPath;
+
+    /// Container of AdBlock Filters that belong to the subscription. Filters are shared with the
+    /// \ref FilterContainer instances built from the subscription, which may outlive its current filter set
+    std::vector< std::shared_ptr<Filter> > m_filters;
+
+    /// Holds the rule text of the subscription's filters. A new arena is created each time the filters are
+    /// loaded, as filter containers built from the previous filters keep a reference to the previous arena
+    std::shared_ptr<FilterStringArena> m_stringArena;
+
+    /// Number of filters that were taken from the outdated cache, rather than parsed again, the last time the
+    /// subscription file was loaded
+    size_t m_numReusedFilters;
+
+    /// Approximate memory usage of the filters, measured the last time the subscription file was loaded
+    FilterMemoryUsage m_memoryUsage;
 };
 
 }
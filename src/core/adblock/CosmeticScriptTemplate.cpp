@@ -0,0 +1,92 @@
+#include "CosmeticScriptTemplate.h"
+
+namespace adblock
+{
+
+CosmeticScriptTemplate::CosmeticScriptTemplate(const QString &text, const QStringList &placeholders) :
+    m_textPieces(),
+    m_placeholderSlots()
+{
+    int pos = 0;
+    while (pos <= text.size())
+    {
+        // Find the placeholder that occurs first from the current position
+        int nextPos = -1, nextSlot = -1;
+        for (int i = 0; i < placeholders.size(); ++i)
+        {
+            if (placeholders.at(i).isEmpty())
+                continue;
+
+            const int placeholderPos = text.indexOf(placeholders.at(i), pos);
+            if (placeholderPos >= 0 && (nextPos < 0 || placeholderPos < nextPos))
+            {
+                nextPos = placeholderPos;
+                nextSlot = i;
+            }
+        }
+
+        if (nextPos < 0)
+        {
+            m_textPieces.append(text.mid(pos));
+            break;
+        }
+
+        m_textPieces.append(text.mid(pos, nextPos - pos));
+        m_placeholderSlots.push_back(nextSlot);
+        pos = nextPos + placeholders.at(nextSlot).size();
+    }
+}
+
+bool CosmeticScriptTemplate::isEmpty() const
+{
+    return m_textPieces.isEmpty() || (m_textPieces.size() == 1 && m_textPieces.at(0).isEmpty());
+}
+
+QString CosmeticScriptTemplate::render(const std::vector<const std::vector<QString>*> &values, const QString &separator) const
+{
+    auto getFragments = [&values](int slot) -> const std::vector<QString>* {
+        return static_cast<size_t>(slot) < values.size() ? values.at(static_cast<size_t>(slot)) : nullptr;
+    };
+
+    // Determine the length of the script before it is written, so that it is only allocated once
+    int length = 0;
+    for (const QString &piece : m_textPieces)
+        length += piece.size();
+
+    for (int slot : m_placeholderSlots)
+    {
+        const std::vector<QString> *fragments = getFragments(slot);
+        if (fragments == nullptr || fragments->empty())
+            continue;
+
+        for (const QString &fragment : *fragments)
+            length += fragment.size();
+        length += separator.size() * static_cast<int>(fragments->size() - 1);
+    }
+
+    QString result;
+    result.reserve(length);
+
+    for (int i = 0; i < m_textPieces.size(); ++i)
+    {
+        result.append(m_textPieces.at(i));
+
+        if (static_cast<size_t>(i) >= m_placeholderSlots.size())
+            break;
+
+        const std::vector<QString> *fragments = getFragments(m_placeholderSlots.at(static_cast<size_t>(i)));
+        if (fragments == nullptr)
+            continue;
+
+        for (size_t j = 0; j < fragments->size(); ++j)
+        {
+            if (j > 0)
+                result.append(separator);
+            result.append(fragments->at(j));
+        }
+    }
+
+    return result;
+}
+
+}
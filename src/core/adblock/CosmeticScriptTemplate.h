@@ -0,0 +1,54 @@
+#ifndef COSMETICSCRIPTTEMPLATE_H
+#define COSMETICSCRIPTTEMPLATE_H
+
+#include <vector>
+
+#include <QString>
+#include <QStringList>
+
+namespace adblock
+{
+
+/**
+ * @class CosmeticScriptTemplate
+ * @brief A script with one or more placeholders, such as the templates of the scripts that apply
+ *        cosmetic filters to a page. The template is split at its placeholders once, and each
+ *        script is rendered from the fragments of its filters into a single allocation.
+ * @ingroup AdBlock
+ */
+class CosmeticScriptTemplate
+{
+public:
+    /// Constructs an empty template
+    CosmeticScriptTemplate() = default;
+
+    /**
+     * @brief Constructs the template
+     * @param text Text of the script
+     * @param placeholders Placeholders that appear in the text. Each placeholder may appear any number of times
+     */
+    CosmeticScriptTemplate(const QString &text, const QStringList &placeholders);
+
+    /// Returns true if the template has no text, false if else
+    bool isEmpty() const;
+
+    /**
+     * @brief Renders the script
+     * @param values Fragments of each placeholder, in the order the placeholders were given to the constructor.
+     *               The fragments of a placeholder are concatenated in place of each of its occurrences.
+     * @param separator Text inserted between two consecutive fragments of the same placeholder
+     * @return The rendered script
+     */
+    QString render(const std::vector<const std::vector<QString>*> &values, const QString &separator = QString()) const;
+
+private:
+    /// Text between the placeholders. There is always one more piece of text than there are placeholder occurrences
+    QStringList m_textPieces;
+
+    /// Index of the placeholder that follows each piece of text, except for the last piece
+    std::vector<int> m_placeholderSlots;
+};
+
+}
+
+#endif // COSMETICSCRIPTTEMPLATE_H
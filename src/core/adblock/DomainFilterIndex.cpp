@@ -0,0 +1,119 @@
+#include "DomainFilterIndex.h"
+
+#include <algorithm>
+
+namespace adblock
+{
+
+void DomainFilterIndex::clear()
+{
+    m_filters.clear();
+    m_fragments.clear();
+    m_buckets.clear();
+    m_unrestrictedFilters.clear();
+}
+
+void DomainFilterIndex::build(std::vector<Filter*> &&filters, const FragmentGenerator &generateFragment)
+{
+    clear();
+
+    m_filters = std::move(filters);
+
+    if (generateFragment)
+    {
+        m_fragments.reserve(m_filters.size());
+        for (const Filter *filter : m_filters)
+            m_fragments.push_back(generateFragment(filter));
+    }
+
+    for (size_t i = 0; i < m_filters.size(); ++i)
+    {
+        const Filter *filter = m_filters.at(i);
+        const quint32 position = static_cast<quint32>(i);
+
+        // Filters that only exclude domains are checked against every domain, since the excluded
+        // domains are the only ones that can be ruled out ahead of time
+        if (filter->m_domainBlacklist.empty())
+        {
+            m_unrestrictedFilters.push_back(position);
+            continue;
+        }
+
+        for (domain_id_t id : filter->m_domainBlacklist)
+            m_buckets[id].push_back(position);
+    }
+
+    m_buckets.squeeze();
+}
+
+std::vector<Filter*> DomainFilterIndex::findMatches(const QString &domain) const
+{
+    std::vector<Filter*> result;
+    for (quint32 position : findMatchPositions(domain))
+        result.push_back(m_filters.at(position));
+    return result;
+}
+
+std::vector<QString> DomainFilterIndex::findFragments(const QString &domain, std::string &filterSetKey) const
+{
+    std::vector<QString> result;
+
+    const std::vector<quint32> positions = findMatchPositions(domain);
+
+    // The number of matches is written first, so that the keys of several indices can be appended to one another
+    const quint32 numMatches = static_cast<quint32>(positions.size());
+    filterSetKey.append(reinterpret_cast<const char*>(&numMatches), sizeof(quint32));
+    if (positions.empty())
+        return result;
+
+    filterSetKey.append(reinterpret_cast<const char*>(positions.data()), positions.size() * sizeof(quint32));
+
+    if (m_fragments.empty())
+        return result;
+
+    result.reserve(positions.size());
+    for (quint32 position : positions)
+        result.push_back(m_fragments.at(position));
+    return result;
+}
+
+size_t DomainFilterIndex::size() const
+{
+    return m_filters.size();
+}
+
+std::vector<quint32> DomainFilterIndex::findMatchPositions(const QString &domain) const
+{
+    std::vector<quint32> result;
+    if (domain.isEmpty() || m_filters.empty())
+        return result;
+
+    std::vector<quint32> candidates = m_unrestrictedFilters;
+
+    if (!m_buckets.isEmpty())
+    {
+        const DomainSuffixIds &suffixIds = DomainTable::instance().getSuffixIds(domain);
+        for (int i = 0; i < suffixIds.Count; ++i)
+        {
+            auto it = m_buckets.constFind(suffixIds.Ids[i]);
+            if (it != m_buckets.constEnd())
+                candidates.insert(candidates.end(), it->cbegin(), it->cend());
+        }
+    }
+
+    // A filter is found once for each of its domains that the host belongs to. Sorting the positions
+    // removes those duplicates, and restores the order in which the filters were given to the index
+    std::sort(candidates.begin(), candidates.end());
+    candidates.erase(std::unique(candidates.begin(), candidates.end()), candidates.end());
+
+    // The excluded domains of each candidate still need to be checked
+    for (quint32 position : candidates)
+    {
+        if (m_filters.at(position)->isDomainStyleMatch(domain))
+            result.push_back(position);
+    }
+
+    return result;
+}
+
+}
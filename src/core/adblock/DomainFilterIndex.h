@@ -0,0 +1,87 @@
+#ifndef DOMAINFILTERINDEX_H
+#define DOMAINFILTERINDEX_H
+
+#include "AdBlockFilter.h"
+#include "DomainTable.h"
+
+#include <functional>
+#include <string>
+#include <vector>
+
+#include <QHash>
+#include <QString>
+
+namespace adblock
+{
+
+/**
+ * @class DomainFilterIndex
+ * @brief A reverse index of cosmetic filters, keyed by the domains and entities (ex: "example.*")
+ *        in each filter's domain option. The suffixes of a host are resolved to domain identifiers
+ *        once, and only the filters keyed on one of those suffixes, along with the filters that are
+ *        not restricted to any domain, are checked against the host.
+ *
+ *        The index may also hold a precompiled script fragment for each filter, so that the scripts
+ *        injected into a page can be assembled from the fragments without processing the filters again.
+ * @ingroup AdBlock
+ */
+class DomainFilterIndex
+{
+public:
+    /// Generates the script fragment of a filter when the index is built
+    using FragmentGenerator = std::function<QString(const Filter*)>;
+
+    /// Default constructor
+    DomainFilterIndex() = default;
+
+    /// Removes all filters from the index
+    void clear();
+
+    /**
+     * @brief Builds the index from the given container of filters, replacing any existing index data.
+     *        The filter pointers must remain valid for the lifetime of the index.
+     * @param filters Filters to be indexed
+     * @param generateFragment Optional function that generates the script fragment of each filter
+     */
+    void build(std::vector<Filter*> &&filters, const FragmentGenerator &generateFragment = FragmentGenerator());
+
+    /**
+     * @brief Finds all filters that apply to the given domain
+     * @param domain Lowercase host name
+     * @return The matching filters, in the same order as they were given to \ref DomainFilterIndex::build
+     */
+    std::vector<Filter*> findMatches(const QString &domain) const;
+
+    /**
+     * @brief Finds the script fragments of all filters that apply to the given domain
+     * @param domain Lowercase host name
+     * @param filterSetKey Key to which the identity of the matching filters is appended. Two hosts that
+     *                     produce the same key are matched by the same set of filters in this index
+     * @return The fragments of the matching filters, in the same order as the filters were given to \ref DomainFilterIndex::build
+     */
+    std::vector<QString> findFragments(const QString &domain, std::string &filterSetKey) const;
+
+    /// Returns the number of filters that belong to the index
+    size_t size() const;
+
+private:
+    /// Returns the positions in m_filters of the filters that apply to the given domain, in ascending order
+    std::vector<quint32> findMatchPositions(const QString &domain) const;
+
+private:
+    /// Every filter in the index, in their original order
+    std::vector<Filter*> m_filters;
+
+    /// Script fragments of the filters, at the same positions as in m_filters. Empty if the index was built without fragments
+    std::vector<QString> m_fragments;
+
+    /// Positions in m_filters of the filters that apply to each domain, keyed by domain identifier
+    QHash<domain_id_t, std::vector<quint32>> m_buckets;
+
+    /// Positions in m_filters of the filters without any included domain, which must be checked against every domain
+    std::vector<quint32> m_unrestrictedFilters;
+};
+
+}
+
+#endif // DOMAINFILTERINDEX_H
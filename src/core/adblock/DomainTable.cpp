@@ -0,0 +1,159 @@
+#include "DomainTable.h"
+
+#include <algorithm>
+#include <limits>
+#include <mutex>
+
+namespace adblock
+{
+
+bool DomainSuffixIds::intersects(const domain_id_t *first, const domain_id_t *last) const
+{
+    const domain_id_t *it = Ids.data(), *end = Ids.data() + Count;
+    while (first != last && it != end)
+    {
+        if (*first < *it)
+            ++first;
+        else if (*it < *first)
+            ++it;
+        else
+            return true;
+    }
+    return false;
+}
+
+DomainTable &DomainTable::instance()
+{
+    static DomainTable table;
+    return table;
+}
+
+DomainTable::DomainTable() :
+    m_mutex(),
+    m_domainIds(),
+    m_domains(),
+    m_size(0)
+{
+}
+
+domain_id_t DomainTable::intern(const QString &domain)
+{
+    const QChar *begin = domain.constData(), *end = begin + domain.size();
+    const quint64 hash = hashRange(begin, end);
+
+    {
+        std::shared_lock<std::shared_mutex> lock(m_mutex);
+        const qint64 id = findRange(begin, end, hash);
+        if (id >= 0)
+            return static_cast<domain_id_t>(id);
+    }
+
+    std::unique_lock<std::shared_mutex> lock(m_mutex);
+
+    // Another thread may have interned the same domain before the lock was acquired
+    const qint64 id = findRange(begin, end, hash);
+    if (id >= 0)
+        return static_cast<domain_id_t>(id);
+
+    const domain_id_t newId = static_cast<domain_id_t>(m_domains.size());
+    m_domains.push_back(domain);
+    m_domainIds.insert(std::make_pair(hash, newId));
+    m_size.store(static_cast<quint32>(m_domains.size()), std::memory_order_release);
+    return newId;
+}
+
+QString DomainTable::getDomain(domain_id_t id) const
+{
+    std::shared_lock<std::shared_mutex> lock(m_mutex);
+    if (id >= m_domains.size())
+        return QString();
+    return m_domains.at(id);
+}
+
+const DomainSuffixIds &DomainTable::getSuffixIds(const QString &host) const
+{
+    struct SuffixLookup
+    {
+        QString Host;
+        quint32 TableSize { std::numeric_limits<quint32>::max() };
+        DomainSuffixIds Ids;
+    };
+    thread_local SuffixLookup lastLookup;
+
+    // Any domain interned since the last lookup may be one of the host's suffixes
+    const quint32 tableSize = m_size.load(std::memory_order_acquire);
+    if (lastLookup.TableSize == tableSize && lastLookup.Host == host)
+        return lastLookup.Ids;
+
+    DomainSuffixIds &result = lastLookup.Ids;
+    result.Count = 0;
+
+    const QChar *data = host.constData();
+    auto addSuffix = [&](const QChar *begin, const QChar *end) {
+        if (begin >= end || result.Count >= DomainSuffixIds::MaxIds)
+            return;
+
+        const qint64 id = findRange(begin, end, hashRange(begin, end));
+        if (id >= 0)
+            result.Ids[result.Count++] = static_cast<domain_id_t>(id);
+    };
+
+    {
+        std::shared_lock<std::shared_mutex> lock(m_mutex);
+
+        // The host and each of its parent domains
+        int pos = 0;
+        while (pos < host.size())
+        {
+            addSuffix(data + pos, data + host.size());
+
+            const int dotIdx = host.indexOf(QChar('.'), pos);
+            if (dotIdx < 0)
+                break;
+            pos = dotIdx + 1;
+        }
+
+        // Entity forms, where the top level domain is removed but the trailing dot is kept
+        const int lastDotIdx = host.lastIndexOf(QChar('.'));
+        pos = 0;
+        while (lastDotIdx > 0 && pos < lastDotIdx)
+        {
+            addSuffix(data + pos, data + lastDotIdx + 1);
+
+            const int dotIdx = host.indexOf(QChar('.'), pos);
+            if (dotIdx < 0 || dotIdx >= lastDotIdx)
+                break;
+            pos = dotIdx + 1;
+        }
+    }
+
+    std::sort(result.Ids.begin(), result.Ids.begin() + result.Count);
+
+    lastLookup.Host = host;
+    lastLookup.TableSize = tableSize;
+    return result;
+}
+
+quint64 DomainTable::hashRange(const QChar *begin, const QChar *end)
+{
+    // 64-bit FNV-1a
+    quint64 hash = 14695981039346656037ULL;
+    for (const QChar *c = begin; c != end; ++c)
+        hash = (hash ^ c->unicode()) * 1099511628211ULL;
+    return hash;
+}
+
+qint64 DomainTable::findRange(const QChar *begin, const QChar *end, quint64 hash) const
+{
+    const int length = static_cast<int>(end - begin);
+    auto range = m_domainIds.equal_range(hash);
+    for (auto it = range.first; it != range.second; ++it)
+    {
+        const QString &domain = m_domains.at(it->second);
+        if (domain.size() == length && std::equal(begin, end, domain.constData()))
+            return static_cast<qint64>(it->second);
+    }
+    return -1;
+}
+
+}
@@ -0,0 +1,102 @@
+#ifndef DOMAINTABLE_H
+#define DOMAINTABLE_H
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <shared_mutex>
+#include <unordered_map>
+#include <vector>
+
+#include <QString>
+
+namespace adblock
+{
+
+/// Identifier of a domain in the \ref DomainTable
+using domain_id_t = quint32;
+
+/**
+ * @struct DomainSuffixIds
+ * @brief Sorted identifiers of every interned domain that a host belongs to. This includes the host
+ *        itself, each of its parent domains, and the entity forms (ex: "example.") of each of them.
+ * @ingroup AdBlock
+ */
+struct DomainSuffixIds
+{
+    /// Maximum number of identifiers that are kept for a single host
+    static constexpr int MaxIds = 64;
+
+    /// Identifiers of the interned suffixes of the host, in ascending order
+    std::array<domain_id_t, MaxIds> Ids;
+
+    /// Number of identifiers in the Ids array
+    int Count { 0 };
+
+    /// Returns true if any identifier of the sorted range [first, last) is also one of the suffix identifiers, false if else
+    bool intersects(const domain_id_t *first, const domain_id_t *last) const;
+};
+
+/**
+ * @class DomainTable
+ * @brief Maps each domain that appears in a filter's domain option to a 32-bit identifier,
+ *        so that filters can store their domain restrictions as compact sorted arrays. The
+ *        domains of a request are resolved to identifiers once, without allocating memory,
+ *        and compared to those arrays with integer comparisons.
+ *
+ *        Domains are interned while filter lists are parsed, which may happen on several
+ *        threads at once. Interned domains are never removed.
+ * @ingroup AdBlock
+ */
+class DomainTable
+{
+public:
+    /// Returns the global domain table
+    static DomainTable &instance();
+
+    /// Returns the identifier of the given domain, adding the domain to the table if it is not already present
+    domain_id_t intern(const QString &domain);
+
+    /// Returns the domain with the given identifier, or an empty string if the identifier is not valid
+    QString getDomain(domain_id_t id) const;
+
+    /**
+     * @brief Finds the identifiers of all interned domains that the given host belongs to. For a host of
+     *        "a.example.com", this will search for "a.example.com", "example.com", "com", as well as the
+     *        entity forms "a.example." and "example.".
+     *
+     *        The result for the most recent host on each thread is reused, so calling this repeatedly
+     *        with the same host (ex: for each filter checked against a single request) is inexpensive.
+     * @param host Lowercase host name
+     * @return Identifiers of the interned suffixes of the host
+     */
+    const DomainSuffixIds &getSuffixIds(const QString &host) const;
+
+private:
+    /// Constructs the domain table
+    DomainTable();
+
+    /// Returns the hash of the characters of the given string in the range [begin, end)
+    static quint64 hashRange(const QChar *begin, const QChar *end);
+
+    /// Returns the identifier of the domain matching the characters in the range [begin, end), or
+    /// -1 if no such domain has been interned. The caller must hold at least a shared lock
+    qint64 findRange(const QChar *begin, const QChar *end, quint64 hash) const;
+
+private:
+    /// Guards the domain containers
+    mutable std::shared_mutex m_mutex;
+
+    /// Map of domain hashes to the identifiers of the domains with that hash
+    std::unordered_multimap<quint64, domain_id_t> m_domainIds;
+
+    /// Interned domains, indexed by identifier
+    std::vector<QString> m_domains;
+
+    /// Number of interned domains. Used to determine whether or not a per-thread lookup result is stale
+    std::atomic<quint32> m_size;
+};
+
+}
+
+#endif // DOMAINTABLE_H
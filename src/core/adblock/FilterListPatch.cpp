@@ -0,0 +1,207 @@
+#include "FilterListPatch.h"
+
+#include <QCryptographicHash>
+#include <QList>
+
+namespace adblock
+{
+
+/// Splits the data into lines, without their line feed characters. Sets hasTrailingNewline to true if the
+/// data ends with a line feed, in which case there is no empty line at the end of the result
+static std::vector<QByteArray> splitLines(const QByteArray &data, bool &hasTrailingNewline)
+{
+    std::vector<QByteArray> result;
+
+    hasTrailingNewline = data.endsWith('\n');
+
+    int pos = 0;
+    while (pos < data.size())
+    {
+        int lineEnd = data.indexOf('\n', pos);
+        if (lineEnd < 0)
+            lineEnd = data.size();
+
+        result.push_back(data.mid(pos, lineEnd - pos));
+        pos = lineEnd + 1;
+    }
+
+    return result;
+}
+
+/// Parses an RCS diff command of the form "a[line] [count]" or "d[line] [count]", returning true on success
+static bool parseCommand(const QByteArray &line, char &type, int &lineNumber, int &count)
+{
+    if (line.size() < 4 || (line.at(0) != 'a' && line.at(0) != 'd'))
+        return false;
+
+    const QList<QByteArray> arguments = line.mid(1).trimmed().split(' ');
+    if (arguments.size() != 2)
+        return false;
+
+    bool lineOk = false, countOk = false;
+    type = line.at(0);
+    lineNumber = arguments.at(0).toInt(&lineOk);
+    count = arguments.at(1).toInt(&countOk);
+    return lineOk && countOk && lineNumber >= 0 && count > 0;
+}
+
+FilterListPatch::FilterListPatch(const QByteArray &patchData) :
+    m_lists(),
+    m_valid(false)
+{
+    bool hasTrailingNewline = false;
+    std::vector<QByteArray> lines = splitLines(patchData, hasTrailingNewline);
+
+    // Changes to a single list, without any header
+    if (lines.empty() || !lines.front().startsWith("diff "))
+    {
+        ListChanges changes;
+        changes.Lines = std::move(lines);
+        m_lists.push_back(std::move(changes));
+        m_valid = true;
+        return;
+    }
+
+    size_t i = 0;
+    while (i < lines.size())
+    {
+        const QByteArray header = lines.at(i++).trimmed();
+        if (header.isEmpty())
+            continue;
+        if (!header.startsWith("diff "))
+            return;
+
+        ListChanges changes;
+        int numLines = -1;
+        const QList<QByteArray> fields = header.mid(5).split(' ');
+        for (const QByteArray &field : fields)
+        {
+            if (field.startsWith("name:"))
+                changes.Name = QString::fromUtf8(field.mid(5));
+            else if (field.startsWith("lines:"))
+                numLines = field.mid(6).toInt();
+            else if (field.startsWith("checksum:"))
+                changes.Checksum = field.mid(9).toLower();
+        }
+
+        if (numLines < 0 || i + static_cast<size_t>(numLines) > lines.size())
+            return;
+
+        changes.Lines.assign(lines.begin() + static_cast<std::ptrdiff_t>(i), lines.begin() + static_cast<std::ptrdiff_t>(i) + numLines);
+        i += static_cast<size_t>(numLines);
+
+        m_lists.push_back(std::move(changes));
+    }
+
+    m_valid = true;
+}
+
+bool FilterListPatch::isValid() const
+{
+    return m_valid;
+}
+
+bool FilterListPatch::apply(const QString &listName, const QByteArray &original, QByteArray &result) const
+{
+    if (!m_valid)
+        return false;
+
+    const ListChanges *changes = nullptr;
+    for (const ListChanges &list : m_lists)
+    {
+        if (list.Name == listName || (m_lists.size() == 1 && list.Name.isEmpty()))
+        {
+            changes = &list;
+            break;
+        }
+    }
+
+    if (changes == nullptr)
+        return false;
+
+    bool hasTrailingNewline = false;
+    const std::vector<QByteArray> originalLines = splitLines(original, hasTrailingNewline);
+
+    std::vector<QByteArray> resultLines;
+    if (!applyChanges(*changes, originalLines, resultLines))
+        return false;
+
+    int resultSize = 0;
+    for (const QByteArray &line : resultLines)
+        resultSize += line.size() + 1;
+
+    result.clear();
+    result.reserve(resultSize);
+    for (size_t i = 0; i < resultLines.size(); ++i)
+    {
+        result.append(resultLines.at(i));
+        if (i + 1 < resultLines.size() || hasTrailingNewline)
+            result.append('\n');
+    }
+
+    if (!changes->Checksum.isEmpty())
+    {
+        const QByteArray checksum = QCryptographicHash::hash(result, QCryptographicHash::Sha1).toHex();
+        if (!checksum.startsWith(changes->Checksum))
+            return false;
+    }
+
+    return true;
+}
+
+bool FilterListPatch::applyChanges(const ListChanges &changes, const std::vector<QByteArray> &originalLines,
+                                   std::vector<QByteArray> &resultLines)
+{
+    resultLines.clear();
+    resultLines.reserve(originalLines.size());
+
+    // Number of lines of the original list that have been copied or deleted so far. Commands are
+    // given in the order of the original lines that they refer to
+    size_t originalPos = 0;
+
+    auto copyOriginalLines = [&](size_t end) {
+        resultLines.insert(resultLines.end(), originalLines.begin() + static_cast<std::ptrdiff_t>(originalPos),
+                           originalLines.begin() + static_cast<std::ptrdiff_t>(end));
+        originalPos = end;
+    };
+
+    const std::vector<QByteArray> &lines = changes.Lines;
+    size_t i = 0;
+    while (i < lines.size())
+    {
+        const QByteArray &line = lines.at(i++);
+
+        char type = 0;
+        int lineNumber = 0, count = 0;
+        if (!parseCommand(line, type, lineNumber, count))
+            return false;
+
+        if (type == 'd')
+        {
+            // Deletes the lines [lineNumber, lineNumber + count) of the original list, numbered from 1
+            const size_t start = static_cast<size_t>(lineNumber) - 1;
+            if (lineNumber < 1 || start < originalPos || start + static_cast<size_t>(count) > originalLines.size())
+                return false;
+
+            copyOriginalLines(start);
+            originalPos += static_cast<size_t>(count);
+        }
+        else
+        {
+            // Adds the next count lines of the patch after the given line of the original list
+            const size_t after = static_cast<size_t>(lineNumber);
+            if (after < originalPos || after > originalLines.size() || i + static_cast<size_t>(count) > lines.size())
+                return false;
+
+            copyOriginalLines(after);
+            resultLines.insert(resultLines.end(), lines.begin() + static_cast<std::ptrdiff_t>(i),
+                               lines.begin() + static_cast<std::ptrdiff_t>(i) + count);
+            i += static_cast<size_t>(count);
+        }
+    }
+
+    copyOriginalLines(originalLines.size());
+    return true;
+}
+
+}
@@ -0,0 +1,71 @@
+#ifndef FILTERLISTPATCH_H
+#define FILTERLISTPATCH_H
+
+#include <vector>
+
+#include <QByteArray>
+#include <QString>
+
+namespace adblock
+{
+
+/**
+ * @class FilterListPatch
+ * @brief A differential update of one or more filter lists, as referenced by the "Diff-Path" header
+ *        of lists that support the differential update format of AdBlock Plus and uBlock Origin.
+ *
+ *        Changes are written in the RCS diff format ("diff -n"). A patch may hold the changes of a
+ *        single list, or of several lists, where the changes of each list are preceded by a line of
+ *        the form "diff name:[list name] lines:[number of lines] checksum:[checksum]". The checksum
+ *        is the start of the SHA-1 hash of the updated list, and is used to verify the result.
+ * @ingroup AdBlock
+ */
+class FilterListPatch
+{
+public:
+    /// Parses the patch from its file contents
+    explicit FilterListPatch(const QByteArray &patchData);
+
+    /// Returns true if the patch could be parsed, false if else
+    bool isValid() const;
+
+    /**
+     * @brief Applies the changes of a list to its current contents
+     * @param listName Name of the list, as given after the '#' of its "Diff-Path" header. May be empty if
+     *                 the patch only holds the changes of a single list
+     * @param original Current contents of the list
+     * @param result Updated contents of the list
+     * @return True if the changes were applied, and the result matches the checksum of the patch. False if
+     *         the patch has no changes for the list, or they do not apply to its current contents
+     */
+    bool apply(const QString &listName, const QByteArray &original, QByteArray &result) const;
+
+private:
+    /// Changes to a single filter list
+    struct ListChanges
+    {
+        /// Name of the list, or an empty string if the patch only holds the changes of one list
+        QString Name;
+
+        /// Expected checksum of the updated list, as a lowercase hexadecimal string. May be empty
+        QByteArray Checksum;
+
+        /// Commands and added lines, in the RCS diff format
+        std::vector<QByteArray> Lines;
+    };
+
+    /// Applies the changes to the lines of a list, returning true on success or false if they do not apply
+    static bool applyChanges(const ListChanges &changes, const std::vector<QByteArray> &originalLines,
+                             std::vector<QByteArray> &resultLines);
+
+private:
+    /// Changes of each list in the patch
+    std::vector<ListChanges> m_lists;
+
+    /// True if the patch could be parsed
+    bool m_valid;
+};
+
+}
+
+#endif // FILTERLISTPATCH_H
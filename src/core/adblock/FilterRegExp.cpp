@@ -0,0 +1,289 @@
+#include "FilterRegExp.h"
+
+#include <algorithm>
+
+#include <QHash>
+
+namespace adblock
+{
+
+/// Literals shorter than this are too common in URLs to be worth searching for
+static constexpr int cMinRequiredLiteralLength = 3;
+
+/// Returns the index just past the end of the character class that begins at the given index, or -1 if the class is not terminated
+static int skipCharacterClass(const QString &pattern, int start)
+{
+    const int len = pattern.size();
+
+    int i = start + 1;
+    if (i < len && pattern.at(i) == QLatin1Char('^'))
+        ++i;
+
+    // A closing bracket at the start of the class is part of the class
+    if (i < len && pattern.at(i) == QLatin1Char(']'))
+        ++i;
+
+    while (i < len)
+    {
+        const QChar c = pattern.at(i);
+        if (c == QLatin1Char('\\'))
+            i += 2;
+        else if (c == QLatin1Char('[') && i + 1 < len && pattern.at(i + 1) == QLatin1Char(':'))
+        {
+            // POSIX class, such as [:alpha:]
+            const int end = pattern.indexOf(QLatin1String(":]"), i + 2);
+            if (end < 0)
+                return -1;
+            i = end + 2;
+        }
+        else if (c == QLatin1Char(']'))
+            return i + 1;
+        else
+            ++i;
+    }
+
+    return -1;
+}
+
+/// Returns the index just past the end of the group that begins at the given index, or -1 if the group is not terminated
+static int skipGroup(const QString &pattern, int start)
+{
+    const int len = pattern.size();
+
+    int depth = 0;
+    int i = start;
+    while (i < len)
+    {
+        const QChar c = pattern.at(i);
+        if (c == QLatin1Char('\\'))
+            i += 2;
+        else if (c == QLatin1Char('['))
+        {
+            i = skipCharacterClass(pattern, i);
+            if (i < 0)
+                return -1;
+        }
+        else
+        {
+            if (c == QLatin1Char('('))
+                ++depth;
+            else if (c == QLatin1Char(')') && --depth == 0)
+                return i + 1;
+            ++i;
+        }
+    }
+
+    return -1;
+}
+
+std::shared_ptr<FilterRegExp> FilterRegExp::create(const QString &pattern, QRegularExpression::PatternOptions options)
+{
+    static std::mutex cacheMutex;
+    static QHash<QString, std::weak_ptr<FilterRegExp>> cache;
+    static int pruneThreshold = 1024;
+
+    QString key = QString::number(static_cast<int>(options));
+    key.append(QLatin1Char('/')).append(pattern);
+
+    std::lock_guard<std::mutex> lock(cacheMutex);
+
+    auto it = cache.find(key);
+    if (it != cache.end())
+    {
+        if (std::shared_ptr<FilterRegExp> result = it->lock())
+            return result;
+    }
+
+    auto result = std::make_shared<FilterRegExp>(pattern, options);
+    cache.insert(key, result);
+
+    // Forget the expressions that are no longer used by any filter, once the cache has grown enough
+    if (cache.size() >= pruneThreshold)
+    {
+        for (auto cacheIt = cache.begin(); cacheIt != cache.end();)
+        {
+            if (cacheIt->expired())
+                cacheIt = cache.erase(cacheIt);
+            else
+                ++cacheIt;
+        }
+        pruneThreshold = std::max(1024, cache.size() * 2);
+    }
+
+    return result;
+}
+
+FilterRegExp::FilterRegExp(const QString &pattern, QRegularExpression::PatternOptions options) :
+    m_regExp(pattern, options),
+    m_requiredLiteral(),
+    m_literalCaseSensitivity(options.testFlag(QRegularExpression::CaseInsensitiveOption) ? Qt::CaseInsensitive : Qt::CaseSensitive),
+    m_optimizeFlag()
+{
+    // Comments and whitespace are ignored in the extended syntax, so literals cannot be extracted from it
+    if (!options.testFlag(QRegularExpression::ExtendedPatternSyntaxOption))
+        m_requiredLiteral = extractRequiredLiteral(pattern, m_literalCaseSensitivity == Qt::CaseSensitive);
+}
+
+bool FilterRegExp::isMatch(const QString &subject) const
+{
+    if (!m_requiredLiteral.isEmpty() && !subject.contains(m_requiredLiteral, m_literalCaseSensitivity))
+        return false;
+
+    std::call_once(m_optimizeFlag, [this]() {
+        m_regExp.optimize();
+    });
+
+    return m_regExp.match(subject).hasMatch();
+}
+
+const QRegularExpression &FilterRegExp::getRegularExpression() const
+{
+    return m_regExp;
+}
+
+const QString &FilterRegExp::getRequiredLiteral() const
+{
+    return m_requiredLiteral;
+}
+
+QString FilterRegExp::extractRequiredLiteral(const QString &pattern, bool caseSensitive)
+{
+    QString best, current;
+
+    // True if the last character of the pattern was appended to the current literal
+    bool lastWasLiteral = false;
+
+    auto endLiteral = [&]() {
+        if (current.size() > best.size())
+            best = current;
+        current.clear();
+        lastWasLiteral = false;
+    };
+
+    auto addLiteral = [&](QChar c) {
+        if (!caseSensitive)
+        {
+            if (c.unicode() > 0x7F)
+            {
+                endLiteral();
+                return;
+            }
+            c = c.toLower();
+        }
+        current.append(c);
+        lastWasLiteral = true;
+    };
+
+    // Called when the previous item of the pattern is made optional by a quantifier
+    auto removeOptionalLiteral = [&]() {
+        if (lastWasLiteral)
+            current.chop(1);
+        endLiteral();
+    };
+
+    const int len = pattern.size();
+    int i = 0;
+    while (i < len)
+    {
+        const QChar c = pattern.at(i);
+        switch (c.unicode())
+        {
+            case '\\':
+            {
+                if (i + 1 >= len)
+                    return QString();
+
+                const QChar next = pattern.at(i + 1);
+                if (!next.isLetterOrNumber())
+                    addLiteral(next);
+                else if (QStringLiteral("dDwWsSbBAzZGhHvVRXKntrfe").contains(next))
+                    endLiteral();
+                else
+                    return QString(); // Escapes with arguments, backreferences, \Q..\E and so on
+
+                i += 2;
+                break;
+            }
+            case '[':
+            {
+                endLiteral();
+                i = skipCharacterClass(pattern, i);
+                if (i < 0)
+                    return QString();
+                break;
+            }
+            case '(':
+            {
+                // Only skip over groups that do not change the options of the rest of the pattern
+                if (i + 1 < len && pattern.at(i + 1) == QLatin1Char('?'))
+                {
+                    const QStringRef groupType = pattern.midRef(i + 2, 2);
+                    if (!groupType.startsWith(QLatin1Char(':'))
+                            && !groupType.startsWith(QLatin1Char('='))
+                            && !groupType.startsWith(QLatin1Char('!'))
+                            && groupType != QLatin1String("<=")
+                            && groupType != QLatin1String("<!"))
+                        return QString();
+                }
+
+                endLiteral();
+                i = skipGroup(pattern, i);
+                if (i < 0)
+                    return QString();
+                break;
+            }
+            case ')':
+            case '|':
+                // Unbalanced group, or an alternative at the top level of the pattern
+                return QString();
+            case '?':
+            case '*':
+                removeOptionalLiteral();
+                ++i;
+                break;
+            case '+':
+                // The previous item is required at least once, but may be repeated
+                endLiteral();
+                ++i;
+                break;
+            case '{':
+            {
+                const int end = pattern.indexOf(QLatin1Char('}'), i + 1);
+                const QStringRef quantifier = end > i + 1 ? pattern.midRef(i + 1, end - i - 1) : QStringRef();
+                const bool isQuantifier = !quantifier.isEmpty()
+                        && std::all_of(quantifier.begin(), quantifier.end(), [](QChar q) { return q.isDigit() || q == QLatin1Char(','); });
+                if (isQuantifier)
+                {
+                    removeOptionalLiteral();
+                    i = end + 1;
+                }
+                else
+                {
+                    // Newer versions of PCRE accept other quantifier forms, so the brace is not assumed to be a literal
+                    endLiteral();
+                    ++i;
+                }
+                break;
+            }
+            case '.':
+            case '^':
+            case '$':
+                endLiteral();
+                ++i;
+                break;
+            default:
+                addLiteral(c);
+                ++i;
+                break;
+        }
+    }
+
+    endLiteral();
+
+    if (best.size() < cMinRequiredLiteralLength)
+        return QString();
+
+    return best;
+}
+
+}
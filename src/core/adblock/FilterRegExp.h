@@ -0,0 +1,74 @@
+#ifndef FILTERREGEXP_H
+#define FILTERREGEXP_H
+
+#include <memory>
+#include <mutex>
+
+#include <QRegularExpression>
+#include <QString>
+
+namespace adblock
+{
+
+/**
+ * @class FilterRegExp
+ * @brief The regular expression of a RegExp category filter. Instances are shared between all filters
+ *        with the same pattern and options, and are immutable once created, so they may be used from
+ *        any number of threads at once.
+ *
+ *        The expression is not compiled until it is first needed. Before the expression is evaluated,
+ *        the subject is searched for the longest literal string that any match of the pattern must
+ *        contain, so that most requests never reach the regular expression engine.
+ * @ingroup AdBlock
+ */
+class FilterRegExp
+{
+public:
+    /// Returns the shared regular expression with the given pattern and options, creating it if needed
+    static std::shared_ptr<FilterRegExp> create(const QString &pattern, QRegularExpression::PatternOptions options);
+
+    /// Constructs the regular expression. Use \ref FilterRegExp::create instead, so that equal expressions are shared
+    FilterRegExp(const QString &pattern, QRegularExpression::PatternOptions options);
+
+    /// Copy constructor (forbid)
+    FilterRegExp(const FilterRegExp &other) = delete;
+
+    /// Copy assignment operator (forbid)
+    FilterRegExp &operator =(const FilterRegExp &other) = delete;
+
+    /// Returns true if the subject matches the regular expression, false if else
+    bool isMatch(const QString &subject) const;
+
+    /// Returns the underlying regular expression
+    const QRegularExpression &getRegularExpression() const;
+
+    /// Returns the literal string that every match of the expression contains, or an empty string
+    /// if no literal could be extracted from the pattern
+    const QString &getRequiredLiteral() const;
+
+    /**
+     * @brief Finds the longest literal string that must be contained in any match of the given pattern
+     * @param pattern Perl-compatible regular expression
+     * @param caseSensitive True if the pattern is matched case-sensitively, false if else
+     * @return The required literal, or an empty string if none of at least three characters could be found.
+     *         When the pattern is case-insensitive, the literal is lowercase and only contains ASCII characters.
+     */
+    static QString extractRequiredLiteral(const QString &pattern, bool caseSensitive);
+
+private:
+    /// The regular expression, which is compiled and optimized on the first evaluation
+    QRegularExpression m_regExp;
+
+    /// Literal string that any match of the expression contains
+    QString m_requiredLiteral;
+
+    /// Case sensitivity of the literal string search, which follows that of the expression
+    Qt::CaseSensitivity m_literalCaseSensitivity;
+
+    /// Ensures the expression is only optimized once
+    mutable std::once_flag m_optimizeFlag;
+};
+
+}
+
+#endif // FILTERREGEXP_H
@@ -0,0 +1,108 @@
+#include "FilterStringArena.h"
+
+#include <algorithm>
+#include <cstring>
+
+#include <QByteArray>
+
+namespace adblock
+{
+
+/// Size of each block of the arena. Strings that are larger than this are given a block of their own
+static constexpr size_t cArenaBlockSize = 64 * 1024;
+
+QString ArenaString::toString() const
+{
+    if (Data == nullptr)
+        return QString();
+
+    const int size = static_cast<int>(Size);
+    return IsLatin1 ? QString::fromLatin1(Data, size) : QString::fromUtf8(Data, size);
+}
+
+bool ArenaString::operator==(const ArenaString &other) const
+{
+    // A string is only stored as UTF-8 when it cannot be stored as Latin-1,
+    // so strings with different encodings can never be equal
+    return Size == other.Size
+            && IsLatin1 == other.IsLatin1
+            && (Data == other.Data || std::memcmp(Data, other.Data, Size) == 0);
+}
+
+FilterStringArena::FilterStringArena() :
+    m_blocks(),
+    m_blockOffset(0),
+    m_blockSize(0),
+    m_capacity(0),
+    m_size(0)
+{
+}
+
+ArenaString FilterStringArena::append(const QString &str)
+{
+    const QChar *data = str.constData();
+    const int len = str.size();
+
+    const bool isLatin1 = std::all_of(data, data + len, [](QChar c) { return c.unicode() <= 0xFF; });
+
+    ArenaString result;
+    result.IsLatin1 = isLatin1;
+
+    if (isLatin1)
+    {
+        char *dest = allocate(static_cast<size_t>(len));
+        for (int i = 0; i < len; ++i)
+            dest[i] = static_cast<char>(data[i].unicode());
+
+        result.Data = dest;
+        result.Size = static_cast<quint32>(len);
+        return result;
+    }
+
+    const QByteArray utf8 = str.toUtf8();
+    char *dest = allocate(static_cast<size_t>(utf8.size()));
+    std::memcpy(dest, utf8.constData(), static_cast<size_t>(utf8.size()));
+
+    result.Data = dest;
+    result.Size = static_cast<quint32>(utf8.size());
+    return result;
+}
+
+size_t FilterStringArena::getCapacity() const
+{
+    return m_capacity;
+}
+
+size_t FilterStringArena::getSize() const
+{
+    return m_size;
+}
+
+char *FilterStringArena::allocate(size_t numBytes)
+{
+    // Empty strings still need a valid address, so they are given a single byte
+    numBytes = std::max(numBytes, size_t(1));
+    m_size += numBytes;
+
+    // Give large strings a block of their own, without giving up the remainder of the current block
+    if (numBytes > cArenaBlockSize / 4)
+    {
+        m_blocks.insert(m_blocks.begin(), std::make_unique<char[]>(numBytes));
+        m_capacity += numBytes;
+        return m_blocks.front().get();
+    }
+
+    if (m_blocks.empty() || m_blockOffset + numBytes > m_blockSize)
+    {
+        m_blockSize = cArenaBlockSize;
+        m_blocks.push_back(std::make_unique<char[]>(m_blockSize));
+        m_blockOffset = 0;
+        m_capacity += m_blockSize;
+    }
+
+    char *result = m_blocks.back().get() + m_blockOffset;
+    m_blockOffset += numBytes;
+    return result;
+}
+
+}
@@ -0,0 +1,94 @@
+#ifndef FILTERSTRINGARENA_H
+#define FILTERSTRINGARENA_H
+
+#include <cstddef>
+#include <memory>
+#include <vector>
+
+#include <QString>
+
+namespace adblock
+{
+
+/**
+ * @struct ArenaString
+ * @brief Location and encoding of a string that was copied into a \ref FilterStringArena
+ * @ingroup AdBlock
+ */
+struct ArenaString
+{
+    /// Pointer to the first byte of the string, or a nullptr if the string has not been stored in an arena
+    const char *Data { nullptr };
+
+    /// Length of the string, in bytes
+    quint32 Size { 0 };
+
+    /// True if the string is stored as Latin-1 (one byte per character), false if it is stored as UTF-8
+    bool IsLatin1 { true };
+
+    /// Returns true if the string has been stored in an arena, false if else
+    bool isValid() const { return Data != nullptr; }
+
+    /// Decodes the string into a QString
+    QString toString() const;
+
+    /// Returns true if both strings have the same contents, false if else
+    bool operator==(const ArenaString &other) const;
+};
+
+/**
+ * @class FilterStringArena
+ * @brief Append-only storage for the text of the filters that belong to a single subscription.
+ *        Strings are packed into large blocks, storing one byte per character for Latin-1
+ *        text (which includes nearly every filter rule), rather than allocating a separate
+ *        UTF-16 buffer for each filter.
+ *
+ *        Strings are never moved or removed, so any \ref ArenaString returned by the arena
+ *        remains valid for as long as the arena exists.
+ * @ingroup AdBlock
+ */
+class FilterStringArena
+{
+public:
+    /// Constructs an empty arena
+    FilterStringArena();
+
+    /// Copy constructor (forbid)
+    FilterStringArena(const FilterStringArena &other) = delete;
+
+    /// Copy assignment operator (forbid)
+    FilterStringArena &operator =(const FilterStringArena &other) = delete;
+
+    /// Copies the string into the arena, returning the location of the copy
+    ArenaString append(const QString &str);
+
+    /// Returns the number of bytes allocated by the arena
+    size_t getCapacity() const;
+
+    /// Returns the number of bytes that are used by strings in the arena
+    size_t getSize() const;
+
+private:
+    /// Returns a pointer to a contiguous region of the given number of bytes, allocating a new block if needed
+    char *allocate(size_t numBytes);
+
+private:
+    /// Blocks of memory that strings are stored in
+    std::vector< std::unique_ptr<char[]> > m_blocks;
+
+    /// Number of bytes that have been used in the most recently allocated block
+    size_t m_blockOffset;
+
+    /// Size of the most recently allocated block, in bytes
+    size_t m_blockSize;
+
+    /// Total number of bytes allocated by the arena
+    size_t m_capacity;
+
+    /// Total number of bytes used by strings in the arena
+    size_t m_size;
+};
+
+}
+
+#endif // FILTERSTRINGARENA_H
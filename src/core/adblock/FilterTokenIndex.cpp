@@ -0,0 +1,234 @@
+#include "FilterTokenIndex.h"
+
+#include <algorithm>
+
+namespace adblock
+{
+
+// FNV-1a constants
+static constexpr token_hash_t cTokenHashBasis = 2166136261u;
+static constexpr token_hash_t cTokenHashPrime = 16777619u;
+
+// Tokens shorter than this are too common to be useful as an index key
+static constexpr int cMinTokenLength = 2;
+
+/// Appends the hash of every token of length >= cMinTokenLength within the string to the result container.
+/// The callback is invoked for each token with its start and end position, and decides whether or not it is kept
+template <typename Predicate>
+static void forEachToken(const QString &str, Predicate shouldKeep, std::vector<token_hash_t> &result)
+{
+    const int len = str.size();
+    const QChar *data = str.constData();
+
+    int i = 0;
+    while (i < len)
+    {
+        if (!FilterTokenIndex::isTokenChar(data[i].unicode()))
+        {
+            ++i;
+            continue;
+        }
+
+        const int start = i;
+        token_hash_t hash = cTokenHashBasis;
+        while (i < len)
+        {
+            ushort c = data[i].unicode();
+            if (!FilterTokenIndex::isTokenChar(c))
+                break;
+            if (c >= 'A' && c <= 'Z')
+                c += 32;
+            hash = (hash ^ static_cast<token_hash_t>(c)) * cTokenHashPrime;
+            ++i;
+        }
+
+        if (i - start >= cMinTokenLength && shouldKeep(start, i))
+            result.push_back(hash);
+    }
+}
+
+void FilterTokenIndex::clear()
+{
+    m_buckets.clear();
+    m_untokenizedFilters.clear();
+    m_numFilters = 0;
+}
+
+void FilterTokenIndex::build(const std::deque<Filter*> &filters)
+{
+    clear();
+
+    // Gather candidate tokens for each filter, and count the number of filters each token appears in
+    std::vector<std::vector<token_hash_t>> filterTokens;
+    filterTokens.reserve(filters.size());
+
+    QHash<token_hash_t, int> tokenFrequency;
+    for (const Filter *filter : filters)
+    {
+        std::vector<token_hash_t> tokens = getCandidateTokens(filter);
+        for (token_hash_t token : tokens)
+            ++tokenFrequency[token];
+        filterTokens.push_back(std::move(tokens));
+    }
+
+    // Place each filter into the bucket of its rarest token
+    for (size_t i = 0; i < filters.size(); ++i)
+    {
+        Filter *filter = filters.at(i);
+        const std::vector<token_hash_t> &tokens = filterTokens.at(i);
+        if (tokens.empty())
+        {
+            m_untokenizedFilters.push_back({ i, filter });
+            continue;
+        }
+
+        token_hash_t bestToken = tokens.front();
+        int bestFrequency = tokenFrequency.value(bestToken);
+        for (token_hash_t token : tokens)
+        {
+            const int frequency = tokenFrequency.value(token);
+            if (frequency < bestFrequency)
+            {
+                bestToken = token;
+                bestFrequency = frequency;
+            }
+        }
+
+        m_buckets[bestToken].push_back({ i, filter });
+    }
+
+    m_numFilters = filters.size();
+}
+
+Filter *FilterTokenIndex::findMatch(const std::vector<token_hash_t> &urlTokens, const QString &baseUrl,
+                                    const QString &requestUrl, const QString &requestDomain, ElementType typeMask) const
+{
+    if (m_numFilters == 0)
+        return nullptr;
+
+    // The buckets are probed in the order of their token hashes. To return the same filter as a scan of the
+    // whole container, each bucket is only searched up to the position of the best match found so far
+    const IndexedFilter *bestMatch = nullptr;
+    auto searchFilters = [&](const std::vector<IndexedFilter> &entries) {
+        for (const IndexedFilter &entry : entries)
+        {
+            if (bestMatch != nullptr && entry.Position >= bestMatch->Position)
+                return;
+
+            if (entry.Rule->isMatch(baseUrl, requestUrl, requestDomain, typeMask))
+            {
+                bestMatch = &entry;
+                return;
+            }
+        }
+    };
+
+    for (token_hash_t token : urlTokens)
+    {
+        auto it = m_buckets.constFind(token);
+        if (it != m_buckets.constEnd())
+            searchFilters(*it);
+    }
+
+    searchFilters(m_untokenizedFilters);
+
+    return bestMatch != nullptr ? bestMatch->Rule : nullptr;
+}
+
+size_t FilterTokenIndex::size() const
+{
+    return m_numFilters;
+}
+
+size_t FilterTokenIndex::getNumUntokenizedFilters() const
+{
+    return m_untokenizedFilters.size();
+}
+
+std::vector<token_hash_t> FilterTokenIndex::tokenize(const QString &url)
+{
+    std::vector<token_hash_t> result;
+    result.reserve(static_cast<size_t>(url.size() / 4));
+
+    forEachToken(url, [](int, int) { return true; }, result);
+
+    std::sort(result.begin(), result.end());
+    result.erase(std::unique(result.begin(), result.end()), result.end());
+    return result;
+}
+
+std::vector<token_hash_t> FilterTokenIndex::getCandidateTokens(const Filter *filter)
+{
+    std::vector<token_hash_t> result;
+
+    if (filter->m_matchAll || filter->m_evalString.isEmpty())
+        return result;
+
+    const QString &evalString = filter->m_evalString;
+    const int len = evalString.size();
+
+    // The evaluation string of a RegExp filter holds its pattern in the ad block format. Tokens are taken from
+    // the literal runs between its wildcards, separators and anchors
+    if (filter->getCategory() == FilterCategory::RegExp)
+    {
+        forEachToken(evalString, [&](int start, int end) {
+            return isPatternTokenBoundary(evalString, start - 1) && isPatternTokenBoundary(evalString, end);
+        }, result);
+        return result;
+    }
+
+    // A token at the very beginning or end of the evaluation string may only be a partial token of the
+    // request URL, unless the filter is anchored on that side
+    bool anchoredStart = false, anchoredEnd = false;
+    switch (filter->getCategory())
+    {
+        case FilterCategory::Domain:
+        case FilterCategory::StringExactMatch:
+            anchoredStart = anchoredEnd = true;
+            break;
+        case FilterCategory::StringStartMatch:
+            anchoredStart = true;
+            break;
+        case FilterCategory::StringEndMatch:
+            anchoredEnd = true;
+            break;
+        case FilterCategory::DomainStart:
+        case FilterCategory::StringContains:
+            break;
+        default:
+            return result;
+    }
+
+    forEachToken(evalString, [&](int start, int end) {
+        return (start > 0 || anchoredStart) && (end < len || anchoredEnd)
+                && (start == 0 || evalString.at(start - 1).unicode() < 0x80)
+                && (end == len || evalString.at(end).unicode() < 0x80);
+    }, result);
+
+    return result;
+}
+
+bool FilterTokenIndex::isPatternTokenBoundary(const QString &pattern, int pos)
+{
+    // The pattern is not anchored at either end, as any leading or trailing wildcard has been removed
+    const int len = pattern.size();
+    if (pos < 0 || pos >= len)
+        return false;
+
+    const ushort c = pattern.at(pos).unicode();
+    switch (c)
+    {
+        // A wildcard may match the remainder of the token
+        case '*':
+            return false;
+        // Anchors are only recognized at the start ('|' or '||') and the end of the pattern
+        case '|':
+            return pos == 0 || pos == len - 1 || (pos == 1 && pattern.at(0) == QLatin1Char('|'));
+        // A separator never matches a token character, and other ASCII characters are matched literally.
+        // Characters outside of the ASCII range may appear in the request URL in percent-encoded form
+        default:
+            return c < 0x80;
+    }
+}
+
+}
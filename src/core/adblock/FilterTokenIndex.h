@@ -0,0 +1,100 @@
+#ifndef FILTERTOKENINDEX_H
+#define FILTERTOKENINDEX_H
+
+#include "AdBlockFilter.h"
+
+#include <cstdint>
+#include <deque>
+#include <vector>
+
+#include <QHash>
+#include <QString>
+
+namespace adblock
+{
+
+/// Hash value of a single alphanumeric token, as extracted from a filter or a request URL
+using token_hash_t = uint32_t;
+
+/**
+ * @class FilterTokenIndex
+ * @brief A reverse index of network filters, keyed by the rarest complete alphanumeric
+ *        token found in each filter's evaluation string. A request URL is tokenized once,
+ *        and only the filters sharing one of its tokens are evaluated. When several filters
+ *        match a request, the one that comes first in the indexed container is returned.
+ * @ingroup AdBlock
+ */
+class FilterTokenIndex
+{
+    /// A filter in the index, along with its position in the container that the index was built from
+    struct IndexedFilter
+    {
+        /// Position of the filter in its container
+        size_t Position;
+
+        /// Pointer to the filter
+        Filter *Rule;
+    };
+
+public:
+    /// Default constructor
+    FilterTokenIndex() = default;
+
+    /// Removes all filters from the index
+    void clear();
+
+    /// Builds the index from the given container of filters, replacing any existing index data.
+    /// The filter pointers must remain valid for the lifetime of the index.
+    void build(const std::deque<Filter*> &filters);
+
+    /**
+     * @brief Searches the index for the filter matching the network request that comes first in the indexed container
+     * @param urlTokens Tokens of the request URL, as returned by \ref FilterTokenIndex::tokenize
+     * @param baseUrl URL of the original network request
+     * @param requestUrl URL of the actual network request
+     * @param requestDomain Domain of the request URL
+     * @param typeMask Element type(s) associated with the request.
+     * @return A pointer to the first matching filter rule, or a nullptr if not found
+     */
+    Filter *findMatch(const std::vector<token_hash_t> &urlTokens, const QString &baseUrl,
+                      const QString &requestUrl, const QString &requestDomain, ElementType typeMask) const;
+
+    /// Returns the number of filters that belong to the index
+    size_t size() const;
+
+    /// Returns the number of filters without an index key, which are checked against every request
+    size_t getNumUntokenizedFilters() const;
+
+    /// Splits the given request URL into a sorted and deduplicated set of token hashes
+    static std::vector<token_hash_t> tokenize(const QString &url);
+
+    /// Returns true if the given character is part of a token, false if it is a separator
+    static inline bool isTokenChar(ushort c)
+    {
+        return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') || c == '%';
+    }
+
+private:
+    /// Returns the hashes of all tokens in the filter's evaluation string that can be safely
+    /// used as an index key. A token is only safe if it is guaranteed to appear as a complete
+    /// token in any URL that the filter matches.
+    static std::vector<token_hash_t> getCandidateTokens(const Filter *filter);
+
+    /// Returns true if the character at the given position of an ad block pattern ends a token
+    /// that precedes it, or starts a token that follows it
+    static bool isPatternTokenBoundary(const QString &pattern, int pos);
+
+private:
+    /// Buckets of filters, keyed by the hash of each filter's rarest token. Each bucket is ordered by position
+    QHash<token_hash_t, std::vector<IndexedFilter>> m_buckets;
+
+    /// Filters which do not have a usable token, and must be checked against every request. Ordered by position
+    std::vector<IndexedFilter> m_untokenizedFilters;
+
+    /// Total number of filters in the index
+    size_t m_numFilters { 0 };
+};
+
+}
+
+#endif // FILTERTOKENINDEX_H
@@ -0,0 +1,160 @@
+#ifndef LOGINTERNTABLE_H
+#define LOGINTERNTABLE_H
+
+#include <mutex>
+#include <shared_mutex>
+#include <vector>
+
+#include <QHash>
+#include <QtGlobal>
+
+namespace adblock
+{
+
+/**
+ * @class LogInternTable
+ * @brief A fixed-capacity table that maps values (ex: URLs, filter rules) referenced by the ad block log
+ *        to 32-bit identifiers, so that log entries can refer to them without holding a copy of each value.
+ *
+ *        Identifiers are handed out in increasing order, and the value with a given identifier is stored
+ *        in the slot (identifier modulo capacity). Once the table is full, each new value replaces the
+ *        value that was interned the longest time ago, and lookups of the replaced identifier fail.
+ *
+ *        A value that is interned again after more than a quarter of the table has been handed out since it
+ *        was last assigned an identifier is given a new one. As long as each log entry interns at most N values
+ *        and the table holds at least 4 * N times as many values as the log holds entries, the values of every
+ *        entry that is still in the log can be looked up.
+ *
+ *        Values are detached when they are added to the table, so a value that is being looked up or interned
+ *        may refer to memory that it does not own (ex: a QByteArray created with QByteArray::fromRawData).
+ * @ingroup AdBlock
+ */
+template <typename ValueType>
+class LogInternTable
+{
+    /// An interned value and its identifier
+    struct Slot
+    {
+        /// Identifier of the value
+        quint32 Id { 0 };
+
+        /// True if a value has been stored in the slot
+        bool Used { false };
+
+        /// The interned value
+        ValueType Value {};
+    };
+
+public:
+    /// Constructs the table with the given capacity, which is rounded up to the next power of two
+    explicit LogInternTable(quint32 capacity) :
+        m_mutex(),
+        m_ids(),
+        m_slots(),
+        m_mask(0),
+        m_nextId(0)
+    {
+        quint32 size = 1;
+        while (size < capacity && size < 0x80000000U)
+            size <<= 1;
+
+        m_slots.resize(size);
+        m_mask = size - 1;
+        m_ids.reserve(static_cast<int>(size));
+    }
+
+    /// Returns the identifier of the given value, adding the value to the table if it is not already present
+    quint32 intern(const ValueType &value)
+    {
+        {
+            std::shared_lock<std::shared_mutex> lock(m_mutex);
+            auto it = m_ids.constFind(value);
+            if (it != m_ids.constEnd() && isFresh(*it))
+                return *it;
+        }
+
+        std::unique_lock<std::shared_mutex> lock(m_mutex);
+
+        // Another thread may have interned the same value before the lock was acquired
+        auto it = m_ids.find(value);
+        if (it != m_ids.end() && isFresh(*it))
+            return *it;
+
+        const quint32 id = m_nextId++;
+        Slot &slot = m_slots[id & m_mask];
+
+        // Forget the value that is being replaced, unless it has since been given a newer slot
+        if (slot.Used)
+        {
+            auto replacedIt = m_ids.find(slot.Value);
+            if (replacedIt != m_ids.end() && *replacedIt == slot.Id)
+                m_ids.erase(replacedIt);
+        }
+
+        slot.Id = id;
+        slot.Used = true;
+        slot.Value = value;
+        slot.Value.detach();
+
+        if (it != m_ids.end())
+            *it = id;
+        else
+            m_ids.insert(slot.Value, id);
+
+        return id;
+    }
+
+    /// Searches for the value with the given identifier. Returns true and sets the value if found, false if else
+    bool get(quint32 id, ValueType &value) const
+    {
+        std::shared_lock<std::shared_mutex> lock(m_mutex);
+
+        const Slot &slot = m_slots[id & m_mask];
+        if (!slot.Used || slot.Id != id)
+            return false;
+
+        value = slot.Value;
+        return true;
+    }
+
+    /// Searches for the identifier of the given value, without interning it. Returns true and sets the id if found, false if else
+    bool find(const ValueType &value, quint32 &id) const
+    {
+        std::shared_lock<std::shared_mutex> lock(m_mutex);
+
+        auto it = m_ids.constFind(value);
+        if (it == m_ids.constEnd())
+            return false;
+
+        id = *it;
+        return true;
+    }
+
+private:
+    /// Returns true if the identifier was handed out recently enough that it does not need to be replaced. The
+    /// difference is computed with unsigned arithmetic, so it remains correct once the identifiers wrap around
+    bool isFresh(quint32 id) const
+    {
+        return m_nextId - id <= (m_mask + 1) / 4;
+    }
+
+private:
+    /// Guards the contents of the table
+    mutable std::shared_mutex m_mutex;
+
+    /// Identifiers of the values in the table
+    QHash<ValueType, quint32> m_ids;
+
+    /// Interned values, indexed by their identifiers modulo the capacity of the table
+    std::vector<Slot> m_slots;
+
+    /// Capacity of the table, minus one
+    quint32 m_mask;
+
+    /// Identifier of the next value to be interned
+    quint32 m_nextId;
+};
+
+}
+
+#endif // LOGINTERNTABLE_H
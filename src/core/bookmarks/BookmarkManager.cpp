@@ -10,6 +10,8 @@
 #include <QTimer>
 #include <QtConcurrent>
 
+const std::string BookmarkManager::StoreName = "BookmarkStore";
+
 BookmarkManager::BookmarkManager(const ViperServiceLocator &serviceLocator, DatabaseTaskScheduler &taskScheduler, QObject *parent) :
     QObject(parent),
     m_taskScheduler(taskScheduler),
@@ -30,11 +32,11 @@ BookmarkManager::BookmarkManager(const ViperServiceLocator &serviceLocator, Data
 
     QTimer::singleShot(250, this, &BookmarkManager::checkIfLoaded);
 
-    m_taskScheduler.onInit([this](){
-        m_bookmarkStore = static_cast<BookmarkStore*>(m_taskScheduler.getWorker("BookmarkStore"));
+    m_taskScheduler.onInit(StoreName, [this](){
+        m_bookmarkStore = static_cast<BookmarkStore*>(m_taskScheduler.getWorker(StoreName));
     });
 
-    m_taskScheduler.post([this](){
+    m_taskScheduler.post(StoreName, TaskPriority::Interactive, [this](){
         m_nextBookmarkId = m_bookmarkStore->getMaxUniqueId() + 1;
         setRootNode(m_bookmarkStore->getRootNode());
     });
@@ -264,7 +266,7 @@ void BookmarkManager::removeBookmark(BookmarkNode *item)
             parent = m_rootNode.get();
 
         if (m_bookmarkStore)
-            m_taskScheduler.post(&BookmarkStore::removeNode, std::ref(m_bookmarkStore), node->getUniqueId(),
+            m_taskScheduler.post(StoreName, TaskPriority::Interactive, &BookmarkStore::removeNode, std::ref(m_bookmarkStore), node->getUniqueId(),
                                  parent->getUniqueId(), node->getPosition());
         //emit bookmarkDeleted(node->getUniqueId(), parent->getUniqueId(), node->getPosition());
 
@@ -456,7 +458,7 @@ void BookmarkManager::scheduleBookmarkInsert(const BookmarkNode *node)
         return;
 
     // params: int nodeId, int parentId, int nodeType, const QString &name, const QUrl &url, int position
-    m_taskScheduler.post(&BookmarkStore::insertNode, std::ref(m_bookmarkStore),
+    m_taskScheduler.post(StoreName, TaskPriority::Interactive, &BookmarkStore::insertNode, std::ref(m_bookmarkStore),
                          node->getUniqueId(), node->getParent()->getUniqueId(),
                          static_cast<int>(node->getType()), node->getName(),
                          node->getURL(), node->getPosition());
@@ -467,11 +469,17 @@ void BookmarkManager::scheduleBookmarkUpdate(const BookmarkNode *node)
     if (!m_bookmarkStore || node == m_rootNode.get())
         return;
 
+    // The store shifts the positions of the node's siblings on each update. A pending update may only be
+    // superseded by one that has the same parent and position, which would shift the same siblings
+    const std::string key = "Update." + std::to_string(node->getUniqueId())
+            + "." + std::to_string(node->getParent()->getUniqueId())
+            + "." + std::to_string(node->getPosition());
+
     // params: int nodeId, int parentId, const QString &name, const QString &url, const QString &shortcut, int position
-    m_taskScheduler.post(&BookmarkStore::updateNode, std::ref(m_bookmarkStore),
-                         node->getUniqueId(), node->getParent()->getUniqueId(),
-                         node->getName(), node->getURL(), node->getShortcut(),
-                         node->getPosition());
+    m_taskScheduler.postKeyed(StoreName, TaskPriority::Interactive, key, &BookmarkStore::updateNode, std::ref(m_bookmarkStore),
+                              node->getUniqueId(), node->getParent()->getUniqueId(),
+                              node->getName(), node->getURL(), node->getShortcut(),
+                              node->getPosition());
 }
 
 void BookmarkManager::scheduleResetList()
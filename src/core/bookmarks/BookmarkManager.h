@@ -151,6 +151,9 @@ private Q_SLOTS:
     void resetBookmarkList();
 
 private:
+    /// Name of the \ref BookmarkStore worker, which identifies its queue in the task scheduler
+    const static std::string StoreName;
+
     /// Reference to the task scheduler. Needed to queue work for the \ref BookmarkStore
     DatabaseTaskScheduler &m_taskScheduler;
 
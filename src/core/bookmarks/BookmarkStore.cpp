@@ -44,7 +44,7 @@ int BookmarkStore::getMaxUniqueId() const
 
 void BookmarkStore::insertNode(int nodeId, int parentId, int nodeType, const QString &name, const QUrl &url, int position)
 {
-    auto stmt = m_database.prepare(R"(INSERT OR REPLACE INTO Bookmarks(ID, ParentID, Type, Name, URL, Position) VALUES (?, ?, ?, ?, ?, ?))");
+    auto stmt = m_database.prepareCached(R"(INSERT OR REPLACE INTO Bookmarks(ID, ParentID, Type, Name, URL, Position) VALUES (?, ?, ?, ?, ?, ?))");
     stmt << nodeId
          << parentId
          << nodeType
@@ -55,34 +55,34 @@ void BookmarkStore::insertNode(int nodeId, int parentId, int nodeType, const QSt
     if (!stmt.execute())
         qWarning() << "BookmarkStore::onBookmarkCreated - could not create bookmark node.";
 
-    stmt = m_database.prepare(R"(UPDATE Bookmarks SET Position = Position + 1 WHERE ParentID = ? AND Position >= ?)");
-    stmt << parentId
-         << position;
+    auto stmtPosition = m_database.prepareCached(R"(UPDATE Bookmarks SET Position = Position + 1 WHERE ParentID = ? AND Position >= ?)");
+    stmtPosition << parentId
+                 << position;
 
-    if (!stmt.execute())
+    if (!stmtPosition.execute())
         qWarning() << "BookmarkStore::onBookmarkCreated - could not update bookmark positions.";
 }
 
 void BookmarkStore::removeNode(int nodeId, int parentId, int position)
 {
-    auto stmt = m_database.prepare(R"(DELETE FROM Bookmarks WHERE ID = ? OR ParentID = ?)");
+    auto stmt = m_database.prepareCached(R"(DELETE FROM Bookmarks WHERE ID = ? OR ParentID = ?)");
     stmt << nodeId
          << nodeId;
     if (!stmt.execute())
         qWarning() << "BookmarkStore::onBookmarkDeleted - could not delete bookmark node.";
 
     // Update positions
-    stmt = m_database.prepare(R"(UPDATE Bookmarks SET Position = Position - 1 WHERE ParentID = ? AND Position >= ?)");
-    stmt << parentId
-         << position;
-    if (!stmt.execute())
+    auto stmtPosition = m_database.prepareCached(R"(UPDATE Bookmarks SET Position = Position - 1 WHERE ParentID = ? AND Position >= ?)");
+    stmtPosition << parentId
+                 << position;
+    if (!stmtPosition.execute())
         qWarning() << "BookmarkStore::onBookmarkDeleted - could not update bookmark positions";
 }
 
 void BookmarkStore::updateNode(int nodeId, int parentId, const QString &name, const QUrl &url, const QString &shortcut, int position)
 {
     auto stmt =
-            m_database.prepare(R"(UPDATE Bookmarks SET ParentID = ?, Name = ?, URL = ?, Shortcut = ?, Position = ? WHERE ID = ?)");
+            m_database.prepareCached(R"(UPDATE Bookmarks SET ParentID = ?, Name = ?, URL = ?, Shortcut = ?, Position = ? WHERE ID = ?)");
     stmt << parentId
          << name
          << url
@@ -93,12 +93,13 @@ void BookmarkStore::updateNode(int nodeId, int parentId, const QString &name, co
     if (!stmt.execute())
         qWarning() << "BookmarkStore::onBookmarkChanged - could not update bookmark node.";
 
-    stmt = m_database.prepare(R"(UPDATE Bookmarks SET Position = Position + 1 WHERE ParentID = ? AND Position >= ? AND ID != ?)");
-    stmt << parentId
-         << position
-         << nodeId;
+    auto stmtPosition =
+            m_database.prepareCached(R"(UPDATE Bookmarks SET Position = Position + 1 WHERE ParentID = ? AND Position >= ? AND ID != ?)");
+    stmtPosition << parentId
+                 << position
+                 << nodeId;
 
-    if (!stmt.execute())
+    if (!stmtPosition.execute())
         qWarning() << "BookmarkStore::onBookmarkChanged - could not update bookmark positions.";
 }
 
@@ -0,0 +1,168 @@
+#ifndef SHARDEDLRUCACHE_H
+#define SHARDEDLRUCACHE_H
+
+#include <array>
+#include <cstdint>
+#include <iterator>
+#include <list>
+#include <mutex>
+#include <unordered_map>
+
+/// Hit and miss counters of a cache, used to determine an appropriate capacity
+struct CacheStatistics
+{
+    /// Number of lookups that found a value in the cache
+    uint64_t Hits;
+
+    /// Number of lookups that did not find a value in the cache
+    uint64_t Misses;
+
+    /// Number of values currently stored in the cache
+    size_t Size;
+
+    /// Returns the fraction of lookups that were cache hits, between 0 and 1
+    double getHitRate() const
+    {
+        const uint64_t lookups = Hits + Misses;
+        return lookups > 0 ? static_cast<double>(Hits) / static_cast<double>(lookups) : 0.0;
+    }
+};
+
+/**
+ * @class ShardedLRUCache
+ * @brief A fixed-capacity least recently used cache with 64-bit hash keys, which may be used
+ *        from multiple threads at once. The keys are distributed over a number of shards, each
+ *        with its own lock and least recently used list, so that concurrent lookups rarely contend.
+ *        Lookups do not allocate memory.
+ */
+template <typename ValueType, std::size_t NumShards = 16>
+class ShardedLRUCache
+{
+    static_assert(NumShards > 0 && (NumShards & (NumShards - 1)) == 0, "ShardedLRUCache: the number of shards must be a power of two");
+
+    typedef typename std::pair<uint64_t, ValueType> Node;
+    typedef typename std::list<Node>::iterator ListIterator;
+
+    /// Independently locked portion of the cache
+    struct Shard
+    {
+        /// Guards the contents of the shard
+        std::mutex Mutex;
+
+        /// Key-value pairs, from most to least recently used
+        std::list<Node> List;
+
+        /// Hashmap of keys pointing to corresponding key-value pair iterators in the list
+        std::unordered_map<uint64_t, ListIterator> Map;
+
+        /// Number of successful lookups in the shard
+        uint64_t Hits { 0 };
+
+        /// Number of failed lookups in the shard
+        uint64_t Misses { 0 };
+    };
+
+public:
+    /// Constructs the cache with a given maximum capacity, which is divided evenly between the shards
+    explicit ShardedLRUCache(size_t maxSize) :
+        m_maxShardSize(maxSize / NumShards > 0 ? maxSize / NumShards : 1),
+        m_shards()
+    {
+        for (Shard &shard : m_shards)
+            shard.Map.reserve(m_maxShardSize + 1);
+    }
+
+    /// Searches for the value associated with the given key. If found, the value is copied into
+    /// the value parameter and true is returned. Otherwise, returns false
+    bool get(uint64_t key, ValueType &value)
+    {
+        Shard &shard = getShard(key);
+        std::lock_guard<std::mutex> lock(shard.Mutex);
+
+        auto it = shard.Map.find(key);
+        if (it == shard.Map.end())
+        {
+            ++shard.Misses;
+            return false;
+        }
+
+        ++shard.Hits;
+
+        // Move item to front of the list
+        shard.List.splice(shard.List.begin(), shard.List, it->second);
+
+        value = it->second->second;
+        return true;
+    }
+
+    /// Places the key-value pair into the front of the cache
+    void put(uint64_t key, const ValueType &value)
+    {
+        Shard &shard = getShard(key);
+        std::lock_guard<std::mutex> lock(shard.Mutex);
+
+        auto it = shard.Map.find(key);
+        if (it != shard.Map.end())
+        {
+            it->second->second = value;
+            shard.List.splice(shard.List.begin(), shard.List, it->second);
+            return;
+        }
+
+        // Reuse the least recently used node when the shard is full, rather than allocating a new one
+        if (shard.List.size() >= m_maxShardSize)
+        {
+            auto lruIt = std::prev(shard.List.end());
+            shard.Map.erase(lruIt->first);
+            lruIt->first = key;
+            lruIt->second = value;
+            shard.List.splice(shard.List.begin(), shard.List, lruIt);
+        }
+        else
+            shard.List.push_front({key, value});
+
+        shard.Map[key] = shard.List.begin();
+    }
+
+    /// Clears the cache. The hit and miss counters are preserved
+    void clear()
+    {
+        for (Shard &shard : m_shards)
+        {
+            std::lock_guard<std::mutex> lock(shard.Mutex);
+            shard.Map.clear();
+            shard.List.clear();
+        }
+    }
+
+    /// Returns the combined hit and miss counters of every shard
+    CacheStatistics getStatistics() const
+    {
+        CacheStatistics result { 0, 0, 0 };
+        for (Shard &shard : m_shards)
+        {
+            std::lock_guard<std::mutex> lock(shard.Mutex);
+            result.Hits += shard.Hits;
+            result.Misses += shard.Misses;
+            result.Size += shard.List.size();
+        }
+        return result;
+    }
+
+private:
+    /// Returns the shard that the given key belongs to
+    inline Shard &getShard(uint64_t key) const
+    {
+        // Use the high bits of the key, as the low bits also select the hashmap bucket within the shard
+        return m_shards[static_cast<std::size_t>(key >> 48) & (NumShards - 1)];
+    }
+
+private:
+    /// The maximum number of key-value pairs in each shard
+    size_t m_maxShardSize;
+
+    /// Shards of the cache
+    mutable std::array<Shard, NumShards> m_shards;
+};
+
+#endif // SHARDEDLRUCACHE_H
@@ -8,10 +8,6 @@ DatabaseWorker::DatabaseWorker(const QString &dbFile) :
     if (!m_database.isValid())
         qWarning() << "Unable to open database " << dbFile;
 
-    // Turn synchronous setting off
-    if (!m_database.execute("PRAGMA journal_mode=WAL"))
-        qWarning() << "In DatabaseWorker constructor - could not set journal mode.";
-
     // Foreign keys
     if (!m_database.execute("PRAGMA foreign_keys=\"1\""))
         qWarning() << "In DatabaseWorker constructor - could not enable foreign keys.";
@@ -26,9 +22,37 @@ bool DatabaseWorker::exec(const QString &queryString)
     return m_database.execute(queryString.toStdString());
 }
 
+bool DatabaseWorker::beginTransaction()
+{
+    return m_database.beginTransaction();
+}
+
+bool DatabaseWorker::commitTransaction()
+{
+    if (m_database.commitTransaction())
+        return true;
+
+    qWarning() << "DatabaseWorker::commitTransaction - " << QString::fromStdString(m_database.getLastError());
+    return false;
+}
+
+bool DatabaseWorker::rollbackTransaction()
+{
+    return m_database.rollbackTransaction();
+}
+
+bool DatabaseWorker::isInTransaction() const
+{
+    return m_database.isInTransaction();
+}
+
+void DatabaseWorker::onGroupedTransactionEnded(bool /*committed*/)
+{
+}
+
 bool DatabaseWorker::hasTable(const QString &tableName)
 {
-    sqlite::PreparedStatement stmt = m_database.prepare(R"(SELECT COUNT(*) FROM sqlite_master WHERE type = 'table' AND name = ?)");
+    sqlite::CachedStatement stmt = m_database.prepareCached(R"(SELECT COUNT(*) FROM sqlite_master WHERE type = 'table' AND name = ?)");
     stmt << tableName;
     if (stmt.next())
     {
@@ -26,6 +26,22 @@ class DatabaseWorker
     /// Executes the given query string, returning true on success, false on failure.
     bool exec(const QString &queryString);
 
+    /// Begins a transaction, returning true on success, false on failure. Transactions may be nested
+    bool beginTransaction();
+
+    /// Commits the innermost active transaction, returning true on success, false on failure.
+    bool commitTransaction();
+
+    /// Reverts the innermost active transaction, returning true on success, false on failure.
+    bool rollbackTransaction();
+
+    /// Returns true if a transaction is active on the database connection, false if else.
+    bool isInTransaction() const;
+
+    /// Called by the task scheduler after a transaction that grouped several tasks of the worker has ended. When the
+    /// transaction could not be committed, its changes were reverted, and the worker may queue their data again
+    virtual void onGroupedTransactionEnded(bool committed);
+
 protected:
     /// Returns true if the database contains the given table, false if else.
     bool hasTable(const QString &tableName);
@@ -7,23 +7,26 @@ sqlite::PreparedStatement &operator<<(sqlite::PreparedStatement &stmt, const QDa
     return stmt;
 }
 
+// Strings and byte arrays are bound straight from their own buffers. The input may be a
+// temporary, so SQLite is still asked to take its own copy of the data, but no intermediate
+// std::string is created along the way
+
 sqlite::PreparedStatement &operator<<(sqlite::PreparedStatement &stmt, const QString &input)
 {
-    const std::string temp = input.toStdString();
+    sqlite::Text16View temp { input.utf16(), input.size() * static_cast<int>(sizeof(QChar)) };
     stmt.read(temp, true);
     return stmt;
 }
 
 sqlite::PreparedStatement &operator<<(sqlite::PreparedStatement &stmt, const QUrl &input)
 {
-    const std::string temp = input.toString(QUrl::FullyEncoded).toStdString();
-    stmt.read(temp, true);
-    return stmt;
+    const QString url = input.toString(QUrl::FullyEncoded);
+    return stmt << url;
 }
 
 sqlite::PreparedStatement &operator<<(sqlite::PreparedStatement &stmt, const QByteArray &input)
 {
-    sqlite::Blob temp { input.toStdString() };
+    sqlite::BlobView temp { input.constData(), input.size() };
     stmt.read(temp, true);
     return stmt;
 }
@@ -36,26 +39,30 @@ sqlite::PreparedStatement &operator>>(sqlite::PreparedStatement &stmt, QDateTime
     return stmt;
 }
 
+// Column values are decoded directly from the buffers owned by SQLite. Text is read in the
+// UTF-8 encoding of the database files, which spares SQLite from converting each value to
+// UTF-16 before it is copied into the QString
+
 sqlite::PreparedStatement &operator>>(sqlite::PreparedStatement &stmt, QString &output)
 {
-    std::string temp;
+    sqlite::TextView temp { nullptr, 0 };
     stmt >> temp;
-    output = QString::fromStdString(temp);
+    output = QString::fromUtf8(temp.data, temp.size);
     return stmt;
 }
 
 sqlite::PreparedStatement &operator>>(sqlite::PreparedStatement &stmt, QUrl &output)
 {
-    std::string temp;
+    sqlite::TextView temp { nullptr, 0 };
     stmt >> temp;
-    output = QUrl(QString::fromStdString(temp));
+    output = QUrl(QString::fromUtf8(temp.data, temp.size));
     return stmt;
 }
 
 sqlite::PreparedStatement &operator>>(sqlite::PreparedStatement &stmt, QByteArray &output)
 {
-    sqlite::Blob temp;
+    sqlite::BlobView temp { nullptr, 0 };
     stmt >> temp;
-    output = QByteArray::fromStdString(temp.data);
+    output = QByteArray(static_cast<const char*>(temp.data), temp.size);
     return stmt;
 }
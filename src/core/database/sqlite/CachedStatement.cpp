@@ -0,0 +1,30 @@
+#include "CachedStatement.h"
+#include "Database.h"
+
+#include <utility>
+
+namespace sqlite
+{
+
+CachedStatement::CachedStatement(Badge<Database>, Database &database, const std::string &sql, PreparedStatement &&statement) :
+    PreparedStatement(std::move(statement)),
+    m_database{&database},
+    m_sql{sql}
+{
+}
+
+CachedStatement::CachedStatement(CachedStatement &&other) noexcept :
+    PreparedStatement(std::move(other)),
+    m_database{other.m_database},
+    m_sql{std::move(other.m_sql)}
+{
+    other.m_database = nullptr;
+}
+
+CachedStatement::~CachedStatement()
+{
+    if (m_database != nullptr && isValid())
+        m_database->releaseStatement({}, m_sql, std::move(*this));
+}
+
+}
@@ -0,0 +1,49 @@
+#ifndef _SQLITE_CACHED_STATEMENT_H_
+#define _SQLITE_CACHED_STATEMENT_H_
+
+#include "Badge.h"
+#include "PreparedStatement.h"
+
+#include <string>
+
+namespace sqlite
+{
+
+class Database;
+
+/**
+ * @class CachedStatement
+ * @brief A prepared statement that has been checked out of the statement cache
+ *        of a \ref Database . It is used in the same way as any other prepared
+ *        statement, and is returned to the cache when it goes out of scope.
+ *        A cached statement must not outlive the database that created it.
+ */
+class CachedStatement : public PreparedStatement
+{
+public:
+    /// Constructs the cached statement from a prepared statement and its SQL text. This may
+    /// only be called by the \ref Database class. Cached statements are generated by calling
+    /// Database.prepareCached(..)
+    CachedStatement(Badge<Database>, Database &database, const std::string &sql, PreparedStatement &&statement);
+
+    /// Move constructor
+    CachedStatement(CachedStatement &&other) noexcept;
+
+    /// Returns the statement to the cache of the database
+    ~CachedStatement();
+
+    CachedStatement(const CachedStatement&) = delete;
+    CachedStatement &operator=(const CachedStatement&) = delete;
+    CachedStatement &operator=(CachedStatement&&) = delete;
+
+private:
+    /// Database that the statement will be returned to
+    Database *m_database;
+
+    /// SQL text of the statement, which is its key in the statement cache
+    std::string m_sql;
+};
+
+}
+
+#endif // _SQLITE_CACHED_STATEMENT_H_
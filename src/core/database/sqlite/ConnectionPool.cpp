@@ -0,0 +1,131 @@
+#include "ConnectionPool.h"
+
+#include <unordered_map>
+#include <utility>
+
+namespace sqlite
+{
+
+ConnectionLease::ConnectionLease(Badge<ConnectionPool>, ConnectionPool &pool, std::unique_ptr<Database> &&connection) :
+    m_pool{&pool},
+    m_connection{std::move(connection)}
+{
+}
+
+ConnectionLease::ConnectionLease(ConnectionLease &&other) noexcept :
+    m_pool{other.m_pool},
+    m_connection{std::move(other.m_connection)}
+{
+    other.m_pool = nullptr;
+}
+
+ConnectionLease::~ConnectionLease()
+{
+    if (m_pool != nullptr && m_connection)
+        m_pool->release({}, std::move(m_connection));
+}
+
+ConnectionLease::operator bool() const
+{
+    return m_connection && m_connection->isValid();
+}
+
+Database &ConnectionLease::operator*() const
+{
+    return *m_connection;
+}
+
+Database *ConnectionLease::operator->() const
+{
+    return m_connection.get();
+}
+
+ConnectionPool::ConnectionPool(const std::string &fileName, std::size_t maxConnections) :
+    m_fileName{fileName},
+    m_maxConnections{maxConnections > 0 ? maxConnections : 1},
+    m_numConnections{0},
+    m_idleConnections{},
+    m_mutex{},
+    m_cv{}
+{
+}
+
+ConnectionPool::~ConnectionPool()
+{
+    std::unique_lock<std::mutex> lock{m_mutex};
+    m_cv.wait(lock, [this](){
+        return m_idleConnections.size() == m_numConnections;
+    });
+
+    m_idleConnections.clear();
+}
+
+std::shared_ptr<ConnectionPool> ConnectionPool::forFile(const std::string &fileName)
+{
+    static std::mutex registryMutex;
+    static std::unordered_map<std::string, std::weak_ptr<ConnectionPool>> registry;
+
+    std::lock_guard<std::mutex> lock{registryMutex};
+
+    std::weak_ptr<ConnectionPool> &entry = registry[fileName];
+    std::shared_ptr<ConnectionPool> pool = entry.lock();
+    if (!pool)
+    {
+        pool = std::make_shared<ConnectionPool>(fileName);
+        entry = pool;
+    }
+
+    return pool;
+}
+
+ConnectionLease ConnectionPool::acquire()
+{
+    std::unique_lock<std::mutex> lock{m_mutex};
+    m_cv.wait(lock, [this](){
+        return !m_idleConnections.empty() || m_numConnections < m_maxConnections;
+    });
+
+    if (!m_idleConnections.empty())
+    {
+        std::unique_ptr<Database> connection = std::move(m_idleConnections.back());
+        m_idleConnections.pop_back();
+        return ConnectionLease({}, *this, std::move(connection));
+    }
+
+    // Reserve the slot of the new connection, and let other threads use the pool while it is being opened
+    m_numConnections++;
+    lock.unlock();
+
+    return ConnectionLease({}, *this, std::make_unique<Database>(m_fileName, getReadOnlyProfile()));
+}
+
+void ConnectionPool::release(Badge<ConnectionLease>, std::unique_ptr<Database> &&connection)
+{
+    {
+        std::lock_guard<std::mutex> lock{m_mutex};
+
+        // Connections that could not be opened are discarded, so that a later lease may try again
+        if (connection->isValid())
+            m_idleConnections.push_back(std::move(connection));
+        else
+            m_numConnections--;
+    }
+
+    m_cv.notify_all();
+}
+
+const std::string &ConnectionPool::getFileName() const
+{
+    return m_fileName;
+}
+
+TuningProfile ConnectionPool::getReadOnlyProfile()
+{
+    TuningProfile profile;
+    profile.ReadOnly = true;
+    profile.CacheSizeKiB = 2048;
+    profile.MaintenanceInterval = 0;
+    return profile;
+}
+
+}
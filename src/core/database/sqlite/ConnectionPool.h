@@ -0,0 +1,126 @@
+#ifndef _SQLITE_CONNECTION_POOL_H_
+#define _SQLITE_CONNECTION_POOL_H_
+
+#include "Badge.h"
+#include "Database.h"
+
+#include <condition_variable>
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace sqlite
+{
+
+class ConnectionPool;
+
+/**
+ * @class ConnectionLease
+ * @brief Grants exclusive use of a read-only connection from a \ref ConnectionPool .
+ *        The connection is returned to the pool when the lease goes out of scope,
+ *        so any statements prepared with it must be destroyed before the lease.
+ */
+class ConnectionLease
+{
+public:
+    /// Constructs the lease of a connection. This may only be called by the \ref ConnectionPool class.
+    /// Leases are obtained by calling ConnectionPool.acquire()
+    ConnectionLease(Badge<ConnectionPool>, ConnectionPool &pool, std::unique_ptr<Database> &&connection);
+
+    /// Move constructor
+    ConnectionLease(ConnectionLease &&other) noexcept;
+
+    /// Returns the connection to its pool
+    ~ConnectionLease();
+
+    ConnectionLease(const ConnectionLease&) = delete;
+    ConnectionLease &operator=(const ConnectionLease&) = delete;
+    ConnectionLease &operator=(ConnectionLease&&) = delete;
+
+    /// Returns true if the lease holds a connection that was opened successfully, false otherwise
+    explicit operator bool() const;
+
+    /// Returns a reference to the leased connection
+    Database &operator*() const;
+
+    /// Returns a pointer to the leased connection
+    Database *operator->() const;
+
+private:
+    /// Pool that the connection will be returned to
+    ConnectionPool *m_pool;
+
+    /// Leased connection
+    std::unique_ptr<Database> m_connection;
+};
+
+/**
+ * @class ConnectionPool
+ * @brief Maintains a set of read-only connections to a single database file, which are
+ *        leased to any thread that needs to read from the database. Connections are opened
+ *        on demand, up to a maximum number, and are reused once their leases are released.
+ *
+ *        When the database is in WAL mode, readers on the pooled connections do not wait on
+ *        the connection that writes to the database, and each read transaction sees the
+ *        changes that were committed before it started.
+ */
+class ConnectionPool
+{
+public:
+    /// Default maximum number of connections opened by a pool
+    static constexpr std::size_t DefaultMaxConnections = 4;
+
+    ConnectionPool() = delete;
+    ConnectionPool(const ConnectionPool&) = delete;
+    ConnectionPool &operator=(const ConnectionPool&) = delete;
+
+    /// Constructs the pool of the given database file, which will open at most maxConnections connections
+    explicit ConnectionPool(const std::string &fileName, std::size_t maxConnections = DefaultMaxConnections);
+
+    /// Waits for all outstanding leases to be released, and closes the pooled connections
+    ~ConnectionPool();
+
+    /// Returns the connection pool of the given database file, creating it if there is no pool for the
+    /// file already. The pool is shared by all of its users, and closes once the last of them releases it
+    static std::shared_ptr<ConnectionPool> forFile(const std::string &fileName);
+
+    /// Leases a connection of the pool, waiting for another lease to be released if all of the
+    /// connections are in use
+    ConnectionLease acquire();
+
+    /// Returns the connection of a lease that has gone out of scope.
+    /// This may only be called by the \ref ConnectionLease class
+    void release(Badge<ConnectionLease>, std::unique_ptr<Database> &&connection);
+
+    /// Returns the name of the database file
+    const std::string &getFileName() const;
+
+private:
+    /// Returns the tuning profile of the pooled connections
+    static TuningProfile getReadOnlyProfile();
+
+private:
+    /// Name of the database file
+    std::string m_fileName;
+
+    /// Maximum number of connections that can be open at once
+    std::size_t m_maxConnections;
+
+    /// Number of connections that have been opened, including leased connections
+    std::size_t m_numConnections;
+
+    /// Connections that are not currently leased
+    std::vector<std::unique_ptr<Database>> m_idleConnections;
+
+    /// Mutex
+    std::mutex m_mutex;
+
+    /// Notified when a connection is returned to the pool
+    std::condition_variable m_cv;
+};
+
+}
+
+#endif // _SQLITE_CONNECTION_POOL_H_
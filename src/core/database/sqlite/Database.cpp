@@ -10,24 +10,43 @@
 namespace sqlite
 {
 
-Database::Database(const std::string &fileName) :
+Database::Database(const std::string &fileName, const TuningProfile &profile) :
     m_handle{nullptr},
     m_isHandleValid{false},
-    m_lastError{}
+    m_lastError{},
+    m_transactionDepth{0},
+    m_profile{profile},
+    m_numCommits{0},
+    m_statementCache{},
+    m_statementIndex{}
 {
     internal::Implementation::instance().init();
 
-    if (sqlite3_open_v2(fileName.c_str(), &m_handle, SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE, NULL) == SQLITE_OK)
+    const int openFlags = m_profile.ReadOnly ? SQLITE_OPEN_READONLY : (SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE);
+    if (sqlite3_open_v2(fileName.c_str(), &m_handle, openFlags, NULL) == SQLITE_OK)
     {
         m_isHandleValid = true;
         sqlite3_busy_handler(m_handle, internal::busyHandler, nullptr); 
+
+        applyTuningProfile();
     }
 }
 
 Database::~Database()
 {
+    // Statements must be finalized before the connection can be closed
+    m_statementIndex.clear();
+    m_statementCache.clear();
+
     if (m_isHandleValid && m_handle != nullptr)
     {
+        if (!m_profile.ReadOnly)
+        {
+            static constexpr char optimizeSql[] = "PRAGMA optimize";
+            execute(optimizeSql);
+        }
+
+        sqlite3_commit_hook(m_handle, nullptr, nullptr);
         sqlite3_close_v2(m_handle);
     }
 }
@@ -39,22 +58,68 @@ bool Database::isValid() const
 
 bool Database::beginTransaction()
 {
-    static constexpr char beginTransactionSql[] = "BEGIN TRANSACTION";
-    return execute(beginTransactionSql);
+    // SQLite may have ended the transaction on its own, such as after an I/O error
+    if (!isInTransaction())
+        m_transactionDepth = 0;
+
+    if (m_transactionDepth == 0)
+    {
+        static constexpr char beginTransactionSql[] = "BEGIN TRANSACTION";
+        if (!execute(beginTransactionSql))
+            return false;
+    }
+    else if (!execute("SAVEPOINT Nested_" + std::to_string(m_transactionDepth)))
+        return false;
+
+    ++m_transactionDepth;
+    return true;
 }
 
 bool Database::commitTransaction()
 {
+    if (m_transactionDepth > 1)
+    {
+        if (!execute("RELEASE SAVEPOINT Nested_" + std::to_string(m_transactionDepth - 1)))
+            return false;
+
+        --m_transactionDepth;
+        return true;
+    }
+
     static constexpr char commitTransactionSql[] = "COMMIT";
-    return execute(commitTransactionSql);
+    if (!execute(commitTransactionSql))
+        return false;
+
+    m_transactionDepth = 0;
+
+    if (m_profile.MaintenanceInterval > 0 && m_numCommits >= m_profile.MaintenanceInterval)
+        runMaintenance();
+
+    return true;
 }
 
 bool Database::rollbackTransaction()
 {
+    if (m_transactionDepth > 1 && isInTransaction())
+    {
+        const std::string savepoint = "Nested_" + std::to_string(m_transactionDepth - 1);
+        if (!execute("ROLLBACK TO SAVEPOINT " + savepoint) || !execute("RELEASE SAVEPOINT " + savepoint))
+            return false;
+
+        --m_transactionDepth;
+        return true;
+    }
+
     static constexpr char rollbackTransactionSql[] = "ROLLBACK";
+    m_transactionDepth = 0;
     return execute(rollbackTransactionSql);
 }
 
+bool Database::isInTransaction() const
+{
+    return isValid() && sqlite3_get_autocommit(m_handle) == 0;
+}
+
 bool Database::execute(const std::string &sql)
 {
     return execute(sql.c_str());
@@ -92,5 +157,89 @@ PreparedStatement Database::prepare(const char *sql, int nByte) const
     return PreparedStatement({}, m_handle, sql, nByte);
 }
 
+CachedStatement Database::prepareCached(const std::string &sql)
+{
+    auto it = m_statementIndex.find(sql);
+    if (it == m_statementIndex.end())
+        return CachedStatement({}, *this, sql, prepare(sql));
+
+    PreparedStatement statement = std::move(it->second->second);
+    m_statementCache.erase(it->second);
+    m_statementIndex.erase(it);
+
+    return CachedStatement({}, *this, sql, std::move(statement));
+}
+
+void Database::releaseStatement(Badge<CachedStatement>, const std::string &sql, PreparedStatement &&statement)
+{
+    // A statement that is not moved into the cache is finalized by its owner
+    if (m_profile.StatementCacheSize == 0 || m_statementIndex.find(sql) != m_statementIndex.end())
+        return;
+
+    statement.reset();
+
+    m_statementCache.emplace_front(sql, std::move(statement));
+    m_statementIndex[sql] = m_statementCache.begin();
+
+    if (m_statementCache.size() > m_profile.StatementCacheSize)
+    {
+        m_statementIndex.erase(m_statementCache.back().first);
+        m_statementCache.pop_back();
+    }
 }
 
+void Database::runMaintenance()
+{
+    m_numCommits = 0;
+
+    if (!isValid() || m_profile.ReadOnly)
+        return;
+
+    if (m_profile.WriteAheadLog)
+        sqlite3_wal_checkpoint_v2(m_handle, nullptr, SQLITE_CHECKPOINT_PASSIVE, nullptr, nullptr);
+
+    static constexpr char optimizeSql[] = "PRAGMA optimize";
+    execute(optimizeSql);
+
+    // Statistics gathered by the optimization are committed like any other change
+    m_numCommits = 0;
+}
+
+void Database::applyTuningProfile()
+{
+    if (m_profile.WriteAheadLog && !m_profile.ReadOnly)
+    {
+        // The journal mode that is in effect is returned by the statement. In-memory databases, for example, cannot use WAL
+        std::string journalMode;
+        PreparedStatement stmt = prepare("PRAGMA journal_mode=WAL");
+        if (stmt.next())
+            stmt >> journalMode;
+
+        if (journalMode.compare("wal") == 0)
+        {
+            static constexpr char synchronousSql[] = "PRAGMA synchronous=NORMAL";
+            execute(synchronousSql);
+        }
+    }
+
+    execute("PRAGMA cache_size=-" + std::to_string(m_profile.CacheSizeKiB));
+    execute("PRAGMA mmap_size=" + std::to_string(m_profile.MmapSize));
+
+    if (m_profile.TempStoreMemory)
+    {
+        static constexpr char tempStoreSql[] = "PRAGMA temp_store=MEMORY";
+        execute(tempStoreSql);
+    }
+
+    sqlite3_commit_hook(m_handle, &Database::onCommit, this);
+}
+
+int Database::onCommit(void *database)
+{
+    static_cast<Database*>(database)->m_numCommits++;
+
+    // A non-zero return value would turn the commit into a rollback
+    return 0;
+}
+
+}
@@ -1,14 +1,51 @@
 #ifndef _SQLITE_DATABASE_H_
 #define _SQLITE_DATABASE_H_
 
+#include "Badge.h"
+#include "CachedStatement.h"
+#include "PreparedStatement.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <list>
 #include <string>
+#include <unordered_map>
+#include <utility>
 
 struct sqlite3;
 
 namespace sqlite
 {
 
-class PreparedStatement;
+/**
+ * @struct TuningProfile
+ * @brief Connection settings that are applied by a \ref Database when it is opened
+ */
+struct TuningProfile
+{
+    /// Opens the connection in read-only mode. Read-only connections leave the journal mode of the
+    /// database as it is, and do not perform any maintenance
+    bool ReadOnly { false };
+
+    /// Switches the database to write-ahead logging. While it is in effect, the synchronous
+    /// mode is relaxed to NORMAL, which remains safe from corruption in WAL mode
+    bool WriteAheadLog { true };
+
+    /// Size of the page cache of the connection, in KiB
+    int CacheSizeKiB { 8192 };
+
+    /// Number of bytes of the database file that may be memory-mapped for reads, or 0 to disable memory-mapped I/O
+    std::int64_t MmapSize { 64 * 1024 * 1024 };
+
+    /// Keeps temporary tables and indices in memory instead of temporary files
+    bool TempStoreMemory { true };
+
+    /// Number of committed transactions between runs of runMaintenance(), or 0 to disable periodic maintenance
+    int MaintenanceInterval { 500 };
+
+    /// Maximum number of statements kept in the statement cache
+    std::size_t StatementCacheSize { 32 };
+};
 
 /**
  * @class Database
@@ -24,21 +61,27 @@ class Database
     Database &operator=(const Database&) = delete;
 
     /// Constructs the database with a given database file.
-    /// The connection is opened immediately in the constructor
-    explicit Database(const std::string &fileName);
+    /// The connection is opened immediately in the constructor, and configured with the given tuning profile
+    explicit Database(const std::string &fileName, const TuningProfile &profile = TuningProfile());
 
     /// Closes the database connection
     ~Database();
 
-    /// Attempts to begin a manual SQLite transaction, returning true on success, false otherwise
+    /// Attempts to begin a manual SQLite transaction, returning true on success, false otherwise.
+    /// Transactions may be nested - when a transaction is already active, a savepoint is created instead
     bool beginTransaction();
 
-    /// Attempts to commit a manual SQLite transaction, returning true on success, false otherwise
+    /// Attempts to commit a manual SQLite transaction, returning true on success, false otherwise.
+    /// Committing a nested transaction releases its savepoint into the enclosing transaction
     bool commitTransaction();
 
-    /// Attempts to revert a manual SQLite transaction, returning true on success, false otherwise
+    /// Attempts to revert a manual SQLite transaction, returning true on success, false otherwise.
+    /// Reverting a nested transaction only undoes the changes made since its savepoint
     bool rollbackTransaction();
 
+    /// Returns true if a transaction is active on the connection, false otherwise
+    bool isInTransaction() const;
+
     /// Executes the given statement, returning true on success, false otherwise
     bool execute(const std::string &sql);
 
@@ -66,6 +109,31 @@ class Database
      */
     PreparedStatement prepare(const char *sql, int nByte) const;
 
+    /**
+     * @brief Fetches the given SQL statement from the statement cache, preparing and adding it
+     *        to the cache if it is not already present. The statement is returned to the cache
+     *        when the \ref CachedStatement goes out of scope. If the same SQL is requested while
+     *        its cached statement is still in use, a separate statement is prepared.
+     * @param sql The SQL string to be prepared
+     * @return Cached statement object, with no bound parameters
+     */
+    CachedStatement prepareCached(const std::string &sql);
+
+    /// Returns a statement to the cache once its \ref CachedStatement has gone out of scope.
+    /// This may only be called by the \ref CachedStatement class
+    void releaseStatement(Badge<CachedStatement>, const std::string &sql, PreparedStatement &&statement);
+
+    /// Checkpoints the write-ahead log without blocking readers or writers, and lets SQLite
+    /// refresh the statistics that are used by the query planner
+    void runMaintenance();
+
+private:
+    /// Applies the settings of the tuning profile to the newly opened connection
+    void applyTuningProfile();
+
+    /// Counts the transactions committed on the connection
+    static int onCommit(void *database);
+
 private:
     /// Pointer to the database connection
     sqlite3 *m_handle;
@@ -75,6 +143,21 @@ class Database
 
     /// Contains any error message set from the last failing call to execute(const char*)
     std::string m_lastError;
+
+    /// Number of nested transactions begun through beginTransaction() that are still active
+    int m_transactionDepth;
+
+    /// Connection settings
+    TuningProfile m_profile;
+
+    /// Number of transactions committed since maintenance was last performed
+    int m_numCommits;
+
+    /// Cached statements and their SQL text, ordered from the most to the least recently used
+    std::list<std::pair<std::string, PreparedStatement>> m_statementCache;
+
+    /// Hashmap of SQL text to the corresponding entry in the statement cache
+    std::unordered_map<std::string, std::list<std::pair<std::string, PreparedStatement>>::iterator> m_statementIndex;
 };
 
 }
@@ -115,4 +115,9 @@ void PreparedStatement::reset()
     m_numCols = 0;
 }
 
+bool PreparedStatement::isValid() const
+{
+    return m_handle != nullptr;
+}
+
 }
@@ -6,6 +6,7 @@
 #include "Badge.h"
 #include "Blob.h"
 #include "Row.h"
+#include "View.h"
 
 #include <iostream>
 #include <string>
@@ -64,6 +65,9 @@ class PreparedStatement
     /// any bound parameters in the process.
     void reset();
 
+    /// Returns true if the statement was prepared successfully, false otherwise
+    bool isValid() const;
+
     template<class T>
     void bind(int index, const T &value, bool copyData = false)
     {
@@ -92,6 +96,21 @@ class PreparedStatement
             auto bindingType = copyData ? SQLITE_TRANSIENT : SQLITE_STATIC;
             sqlite3_bind_blob(m_handle, index, value.data.data(), value.data.size(), bindingType);
         }
+        else if constexpr (std::is_same_v<TextView, paramType>)
+        {
+            auto bindingType = copyData ? SQLITE_TRANSIENT : SQLITE_STATIC;
+            sqlite3_bind_text(m_handle, index, value.data, value.size, bindingType);
+        }
+        else if constexpr (std::is_same_v<Text16View, paramType>)
+        {
+            auto bindingType = copyData ? SQLITE_TRANSIENT : SQLITE_STATIC;
+            sqlite3_bind_text16(m_handle, index, value.data, value.size, bindingType);
+        }
+        else if constexpr (std::is_same_v<BlobView, paramType>)
+        {
+            auto bindingType = copyData ? SQLITE_TRANSIENT : SQLITE_STATIC;
+            sqlite3_bind_blob(m_handle, index, value.data, value.size, bindingType);
+        }
         else if constexpr (std::is_integral_v<paramType>)
         {
             sqlite3_bind_int64(m_handle, index, static_cast<sqlite3_int64>(value));
@@ -159,6 +178,30 @@ class PreparedStatement
 
             m_colIdx++;
         }
+        else if constexpr (std::is_same_v<TextView, paramType>)
+        {
+            const char *data = reinterpret_cast<const char*>(sqlite3_column_text(m_handle, m_colIdx));
+            output.size = sqlite3_column_bytes(m_handle, m_colIdx);
+            output.data = data != nullptr ? data : "";
+
+            m_colIdx++;
+        }
+        else if constexpr (std::is_same_v<Text16View, paramType>)
+        {
+            const void *data = sqlite3_column_text16(m_handle, m_colIdx);
+            output.size = sqlite3_column_bytes16(m_handle, m_colIdx);
+            output.data = data != nullptr ? data : u"";
+
+            m_colIdx++;
+        }
+        else if constexpr (std::is_same_v<BlobView, paramType>)
+        {
+            const void *data = sqlite3_column_blob(m_handle, m_colIdx);
+            output.size = sqlite3_column_bytes(m_handle, m_colIdx);
+            output.data = data != nullptr ? data : "";
+
+            m_colIdx++;
+        }
         else if constexpr (std::is_integral_v<paramType>)
         {
             if (sqlite3_column_type(m_handle, m_colIdx) == SQLITE_NULL)
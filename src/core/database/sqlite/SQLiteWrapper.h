@@ -6,8 +6,11 @@
 #include "Badge.h"
 #include "Blob.h"
 #include "Row.h"
+#include "View.h"
 #include "PreparedStatement.h"
+#include "CachedStatement.h"
 #include "Database.h"
+#include "ConnectionPool.h"
 
 #endif // _SQLITE_WRAPPER_H_
 
@@ -0,0 +1,38 @@
+#ifndef _SQLITE_VIEW_H_
+#define _SQLITE_VIEW_H_
+
+namespace sqlite
+{
+    /**
+     * Non-owning views of text and BLOB data. They let API consumers bind their own
+     * string and byte buffers, or read column values, without an intermediate std::string.
+     *
+     * When bound with copyData = false, the viewed buffer must outlive the execution of
+     * the statement. When written from a result set, the view is only valid until the
+     * statement advances to the next row, is reset or is destroyed. NULL values are
+     * written as an empty, non-null buffer.
+     */
+
+    /// View of UTF-8 encoded text, with the size given in bytes
+    struct TextView
+    {
+        const char *data;
+        int size;
+    };
+
+    /// View of UTF-16 encoded text in the native byte order, with the size given in bytes
+    struct Text16View
+    {
+        const void *data;
+        int size;
+    };
+
+    /// View of BLOB data, with the size given in bytes
+    struct BlobView
+    {
+        const void *data;
+        int size;
+    };
+}
+
+#endif // _SQLITE_VIEW_H_
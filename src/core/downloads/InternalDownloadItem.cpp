@@ -94,17 +94,18 @@ void InternalDownloadItem::onFinished()
 
     m_finished = true;
     const bool hadError = m_reply->error() != QNetworkReply::NoError;
-    if (!hadError && (m_file.size() == 0 || m_reply->isReadable()))
+    if (!hadError && (!m_file.isOpen() || m_reply->isReadable()))
     {
         onReadyRead();
     }
 
-    m_file.flush();
-    m_file.close();
-
-    if (!hadError)
+    if (!hadError && m_file.commit())
+    {
+        emit downloadFinished(QFileInfo(m_file.fileName()).absoluteFilePath());
+    }
+    else
     {
-        emit downloadFinished(QFileInfo(m_file).absoluteFilePath());
+        emit downloadFailed();
     }
 
     m_reply->deleteLater();
@@ -119,10 +120,11 @@ void InternalDownloadItem::onMetaDataChanged()
     m_reply->deleteLater();
     m_reply = sBrowserApplication->getNetworkAccessManager()->get(QNetworkRequest(locHeader.toUrl()));
 
+    // Discard the partial download, leaving any existing file at the destination untouched
     if (m_file.isOpen())
     {
-        m_file.close();
-        m_file.remove();
+        m_file.cancelWriting();
+        m_file.commit();
     }
 
     setupItem();
@@ -1,7 +1,7 @@
 #ifndef InternalDownloadItem_H
 #define InternalDownloadItem_H
 
-#include <QFile>
+#include <QSaveFile>
 #include <QNetworkReply>
 #include <QObject>
 
@@ -29,6 +29,9 @@ class InternalDownloadItem : public QObject
     /// Emitted when the download has successfully completed
     void downloadFinished(const QString &filePath);
 
+    /// Emitted when the download could not be completed
+    void downloadFailed();
+
 private Q_SLOTS:
     /// Called when the download is ready to be read onto the disk
     void onReadyRead();
@@ -65,8 +68,9 @@ private Q_SLOTS:
     /// Total number of bytes received
     qint64 m_bytesReceived;
 
-    /// File being written to on disk
-    QFile m_file;
+    /// File being written to on disk. The contents are written to a temporary file, which only replaces
+    /// the destination once the download completes, so that readers of an existing file never see it truncated
+    QSaveFile m_file;
 
     /// True if download is currently in progress
     bool m_inProgress;
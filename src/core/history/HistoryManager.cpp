@@ -5,12 +5,57 @@
 
 #include <algorithm>
 #include <array>
+#include <type_traits>
+#include <utility>
 
 #include <QDateTime>
+#include <QTimer>
 #include <QUrl>
 
 #include <QDebug>
 
+const std::string HistoryManager::StoreName = "HistoryStore";
+const std::string HistoryManager::ReaderName = "HistoryReader";
+
+template<class Read, class Callback>
+void HistoryManager::readHistory(Read &&read, Callback &&callback)
+{
+    using ResultType = std::invoke_result_t<Read, sqlite::Database&>;
+
+    if (!m_historyPool)
+    {
+        m_taskScheduler.postAndThen(StoreName, TaskPriority::Interactive, [this, read = std::forward<Read>(read)]() mutable {
+            return m_historyStore->read(read);
+        }, this, std::forward<Callback>(callback));
+        return;
+    }
+
+    // The read has its own queue, which does not wait on the tasks of the history store
+    auto readFromPool = [this, pool = m_historyPool, read = std::forward<Read>(read), callback = std::forward<Callback>(callback)]() mutable {
+        m_taskScheduler.postAndThen(ReaderName, TaskPriority::Interactive, [pool, read = std::move(read)]() mutable {
+            sqlite::ConnectionLease connection = pool->acquire();
+            if (!connection)
+                return ResultType();
+            return read(*connection);
+        }, this, std::move(callback));
+    };
+
+    if (m_readGeneration == m_writeGeneration)
+    {
+        readFromPool();
+        return;
+    }
+
+    // Changes that were posted to the history store, such as visits held in its current batch, are written first
+    const quint64 writeGeneration = m_writeGeneration;
+    m_taskScheduler.postAndThen(StoreName, TaskPriority::Interactive, [this](){
+        m_historyStore->flushVisits();
+    }, this, [this, writeGeneration, readFromPool = std::move(readFromPool)]() mutable {
+        m_readGeneration = std::max(m_readGeneration, writeGeneration);
+        readFromPool();
+    });
+}
+
 HistoryManager::HistoryManager(const ViperServiceLocator &serviceLocator, DatabaseTaskScheduler &taskScheduler) :
     QObject(nullptr),
     m_taskScheduler(taskScheduler),
@@ -18,24 +63,29 @@ HistoryManager::HistoryManager(const ViperServiceLocator &serviceLocator, Databa
     m_recentItems(),
     m_storagePolicy(HistoryStoragePolicy::Remember),
     m_historyStore(nullptr),
-    m_lastVisitId(0)
+    m_lastVisitId(0),
+    m_visitFlushScheduled(false),
+    m_historyPool(nullptr),
+    m_writeGeneration(0),
+    m_readGeneration(0)
 {
     setObjectName(QLatin1String("HistoryManager"));
 
     if (Settings *settings = serviceLocator.getServiceAs<Settings>("Settings"))
     {
         m_storagePolicy = static_cast<HistoryStoragePolicy>(settings->getValue(BrowserSetting::HistoryStoragePolicy).toInt());
+        setHistoryFile(settings->getPathValue(BrowserSetting::HistoryPath));
 
         connect(settings, &Settings::settingChanged, this, &HistoryManager::onSettingChanged);
     }
     else
         qWarning() << "Could not fetch application settings in history manager!";
 
-    m_taskScheduler.onInit([this](){
-        m_historyStore = static_cast<HistoryStore*>(m_taskScheduler.getWorker("HistoryStore"));
+    m_taskScheduler.onInit(StoreName, [this](){
+        m_historyStore = static_cast<HistoryStore*>(m_taskScheduler.getWorker(StoreName));
     });
 
-    m_taskScheduler.post([this](){
+    m_taskScheduler.post(StoreName, TaskPriority::Interactive, [this](){
         //onHistoryRecordsLoaded(m_historyStore->getEntries());
         onRecentItemsLoaded(m_historyStore->getRecentItems());
 
@@ -61,8 +111,9 @@ void HistoryManager::clearAllHistory()
 {
     m_recentItems.clear();
     m_historyItems.clear();
+    ++m_writeGeneration;
 
-    m_taskScheduler.post(&HistoryStore::clearAllHistory, std::ref(m_historyStore));
+    m_taskScheduler.post(StoreName, TaskPriority::Interactive, &HistoryStore::clearAllHistory, std::ref(m_historyStore));
 }
 
 void HistoryManager::clearHistoryFrom(const QDateTime &start)
@@ -72,7 +123,8 @@ void HistoryManager::clearHistoryFrom(const QDateTime &start)
 
 void HistoryManager::clearHistoryInRange(std::pair<QDateTime, QDateTime> range)
 {
-    m_taskScheduler.post([this, range](){
+    ++m_writeGeneration;
+    m_taskScheduler.post(StoreName, TaskPriority::Interactive, [this, range](){
         m_recentItems.clear();
 
         m_historyStore->clearHistoryInRange(range);
@@ -115,8 +167,19 @@ void HistoryManager::addVisit(const QUrl &url, const QString &title, const QDate
             || url.toString(QUrl::FullyEncoded).startsWith(QLatin1String("data:"), Qt::CaseInsensitive))
         return;
 
-    m_taskScheduler.post(&HistoryStore::addVisit, std::ref(m_historyStore), QUrl(url), QString(title),
+    m_taskScheduler.post(StoreName, TaskPriority::Interactive, &HistoryStore::addVisit, std::ref(m_historyStore), QUrl(url), QString(title),
                          QDateTime(visitTime), QUrl(requestedUrl), wasTypedByUser);
+    ++m_writeGeneration;
+
+    // The history store writes visits in batches. Make sure that a partial batch is not kept in memory for long
+    if (!m_visitFlushScheduled)
+    {
+        m_visitFlushScheduled = true;
+        QTimer::singleShot(2000, this, [this](){
+            m_visitFlushScheduled = false;
+            flushVisits();
+        });
+    }
 
     if (!CommonUtil::doUrlsMatch(requestedUrl, url))
     {
@@ -163,25 +226,50 @@ void HistoryManager::addVisitToLocalStore(const QUrl &url, const QString &title,
     }
 }
 
+void HistoryManager::setHistoryFile(const QString &historyDbFile)
+{
+    if (historyDbFile.isEmpty())
+        m_historyPool.reset();
+    else
+        m_historyPool = sqlite::ConnectionPool::forFile(historyDbFile.toStdString());
+}
+
+void HistoryManager::flushVisits()
+{
+    m_taskScheduler.postKeyed(StoreName, TaskPriority::Background, "FlushVisits", &HistoryStore::flushVisits, std::ref(m_historyStore));
+}
+
 void HistoryManager::getHistoryBetween(const QDateTime &startDate, const QDateTime &endDate, std::function<void(std::vector<URLRecord>)> callback)
 {
-    m_taskScheduler.post([this, startDate, endDate, callback](){
-        callback(m_historyStore->getHistoryBetween(startDate, endDate));
-    });
+    m_taskScheduler.postAndThen(StoreName, TaskPriority::Interactive, [this, startDate, endDate](){
+        return m_historyStore->getHistoryBetween(startDate, endDate);
+    }, this, callback);
 }
 
 void HistoryManager::getHistoryFrom(const QDateTime &startDate, std::function<void(std::vector<URLRecord>)> callback)
 {
-    m_taskScheduler.post([this, startDate, callback](){
-        callback(m_historyStore->getHistoryFrom(startDate));
+    m_taskScheduler.postAndThen(StoreName, TaskPriority::Interactive, [this, startDate](){
+        return m_historyStore->getHistoryFrom(startDate);
+    }, this, callback);
+}
+
+void HistoryManager::getHistoryPage(const QDateTime &startDate, const HistoryPosition &position, int limit,
+                                    std::function<void(std::vector<URLRecord>, HistoryPosition)> callback)
+{
+    readHistory([startDate, position, limit](sqlite::Database &connection){
+        HistoryPosition nextPosition = position;
+        std::vector<URLRecord> records = HistoryStore::readHistoryPage(connection, startDate, nextPosition, limit);
+        return std::make_pair(std::move(records), nextPosition);
+    }, [callback](std::pair<std::vector<URLRecord>, HistoryPosition> page){
+        callback(std::move(page.first), page.second);
     });
 }
 
 void HistoryManager::contains(const QUrl &url, std::function<void(bool)> callback)
 {
-    m_taskScheduler.post([this, url, callback](){
-        callback(m_historyStore->contains(url));
-    });
+    m_taskScheduler.postAndThen(StoreName, TaskPriority::Interactive, [this, url](){
+        return m_historyStore->contains(url);
+    }, this, callback);
 }
 
 HistoryEntry HistoryManager::getEntry(const QUrl &url) const
@@ -197,9 +285,9 @@ HistoryEntry HistoryManager::getEntry(const QUrl &url) const
 
 void HistoryManager::getTimesVisitedHost(const QUrl &host, std::function<void(int)> callback)
 {
-    m_taskScheduler.post([this, host, callback](){
-        callback(m_historyStore->getTimesVisitedHost(host));
-    });
+    m_taskScheduler.postAndThen(StoreName, TaskPriority::Interactive, [this, host](){
+        return m_historyStore->getTimesVisitedHost(host);
+    }, this, callback);
 }
 
 HistoryStoragePolicy HistoryManager::getStoragePolicy() const
@@ -238,21 +326,7 @@ void HistoryManager::onHistoryRecordsLoaded(std::vector<URLRecord> &&records)
 
 void HistoryManager::loadMostVisitedEntries(int limit, std::function<void(std::vector<WebPageInformation>)> callback)
 {
-    m_taskScheduler.post([this, limit, callback](){
-        callback(m_historyStore->loadMostVisitedEntries(limit));
-    });
-}
-
-void HistoryManager::loadWordDatabase(std::function<void(std::map<int, QString>)> callback)
-{
-    m_taskScheduler.post([this, callback](){
-        callback(m_historyStore->getWords());
-    });
-}
-
-void HistoryManager::loadHistoryWordMapping(std::function<void(std::map<int, std::vector<int>>)> callback)
-{
-    m_taskScheduler.post([this, callback](){
-        callback(m_historyStore->getEntryWordMapping());
-    });
+    readHistory([limit](sqlite::Database &connection){
+        return HistoryStore::readMostVisitedEntries(connection, limit);
+    }, callback);
 }
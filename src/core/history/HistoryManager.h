@@ -17,11 +17,17 @@
 #include <QUrl>
 
 #include <deque>
+#include <memory>
 #include <unordered_map>
 #include <vector>
 
 class HistoryStore;
 
+namespace sqlite
+{
+    class ConnectionPool;
+}
+
 /// Available policies for storage of browsing history data
 enum class HistoryStoragePolicy
 {
@@ -34,7 +40,13 @@ Q_DECLARE_METATYPE(HistoryStoragePolicy)
 
 /**
  * @class HistoryManager
- * @brief Maintains the state of the browsing history that belongs to a user profile
+ * @brief Maintains the state of the browsing history that belongs to a user profile.
+ *        Queries of the history database run in the background, and their callbacks are
+ *        invoked in the thread of the history manager once the result is ready.
+ *
+ *        Pages of the history and the most visited entries are read with pooled read-only
+ *        connections, so that they do not wait on the writes of the history store. Changes
+ *        that are still queued in the history store are written before such a read.
  */
 class HistoryManager : public QObject, public ISettingsObserver
 {
@@ -69,6 +81,14 @@ class HistoryManager : public QObject, public ISettingsObserver
     /// Adds an entry to the history data store, given the URL, page title, time of visit, and the requested URL
     void addVisit(const QUrl &url, const QString &title, const QDateTime &visitTime, const QUrl &requestedUrl, bool wasTypedByUser);
 
+    /// Specifies which history database file is read with pooled connections. If not set, the history
+    /// manager will use the application settings to get the value
+    void setHistoryFile(const QString &historyDbFile);
+
+    /// Writes the visits that the history store is holding in its current batch to the database. Batches are
+    /// otherwise written once they are full, or shortly after the first visit in the batch was added
+    void flushVisits();
+
     /// Loads a list of all \ref URLRecord visited between the given start date and end dates, passing them on to
     /// the callback once the data has been fetched
     void getHistoryBetween(const QDateTime &startDate, const QDateTime &endDate, std::function<void(std::vector<URLRecord>)> callback);
@@ -77,6 +97,11 @@ class HistoryManager : public QObject, public ISettingsObserver
     /// the callback once the data has been fetched
     void getHistoryFrom(const QDateTime &startDate, std::function<void(std::vector<URLRecord>)> callback);
 
+    /// Loads a page of up to the given number of visits, made from the start date up to the given position, from the most recent
+    /// to the oldest. Passes the entries visited in the page to the callback, along with the position of the next page
+    void getHistoryPage(const QDateTime &startDate, const HistoryPosition &position, int limit,
+                        std::function<void(std::vector<URLRecord>, HistoryPosition)> callback);
+
     /// Checks if the given URL is contained in the history database, passing the result as a boolean
     /// in the given callback function
     void contains(const QUrl &url, std::function<void(bool)> callback);
@@ -102,13 +127,6 @@ class HistoryManager : public QObject, public ISettingsObserver
     /// determine which web pages' thumbnails to retrieve for the "New Tab" page
     void loadMostVisitedEntries(int limit, std::function<void(std::vector<WebPageInformation>)> callback);
 
-    /// Loads the word table into a map, returning the data in the callback function. Used by the
-    /// URL suggestion worker when recommending matches based on user input
-    void loadWordDatabase(std::function<void(std::map<int, QString>)> callback);
-
-    /// Loads a mapping of history entries to the lists of their corresponding words
-    void loadHistoryWordMapping(std::function<void(std::map<int, std::vector<int>>)> callback);
-
 Q_SIGNALS:
     /// Emitted when a page has been visited
     void pageVisited(const QUrl &url, const QString &title);
@@ -124,6 +142,11 @@ private Q_SLOTS:
     /// Adds the history visit to the in-memory history store.
     void addVisitToLocalStore(const QUrl &url, const QString &title, const QDateTime &visitTime, bool wasTypedByUser);
 
+    /// Invokes the read function with a pooled connection to the history database, passing its result to the callback
+    /// in the thread of the history manager. Falls back to the queue of the history store if there is no connection pool
+    template<class Read, class Callback>
+    void readHistory(Read &&read, Callback &&callback);
+
     /// Handles the recent history record load event - called during instantiation of the \ref HistoryStore
     void onRecentItemsLoaded(std::deque<HistoryEntry> &&entries);
 
@@ -131,6 +154,12 @@ private Q_SLOTS:
     void onHistoryRecordsLoaded(std::vector<URLRecord> &&records);
 
 private:
+    /// Name of the \ref HistoryStore worker, which identifies its queue in the task scheduler
+    const static std::string StoreName;
+
+    /// Name of the task queue that reads the history database with pooled connections
+    const static std::string ReaderName;
+
     /// Reference to the task scheduler. Needed to queue work for the \ref HistoryStore
     DatabaseTaskScheduler &m_taskScheduler;
 
@@ -148,6 +177,19 @@ private Q_SLOTS:
 
     /// Unique id of the most recent entry in the database
     uint64_t m_lastVisitId;
+
+    /// True if the history store has been asked to write its queued visits to the database, and has yet to do so
+    bool m_visitFlushScheduled;
+
+    /// Read-only connections to the history database, or a nullptr if the location of the database is unknown
+    std::shared_ptr<sqlite::ConnectionPool> m_historyPool;
+
+    /// Incremented each time a change to the browsing history is posted to the history store
+    quint64 m_writeGeneration;
+
+    /// Value of m_writeGeneration when the history store last wrote every change that was posted before it.
+    /// Pooled connections only see the changes up to this point
+    quint64 m_readGeneration;
 };
 
 #endif // HISTORYMANAGER_H
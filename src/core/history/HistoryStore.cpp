@@ -1,30 +1,35 @@
 #include "CommonUtil.h"
 #include "HistoryStore.h"
 
+#include <algorithm>
+
 #include <QDateTime>
+#include <QHash>
 #include <QUrl>
 #include <QDebug>
 
 HistoryStore::HistoryStore(const QString &databaseFile) :
     DatabaseWorker(databaseFile),
     m_lastVisitID(0),
-    m_statements()
+    m_statements(),
+    m_pendingVisits(),
+    m_uncommittedVisits(),
+    m_uncommittedLastVisitID(0)
 {
     m_database.execute("PRAGMA foreign_keys=\"0\"");
 }
 
 HistoryStore::~HistoryStore()
 {
+    flushVisits();
+
     m_statements.clear();
 }
 
 void HistoryStore::clearAllHistory()
 {
-    if (!exec(QLatin1String("DELETE FROM URLWords")))
-        qWarning() << "In HistoryStore::clearAllHistory - Unable to clear History Word Mapping table.";
-
-    if (!exec(QLatin1String("DELETE FROM Words")))
-        qWarning() << "In HistoryStore::clearAllHistory - Unable to clear History Word table.";
+    // Visits that have yet to be saved are discarded along with the rest of the history
+    m_pendingVisits.clear();
 
     if (!exec(QLatin1String("DELETE FROM History")))
         qWarning() << "In HistoryStore::clearAllHistory - Unable to clear History table.";
@@ -35,35 +40,48 @@ void HistoryStore::clearAllHistory()
 
 void HistoryStore::clearHistoryFrom(const QDateTime &start)
 {
+    flushVisits();
+
     auto stmt = m_database.prepare(R"(DELETE FROM Visits WHERE Date >= ?)");
     stmt << start;
     if (!stmt.execute())
         qWarning() << "In HistoryStore::clearHistoryFrom - Unable to clear history.";
 
-    if (!m_database.execute("DELETE FROM History WHERE VisitID NOT IN (SELECT DISTINCT VisitID FROM Visits)"))
+    if (!m_database.execute("DELETE FROM History WHERE VisitCount = 0"))
         qWarning() << "In HistoryStore::clearHistoryFrom - Unable to clear history.";
 }
 
 void HistoryStore::clearHistoryInRange(std::pair<QDateTime, QDateTime> range)
 {
+    flushVisits();
+
     auto stmt = m_database.prepare(R"(DELETE FROM Visits WHERE Date >= ? AND Date <= ?)");
     stmt << range.first
          << range.second;
     if (!stmt.execute())
         qWarning() << "In HistoryStore::clearHistoryInRange - Unable to clear history.";
 
-    if (!m_database.execute("DELETE FROM History WHERE VisitID NOT IN (SELECT DISTINCT VisitID FROM Visits)"))
+    if (!m_database.execute("DELETE FROM History WHERE VisitCount = 0"))
         qWarning() << "In HistoryStore::clearHistoryInRange - Unable to clear history. ";
 }
 
-bool HistoryStore::contains(const QUrl &url) const
+bool HistoryStore::contains(const QUrl &url)
 {
-    auto stmt = m_database.prepare(R"(SELECT VisitID FROM History WHERE URL = ?)");
+    flushVisits();
+
+    auto stmt = m_database.prepareCached(R"(SELECT VisitID FROM History WHERE URL = ?)");
     stmt << url;
     return stmt.next();
 }
 
 HistoryEntry HistoryStore::getEntry(const QUrl &url)
+{
+    flushVisits();
+
+    return findEntry(url);
+}
+
+HistoryEntry HistoryStore::findEntry(const QUrl &url)
 {
     HistoryEntry result;
     result.URL = url;
@@ -80,9 +98,11 @@ HistoryEntry HistoryStore::getEntry(const QUrl &url)
 
 std::vector<VisitEntry> HistoryStore::getVisits(const HistoryEntry &record)
 {
+    flushVisits();
+
     std::vector<VisitEntry> result;
 
-    auto stmt = m_database.prepare(R"(SELECT Date FROM Visits WHERE VisitID = ? ORDER BY Date ASC)");
+    auto stmt = m_database.prepareCached(R"(SELECT Date FROM Visits WHERE VisitID = ? ORDER BY Date ASC)");
     stmt << record.VisitID;
     while (stmt.next())
     {
@@ -96,6 +116,8 @@ std::vector<VisitEntry> HistoryStore::getVisits(const HistoryEntry &record)
 
 std::deque<HistoryEntry> HistoryStore::getRecentItems()
 {
+    flushVisits();
+
     std::deque<HistoryEntry> result;
 
     auto stmt = m_database.prepare(R"(SELECT Visits.VisitID, History.URL, History.Title,
@@ -113,69 +135,111 @@ std::deque<HistoryEntry> HistoryStore::getRecentItems()
     return result;
 }
 
-std::vector<URLRecord> HistoryStore::getHistoryFrom(const QDateTime &startDate) const
+std::vector<URLRecord> HistoryStore::getHistoryFrom(const QDateTime &startDate)
 {
     return getHistoryBetween(startDate, QDateTime::currentDateTime());
 }
 
-std::vector<URLRecord> HistoryStore::getHistoryBetween(const QDateTime &startDate, const QDateTime &endDate) const
+std::vector<URLRecord> HistoryStore::getHistoryBetween(const QDateTime &startDate, const QDateTime &endDate)
 {
+    flushVisits();
+
     std::vector<URLRecord> result;
 
     if (!startDate.isValid() || !endDate.isValid())
         return result;
 
-    auto queryVisitIds = m_database.prepare(R"(SELECT DISTINCT VisitID FROM Visits WHERE Date >= ? AND Date <= ?
-                                            ORDER BY Date ASC)");
-    auto queryHistoryItem = m_database.prepare(R"(SELECT URL, Title, URLTypedCount FROM History WHERE VisitID = ?)");
-    auto queryVisitDates = m_database.prepare(R"(SELECT Date FROM Visits WHERE VisitID = ?
-                                              AND Date >= ? AND Date <= ? ORDER BY Date ASC)");
+    sqlite::PreparedStatement &stmt = m_statements.at(Statement::GetHistoryBetween);
+    stmt.reset();
+    stmt << startDate
+         << endDate;
 
-    queryVisitIds << startDate
-                  << endDate;
-    while (queryVisitIds.next())
-    {
-        int visitId = 0;
-        queryVisitIds >> visitId;
+    readVisits(stmt, result);
+    return result;
+}
+
+std::vector<URLRecord> HistoryStore::getHistoryPage(const QDateTime &startDate, HistoryPosition &position, int limit)
+{
+    flushVisits();
+    return readHistoryPage(m_database, startDate, position, limit);
+}
+
+std::vector<URLRecord> HistoryStore::readHistoryPage(sqlite::Database &connection, const QDateTime &startDate, HistoryPosition &position, int limit)
+{
+    std::vector<URLRecord> result;
+
+    if (!startDate.isValid() || !position.VisitTime.isValid() || limit <= 0)
+        return result;
+
+    auto stmt = connection.prepareCached(R"(SELECT V.VisitID, H.URL, H.Title, H.URLTypedCount, V.Date
+                                         FROM Visits AS V INDEXED BY Visit_Date_ID_Index
+                                         INNER JOIN History AS H ON H.VisitID = V.VisitID
+                                         WHERE V.Date >= ? AND V.Date <= ? AND (V.Date < ? OR V.VisitID < ?)
+                                         ORDER BY V.Date DESC, V.VisitID DESC LIMIT ?)");
+    stmt << startDate
+         << position.VisitTime
+         << position.VisitTime
+         << position.VisitID
+         << limit;
+
+    const HistoryPosition lastPosition = readVisits(stmt, result);
+    if (result.empty())
+        return result;
+
+    position = lastPosition;
+
+    // Visits are read from the most recent to the oldest, while the visits of a record are kept in chronological order
+    for (URLRecord &record : result)
+        std::reverse(record.m_visits.begin(), record.m_visits.end());
+
+    return result;
+}
+
+HistoryPosition HistoryStore::readVisits(sqlite::PreparedStatement &stmt, std::vector<URLRecord> &records)
+{
+    HistoryPosition position { QDateTime(), -1 };
 
-        queryHistoryItem.reset();
-        queryHistoryItem << visitId;
-        if (!queryHistoryItem.execute() || !queryHistoryItem.next())
-            continue;
+    // Index of each history entry in the list of records
+    QHash<int, std::size_t> recordIndices;
 
+    while (stmt.next())
+    {
         HistoryEntry entry;
-        entry.VisitID = visitId;
-        queryHistoryItem >> entry.URL
-                         >> entry.Title
-                         >> entry.URLTypedCount;
-
-        std::vector<VisitEntry> visits;
-        queryVisitDates.reset();
-        queryVisitDates << visitId
-                        << startDate
-                        << endDate;
-        while (queryVisitDates.next())
+        stmt >> entry.VisitID
+             >> entry.URL
+             >> entry.Title
+             >> entry.URLTypedCount
+             >> position.VisitTime;
+        position.VisitID = entry.VisitID;
+
+        auto it = recordIndices.find(entry.VisitID);
+        if (it == recordIndices.end())
         {
-            QDateTime temp = QDateTime();
-            queryVisitDates >> temp;
-            visits.push_back(temp);
+            it = recordIndices.insert(entry.VisitID, records.size());
+
+            entry.LastVisit = position.VisitTime;
+            records.push_back(URLRecord{ std::move(entry) });
         }
 
-        entry.LastVisit = visits.at(visits.size() - 1);
-        entry.NumVisits = static_cast<int>(visits.size());
-        result.push_back( URLRecord{ std::move(entry), std::move(visits) } );
+        records.at(*it).addVisit(position.VisitTime);
     }
 
-    return result;
+    return position;
 }
 
-int HistoryStore::getTimesVisitedHost(const QUrl &url) const
+int HistoryStore::getTimesVisitedHost(const QUrl &url)
 {
-    auto query = m_database.prepare(R"(SELECT COUNT(NumVisits) FROM (SELECT VisitID, COUNT(VisitID) AS NumVisits
-                                    FROM Visits INDEXED BY Visit_ID_Index GROUP BY VisitID ) WHERE VisitID IN (SELECT VisitID FROM History
-                                    WHERE URL LIKE ?))");
-    std::string param = QString("%%1%").arg(url.host().remove(QRegularExpression("^www\\.")).toLower()).toStdString();
-    query << param;
+    flushVisits();
+
+    const QString host = url.host().remove(QRegularExpression("^www\\.")).toLower();
+    if (host.isEmpty())
+        return 0;
+
+    // Match the host as a phrase within the URL column of the search index
+    auto query = m_database.prepareCached(R"(SELECT COUNT(H.VisitID) FROM HistorySearch
+                                          INNER JOIN History AS H ON H.VisitID = HistorySearch.rowid
+                                          WHERE HistorySearch MATCH ? AND H.VisitCount > 0)");
+    query << QString("URL : \"%1\"").arg(host);
     if (query.next())
     {
         int numVisits = 0;
@@ -186,115 +250,122 @@ int HistoryStore::getTimesVisitedHost(const QUrl &url) const
     return 0;
 }
 
-int HistoryStore::getTimesVisited(const QUrl &url) const
+int HistoryStore::getTimesVisited(const QUrl &url)
 {
-    auto query = m_database.prepare(R"(SELECT h.VisitID, v.NumVisits FROM History AS h
-                                    INNER JOIN (SELECT VisitID, COUNT(VisitID) AS NumVisits
-                                    FROM Visits INDEXED BY Visit_ID_Index GROUP BY VisitID) AS v
-                                    ON h.VisitID = v.VisitID WHERE h.URL = ?)");
+    flushVisits();
+
+    auto query = m_database.prepareCached(R"(SELECT VisitCount FROM History WHERE URL = ?)");
     query << url;
     if (query.next())
     {
-        int visitId = 0,
-            numVisits = 0;
-        query >> visitId
-              >> numVisits;
+        int numVisits = 0;
+        query >> numVisits;
         return numVisits;
     }
 
     return 0;
 }
 
-std::map<int, QString> HistoryStore::getWords() const
+void HistoryStore::addVisit(const QUrl &url, const QString &title, const QDateTime &visitTime, const QUrl &requestedUrl, bool wasTypedByUser)
 {
-    std::map<int, QString> result;
+    if (url.toString(QUrl::FullyEncoded).startsWith(QStringLiteral("data:")))
+        return;
+
+    m_pendingVisits.push_back({ url, title, visitTime, wasTypedByUser });
 
-    auto stmt = m_database.prepare(R"(SELECT WordID, Word FROM Words ORDER BY WordID ASC)");
-    if (stmt.execute())
+    if (!CommonUtil::doUrlsMatch(url, requestedUrl, true)
+            && !requestedUrl.toString(QUrl::FullyEncoded).startsWith(QStringLiteral("data:")))
     {
-        while (stmt.next())
-        {
-            int wordId = 0;
-            QString word;
+        QDateTime requestDateTime = visitTime.addMSecs(-100);
+        if (!requestDateTime.isValid())
+            requestDateTime = visitTime;
 
-            stmt >> wordId
-                 >> word;
-            result.insert(std::make_pair(wordId, word));
-        }
+        m_pendingVisits.push_back({ requestedUrl, title, requestDateTime, wasTypedByUser });
     }
 
-    return result;
+    if (m_pendingVisits.size() >= VisitBatchSize)
+        flushVisits();
 }
 
-std::map<int, std::vector<int>> HistoryStore::getEntryWordMapping() const
+void HistoryStore::flushVisits()
 {
-    std::map<int, std::vector<int>> result;
+    if (m_pendingVisits.empty())
+        return;
+
+    std::vector<PendingVisit> visits;
+    visits.swap(m_pendingVisits);
 
-    auto queryDistinctHistoryId = m_database.prepare(R"(SELECT DISTINCT(HistoryID) FROM URLWords ORDER BY HistoryID ASC)");
-    auto queryHistoryWordMapping =
-            m_database.prepare(R"(SELECT WordID FROM URLWords WHERE HistoryID = ?)");
+    // Each statement would otherwise be committed in a transaction of its own
+    const bool inTransaction = m_database.beginTransaction();
+    const uint64_t lastVisitId = m_lastVisitID;
 
-    while (queryDistinctHistoryId.next())
+    for (const PendingVisit &visit : visits)
+        saveVisit(visit);
+
+    if (inTransaction && !m_database.commitTransaction())
     {
-        int historyId = 0;
-        queryDistinctHistoryId >> historyId;
-        //queryDistinctHistoryId.value(0).toInt();
-
-        std::vector<int> wordIds;
-        queryHistoryWordMapping.reset();
-        queryHistoryWordMapping << historyId;
-        while (queryHistoryWordMapping.next())
-        {
-            int wordId = 0;
-            queryHistoryWordMapping >> wordId;
-            wordIds.push_back(wordId);
-        }
+        qWarning() << "HistoryStore::flushVisits - could not commit visits to database. Message: "
+                   << QString::fromStdString(m_database.getLastError());
+        m_database.rollbackTransaction();
 
-        if (!wordIds.empty())
-            result.insert(std::make_pair(historyId, wordIds));
+        // Nothing from the batch was written, so its visits are kept ahead of any newer visits for the next flush
+        m_lastVisitID = lastVisitId;
+        m_pendingVisits.insert(m_pendingVisits.begin(), visits.begin(), visits.end());
+    }
+    else if (m_database.isInTransaction())
+    {
+        // The batch was written within a transaction of the task scheduler, which may still fail to be committed
+        if (m_uncommittedVisits.empty())
+            m_uncommittedLastVisitID = lastVisitId;
+        m_uncommittedVisits.insert(m_uncommittedVisits.end(), visits.begin(), visits.end());
     }
-
-    return result;
 }
 
-void HistoryStore::addVisit(const QUrl &url, const QString &title, const QDateTime &visitTime, const QUrl &requestedUrl, bool wasTypedByUser)
+void HistoryStore::onGroupedTransactionEnded(bool committed)
 {
-    if (url.toString(QUrl::FullyEncoded).startsWith(QStringLiteral("data:")))
-        return;
+    if (!committed && !m_uncommittedVisits.empty())
+    {
+        m_lastVisitID = m_uncommittedLastVisitID;
+        m_pendingVisits.insert(m_pendingVisits.begin(), m_uncommittedVisits.begin(), m_uncommittedVisits.end());
+    }
 
-    auto existingEntry = getEntry(url);
+    m_uncommittedVisits.clear();
+}
+
+void HistoryStore::saveVisit(const PendingVisit &visit)
+{
+    auto existingEntry = findEntry(visit.URL);
     qulonglong visitId = existingEntry.VisitID >= 0 ? static_cast<qulonglong>(existingEntry.VisitID) : ++m_lastVisitID;
     if (existingEntry.VisitID >= 0)
     {
-        if (wasTypedByUser)
+        if (visit.WasTypedByUser)
             existingEntry.URLTypedCount++;
 
-        existingEntry.Title = title;
+        existingEntry.Title = visit.Title;
 
+        // The visit count and time of the last visit are updated by the triggers on the visit table
         sqlite::PreparedStatement &stmtUpdate = m_statements.at(Statement::UpdateHistoryRecord);
         stmtUpdate.reset();
-        stmtUpdate << existingEntry;
+        stmtUpdate << existingEntry.Title
+                   << existingEntry.URLTypedCount
+                   << existingEntry.VisitID;
 
         if (!stmtUpdate.execute())
             qWarning() << "HistoryStore::addVisit - could not save entry to database.";
-
-        tokenizeAndSaveUrl(static_cast<int>(visitId), url, title);
     }
     else
     {
-        const int urlTypedCount = wasTypedByUser ? 1 : 0;
+        const int urlTypedCount = visit.WasTypedByUser ? 1 : 0;
 
         sqlite::PreparedStatement &stmtNew = m_statements.at(Statement::CreateHistoryRecord);
         stmtNew.reset();
 
         stmtNew << visitId
-                << url
-                << title
+                << visit.URL
+                << visit.Title
                 << urlTypedCount;
 
-        if (stmtNew.execute())
-            tokenizeAndSaveUrl(static_cast<int>(visitId), url, title);
-        else
+        if (!stmtNew.execute())
             qWarning() << "HistoryStore::addVisit - could not save entry to database.";
     }
 
@@ -302,19 +373,10 @@ void HistoryStore::addVisit(const QUrl &url, const QString &title, const QDateTi
     stmtVisit.reset();
 
     stmtVisit << visitId
-              << visitTime;
+              << visit.VisitTime;
 
     if (!stmtVisit.execute())
         qWarning() << "HistoryStore::addVisit - could not save visit to database.";
-
-    if (!CommonUtil::doUrlsMatch(url, requestedUrl, true))
-    {
-        QDateTime requestDateTime = visitTime.addMSecs(-100);
-        if (!requestDateTime.isValid())
-            requestDateTime = visitTime;
-
-        addVisit(requestedUrl, title, requestDateTime, requestedUrl, wasTypedByUser);
-    }
 }
 
 uint64_t HistoryStore::getLastVisitId() const
@@ -322,30 +384,6 @@ uint64_t HistoryStore::getLastVisitId() const
     return m_lastVisitID;
 }
 
-void HistoryStore::tokenizeAndSaveUrl(int visitId, const QUrl &url, const QString &title)
-{
-    QStringList urlWords = CommonUtil::tokenizePossibleUrl(url.toString().toUpper());
-
-    if (!title.startsWith(QLatin1String("http"), Qt::CaseInsensitive))
-        urlWords = urlWords + title.toUpper().split(QLatin1Char(' '), QStringSplitFlag::SkipEmptyParts);
-
-    sqlite::PreparedStatement &stmtInsertWord = m_statements.at(Statement::CreateWordRecord);
-    sqlite::PreparedStatement &stmtAssociateWord = m_statements.at(Statement::CreateUrlWordRecord);
-
-    for (const QString &word : qAsConst(urlWords))
-    {
-        stmtInsertWord.reset();
-        stmtAssociateWord.reset();
-
-        stmtInsertWord << word;
-        stmtInsertWord.execute();
-
-        stmtAssociateWord << visitId
-                          << word;
-        stmtAssociateWord.execute();
-    }
-}
-
 bool HistoryStore::hasProperStructure()
 {
     // Verify existence of Visits and History tables
@@ -355,7 +393,7 @@ bool HistoryStore::hasProperStructure()
 void HistoryStore::setup()
 {
     if (!exec(QLatin1String("CREATE TABLE IF NOT EXISTS History(VisitID INTEGER PRIMARY KEY AUTOINCREMENT, URL TEXT UNIQUE NOT NULL, Title TEXT, "
-                                  "URLTypedCount INTEGER DEFAULT 0)")))
+                                  "URLTypedCount INTEGER DEFAULT 0, VisitCount INTEGER NOT NULL DEFAULT 0, LastVisit INTEGER NOT NULL DEFAULT 0)")))
     {
         qWarning() << "In HistoryStore::setup - unable to create history table.";
     }
@@ -366,32 +404,72 @@ void HistoryStore::setup()
         qWarning() << "In HistoryStore::setup - unable to create visit table.";
     }
 
-    if (!exec(QLatin1String("CREATE TABLE IF NOT EXISTS Words(WordID INTEGER PRIMARY KEY AUTOINCREMENT, Word TEXT NOT NULL, UNIQUE (Word))")))
-    {
-        qWarning() << "In HistoryStore::setup - unable to create words table.";
-    }
+    createSearchIndex();
+}
 
-    if (!exec(QLatin1String("CREATE TABLE IF NOT EXISTS URLWords(HistoryID INTEGER NOT NULL, WordID INTEGER NOT NULL, "
-                                  "FOREIGN KEY(HistoryID) REFERENCES History(VisitID) ON DELETE CASCADE, "
-                                  "FOREIGN KEY(WordID) REFERENCES Words(WordID) ON DELETE CASCADE, PRIMARY KEY(HistoryID, WordID))")))
+void HistoryStore::createSearchIndex()
+{
+    // The index refers to the contents of the history table instead of holding a copy of each URL and title.
+    // Older versions of SQLite do not have the trigram tokenizer, in which case words and their prefixes are indexed
+    const bool hasIndex =
+            exec(QLatin1String("CREATE VIRTUAL TABLE IF NOT EXISTS HistorySearch USING fts5(URL, Title, "
+                               "content='History', content_rowid='VisitID', tokenize='trigram')"))
+            || exec(QLatin1String("CREATE VIRTUAL TABLE IF NOT EXISTS HistorySearch USING fts5(URL, Title, "
+                                  "content='History', content_rowid='VisitID', prefix='2 3 4')"));
+    if (!hasIndex)
     {
-        qWarning() << "In HistoryStore::setup - unable to create url-word association table.";
+        qWarning() << "In HistoryStore::createSearchIndex - unable to create history search table.";
+        return;
     }
+
+    if (!exec(QLatin1String("CREATE TRIGGER IF NOT EXISTS History_Search_Insert_Trigger AFTER INSERT ON History BEGIN "
+                            "INSERT INTO HistorySearch(rowid, URL, Title) VALUES (NEW.VisitID, NEW.URL, NEW.Title); END")))
+        qWarning() << "In HistoryStore::createSearchIndex - unable to create history search insertion trigger.";
+
+    if (!exec(QLatin1String("CREATE TRIGGER IF NOT EXISTS History_Search_Delete_Trigger AFTER DELETE ON History BEGIN "
+                            "INSERT INTO HistorySearch(HistorySearch, rowid, URL, Title) VALUES ('delete', OLD.VisitID, OLD.URL, OLD.Title); END")))
+        qWarning() << "In HistoryStore::createSearchIndex - unable to create history search deletion trigger.";
+
+    if (!exec(QLatin1String("CREATE TRIGGER IF NOT EXISTS History_Search_Update_Trigger AFTER UPDATE OF URL, Title ON History BEGIN "
+                            "INSERT INTO HistorySearch(HistorySearch, rowid, URL, Title) VALUES ('delete', OLD.VisitID, OLD.URL, OLD.Title); "
+                            "INSERT INTO HistorySearch(rowid, URL, Title) VALUES (NEW.VisitID, NEW.URL, NEW.Title); END")))
+        qWarning() << "In HistoryStore::createSearchIndex - unable to create history search update trigger.";
 }
 
 void HistoryStore::load()
 {
-    purgeOldEntries();
     checkForUpdate();
 
     if (!exec(QLatin1String("CREATE INDEX IF NOT EXISTS Visit_ID_Index ON Visits(VisitID)")))
         qWarning() << "In HistoryStore::load - unable to create index on the visit ID column of the visit table.";
 
-    if (!exec(QLatin1String("CREATE INDEX IF NOT EXISTS Visit_Date_Index ON Visits(Date)")))
+    // The visit ID is part of the date index so that the history can be paged through in the order of the index
+    if (!exec(QLatin1String("DROP INDEX IF EXISTS Visit_Date_Index")))
+        qWarning() << "In HistoryStore::load - unable to remove the previous index on the date column of the visit table.";
+
+    if (!exec(QLatin1String("CREATE INDEX IF NOT EXISTS Visit_Date_ID_Index ON Visits(Date, VisitID)")))
         qWarning() << "In HistoryStore::load - unable to create index on the date column of the visit table.";
 
-    if (!exec(QLatin1String("CREATE INDEX IF NOT EXISTS Word_Index ON Words(Word)")))
-        qWarning() << "In HistoryStore::load - unable to create index on the word column of the words table.";
+    if (!exec(QLatin1String("CREATE INDEX IF NOT EXISTS History_Visit_Count_Index ON History(VisitCount)")))
+        qWarning() << "In HistoryStore::load - unable to create index on the visit count column of the history table.";
+
+    if (!exec(QLatin1String("CREATE INDEX IF NOT EXISTS History_Last_Visit_Index ON History(LastVisit)")))
+        qWarning() << "In HistoryStore::load - unable to create index on the last visit column of the history table.";
+
+    // Keep the visit count and time of the most recent visit of each history entry up to date
+    if (!exec(QLatin1String("CREATE TRIGGER IF NOT EXISTS Visit_Insert_Trigger AFTER INSERT ON Visits BEGIN "
+                            "UPDATE History SET VisitCount = VisitCount + 1, LastVisit = MAX(LastVisit, NEW.Date) "
+                            "WHERE VisitID = NEW.VisitID; END")))
+        qWarning() << "In HistoryStore::load - unable to create visit insertion trigger.";
+
+    if (!exec(QLatin1String("CREATE TRIGGER IF NOT EXISTS Visit_Delete_Trigger AFTER DELETE ON Visits BEGIN "
+                            "UPDATE History SET VisitCount = VisitCount - 1, "
+                            "LastVisit = IFNULL((SELECT MAX(Date) FROM Visits WHERE VisitID = OLD.VisitID), 0) "
+                            "WHERE VisitID = OLD.VisitID; END")))
+        qWarning() << "In HistoryStore::load - unable to create visit deletion trigger.";
+
+    // Purge after the triggers exist, so that the visit counts of the remaining entries stay accurate
+    purgeOldEntries();
 
     // Create and cache our prepared statements
     auto cacheStatement = [this](Statement statement, const std::string &sql) {
@@ -399,16 +477,14 @@ void HistoryStore::load()
     };
 
     cacheStatement(Statement::CreateHistoryRecord, R"(INSERT INTO History(VisitID, URL, Title, URLTypedCount) VALUES(?, ?, ?, ?))");
-    cacheStatement(Statement::UpdateHistoryRecord, R"(INSERT OR REPLACE INTO History(VisitID, URL, Title, URLTypedCount) VALUES(?, ?, ?, ?))");
+    cacheStatement(Statement::UpdateHistoryRecord, R"(UPDATE History SET Title = ?, URLTypedCount = ? WHERE VisitID = ?)");
     cacheStatement(Statement::CreateVisitRecord, R"(INSERT INTO Visits(VisitID, Date) VALUES (?, ?))");
-    cacheStatement(Statement::CreateWordRecord, R"(INSERT OR IGNORE INTO Words(Word) VALUES (?))");
-    cacheStatement(Statement::CreateUrlWordRecord, R"(INSERT OR IGNORE INTO URLWords(HistoryID, WordID) VALUES (?, (SELECT WordID FROM Words WHERE Word = ?)))");
-    cacheStatement(Statement::GetHistoryRecord, "SELECT History.VisitID, History.URL, History.Title, History.URLTypedCount, V.NumVisits, "
-                                                " V.RecentVisit FROM History INNER JOIN"
-                                                " (SELECT VisitID, MAX(Date) AS RecentVisit, COUNT(Date) AS NumVisits "
-                                                " FROM Visits INDEXED BY Visit_ID_Index GROUP BY VisitID) AS V"
-                                                " ON History.VisitID = V.VisitID "
-                                                " WHERE History.URL = ?");
+    cacheStatement(Statement::GetHistoryRecord, R"(SELECT VisitID, URL, Title, URLTypedCount, VisitCount, LastVisit FROM History WHERE URL = ?)");
+    cacheStatement(Statement::GetHistoryBetween, R"(SELECT V.VisitID, H.URL, H.Title, H.URLTypedCount, V.Date
+                                                 FROM Visits AS V INDEXED BY Visit_Date_ID_Index
+                                                 INNER JOIN History AS H ON H.VisitID = V.VisitID
+                                                 WHERE V.Date >= ? AND V.Date <= ?
+                                                 ORDER BY V.Date ASC)");
 
     auto stmt = m_database.prepare(R"(SELECT MAX(VisitID) FROM History)");
     if (stmt.next())
@@ -417,13 +493,31 @@ void HistoryStore::load()
 
 void HistoryStore::checkForUpdate()
 {
+    // Replace the word tables of older versions with the full-text search index
+    if (!hasTable(QLatin1String("HistorySearch")))
+    {
+        createSearchIndex();
+
+        if (!hasTable(QLatin1String("HistorySearch")))
+            qDebug() << "Error creating the history search index";
+        else if (!exec(QLatin1String("INSERT INTO HistorySearch(HistorySearch) VALUES ('rebuild')")))
+            qDebug() << "Error indexing existing history entries for search";
+    }
+
+    // The word tables are kept until the search index exists to replace them
+    if (hasTable(QLatin1String("URLWords")) && hasTable(QLatin1String("HistorySearch")))
+    {
+        if (!exec(QLatin1String("DROP TABLE URLWords")) || !exec(QLatin1String("DROP TABLE IF EXISTS Words")))
+            qDebug() << "Error removing history word tables";
+    }
+
     // Check if table structure needs update before loading
     auto stmt = m_database.prepare(R"(PRAGMA table_info(History))");
     if (!stmt.execute())
         return;
 
-    bool hasUrlTypeCountColumn = false;
-    const QString urlTypeCountColumn("URLTypedCount");
+    bool hasUrlTypeCountColumn = false, hasVisitCountColumn = false, hasLastVisitColumn = false;
+    const QString urlTypeCountColumn("URLTypedCount"), visitCountColumn("VisitCount"), lastVisitColumn("LastVisit");
 
     while (stmt.next())
     {
@@ -434,10 +528,11 @@ void HistoryStore::checkForUpdate()
              >> colName;
 
         if (colName.compare(urlTypeCountColumn) == 0)
-        {
             hasUrlTypeCountColumn = true;
-            break;
-        }
+        else if (colName.compare(visitCountColumn) == 0)
+            hasVisitCountColumn = true;
+        else if (colName.compare(lastVisitColumn) == 0)
+            hasLastVisitColumn = true;
     }
 
     if (!hasUrlTypeCountColumn)
@@ -445,6 +540,21 @@ void HistoryStore::checkForUpdate()
         if (!exec(QLatin1String("ALTER TABLE History ADD URLTypedCount INTEGER DEFAULT 0")))
             qDebug() << "Error updating history table with url typed count column";
     }
+
+    if (hasVisitCountColumn && hasLastVisitColumn)
+        return;
+
+    if (!hasVisitCountColumn && !exec(QLatin1String("ALTER TABLE History ADD VisitCount INTEGER NOT NULL DEFAULT 0")))
+        qDebug() << "Error updating history table with visit count column";
+
+    if (!hasLastVisitColumn && !exec(QLatin1String("ALTER TABLE History ADD LastVisit INTEGER NOT NULL DEFAULT 0")))
+        qDebug() << "Error updating history table with last visit column";
+
+    // Fill in the new columns from the visits that were recorded before they existed
+    if (!exec(QLatin1String("UPDATE History SET "
+                            "VisitCount = (SELECT COUNT(Date) FROM Visits WHERE Visits.VisitID = History.VisitID), "
+                            "LastVisit = IFNULL((SELECT MAX(Date) FROM Visits WHERE Visits.VisitID = History.VisitID), 0)")))
+        qDebug() << "Error computing visit counts of history entries";
 }
 
 void HistoryStore::purgeOldEntries()
@@ -463,28 +573,30 @@ void HistoryStore::purgeOldEntries()
             qWarning() << "HistoryStore - Could not purge old history entries.";
         }
 
-        if (!m_database.execute(R"(DELETE FROM History WHERE VisitID NOT IN (SELECT VisitID FROM Visits);)"))
+        if (!m_database.execute(R"(DELETE FROM History WHERE VisitCount = 0;)"))
             qWarning() << "HistoryStore - Error purging unused history entries. Message: " << QString::fromStdString(m_database.getLastError());
     }
 }
 
 std::vector<WebPageInformation> HistoryStore::loadMostVisitedEntries(int limit)
+{
+    flushVisits();
+    return readMostVisitedEntries(m_database, limit);
+}
+
+std::vector<WebPageInformation> HistoryStore::readMostVisitedEntries(sqlite::Database &connection, int limit)
 {
     std::vector<WebPageInformation> result;
     if (limit <= 0)
         return result;
 
     auto stmt =
-            m_database.prepare(R"(SELECT v.VisitID, COUNT(v.VisitID) AS NumVisits, h.URL, h.Title
-                               FROM Visits AS v
-                               JOIN History AS h
-                                 ON v.VisitID = h.VisitID
-                               GROUP BY v.VisitID
-                               ORDER BY NumVisits DESC LIMIT ?)");
+            connection.prepareCached(R"(SELECT VisitID, VisitCount, URL, Title FROM History
+                                     WHERE VisitCount > 0 ORDER BY VisitCount DESC LIMIT ?)");
     stmt << limit;
     if (!stmt.execute())
     {
-        qWarning() << "In HistoryStore::loadMostVisitedEntries - unable to load most frequently visited entries.";
+        qWarning() << "In HistoryStore::readMostVisitedEntries - unable to load most frequently visited entries.";
         return result;
     }
 
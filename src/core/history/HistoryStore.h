@@ -16,6 +16,7 @@
 
 #include <deque>
 #include <map>
+#include <type_traits>
 #include <vector>
 
 /**
@@ -31,12 +32,30 @@ class HistoryStore : public DatabaseWorker
         CreateHistoryRecord,  /// INSERT OR REPLACE INTO History(VisitID, URL, Title, URLTypedCount) VALUES(?, ?, ?, ?)
         UpdateHistoryRecord,  /// UPDATE History SET Title = ?, URLTypedCount = ? WHERE VisitID = ?
         CreateVisitRecord,    /// INSERT INTO Visits(VisitID, Date) VALUES (?, ?)
-        CreateWordRecord,     /// INSERT OR IGNORE INTO Words(Word) VALUES(?)
-        CreateUrlWordRecord,  /// INSERT OR IGNORE INTO URLWords(HistoryID, WordID) VALUES(?, (SELECT WordID FROM Words WHERE Word = ?))
-        GetHistoryRecord      /// SELECT History.VisitID, History.URL, History.Title, History.URLTypedCount, V.NumVisits, ...
+        GetHistoryRecord,     /// SELECT VisitID, URL, Title, URLTypedCount, VisitCount, LastVisit FROM History WHERE URL = ?
+        GetHistoryBetween     /// SELECT V.VisitID, H.URL, H.Title, H.URLTypedCount, V.Date FROM Visits AS V INNER JOIN History AS H ...
+    };
+
+    /// A visit that has been added to the history store, but has not yet been written to the database
+    struct PendingVisit
+    {
+        /// URL of the visited page
+        QUrl URL;
+
+        /// Title of the visited page
+        QString Title;
+
+        /// Time of the visit
+        QDateTime VisitTime;
+
+        /// True if the URL was typed by the user, false if else
+        bool WasTypedByUser;
     };
 
 public:
+    /// Number of pending visits at which they are written to the database, without waiting for a call to \ref HistoryStore::flushVisits
+    static constexpr std::size_t VisitBatchSize = 32;
+
     /// Constructs the history manager, given the path to the history database
     explicit HistoryStore(const QString &databaseFile);
 
@@ -54,7 +73,7 @@ class HistoryStore : public DatabaseWorker
 
     /// Returns true if the history contains the given url, false if else. Will return
     /// false if private browsing mode is enabled
-    bool contains(const QUrl &url) const;
+    bool contains(const QUrl &url);
 
     /// Returns a history record corresponding to the given URL, or an empty record if it was not found in the
     /// database
@@ -67,33 +86,63 @@ class HistoryStore : public DatabaseWorker
     std::deque<HistoryEntry> getRecentItems();
 
     /// Loads and returns a list of all \ref HistoryEntry items visited from the given start date to the present
-    std::vector<URLRecord> getHistoryFrom(const QDateTime &startDate) const;
+    std::vector<URLRecord> getHistoryFrom(const QDateTime &startDate);
 
     /// Loads and returns a list of all \ref HistoryEntry items visited between the given start date and end dates
-    std::vector<URLRecord> getHistoryBetween(const QDateTime &startDate, const QDateTime &endDate) const;
+    std::vector<URLRecord> getHistoryBetween(const QDateTime &startDate, const QDateTime &endDate);
+
+    /**
+     * @brief Loads a page of the browsing history, from the most recent visit to the oldest
+     * @param startDate Date of the oldest visits to be loaded
+     * @param position Position of the last visit that was loaded by the previous call, or a position after the most recent visit
+     *                 to load the first page. Set to the position of the oldest visit in the page
+     * @param limit Maximum number of visits in the page
+     * @return The entries visited in the page, along with their visits in the page. Empty once every visit has been loaded
+     */
+    std::vector<URLRecord> getHistoryPage(const QDateTime &startDate, HistoryPosition &position, int limit);
 
     /// Returns the number of times the user has visited the given website by its hostname
-    int getTimesVisitedHost(const QUrl &url) const;
+    int getTimesVisitedHost(const QUrl &url);
 
     /// Returns the number of times that the given URL has been visited
-    int getTimesVisited(const QUrl &url) const;
-
-    /// Returns all of the words stored in the words table
-    std::map<int, QString> getWords() const;
-
-    /// Returns a mapping of history entries to the list of word IDs associated with them
-    std::map<int, std::vector<int>> getEntryWordMapping() const;
+    int getTimesVisited(const QUrl &url);
 
     /// Fetches the set of most frequently visited web pages, up to the given limit. This is used to
     /// determine which web pages' thumbnails to retrieve for the "New Tab" page
     std::vector<WebPageInformation> loadMostVisitedEntries(int limit = 10);
 
-    /// Adds an entry to the history data store, given the URL, page title, time of visit, and the requested URL
+    /// Loads a page of the browsing history with the given connection, which may be a read-only connection to the history
+    /// database that is used by another thread. Visits that are pending in the history store are not included.
+    /// See \ref HistoryStore::getHistoryPage for a description of the parameters
+    static std::vector<URLRecord> readHistoryPage(sqlite::Database &connection, const QDateTime &startDate, HistoryPosition &position, int limit);
+
+    /// Fetches the set of most frequently visited web pages with the given connection, which may be a read-only connection
+    /// to the history database that is used by another thread. Visits that are pending in the history store are not included
+    static std::vector<WebPageInformation> readMostVisitedEntries(sqlite::Database &connection, int limit);
+
+    /// Writes the pending visits to the database, then invokes the given function with the connection of the history store
+    template<class Fn>
+    std::invoke_result_t<Fn, sqlite::Database&> read(Fn &&fn)
+    {
+        flushVisits();
+        return fn(m_database);
+    }
+
+    /// Adds an entry to the history data store, given the URL, page title, time of visit, and the requested URL.
+    /// The visit is queued, and written to the database along with other visits in a single transaction once
+    /// enough visits have been queued, when \ref HistoryStore::flushVisits is called, or before the history is read
     void addVisit(const QUrl &url, const QString &title, const QDateTime &visitTime, const QUrl &requestedUrl, bool wasTypedByUser);
 
+    /// Writes all pending visits to the database, in a single transaction
+    void flushVisits();
+
     /// Returns the last unique id of an entry in the visit database. This is an auto-incrementing value
     uint64_t getLastVisitId() const;
 
+    /// Queues the visits that were written within a transaction of the task scheduler to be written again,
+    /// if that transaction could not be committed
+    void onGroupedTransactionEnded(bool committed) override;
+
 protected:
     /// Returns true if the history database contains the table structures needed for it to function properly,
     /// false if else.
@@ -106,8 +155,19 @@ class HistoryStore : public DatabaseWorker
     void load() override;
 
 private:
-    /// Splits the given URL into distinct words, saving the association in the database
-    void tokenizeAndSaveUrl(int visitId, const QUrl &url, const QString &title);
+    /// Returns the history record of the given URL, without writing pending visits to the database first
+    HistoryEntry findEntry(const QUrl &url);
+
+    /// Writes a single visit to the database. Called by \ref HistoryStore::flushVisits within its transaction
+    void saveVisit(const PendingVisit &visit);
+
+    /// Reads the visits returned by a history query, one row per visit, and groups them by their history entries. The entries
+    /// are ordered by their first visit in the result. Returns the position of the last visit that was read
+    static HistoryPosition readVisits(sqlite::PreparedStatement &stmt, std::vector<URLRecord> &records);
+
+    /// Creates the full-text search index of the URLs and titles in the history table, along with the triggers
+    /// that keep it up to date. Uses the trigram tokenizer when it is available, for substring matches
+    void createSearchIndex();
 
     /// Called during the load() routine, this checks if any of the table structures need to be updated
     void checkForUpdate();
@@ -121,6 +181,15 @@ class HistoryStore : public DatabaseWorker
 
     /// Cache of prepared statements
     std::map<Statement, sqlite::PreparedStatement> m_statements;
+
+    /// Visits that have not yet been written to the database
+    std::vector<PendingVisit> m_pendingVisits;
+
+    /// Visits that have been written within a transaction of the task scheduler that has yet to be committed
+    std::vector<PendingVisit> m_uncommittedVisits;
+
+    /// Last visit ID from before the first of the uncommitted visits was written
+    uint64_t m_uncommittedLastVisitID;
 };
 
 #endif // HISTORYSTORE_H
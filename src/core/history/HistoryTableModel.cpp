@@ -2,14 +2,20 @@
 #include "HistoryManager.h"
 #include "FaviconManager.h"
 
+#include <limits>
 #include <utility>
 
+#include <QPointer>
+
 HistoryTableModel::HistoryTableModel(const ViperServiceLocator &serviceLocator, QObject *parent) :
     QAbstractTableModel(parent),
     m_historyManager(serviceLocator.getServiceAs<HistoryManager>("HistoryManager")),
     m_faviconManager(serviceLocator.getServiceAs<FaviconManager>("FaviconManager")),
     m_targetDate(),
-    m_loadedDate(),
+    m_loadedPosition { QDateTime(), 0 },
+    m_hasMoreHistory(false),
+    m_isFetching(false),
+    m_loadGeneration(0),
     m_commonData(),
     m_history()
 {
@@ -52,24 +58,35 @@ int HistoryTableModel::columnCount(const QModelIndex &parent) const
 
 bool HistoryTableModel::canFetchMore(const QModelIndex &/*parent*/) const
 {
-    return m_targetDate < m_loadedDate;
+    return m_hasMoreHistory && !m_isFetching;
 }
 
 void HistoryTableModel::fetchMore(const QModelIndex &/*parent*/)
 {
-    qint64 daysLeft = m_targetDate.daysTo(m_loadedDate);
-    if (daysLeft <= 0)
-    {
-        m_loadedDate = m_targetDate;
+    // The view may ask for more rows before the previous page has been received
+    if (!m_hasMoreHistory || m_isFetching)
         return;
-    }
-    m_historyManager->getHistoryBetween(m_loadedDate.addDays(-1), m_loadedDate,
-                                    std::bind(&HistoryTableModel::onHistoryFetched, this, std::placeholders::_1));
+
+    m_isFetching = true;
+
+    // Pages requested before the model was last reset belong to another target date, and are discarded
+    QPointer<HistoryTableModel> model(this);
+    const quint64 generation = m_loadGeneration;
+    m_historyManager->getHistoryPage(m_targetDate, m_loadedPosition, HistoryPageSize,
+                                     [model, generation](std::vector<URLRecord> entries, HistoryPosition position){
+        if (!model.isNull() && model->m_loadGeneration == generation)
+            model->onHistoryFetched(std::move(entries), position);
+    });
 }
 
-void HistoryTableModel::onHistoryFetched(std::vector<URLRecord> &&entries)
+void HistoryTableModel::onHistoryFetched(std::vector<URLRecord> &&entries, HistoryPosition position)
 {
-    QDateTime nextLoadedDate = m_loadedDate.addDays(-1);
+    if (entries.empty())
+    {
+        m_hasMoreHistory = false;
+        m_isFetching = false;
+        return;
+    }
 
     QMap<qint64, int> tmpVisitInfo; // Used to sort visits by date
     for (auto &it : entries)
@@ -107,8 +124,10 @@ void HistoryTableModel::onHistoryFetched(std::vector<URLRecord> &&entries)
         m_history.push_back(row);
     }
 
-    m_loadedDate = nextLoadedDate;
+    m_loadedPosition = position;
     endInsertRows();
+
+    m_isFetching = false;
 }
 
 QVariant HistoryTableModel::data(const QModelIndex &index, int role) const
@@ -151,9 +170,14 @@ void HistoryTableModel::loadFromDate(const QDateTime &date)
     beginResetModel();
     m_targetDate = date;
 
-    // Set loaded date to a time in the future, as fetchMore() will grab history items one day at a time
+    // Any page that is still being fetched was requested for the previous target date
+    ++m_loadGeneration;
+    m_isFetching = false;
+
+    // Start from a position in the future, as fetchMore() will grab history items from the most recent visit onwards
     QDateTime tomorrow = QDateTime(QDate::currentDate(), QTime(0, 0));
-    m_loadedDate = tomorrow.addDays(1);
+    m_loadedPosition = { tomorrow.addDays(1), std::numeric_limits<int>::max() };
+    m_hasMoreHistory = true;
 
     // Clear old model data
     m_commonData.clear();
@@ -81,8 +81,13 @@ class HistoryTableModel : public QAbstractTableModel
     void loadFromDate(const QDateTime &date);
 
 private:
-    /// Callback registered in fetchMore(..) - this handles the result of fetching more history entries
-    void onHistoryFetched(std::vector<URLRecord> &&entries);
+    /// Callback registered in fetchMore(..) - this handles the result of fetching more history entries, along with
+    /// the position from which the next page of history is fetched
+    void onHistoryFetched(std::vector<URLRecord> &&entries, HistoryPosition position);
+
+private:
+    /// Maximum number of visits fetched by each call to fetchMore(..)
+    static constexpr int HistoryPageSize = 256;
 
 private:
     /// History manager
@@ -91,11 +96,23 @@ class HistoryTableModel : public QAbstractTableModel
     /// Favicon manager
     FaviconManager *m_faviconManager;
 
-    /// Date-time requested from the last call to loadFromDate(..) - when the date is older than 24 hours, it is loaded incrementially
+    /// Date-time requested from the last call to loadFromDate(..) - history is loaded incrementally, one page at a time,
+    /// until this date is reached
     QDateTime m_targetDate;
 
-    /// Date of the most recently loaded history item
-    QDateTime m_loadedDate;
+    /// Position of the oldest visit that has been loaded
+    HistoryPosition m_loadedPosition;
+
+    /// True if there may be more visits to load before the target date is reached. Pages are received in the
+    /// thread of the history manager, so this and the other loading state are only accessed from the GUI thread
+    bool m_hasMoreHistory;
+
+    /// True while a page of history is being fetched
+    bool m_isFetching;
+
+    /// Incremented each time the model is reset by \ref HistoryTableModel::loadFromDate. Pages that were
+    /// requested with an earlier value are ignored when they arrive
+    quint64 m_loadGeneration;
 
     /// Common history data
     std::vector<HistoryTableItem> m_commonData;
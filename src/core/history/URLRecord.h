@@ -13,6 +13,21 @@
 
 using VisitEntry = QDateTime;
 
+/**
+ * @struct HistoryPosition
+ * @brief Position within the visits of the browsing history, used to load the history one page at a time,
+ *        from the most recent visit to the oldest
+ */
+struct HistoryPosition
+{
+    /// Time of the most recently loaded visit. Only visits made before this time, or made at this time to an
+    /// entry with a lower visit ID, are loaded in the next page
+    VisitEntry VisitTime;
+
+    /// Unique visit ID of the history entry of the most recently loaded visit
+    int VisitID;
+};
+
 /**
  * @struct HistoryEntry
  * @brief Contains data about a specific web URL visited by the user
@@ -129,6 +144,7 @@ struct HistoryEntry final : public sqlite::Row
 class URLRecord
 {
     friend class HistoryManager;
+    friend class HistoryStore;
 
 public:
     /// Constructs the URL record given the associated history entry and a list of visits
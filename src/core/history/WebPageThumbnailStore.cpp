@@ -53,7 +53,7 @@ QImage WebPageThumbnailStore::getThumbnail(const QUrl &url)
     if (it != m_thumbnails.end())
         return it.value();
 
-    auto stmt = m_database.prepare(R"(SELECT Thumbnail FROM Thumbnails WHERE Host = ?)");
+    auto stmt = m_database.prepareCached(R"(SELECT Thumbnail FROM Thumbnails WHERE Host = ?)");
     stmt << host;
     if (stmt.next())
     {
@@ -188,7 +188,7 @@ void WebPageThumbnailStore::onMostVisitedPagesLoaded(std::vector<WebPageInformat
     }
 
     // Save applicable thumbnails
-    auto stmt = m_database.prepare(R"(INSERT OR REPLACE INTO Thumbnails(Host, Thumbnail) VALUES (?, ?))");
+    auto stmt = m_database.prepareCached(R"(INSERT OR REPLACE INTO Thumbnails(Host, Thumbnail) VALUES (?, ?))");
 
     for (auto it = m_thumbnails.begin(); it != m_thumbnails.end(); ++it)
     {
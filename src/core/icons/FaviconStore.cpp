@@ -29,7 +29,7 @@ int FaviconStore::getFaviconId(const QUrl &url)
     if (it != m_webPageMap.end())
         return *it;
 
-    auto iconQuery = m_database.prepare(R"(SELECT FaviconID FROM FaviconMap WHERE PageURL LIKE ?)");
+    auto iconQuery = m_database.prepareCached(R"(SELECT FaviconID FROM FaviconMap WHERE PageURL LIKE ?)");
 
     QString searchTemplate("%%1%");
     std::array<QString, 2> searchTerms = { searchTemplate.arg(url.host()),
@@ -61,7 +61,7 @@ int FaviconStore::getFaviconIdForIconUrl(const QUrl &url)
             return it.first;
     }
 
-    auto idQuery = m_database.prepare(R"(SELECT FaviconID FROM Favicons WHERE URL = ?)");
+    auto idQuery = m_database.prepareCached(R"(SELECT FaviconID FROM Favicons WHERE URL = ?)");
     idQuery << url;
     if (idQuery.next())
     {
@@ -113,7 +113,7 @@ FaviconData &FaviconStore::getDataRecord(int faviconId)
 
 void FaviconStore::saveDataRecord(FaviconData &dataRecord)
 {
-    auto stmt = m_database.prepare(R"(UPDATE FaviconData SET Data = ? WHERE DataID = ?)");
+    auto stmt = m_database.prepareCached(R"(UPDATE FaviconData SET Data = ? WHERE DataID = ?)");
     stmt << dataRecord.iconData
          << dataRecord.id;
     if (!stmt.execute())
@@ -133,7 +133,7 @@ void FaviconStore::addPageMapping(const QUrl &webPageUrl, int faviconId)
     else
         m_webPageMap.insert(webPageUrl, faviconId);
 
-    auto stmt = m_database.prepare(R"(INSERT OR REPLACE INTO FaviconMap(PageURL, FaviconID) VALUES (?, ?))");
+    auto stmt = m_database.prepareCached(R"(INSERT OR REPLACE INTO FaviconMap(PageURL, FaviconID) VALUES (?, ?))");
     stmt << webPageUrl
          << faviconId;
 
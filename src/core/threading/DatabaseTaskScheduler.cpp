@@ -1,14 +1,39 @@
 #include "DatabaseFactory.h"
 #include "DatabaseTaskScheduler.h"
 
-DatabaseTaskScheduler::DatabaseTaskScheduler() :
-    m_registry(),
-    m_workersToCreate(),
+#include <algorithm>
+
+#include <QDebug>
+
+namespace
+{
+    /// Results of the tasks that are being grouped into a transaction by the current thread, which are
+    /// delivered once the transaction has ended. A nullptr while the thread is not running such a group
+    thread_local std::vector<std::function<void()>> *pendingDeliveries = nullptr;
+}
+
+DatabaseTaskScheduler::TaskQueue::TaskQueue(const std::string &name) :
+    Name(name),
+    Worker(nullptr),
+    Construction(),
+    InitCallbacks(),
+    InteractiveTasks(),
+    BackgroundTasks(),
+    KeyedTasks(),
+    Busy(false),
+    TasksExecuted(0),
+    TasksCoalesced(0),
+    TotalWaitTime(0),
+    MaxWaitTime(0)
+{
+}
+
+DatabaseTaskScheduler::DatabaseTaskScheduler(std::size_t numThreads) :
+    m_queues(),
     m_mutex(),
     m_cv(),
-    m_thread(nullptr),
-    m_tasks(),
-    m_initCallbacks(),
+    m_numThreads(std::max<std::size_t>(numThreads, 1)),
+    m_threads(),
     m_working(false)
 {
 }
@@ -20,82 +45,301 @@ DatabaseTaskScheduler::~DatabaseTaskScheduler()
 
 DatabaseWorker *DatabaseTaskScheduler::getWorker(const std::string &name) const
 {
-    const auto it = m_registry.find(name);
-    if (it != m_registry.end())
-        return it->second.get();
+    std::lock_guard<std::mutex> lock{m_mutex};
+
+    const auto it = m_queues.find(name);
+    if (it != m_queues.end())
+        return it->second->Worker.get();
     return nullptr;
 }
 
-void DatabaseTaskScheduler::onInit(std::function<void()> &&callback)
+void DatabaseTaskScheduler::onInit(const std::string &name, std::function<void()> &&callback)
+{
+    std::lock_guard<std::mutex> lock{m_mutex};
+    getQueue(name).InitCallbacks.push_back(std::move(callback));
+}
+
+void DatabaseTaskScheduler::post(const std::string &name, TaskPriority priority, std::function<void()> &&work)
 {
-    m_initCallbacks.push_back(std::move(callback));
+    std::lock_guard<std::mutex> lock{m_mutex};
+
+    TaskQueue &queue = getQueue(name);
+    std::deque<Task> &tasks = (priority == TaskPriority::Interactive) ? queue.InteractiveTasks : queue.BackgroundTasks;
+    tasks.push_back({ std::move(work), std::chrono::steady_clock::now(), std::string() });
+
+    m_cv.notify_one();
 }
 
-void DatabaseTaskScheduler::post(std::function<void()> &&work)
+void DatabaseTaskScheduler::postKeyed(const std::string &name, TaskPriority priority, const std::string &key, std::function<void()> &&work)
 {
     std::lock_guard<std::mutex> lock{m_mutex};
-    m_tasks.push_back(std::move(work));
+
+    TaskQueue &queue = getQueue(name);
+
+    // The superseded task stays in the queue as a no-op. Moving the new task to its place would
+    // reorder it ahead of the tasks that were posted in between the two
+    auto it = queue.KeyedTasks.find(key);
+    if (it != queue.KeyedTasks.end())
+    {
+        it->second->Work = nullptr;
+        it->second->Key.clear();
+        queue.TasksCoalesced++;
+    }
+
+    std::deque<Task> &tasks = (priority == TaskPriority::Interactive) ? queue.InteractiveTasks : queue.BackgroundTasks;
+    tasks.push_back({ std::move(work), std::chrono::steady_clock::now(), key });
+    queue.KeyedTasks[key] = &tasks.back();
+
     m_cv.notify_one();
 }
 
 void DatabaseTaskScheduler::addWorker(const std::string &name, std::function<std::unique_ptr<DatabaseWorker>()> construction)
 {
-    m_workersToCreate.push_back({name, construction});
+    std::lock_guard<std::mutex> lock{m_mutex};
+    getQueue(name).Construction = std::move(construction);
+}
+
+std::vector<DatabaseQueueStats> DatabaseTaskScheduler::getQueueStats() const
+{
+    std::lock_guard<std::mutex> lock{m_mutex};
+
+    std::vector<DatabaseQueueStats> result;
+    result.reserve(m_queues.size());
+
+    for (const auto &it : m_queues)
+    {
+        const TaskQueue &queue = *it.second;
+        result.push_back({ queue.Name, queue.InteractiveTasks.size(), queue.BackgroundTasks.size(),
+                           queue.TasksExecuted, queue.TasksCoalesced, queue.TotalWaitTime, queue.MaxWaitTime });
+    }
+
+    return result;
 }
 
 void DatabaseTaskScheduler::run()
 {
-    if (m_thread != nullptr || m_working)
+    std::lock_guard<std::mutex> lock{m_mutex};
+
+    if (!m_threads.empty() || m_working)
         return;
 
+    // Instantiate each database worker in its own queue, ahead of any tasks that were posted before
+    // the scheduler started running. A slow database will then only hold up its own tasks
+    for (auto &it : m_queues)
+    {
+        TaskQueue *queue = it.second.get();
+        if (!queue->Construction)
+            continue;
+
+        std::function<void()> setup = [this, queue, construction = std::move(queue->Construction)](){
+            std::unique_ptr<DatabaseWorker> worker = construction();
+
+            std::vector<std::function<void()>> initCallbacks;
+            {
+                std::lock_guard<std::mutex> lock{m_mutex};
+                queue->Worker = std::move(worker);
+                initCallbacks.swap(queue->InitCallbacks);
+            }
+
+            for (auto &initCallback : initCallbacks)
+                initCallback();
+        };
+        queue->Construction = nullptr;
+        queue->InteractiveTasks.push_front({ std::move(setup), std::chrono::steady_clock::now(), std::string() });
+    }
+
     m_working = true;
-    m_thread = new std::thread(&DatabaseTaskScheduler::workerThread, this);
+    for (std::size_t i = 0; i < m_numThreads; ++i)
+        m_threads.emplace_back(&DatabaseTaskScheduler::workerThread, this);
 }
 
 void DatabaseTaskScheduler::stop()
 {
-    if (m_thread != nullptr)
     {
+        std::lock_guard<std::mutex> lock{m_mutex};
         m_working = false;
-        m_cv.notify_all();
-
-        if (m_thread->joinable())
-            m_thread->join();
-
-        delete m_thread;
-        m_thread = nullptr;
     }
-}
+    m_cv.notify_all();
 
-void DatabaseTaskScheduler::workerThread()
-{
-    for (auto &&workerInfo : m_workersToCreate)
+    for (std::thread &thread : m_threads)
     {
-        m_registry[workerInfo.first] = workerInfo.second();
+        if (thread.joinable())
+            thread.join();
     }
 
-    for (auto &initCallback : m_initCallbacks)
-        initCallback();
+    m_threads.clear();
+}
 
-    m_initCallbacks.clear();
+void DatabaseTaskScheduler::workerThread()
+{
+    std::unique_lock<std::mutex> lock{m_mutex};
 
     for (;;)
     {
-        std::unique_lock<std::mutex> lock{m_mutex};
-        m_cv.wait(lock, [this](){
-            return !m_tasks.empty() || !m_working;
+        TaskQueue *queue = nullptr;
+        m_cv.wait(lock, [this, &queue](){
+            queue = getNextQueue();
+            return queue != nullptr || (!m_working && !hasPendingTasks());
         });
 
-        if (!m_working && m_tasks.empty())
+        if (queue == nullptr)
             break;
 
-        std::function<void()> task = std::move(m_tasks.front());
-        m_tasks.pop_front();
+        queue->Busy = true;
+        Task task = takeNextTask(*queue);
+
+        // When more tasks are waiting on the same database, they are executed together in one transaction
+        // rather than having SQLite commit the changes of each statement on its own
+        DatabaseWorker *worker = queue->Worker.get();
+        const bool hasMoreTasks = !queue->InteractiveTasks.empty() || !queue->BackgroundTasks.empty();
+
         lock.unlock();
 
-        task();
+        if (worker == nullptr || !hasMoreTasks || !worker->beginTransaction())
+        {
+            if (task.Work)
+                task.Work();
 
-        if (!m_working && m_tasks.empty())
-            break;
+            lock.lock();
+        }
+        else
+        {
+            // Keys of the tasks in the transaction, to report which changes were lost if it can not be committed
+            std::vector<std::string> taskKeys;
+
+            std::vector<std::function<void()>> deliveries;
+            pendingDeliveries = &deliveries;
+
+            bool inTransaction = executeInSavepoint(*worker, task, queue->Name);
+            taskKeys.push_back(std::move(task.Key));
+
+            lock.lock();
+
+            while (inTransaction
+                   && static_cast<int>(taskKeys.size()) < MaxTasksPerTransaction
+                   && (!queue->InteractiveTasks.empty() || !queue->BackgroundTasks.empty()))
+            {
+                task = takeNextTask(*queue);
+
+                lock.unlock();
+                inTransaction = executeInSavepoint(*worker, task, queue->Name);
+                taskKeys.push_back(std::move(task.Key));
+                lock.lock();
+            }
+
+            lock.unlock();
+
+            // The results of the tasks are only delivered below, but the tasks themselves can not be executed again.
+            // Workers that keep the data they wrote can queue it again when the transaction is reverted
+            bool committed = true;
+            if (inTransaction && !worker->commitTransaction())
+            {
+                committed = false;
+                worker->rollbackTransaction();
+
+                const QString queueName = QString::fromStdString(queue->Name);
+                for (std::size_t i = 0; i < taskKeys.size(); ++i)
+                {
+                    qWarning() << "DatabaseTaskScheduler - lost the changes of task" << (i + 1) << "of" << taskKeys.size()
+                               << "in queue" << queueName << "key:" << QString::fromStdString(taskKeys.at(i));
+                }
+            }
+
+            worker->onGroupedTransactionEnded(committed);
+
+            pendingDeliveries = nullptr;
+            for (auto &delivery : deliveries)
+                delivery();
+
+            lock.lock();
+        }
+
+        queue->Busy = false;
+
+        // Another thread may be waiting on the tasks of the queue that was just released
+        m_cv.notify_all();
+    }
+}
+
+DatabaseTaskScheduler::TaskQueue &DatabaseTaskScheduler::getQueue(const std::string &name)
+{
+    std::unique_ptr<TaskQueue> &queue = m_queues[name];
+    if (!queue)
+        queue = std::make_unique<TaskQueue>(name);
+    return *queue;
+}
+
+DatabaseTaskScheduler::TaskQueue *DatabaseTaskScheduler::getNextQueue()
+{
+    TaskQueue *backgroundQueue = nullptr;
+    for (auto &it : m_queues)
+    {
+        TaskQueue *queue = it.second.get();
+        if (queue->Busy)
+            continue;
+
+        if (!queue->InteractiveTasks.empty())
+            return queue;
+
+        if (backgroundQueue == nullptr && !queue->BackgroundTasks.empty())
+            backgroundQueue = queue;
     }
+
+    return backgroundQueue;
+}
+
+bool DatabaseTaskScheduler::hasPendingTasks() const
+{
+    return std::any_of(m_queues.begin(), m_queues.end(), [](const auto &it){
+        return !it.second->InteractiveTasks.empty() || !it.second->BackgroundTasks.empty() || it.second->Busy;
+    });
+}
+
+DatabaseTaskScheduler::Task DatabaseTaskScheduler::takeNextTask(TaskQueue &queue)
+{
+    std::deque<Task> &tasks = queue.InteractiveTasks.empty() ? queue.BackgroundTasks : queue.InteractiveTasks;
+
+    if (!tasks.front().Key.empty())
+        queue.KeyedTasks.erase(tasks.front().Key);
+
+    Task task = std::move(tasks.front());
+    tasks.pop_front();
+
+    // Superseded tasks were already counted as coalesced
+    if (!task.Work)
+        return task;
+
+    const auto waitTime = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - task.PostTime);
+    queue.TasksExecuted++;
+    queue.TotalWaitTime += waitTime;
+    queue.MaxWaitTime = std::max(queue.MaxWaitTime, waitTime);
+
+    return task;
+}
+
+void DatabaseTaskScheduler::deliver(std::function<void()> &&delivery)
+{
+    if (pendingDeliveries != nullptr)
+        pendingDeliveries->push_back(std::move(delivery));
+    else
+        delivery();
+}
+
+bool DatabaseTaskScheduler::executeInSavepoint(DatabaseWorker &worker, Task &task, const std::string &queueName)
+{
+    if (!task.Work)
+        return true;
+
+    const bool hasSavepoint = worker.beginTransaction();
+    task.Work();
+
+    // Releasing the savepoint fails when the task has ended the transaction on its own
+    if (hasSavepoint && !worker.commitTransaction())
+    {
+        qWarning() << "DatabaseTaskScheduler - task in queue" << QString::fromStdString(queueName)
+                   << "did not leave its transaction intact, key:" << QString::fromStdString(task.Key);
+        worker.rollbackTransaction();
+    }
+
+    return worker.isInTransaction();
 }
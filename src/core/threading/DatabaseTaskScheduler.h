@@ -1,78 +1,316 @@
 #ifndef DATABASETASKSCHEDULER_H
 #define DATABASETASKSCHEDULER_H
 
+#include <chrono>
 #include <condition_variable>
+#include <cstdint>
 #include <deque>
 #include <functional>
+#include <future>
 #include <memory>
 #include <mutex>
 #include <thread>
+#include <type_traits>
 #include <unordered_map>
+#include <utility>
 #include <vector>
 
+#include <QObject>
+#include <QPointer>
 #include <QString>
 
 class DatabaseWorker;
 
+/// Priority lanes of a database task queue. Pending interactive tasks are always
+/// executed before any pending background task of the same database
+enum class TaskPriority
+{
+    /// Work that the user is waiting on, such as lookups and bookmark changes
+    Interactive,
+
+    /// Deferrable work, such as recording visits or pruning old records
+    Background
+};
+
+/**
+ * @struct DatabaseQueueStats
+ * @brief Snapshot of the queue depth and wait time metrics of a single database task queue
+ */
+struct DatabaseQueueStats
+{
+    /// Name of the database worker that the queue belongs to
+    std::string Name;
+
+    /// Number of tasks waiting in the interactive lane
+    std::size_t InteractiveDepth;
+
+    /// Number of tasks waiting in the background lane
+    std::size_t BackgroundDepth;
+
+    /// Total number of tasks executed by the queue
+    std::uint64_t TasksExecuted;
+
+    /// Total number of keyed tasks that were superseded by a later task with the same key
+    std::uint64_t TasksCoalesced;
+
+    /// Sum of the time that each executed task spent waiting in the queue
+    std::chrono::microseconds TotalWaitTime;
+
+    /// Longest time that a task has spent waiting in the queue
+    std::chrono::microseconds MaxWaitTime;
+};
+
 /**
  * @class DatabaseTaskScheduler
- * @brief Manages a collection of DatabaseWorkers
- *        that operate outside of the main thread
+ * @brief Manages a collection of DatabaseWorkers that operate outside of the main thread.
+ *
+ *        Each registered worker has its own serial task queue, which means the tasks of a
+ *        database never run concurrently with each other. The queues of different databases
+ *        are executed in parallel by a small, shared pool of threads, so that a long running
+ *        task on one database does not hold up the others.
+ *
+ *        Consecutive tasks of a database worker are grouped into a single SQLite transaction,
+ *        and keyed tasks let a newer write replace an older write that is still queued.
+ *        Each task of a group runs in its own savepoint. Tasks must therefore end any transaction
+ *        that they begin, and must not execute statements that SQLite refuses to run within a
+ *        transaction, such as VACUUM or a change of the journal mode - those statements fail.
  */
 class DatabaseTaskScheduler
 {
+    /// Maximum number of consecutive tasks that will be grouped into a single transaction
+    static constexpr int MaxTasksPerTransaction = 64;
+
+    /// A unit of work, along with the time at which it was posted
+    struct Task
+    {
+        /// Function to be invoked, or a nullptr if the task was superseded by a keyed task
+        std::function<void()> Work;
+        std::chrono::steady_clock::time_point PostTime;
+
+        /// Identifies the data written by a keyed task, or empty for regular tasks
+        std::string Key;
+    };
+
+    /// Serial task queue and state of a single database worker
+    struct TaskQueue
+    {
+        explicit TaskQueue(const std::string &name);
+
+        /// Name of the database worker
+        std::string Name;
+
+        /// Database worker instance, constructed when the scheduler starts running
+        std::unique_ptr<DatabaseWorker> Worker;
+
+        /// Constructs the database worker
+        std::function<std::unique_ptr<DatabaseWorker>()> Construction;
+
+        /// Callbacks to be executed after instantiating the database worker
+        std::vector<std::function<void()>> InitCallbacks;
+
+        /// Pending interactive tasks
+        std::deque<Task> InteractiveTasks;
+
+        /// Pending background tasks
+        std::deque<Task> BackgroundTasks;
+
+        /// Hashmap of the keys of pending keyed tasks to the tasks themselves
+        std::unordered_map<std::string, Task*> KeyedTasks;
+
+        /// Set to true while one of the pool threads is executing a task from this queue
+        bool Busy;
+
+        /// Number of tasks executed by the queue
+        std::uint64_t TasksExecuted;
+
+        /// Number of keyed tasks that were superseded before being executed
+        std::uint64_t TasksCoalesced;
+
+        /// Sum of the wait times of each executed task
+        std::chrono::microseconds TotalWaitTime;
+
+        /// Longest wait time of an executed task
+        std::chrono::microseconds MaxWaitTime;
+    };
+
 public:
-    /// Constructs the task schedulerr
-    DatabaseTaskScheduler();
+    /// Constructs the task scheduler, which will execute its tasks with the given number of threads
+    explicit DatabaseTaskScheduler(std::size_t numThreads = 2);
 
     /// Destructor
     ~DatabaseTaskScheduler();
 
     /// Returns a database worker that has been registered with the given name
     /// Note: this function should *only* be called in a callback registered with
-    /// the onInit() method
+    /// the onInit() method, or in a task posted to the worker's own queue
     DatabaseWorker *getWorker(const std::string &name) const;
 
-    /// Registers a callback to be executed when the worker thread has started
-    void onInit(std::function<void()> &&callback);
+    /// Registers a callback to be executed in the queue of the given database
+    /// worker, right after the worker has been instantiated
+    void onInit(const std::string &name, std::function<void()> &&callback);
+
+    /**
+     * @brief Posts a task to the end of a database worker's queue
+     * @param name Name of the database worker
+     * @param priority Priority lane of the task
+     * @param f Member function to be invoked
+     * @param args Function arguments
+     */
+    template<class Fn, class ...Args>
+    void post(const std::string &name, TaskPriority priority, Fn &&f, Args &&...args)
+    {
+        post(name, priority, std::function<void()>(std::bind(std::forward<Fn>(f), std::forward<Args>(args)...)));
+    }
+
+    /// Posts a task to the end of a database worker's queue
+    void post(const std::string &name, TaskPriority priority, std::function<void()> &&work);
 
     /**
-     * @brief Posts a task to the end of the work queue
+     * @brief Posts a keyed task to the end of a database worker's queue. If a task with the same key is still
+     *        waiting in the queue, that task is cancelled, so that only the newest task of a key is executed.
+     *        The new task still runs after every task that was posted before it.
+     *        Keyed tasks should leave the database in the same state regardless of the tasks they supersede,
+     *        such as when writing all of the columns of a single record.
+     * @param name Name of the database worker
+     * @param priority Priority lane of the task
+     * @param key Identifies the data written by the task
      * @param f Member function to be invoked
      * @param args Function arguments
      */
     template<class Fn, class ...Args>
-    void post(Fn &&f, Args &&...args)
+    void postKeyed(const std::string &name, TaskPriority priority, const std::string &key, Fn &&f, Args &&...args)
     {
-        std::lock_guard<std::mutex> lock{m_mutex};
-        m_tasks.push_back(std::bind(std::forward<Fn>(f), std::forward<Args>(args)...));
-        m_cv.notify_one();
+        postKeyed(name, priority, key, std::function<void()>(std::bind(std::forward<Fn>(f), std::forward<Args>(args)...)));
     }
 
-    /// Posts a task to the end of the work queue
-    void post(std::function<void()> &&work);
+    /// Posts a keyed task to the end of a database worker's queue, cancelling a pending task with the same key
+    void postKeyed(const std::string &name, TaskPriority priority, const std::string &key, std::function<void()> &&work);
+
+    /**
+     * @brief Posts a task that produces a value to the end of a database worker's queue
+     * @param name Name of the database worker
+     * @param priority Priority lane of the task
+     * @param work Function to be invoked in the database queue
+     * @return A future that is resolved with the result of the task. When the task is grouped into a
+     *         transaction, the future is resolved after the transaction has ended
+     */
+    template<class Fn>
+    std::future<std::invoke_result_t<Fn>> postWithResult(const std::string &name, TaskPriority priority, Fn &&work)
+    {
+        using ResultType = std::invoke_result_t<Fn>;
+
+        auto promise = std::make_shared<std::promise<ResultType>>();
+        std::future<ResultType> result = promise->get_future();
+
+        std::function<void()> task = [promise, work = std::forward<Fn>(work)]() mutable {
+            if constexpr (std::is_void_v<ResultType>)
+            {
+                work();
+                deliver([promise](){ promise->set_value(); });
+            }
+            else
+            {
+                deliver([promise, result = work()]() mutable { promise->set_value(std::move(result)); });
+            }
+        };
+        post(name, priority, std::move(task));
+        return result;
+    }
+
+    /**
+     * @brief Posts a task to the end of a database worker's queue, passing its result to
+     *        a continuation that is invoked in the thread of the given context object.
+     *        When the task is grouped into a transaction, the continuation is invoked after the
+     *        transaction has ended, so that other connections can read the changes of the task.
+     *        The continuation is dropped if the context object is destroyed first.
+     * @param name Name of the database worker
+     * @param priority Priority lane of the task
+     * @param work Function to be invoked in the database queue
+     * @param context Object whose thread will execute the continuation, usually one living in the GUI thread
+     * @param continuation Function that receives the result of the task
+     */
+    template<class Fn, class Continuation>
+    void postAndThen(const std::string &name, TaskPriority priority, Fn &&work, QObject *context, Continuation &&continuation)
+    {
+        using ResultType = std::invoke_result_t<Fn>;
+
+        QPointer<QObject> receiver(context);
+        std::function<void()> task = [receiver, work = std::forward<Fn>(work),
+                continuation = std::forward<Continuation>(continuation)]() mutable {
+            if constexpr (std::is_void_v<ResultType>)
+            {
+                work();
+                deliver([receiver, continuation = std::move(continuation)]() mutable {
+                    invokeInThreadOf(receiver, std::move(continuation));
+                });
+            }
+            else
+            {
+                deliver([receiver, result = work(), continuation = std::move(continuation)]() mutable {
+                    invokeInThreadOf(receiver, [result = std::move(result), continuation = std::move(continuation)]() mutable {
+                        continuation(std::move(result));
+                    });
+                });
+            }
+        };
+        post(name, priority, std::move(task));
+    }
 
     /// Adds a database worker to the pool of workers. It will be constructed after calling the run() method.
     /// Anything registered with this method after calling run() will not be instantiated
     void addWorker(const std::string &name, std::function<std::unique_ptr<DatabaseWorker>()> construction);
 
-    /// Starts the worker thread
+    /// Returns the queue depth and wait time metrics of each database worker's task queue
+    std::vector<DatabaseQueueStats> getQueueStats() const;
+
+    /// Starts the worker threads
     void run();
 
-    /// Stops the worker thread
+    /// Stops the worker threads, after all pending tasks have been executed
     void stop();
 
 private:
-    /// Main loop of the worker thread
+    /// Main loop of each thread in the pool
     void workerThread();
 
-private:
-    /// Hashmap of database worker names to their corresponding instances
-    std::unordered_map<std::string, std::unique_ptr<DatabaseWorker>> m_registry;
+    /// Returns the task queue of the database worker with the given name, creating it if it does not exist.
+    /// Must be called while holding the mutex
+    TaskQueue &getQueue(const std::string &name);
+
+    /// Returns a queue that is not busy and has pending tasks, favouring queues with interactive tasks, or
+    /// a nullptr if there is no such queue. Must be called while holding the mutex
+    TaskQueue *getNextQueue();
+
+    /// Returns true if any of the task queues have pending tasks. Must be called while holding the mutex
+    bool hasPendingTasks() const;
+
+    /// Removes the next task from the given queue, favouring its interactive lane, and updates the
+    /// queue's metrics. Must be called while holding the mutex, on a queue that has pending tasks
+    Task takeNextTask(TaskQueue &queue);
 
-    /// Vector of callbacks waiting to be executed in the run() method
-    std::vector<std::pair<std::string, 
-        std::function<std::unique_ptr<DatabaseWorker>()>>> m_workersToCreate;
+    /// Executes a task of a grouped transaction in a savepoint of its own, so that the task can not revert
+    /// the changes of the tasks before it. Returns true if the transaction is still active afterwards
+    bool executeInSavepoint(DatabaseWorker &worker, Task &task, const std::string &queueName);
+
+    /// Invokes the given delivery of a task's result right away, or once the transaction of the calling pool thread has ended
+    static void deliver(std::function<void()> &&delivery);
+
+    /// Invokes the given function in the thread of the receiver, through its event loop
+    template<class Fn>
+    static void invokeInThreadOf(const QPointer<QObject> &receiver, Fn &&fn)
+    {
+        if (receiver.isNull())
+            return;
+
+        // A queued connection posts a single event to the receiver's thread, which
+        // works from threads that do not have a Qt event loop of their own
+        QObject sender;
+        QObject::connect(&sender, &QObject::destroyed, receiver.data(), std::forward<Fn>(fn), Qt::QueuedConnection);
+    }
+
+private:
+    /// Hashmap of database worker names to their corresponding task queues
+    std::unordered_map<std::string, std::unique_ptr<TaskQueue>> m_queues;
 
     /// Mutex
     mutable std::mutex m_mutex;
@@ -80,16 +318,13 @@ class DatabaseTaskScheduler
     /// Condition variable
     std::condition_variable m_cv;
 
-    /// Worker thread
-    std::thread *m_thread;
-
-    /// Pending tasks
-    std::deque<std::function<void()>> m_tasks;
+    /// Number of threads in the pool
+    std::size_t m_numThreads;
 
-    /// Callbacks to be executed after insantiating all of the database workers in the worker thread
-    std::vector<std::function<void()>> m_initCallbacks;
+    /// Thread pool
+    std::vector<std::thread> m_threads;
 
-    /// Worker flag - when set to false, the worker thread will halt
+    /// Worker flag - when set to false, the pool threads will halt once all pending tasks have been executed
     bool m_working;
 };
 
@@ -25,13 +25,18 @@ void HistorySuggestor::setServiceLocator(const ViperServiceLocator &serviceLocat
 
     if (Settings *settings = serviceLocator.getServiceAs<Settings>("Settings"))
     {
+        std::lock_guard<std::mutex> lock{m_mutex};
         m_historyDatabaseFile = settings->getPathValue(BrowserSetting::HistoryPath);
     }
 }
 
 void HistorySuggestor::setHistoryFile(const QString &historyDbFile)
 {
+    std::lock_guard<std::mutex> lock{m_mutex};
+
     m_historyDatabaseFile = historyDbFile;
+    m_historyPool.reset();
+    m_searchIndex = SearchIndex::Unknown;
 }
 
 std::vector<URLSuggestion> HistorySuggestor::getSuggestions(const std::atomic_bool &working,
@@ -41,21 +46,34 @@ std::vector<URLSuggestion> HistorySuggestor::getSuggestions(const std::atomic_bo
 {
     std::vector<URLSuggestion> result;
 
+    // Held for the whole lookup, as the search index state belongs to the database that is being read
+    std::lock_guard<std::mutex> lock{m_mutex};
+
     if (!m_faviconManager || m_historyDatabaseFile.isEmpty())
         return result;
 
-    if (!m_historyDb)
-        setupConnection();
+    if (!m_historyPool)
+        m_historyPool = sqlite::ConnectionPool::forFile(m_historyDatabaseFile.toStdString());
 
-    if (!m_historyDb || !m_historyDb->isValid())
+    // The lease must outlive the statements prepared with its connection
+    sqlite::ConnectionLease connection = m_historyPool->acquire();
+    if (!connection)
         return result;
 
-    const QString fullTermParam = QString("%%1%").arg(searchTerm);
+    detectSearchIndex(*connection);
+
+    // Match the input as a whole, then match any of its words. Without a search index, only the whole input is matched
+    const QString fullTermMatch = getMatchExpression(searchTerm);
+    auto stmt = connection->prepareCached(getStatementSql(fullTermMatch.isEmpty() ? Statement::SearchByShortInput : Statement::SearchByWholeInput));
+    if (fullTermMatch.isEmpty())
+    {
+        const QString fullTermParam = QString("%%1%").arg(searchTerm);
+        stmt << fullTermParam
+             << fullTermParam;
+    }
+    else
+        stmt << fullTermMatch;
 
-    sqlite::PreparedStatement &stmt = m_statements.at(Statement::SearchByWholeInput);
-    stmt.reset();
-    stmt << fullTermParam
-         << fullTermParam;
     if (stmt.execute())
     {
         auto fullTermResult = getSuggestionsFromQuery(working, searchTerm, MatchType::URL, stmt);
@@ -64,46 +82,36 @@ std::vector<URLSuggestion> HistorySuggestor::getSuggestions(const std::atomic_bo
             return result;
     }
 
-    if (searchTermParts.size() == 1)
+    if (searchTermParts.size() == 1 || m_searchIndex == SearchIndex::Missing)
         return result;
 
-    // Sort search words by their string length, in descending order
-    std::vector<QString> searchWords;
-    searchWords.reserve(static_cast<size_t>(searchTermParts.size()));
+    QStringList wordMatches;
     for (const QString &word : searchTermParts)
-        searchWords.push_back(word);
-
-    std::sort(searchWords.begin(), searchWords.end(), [](const QString &a, const QString &b) -> bool {
-        return a.length() > b.length();
-    });
-
-    sqlite::PreparedStatement &stmtWords = m_statements.at(Statement::SearchBySingleWord);
-
-    for (const QString &word : searchWords)
     {
-        if (!working.load())
-            return result;
+        const QString wordMatch = getMatchExpression(word.trimmed());
+        if (!wordMatch.isEmpty())
+            wordMatches.append(wordMatch);
+    }
 
-        QString wordTemp = word.size() < 4 ? QString("%%1%") : QString("%1%");
-        wordTemp = wordTemp.arg(word.trimmed().toUpper());
-        const std::string wordStdBinding = wordTemp.toStdString();
+    if (wordMatches.isEmpty())
+        return result;
 
-        stmtWords.reset();
-        stmtWords << wordStdBinding;
+    // Entries that contain more of the words are ranked higher by the search index
+    auto stmtWords = connection->prepareCached(getStatementSql(Statement::SearchByWords));
+    stmtWords << wordMatches.join(QLatin1String(" OR "));
 
-        if (!stmtWords.execute())
-            continue;
+    if (!stmtWords.execute())
+        return result;
 
-        auto wordQueryResult = getSuggestionsFromQuery(working, searchTerm, MatchType::SearchWords, stmtWords);
-        for (auto& suggestion : wordQueryResult)
-        {
-            auto match = std::find_if(result.begin(), result.end(), [&suggestion](const URLSuggestion &other){
-                return other.HistoryId == suggestion.HistoryId;
-            });
+    auto wordQueryResult = getSuggestionsFromQuery(working, searchTerm, MatchType::SearchWords, stmtWords);
+    for (auto& suggestion : wordQueryResult)
+    {
+        auto match = std::find_if(result.begin(), result.end(), [&suggestion](const URLSuggestion &other){
+            return other.HistoryId == suggestion.HistoryId;
+        });
 
-            if (match == result.end())
-                result.emplace_back(std::move(suggestion));
-        }
+        if (match == result.end())
+            result.emplace_back(std::move(suggestion));
     }
 
     return result;
@@ -195,24 +203,73 @@ std::vector<URLSuggestion> HistorySuggestor::getSuggestionsFromQuery(const std::
     return result;
 }
 
-void HistorySuggestor::setupConnection()
+const char *HistorySuggestor::getStatementSql(Statement statement)
 {
-    m_historyDb = std::make_unique<sqlite::Database>(m_historyDatabaseFile.toStdString());
-    m_statements.insert(std::make_pair(Statement::SearchByWholeInput,
-                                       m_historyDb->prepare(R"(SELECT H.VisitID, H.URL, H.Title, H.URLTypedCount, V.VisitCount, V.RecentVisit
-                                                            FROM History AS H INNER JOIN
-                                                            (SELECT VisitID, MAX(Date) AS RecentVisit, COUNT(Date) AS VisitCount FROM Visits INDEXED BY Visit_ID_Index GROUP BY VisitID) AS V
-                                                            ON H.VisitID = V.VisitID
-                                                            WHERE H.Title LIKE ? OR H.URL LIKE ?
-                                                            ORDER BY V.VisitCount DESC, H.URLTypedCount DESC LIMIT 25)")));
-    m_statements.insert(std::make_pair(Statement::SearchBySingleWord,
-                                       m_historyDb->prepare(R"(SELECT U.HistoryID, H.URL, H.Title, H.URLTypedCount, V.VisitCount, V.RecentVisit
-                                                            FROM URLWords AS U INNER JOIN Words
-                                                              ON U.WordID = Words.WordID
-                                                            INNER JOIN History AS H
-                                                              ON U.HistoryID = H.VisitID
-                                                            INNER JOIN (SELECT VisitID, MAX(Date) AS RecentVisit, COUNT(Date) AS VisitCount FROM Visits INDEXED BY Visit_ID_Index GROUP BY VisitID) AS V
-                                                              ON H.VisitID = V.VisitID
-                                                            WHERE Words.Word LIKE ?
-                                                            ORDER BY V.VisitCount DESC, V.RecentVisit DESC, H.URLTypedCount DESC LIMIT 5)")));
+    // Search results are ranked by relevance, with a bonus for frequently visited and typed entries. The bonus is capped
+    // so that a frequently visited entry that barely matches the input does not outrank a close match
+    switch (statement)
+    {
+        case Statement::SearchByWholeInput:
+            return R"(SELECT H.VisitID, H.URL, H.Title, H.URLTypedCount, H.VisitCount, H.LastVisit
+                    FROM HistorySearch INNER JOIN History AS H
+                      ON H.VisitID = HistorySearch.rowid
+                    WHERE HistorySearch MATCH ? AND H.VisitCount > 0
+                    ORDER BY bm25(HistorySearch, 2.0, 1.0)
+                      * (1.0 + MIN(H.VisitCount, 25) / 5.0 + MIN(H.URLTypedCount, 5) / 5.0)
+                    LIMIT 25)";
+        case Statement::SearchByShortInput:
+            return R"(SELECT VisitID, URL, Title, URLTypedCount, VisitCount, LastVisit
+                    FROM History
+                    WHERE VisitCount > 0 AND (Title LIKE ? OR URL LIKE ?)
+                    ORDER BY VisitCount DESC, URLTypedCount DESC LIMIT 25)";
+        case Statement::SearchByWords:
+            return R"(SELECT H.VisitID, H.URL, H.Title, H.URLTypedCount, H.VisitCount, H.LastVisit
+                    FROM HistorySearch INNER JOIN History AS H
+                      ON H.VisitID = HistorySearch.rowid
+                    WHERE HistorySearch MATCH ? AND H.VisitCount > 0
+                    ORDER BY bm25(HistorySearch, 2.0, 1.0)
+                      * (1.0 + MIN(H.VisitCount, 25) / 5.0 + MIN(H.URLTypedCount, 5) / 5.0),
+                      H.LastVisit DESC
+                    LIMIT 25)";
+    }
+
+    return "";
+}
+
+void HistorySuggestor::detectSearchIndex(sqlite::Database &connection)
+{
+    const auto now = std::chrono::steady_clock::now();
+    if (m_searchIndex == SearchIndex::Words
+            || m_searchIndex == SearchIndex::Trigram
+            || (m_searchIndex == SearchIndex::Missing && now < m_nextSearchIndexCheck))
+        return;
+
+    m_searchIndex = SearchIndex::Missing;
+    m_nextSearchIndexCheck = now + std::chrono::seconds(30);
+
+    auto stmtIndex = connection.prepare(R"(SELECT sql FROM sqlite_master WHERE name = 'HistorySearch')");
+    if (stmtIndex.next())
+    {
+        QString indexSql;
+        stmtIndex >> indexSql;
+        m_searchIndex = indexSql.contains(QLatin1String("trigram"), Qt::CaseInsensitive) ? SearchIndex::Trigram : SearchIndex::Words;
+    }
+}
+
+QString HistorySuggestor::getMatchExpression(const QString &text) const
+{
+    const bool hasTrigramIndex = m_searchIndex == SearchIndex::Trigram;
+    if (text.isEmpty() || m_searchIndex == SearchIndex::Missing || (hasTrigramIndex && text.size() < 3))
+        return QString();
+
+    // Quote the text so that it is matched as a phrase, regardless of any characters that are part of the query syntax
+    QString phrase = text;
+    phrase.replace(QLatin1Char('"'), QLatin1String("\"\""));
+    phrase = QString("\"%1\"").arg(phrase);
+
+    // The trigram tokenizer matches substrings on its own, while the word tokenizer needs a prefix query
+    if (!hasTrigramIndex)
+        phrase.append(QLatin1Char('*'));
+
+    return phrase;
 }
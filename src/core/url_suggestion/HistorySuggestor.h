@@ -4,7 +4,9 @@
 #include "IURLSuggestor.h"
 #include "URLSuggestionListModel.h"
 
-#include <map>
+#include <chrono>
+#include <memory>
+#include <mutex>
 #include <vector>
 
 class BookmarkManager;
@@ -12,6 +14,7 @@ class FaviconManager;
 
 namespace sqlite
 {
+    class ConnectionPool;
     class Database;
     class PreparedStatement;
 }
@@ -27,7 +30,24 @@ class HistorySuggestor final : public IURLSuggestor
     enum class Statement
     {
         SearchByWholeInput,
-        SearchBySingleWord
+        SearchByShortInput,
+        SearchByWords
+    };
+
+    /// Types of full-text search index that the history database may have
+    enum class SearchIndex
+    {
+        /// The history database has not been checked for a search index yet
+        Unknown,
+
+        /// The history database has no search index, and is searched with LIKE patterns instead
+        Missing,
+
+        /// The search index matches words and their prefixes
+        Words,
+
+        /// The search index was created with the trigram tokenizer, and matches any substring of at least three characters
+        Trigram
     };
 
 public:
@@ -41,7 +61,8 @@ class HistorySuggestor final : public IURLSuggestor
     void setServiceLocator(const ViperServiceLocator &serviceLocator) override;
 
     /// Specifies which history database file the suggestor should use. If not set, the
-    /// suggestor will use the application settings to get the value
+    /// suggestor will use the application settings to get the value. Waits for any lookup
+    /// that is running in the suggestion thread to complete
     void setHistoryFile(const QString &historyDbFile);
 
     /// Suggests history entries to the user, based on their text input
@@ -57,8 +78,17 @@ class HistorySuggestor final : public IURLSuggestor
                                                        MatchType queryMatchType,
                                                        sqlite::PreparedStatement &query);
 
-    /// Connects to the history database and creates the prepared statement cache
-    void setupConnection();
+    /// Returns the SQL of the given prepared statement type
+    static const char *getStatementSql(Statement statement);
+
+    /// Determines whether the history database has a search index, and which tokenizer it was created with.
+    /// Once found, the index is not looked up again. A missing index is looked up again after a delay, as the
+    /// history store creates it when it loads the database
+    void detectSearchIndex(sqlite::Database &connection);
+
+    /// Returns the full-text search expression that matches the given text, or an empty string if there is
+    /// no search index, or the search index cannot match text that short
+    QString getMatchExpression(const QString &text) const;
 
 private:
     /// Determines whether or not a suggestion is also a bookmark
@@ -67,14 +97,21 @@ class HistorySuggestor final : public IURLSuggestor
     /// Gathers icons which are sent in the suggestion results
     FaviconManager *m_faviconManager;
 
-    /// History database handle
-    std::unique_ptr<sqlite::Database> m_historyDb;
+    /// Guards the history database file, the connection pool and the search index state, which are
+    /// used by lookups in the suggestion thread and may be changed from another thread
+    std::mutex m_mutex;
+
+    /// Read-only connections to the history database, which are shared with any other reader of the history file
+    std::shared_ptr<sqlite::ConnectionPool> m_historyPool;
 
     /// Stores the location of the history database
     QString m_historyDatabaseFile;
 
-    /// Prepared statements used by the suggestor
-    std::map<Statement, sqlite::PreparedStatement> m_statements;
+    /// Type of the search index of the history database
+    SearchIndex m_searchIndex { SearchIndex::Unknown };
+
+    /// Time after which a missing search index is looked up again
+    std::chrono::steady_clock::time_point m_nextSearchIndexCheck;
 };
 
 #endif // HISTORYSUGGESTOR_H
@@ -0,0 +1,168 @@
+#include "MultiPatternMatcher.h"
+
+#include <deque>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+MultiPatternMatcher::MultiPatternMatcher() :
+    m_nodes(),
+    m_transitions(),
+    m_outputs(),
+    m_rootTransitions(),
+    m_trie()
+{
+    m_rootTransitions.fill(0);
+}
+
+void MultiPatternMatcher::clear()
+{
+    m_nodes.clear();
+    m_transitions.clear();
+    m_outputs.clear();
+    m_rootTransitions.fill(0);
+    m_trie.clear();
+}
+
+void MultiPatternMatcher::addPattern(const std::string &pattern, uint32_t id)
+{
+    if (pattern.empty())
+        return;
+
+    if (m_trie.empty())
+        m_trie.emplace_back();
+
+    uint32_t current = 0;
+    for (char ch : pattern)
+    {
+        const uint8_t c = static_cast<uint8_t>(ch);
+        auto it = m_trie[current].Children.find(c);
+        if (it != m_trie[current].Children.end())
+        {
+            current = it->second;
+            continue;
+        }
+
+        const uint32_t child = static_cast<uint32_t>(m_trie.size());
+        m_trie[current].Children.insert(std::make_pair(c, child));
+        m_trie.emplace_back();
+        current = child;
+    }
+
+    m_trie[current].Outputs.push_back(id);
+}
+
+void MultiPatternMatcher::build()
+{
+    m_nodes.clear();
+    m_transitions.clear();
+    m_outputs.clear();
+    m_rootTransitions.fill(0);
+
+    if (m_trie.empty())
+        return;
+
+    // Flatten the trie, keeping the trie node indices as state identifiers
+    m_nodes.resize(m_trie.size());
+    for (std::size_t i = 0; i < m_trie.size(); ++i)
+    {
+        const TrieNode &trieNode = m_trie[i];
+        Node &node = m_nodes[i];
+
+        node.TransitionBegin = static_cast<uint32_t>(m_transitions.size());
+        for (const auto &child : trieNode.Children)
+            m_transitions.push_back(Transition { child.first, child.second });
+        node.TransitionEnd = static_cast<uint32_t>(m_transitions.size());
+
+        node.OutputBegin = static_cast<uint32_t>(m_outputs.size());
+        m_outputs.insert(m_outputs.end(), trieNode.Outputs.begin(), trieNode.Outputs.end());
+        node.OutputEnd = static_cast<uint32_t>(m_outputs.size());
+
+        node.Fail = 0;
+        node.DictionaryLink = 0;
+    }
+
+    for (const auto &child : m_trie[0].Children)
+        m_rootTransitions[child.first] = child.second;
+
+    // Compute failure and dictionary links in breadth-first order, so that the links of
+    // every shallower state are known before they are needed
+    std::deque<uint32_t> queue;
+    for (const auto &child : m_trie[0].Children)
+        queue.push_back(child.second);
+
+    while (!queue.empty())
+    {
+        const uint32_t state = queue.front();
+        queue.pop_front();
+
+        for (const auto &child : m_trie[state].Children)
+        {
+            const uint8_t c = child.first;
+            const uint32_t target = child.second;
+
+            uint32_t fail = m_nodes[state].Fail;
+            uint32_t failTarget = 0;
+            for (;;)
+            {
+                failTarget = (fail == 0) ? m_rootTransitions[c] : findTransition(fail, c);
+                if (failTarget != 0 || fail == 0)
+                    break;
+                fail = m_nodes[fail].Fail;
+            }
+
+            Node &targetNode = m_nodes[target];
+            targetNode.Fail = (failTarget != target) ? failTarget : 0;
+
+            const Node &failNode = m_nodes[targetNode.Fail];
+            targetNode.DictionaryLink = (failNode.OutputBegin != failNode.OutputEnd) ? targetNode.Fail : failNode.DictionaryLink;
+
+            queue.push_back(target);
+        }
+    }
+
+    // The trie is no longer needed once the automaton has been built
+    std::vector<TrieNode>().swap(m_trie);
+}
+
+bool MultiPatternMatcher::isEmpty() const
+{
+    return m_nodes.size() <= 1 && m_trie.size() <= 1;
+}
+
+void MultiPatternMatcher::toLowerLatin1(const QString &str, std::string &result)
+{
+    const std::size_t length = static_cast<std::size_t>(str.size());
+    result.resize(length);
+
+    const ushort *src = str.utf16();
+    char *dst = &result[0];
+    std::size_t i = 0;
+
+#if defined(__SSE2__)
+    // Narrow and lowercase 16 characters at a time. Characters above 0xFF saturate to 0x00 or 0xFF
+    const __m128i upperBound = _mm_set1_epi8('A' - 1);
+    const __m128i lowerBound = _mm_set1_epi8('Z' + 1);
+    const __m128i caseBit = _mm_set1_epi8(0x20);
+    for (; i + 16 <= length; i += 16)
+    {
+        const __m128i first = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i));
+        const __m128i second = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i + 8));
+        __m128i bytes = _mm_packus_epi16(first, second);
+
+        const __m128i isUpper = _mm_and_si128(_mm_cmpgt_epi8(bytes, upperBound), _mm_cmplt_epi8(bytes, lowerBound));
+        bytes = _mm_or_si128(bytes, _mm_and_si128(isUpper, caseBit));
+
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i), bytes);
+    }
+#endif
+
+    for (; i < length; ++i)
+    {
+        ushort c = src[i];
+        if (c >= 'A' && c <= 'Z')
+            c += 0x20;
+        dst[i] = static_cast<char>(c > 0xFF ? 0xFF : c);
+    }
+}
@@ -0,0 +1,168 @@
+#ifndef MULTIPATTERNMATCHER_H
+#define MULTIPATTERNMATCHER_H
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <map>
+#include <string>
+#include <vector>
+
+#include <QString>
+
+/**
+ * @class MultiPatternMatcher
+ * @brief An implementation of the Aho-Corasick string matching algorithm, which
+ *        finds every occurrence of a set of 8-bit patterns within a text in a
+ *        single pass. This is used in place of running a separate substring search
+ *        for each pattern when the number of patterns is very large.
+ */
+class MultiPatternMatcher
+{
+public:
+    /// Default constructor
+    MultiPatternMatcher();
+
+    /// Removes all patterns from the matcher
+    void clear();
+
+    /// Adds a pattern, associated with the given identifier, to the matcher. Empty patterns are ignored.
+    /// Patterns may only be added before the call to \ref MultiPatternMatcher::build
+    void addPattern(const std::string &pattern, uint32_t id);
+
+    /// Builds the search automaton from the set of patterns
+    void build();
+
+    /// Returns true if the matcher does not contain any patterns, false if else
+    bool isEmpty() const;
+
+    /**
+     * @brief Searches the text for all occurrences of every pattern
+     * @param text Pointer to the text that will be searched
+     * @param length Number of characters in the text
+     * @param onMatch Callback that is invoked with the identifier of each pattern found in the text,
+     *                once per occurrence. Returning true from the callback stops the search.
+     * @return True if the search was stopped by the callback, false if else
+     */
+    template <typename Callback>
+    bool search(const char *text, std::size_t length, Callback &&onMatch) const
+    {
+        if (m_nodes.empty())
+            return false;
+
+        uint32_t state = 0;
+        for (std::size_t i = 0; i < length; ++i)
+        {
+            const uint8_t c = static_cast<uint8_t>(text[i]);
+
+            uint32_t next = 0;
+            for (;;)
+            {
+                if (state == 0)
+                {
+                    next = m_rootTransitions[c];
+                    break;
+                }
+
+                next = findTransition(state, c);
+                if (next != 0)
+                    break;
+
+                state = m_nodes[state].Fail;
+            }
+            state = next;
+
+            const Node &node = m_nodes[state];
+            uint32_t outputState = (node.OutputBegin != node.OutputEnd) ? state : node.DictionaryLink;
+            while (outputState != 0)
+            {
+                const Node &outputNode = m_nodes[outputState];
+                for (uint32_t j = outputNode.OutputBegin; j < outputNode.OutputEnd; ++j)
+                {
+                    if (onMatch(m_outputs[j]))
+                        return true;
+                }
+                outputState = outputNode.DictionaryLink;
+            }
+        }
+
+        return false;
+    }
+
+    /// Converts the given string into lowercase 8-bit characters, storing the result in the given buffer.
+    /// Characters outside of the Latin-1 range are not preserved, and will never match an ASCII pattern.
+    static void toLowerLatin1(const QString &str, std::string &result);
+
+private:
+    /// Returns the state reached from the given state through the given character, or 0 if there is no such transition
+    inline uint32_t findTransition(uint32_t state, uint8_t c) const
+    {
+        const Node &node = m_nodes[state];
+        auto begin = m_transitions.begin() + node.TransitionBegin;
+        auto end = m_transitions.begin() + node.TransitionEnd;
+        auto it = std::lower_bound(begin, end, c, [](const Transition &t, uint8_t label) {
+            return t.Label < label;
+        });
+        return (it != end && it->Label == c) ? it->Target : 0;
+    }
+
+private:
+    /// State of the automaton. Transitions and outputs are stored as ranges within shared containers
+    struct Node
+    {
+        /// Index of the first transition of this state in m_transitions
+        uint32_t TransitionBegin;
+
+        /// Index one past the last transition of this state in m_transitions
+        uint32_t TransitionEnd;
+
+        /// State to fall back to when there is no transition for the current character
+        uint32_t Fail;
+
+        /// Nearest state along the failure chain that has output, or 0 if there is none
+        uint32_t DictionaryLink;
+
+        /// Index of the first pattern identifier ending in this state, in m_outputs
+        uint32_t OutputBegin;
+
+        /// Index one past the last pattern identifier ending in this state, in m_outputs
+        uint32_t OutputEnd;
+    };
+
+    /// Labelled edge between two states
+    struct Transition
+    {
+        /// Character of the transition
+        uint8_t Label;
+
+        /// Target state
+        uint32_t Target;
+    };
+
+    /// Trie node, only used while patterns are being added
+    struct TrieNode
+    {
+        /// Child nodes, keyed by character
+        std::map<uint8_t, uint32_t> Children;
+
+        /// Identifiers of the patterns ending at this node
+        std::vector<uint32_t> Outputs;
+    };
+
+    /// States of the automaton, where the root state is at index 0
+    std::vector<Node> m_nodes;
+
+    /// Transitions of every state, sorted by label within each state's range
+    std::vector<Transition> m_transitions;
+
+    /// Pattern identifiers of every state
+    std::vector<uint32_t> m_outputs;
+
+    /// Direct lookup table of the transitions from the root state
+    std::array<uint32_t, 256> m_rootTransitions;
+
+    /// Trie of the patterns that have been added since the last build
+    std::vector<TrieNode> m_trie;
+};
+
+#endif // MULTIPATTERNMATCHER_H
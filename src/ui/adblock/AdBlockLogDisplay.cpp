@@ -50,14 +50,16 @@ void AdBlockLogDisplay::setLogTableFor(const QUrl &url)
     m_sourceUrl = url;
     ui->comboBoxLogSource->setCurrentIndex(0);
     ui->comboBoxLogSource->setItemText(0, url.toString());
-    m_sourceModel->setLogEntries(m_adBlockManager->getLog()->getEntriesFor(url));
+    adblock::AdBlockLog *log = m_adBlockManager->getLog();
+    m_sourceModel->setLogWindow(log, log->getWindowFor(url));
     ui->tableView->resizeColumnsToContents();
 }
 
 void AdBlockLogDisplay::showAllLogs()
 {
     ui->comboBoxLogSource->setCurrentIndex(1);
-    m_sourceModel->setLogEntries(m_adBlockManager->getLog()->getAllEntries());
+    adblock::AdBlockLog *log = m_adBlockManager->getLog();
+    m_sourceModel->setLogWindow(log, log->getWindow());
     ui->tableView->resizeColumnsToContents();
 }
 
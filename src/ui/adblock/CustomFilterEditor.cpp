@@ -11,6 +11,7 @@
 #include <QFile>
 #include <QLineEdit>
 #include <QMessageBox>
+#include <QSaveFile>
 #include <QDebug>
 
 CustomFilterEditor::CustomFilterEditor(QWidget *parent) :
@@ -55,14 +56,16 @@ void CustomFilterEditor::toggleFindTextWidget()
 
 void CustomFilterEditor::saveFilters()
 {
-    QFile outFile(m_filePath);
+    // The file is replaced rather than rewritten in place, as the subscription may have it mapped into memory
+    QSaveFile outFile(m_filePath);
     if (!outFile.open(QIODevice::WriteOnly))
         return;
 
     QByteArray filterData;
     filterData.append(ui->filterEditor->toPlainText().toUtf8());
     outFile.write(filterData);
-    outFile.close();
+    if (!outFile.commit())
+        return;
 
     emit filtersModified();
 
@@ -0,0 +1,530 @@
+#include "AdBlockFilterContainer.h"
+#include "AdBlockRequestHandler.h"
+#include "AdBlockSubscription.h"
+#include "CommonUtil.h"
+#include "URL.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdlib>
+#include <memory>
+#include <new>
+#include <random>
+#include <vector>
+
+#include <QDir>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QFileInfo>
+#include <QString>
+#include <QStringList>
+#include <QTemporaryDir>
+#include <QTextStream>
+#include <QtTest>
+#include <QUrl>
+
+#if defined(Q_OS_UNIX)
+#include <sys/resource.h>
+#endif
+
+using namespace adblock;
+
+/// Number of heap allocations made by the process since it started
+static std::atomic<quint64> numAllocations { 0 };
+
+#if defined(__GLIBC__)
+
+// Qt containers allocate with malloc rather than operator new, so the C allocation functions are
+// interposed on glibc to count every allocation made by the process
+extern "C"
+{
+void *__libc_malloc(size_t size);
+void *__libc_calloc(size_t count, size_t size);
+void *__libc_realloc(void *ptr, size_t size);
+
+void *malloc(size_t size)
+{
+    numAllocations.fetch_add(1, std::memory_order_relaxed);
+    return __libc_malloc(size);
+}
+
+void *calloc(size_t count, size_t size)
+{
+    numAllocations.fetch_add(1, std::memory_order_relaxed);
+    return __libc_calloc(count, size);
+}
+
+void *realloc(void *ptr, size_t size)
+{
+    numAllocations.fetch_add(1, std::memory_order_relaxed);
+    return __libc_realloc(ptr, size);
+}
+}
+
+#else
+
+// Elsewhere only the allocations made through operator new are counted
+void *operator new(std::size_t size)
+{
+    numAllocations.fetch_add(1, std::memory_order_relaxed);
+    if (void *ptr = std::malloc(size > 0 ? size : 1))
+        return ptr;
+    throw std::bad_alloc();
+}
+
+void *operator new[](std::size_t size)
+{
+    return ::operator new(size);
+}
+
+void operator delete(void *ptr) noexcept
+{
+    std::free(ptr);
+}
+
+void operator delete[](void *ptr) noexcept
+{
+    std::free(ptr);
+}
+
+void operator delete(void *ptr, std::size_t) noexcept
+{
+    std::free(ptr);
+}
+
+void operator delete[](void *ptr, std::size_t) noexcept
+{
+    std::free(ptr);
+}
+
+#endif
+
+/// Returns the peak resident set size of the process, in bytes, or -1 if it cannot be determined on this platform
+static qint64 getPeakResidentSetSize()
+{
+#if defined(Q_OS_UNIX)
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) != 0)
+        return -1;
+#if defined(Q_OS_MACOS)
+    return static_cast<qint64>(usage.ru_maxrss);
+#else
+    return static_cast<qint64>(usage.ru_maxrss) * 1024;
+#endif
+#else
+    return -1;
+#endif
+}
+
+/// Returns the given number of bytes as a human readable string
+static QString formatBytes(qint64 bytes)
+{
+    if (bytes < 0)
+        return QLatin1String("n/a");
+
+    return QString("%1 MiB").arg(static_cast<double>(bytes) / (1024.0 * 1024.0), 0, 'f', 1);
+}
+
+/**
+ * @class AdBlockBenchmark
+ * @brief Measures the time and memory needed to load filter lists, and replays a corpus of network
+ *        requests through the \ref adblock::FilterContainer and \ref adblock::RequestHandler to
+ *        measure per-request latency and allocations.
+ *
+ *        By default, a sample list padded with generated rules and a sample request corpus from
+ *        the data directory are used. Real list snapshots and recorded corpora can be given with
+ *        the following environment variables:
+ *
+ *        VIPER_ADBLOCK_BENCHMARK_LISTS - Filter list files, separated by the platform's path list separator
+ *        VIPER_ADBLOCK_BENCHMARK_CORPUS - Request corpus, with one "first party URL<tab>request URL<tab>type" per line
+ *        VIPER_ADBLOCK_BENCHMARK_SYNTHETIC_RULES - Number of generated rules added to the sample list (default 50000)
+ *        VIPER_ADBLOCK_BENCHMARK_ITERATIONS - Number of times the corpus is replayed (default 5)
+ */
+class AdBlockBenchmark : public QObject
+{
+    Q_OBJECT
+
+public:
+    AdBlockBenchmark();
+
+private Q_SLOTS:
+    void initTestCase();
+    void benchmarkListLoading();
+    void benchmarkFilterContainer();
+    void benchmarkRequestHandler();
+
+private:
+    /// Network request from the corpus
+    struct CorpusRequest
+    {
+        /// URL of the page that made the request
+        QUrl FirstPartyUrl;
+
+        /// URL of the request
+        QUrl RequestUrl;
+
+        /// Lowercase, fully encoded form of the request URL
+        QString RequestUrlStr;
+
+        /// Second level domain of the request URL
+        QString SecondLevelDomain;
+
+        /// Lowercase host of the first party URL
+        QString BaseUrl;
+
+        /// Resource type of the request, as the web engine would report it
+        QWebEngineUrlRequestInfo::ResourceType ResourceType;
+
+        /// Element type(s) of the request
+        ElementType Type;
+    };
+
+    /// Copies the filter lists that will be loaded into the temporary directory, where their caches will be written
+    void prepareLists();
+
+    /// Writes a list of generated rules, similar in composition to a real subscription, to the given path
+    void writeSyntheticList(const QString &path, int numRules) const;
+
+    /// Loads the request corpus from the given path
+    void loadCorpus(const QString &path);
+
+    /// Loads the subscriptions from the prepared filter lists, returning the time taken in milliseconds
+    qint64 loadSubscriptions();
+
+    /// Converts a request type name, as used in filter options, to the resource type reported by the web engine
+    static QWebEngineUrlRequestInfo::ResourceType getResourceType(const QString &typeName);
+
+    /// Prints the latency percentiles and allocation rate of a corpus replay
+    void reportReplay(const QString &name, std::vector<qint64> &latencies, quint64 allocations) const;
+
+private:
+    /// Directory holding the copies of the filter lists and their caches
+    QTemporaryDir m_tempDir;
+
+    /// Paths of the filter lists in the temporary directory
+    QStringList m_listPaths;
+
+    /// Loaded subscriptions
+    std::vector<Subscription> m_subscriptions;
+
+    /// Filter container built from the subscriptions
+    std::shared_ptr<FilterContainer> m_filterContainer;
+
+    /// Network requests to replay
+    std::vector<CorpusRequest> m_corpus;
+
+    /// Number of times the corpus is replayed through the request handler
+    int m_iterations;
+};
+
+AdBlockBenchmark::AdBlockBenchmark() :
+    QObject(),
+    m_tempDir(),
+    m_listPaths(),
+    m_subscriptions(),
+    m_filterContainer(nullptr),
+    m_corpus(),
+    m_iterations(5)
+{
+}
+
+void AdBlockBenchmark::initTestCase()
+{
+    QVERIFY(m_tempDir.isValid());
+
+    bool ok = false;
+    const int iterations = qEnvironmentVariableIntValue("VIPER_ADBLOCK_BENCHMARK_ITERATIONS", &ok);
+    if (ok && iterations > 0)
+        m_iterations = iterations;
+
+    prepareLists();
+    QVERIFY(!m_listPaths.isEmpty());
+
+    QString corpusPath = QString::fromLocal8Bit(qgetenv("VIPER_ADBLOCK_BENCHMARK_CORPUS"));
+    if (corpusPath.isEmpty())
+        corpusPath = QStringLiteral(ADBLOCK_BENCHMARK_DATA_DIR "/benchmark_requests.tsv");
+
+    loadCorpus(corpusPath);
+    QVERIFY(!m_corpus.empty());
+
+    qInfo().noquote() << QString("Corpus: %1 requests from %2").arg(m_corpus.size()).arg(corpusPath);
+}
+
+void AdBlockBenchmark::benchmarkListLoading()
+{
+    const qint64 parseTime = loadSubscriptions();
+
+    FilterMemoryUsage memoryUsage;
+    for (const Subscription &subscription : m_subscriptions)
+        memoryUsage += subscription.getMemoryUsage();
+
+    QVERIFY(memoryUsage.NumFilters > 0);
+
+    qInfo().noquote() << QString("Parse: %1 filters in %2 ms, filter memory %3, peak RSS %4")
+                         .arg(memoryUsage.NumFilters).arg(parseTime)
+                         .arg(formatBytes(static_cast<qint64>(memoryUsage.getTotal())), formatBytes(getPeakResidentSetSize()));
+
+    // The first load wrote the binary caches of the subscriptions, which are used from now on
+    const qint64 cacheLoadTime = loadSubscriptions();
+    qInfo().noquote() << QString("Load from cache: %1 ms").arg(cacheLoadTime);
+
+    QElapsedTimer timer;
+    timer.start();
+
+    m_filterContainer = std::make_shared<FilterContainer>();
+    m_filterContainer->extractFilters(m_subscriptions);
+
+    qInfo().noquote() << QString("Filter container: built in %1 ms, peak RSS %2")
+                         .arg(timer.elapsed()).arg(formatBytes(getPeakResidentSetSize()));
+}
+
+void AdBlockBenchmark::benchmarkFilterContainer()
+{
+    QVERIFY(m_filterContainer != nullptr);
+
+    // Matches each request against the filters directly, without the decision cache of the request handler
+    RequestHandler requestHandler(m_filterContainer, nullptr, nullptr);
+
+    std::vector<qint64> latencies;
+    latencies.reserve(m_corpus.size());
+
+    int numBlocked = 0;
+    QElapsedTimer timer;
+
+    const quint64 allocationsBefore = numAllocations.load(std::memory_order_relaxed);
+    for (const CorpusRequest &request : m_corpus)
+    {
+        timer.start();
+        const RequestHandler::RequestDecision decision = requestHandler.evaluateRequest(*m_filterContainer, request.RequestUrl, request.RequestUrlStr,
+                                                                                         request.SecondLevelDomain, request.BaseUrl, request.Type);
+        latencies.push_back(timer.nsecsElapsed());
+
+        if (decision.MatchingFilter != nullptr && decision.Action != FilterAction::Allow)
+            ++numBlocked;
+    }
+    const quint64 allocations = numAllocations.load(std::memory_order_relaxed) - allocationsBefore;
+
+    qInfo().noquote() << QString("FilterContainer: %1 of %2 requests blocked").arg(numBlocked).arg(m_corpus.size());
+    reportReplay(QStringLiteral("FilterContainer"), latencies, allocations);
+}
+
+void AdBlockBenchmark::benchmarkRequestHandler()
+{
+    QVERIFY(m_filterContainer != nullptr);
+
+    RequestHandler requestHandler(m_filterContainer, nullptr, nullptr);
+
+    std::vector<qint64> latencies;
+    latencies.reserve(m_corpus.size() * static_cast<size_t>(m_iterations));
+
+    QElapsedTimer timer;
+
+    const quint64 allocationsBefore = numAllocations.load(std::memory_order_relaxed);
+    for (int i = 0; i < m_iterations; ++i)
+    {
+        for (const CorpusRequest &request : m_corpus)
+        {
+            timer.start();
+            requestHandler.getDecision(*m_filterContainer, request.ResourceType, request.RequestUrl, request.FirstPartyUrl, request.BaseUrl);
+            latencies.push_back(timer.nsecsElapsed());
+        }
+    }
+    const quint64 allocations = numAllocations.load(std::memory_order_relaxed) - allocationsBefore;
+
+    const CacheStatistics cacheStats = requestHandler.getDecisionCacheStatistics();
+    qInfo().noquote() << QString("RequestHandler: %1 passes over the corpus, decision cache hit rate %2%")
+                         .arg(m_iterations).arg(cacheStats.getHitRate() * 100.0, 0, 'f', 1);
+    reportReplay(QStringLiteral("RequestHandler"), latencies, allocations);
+
+    qInfo().noquote() << QString("Peak RSS: %1").arg(formatBytes(getPeakResidentSetSize()));
+}
+
+void AdBlockBenchmark::prepareLists()
+{
+    const QString tempPath = m_tempDir.path();
+
+    const QString envLists = QString::fromLocal8Bit(qgetenv("VIPER_ADBLOCK_BENCHMARK_LISTS"));
+    if (!envLists.isEmpty())
+    {
+        const QStringList sourcePaths = envLists.split(QDir::listSeparator(), QStringSplitFlag::SkipEmptyParts);
+        for (const QString &sourcePath : sourcePaths)
+        {
+            const QString listPath = QString("%1/%2-%3").arg(tempPath).arg(m_listPaths.size()).arg(QFileInfo(sourcePath).fileName());
+            if (QFile::copy(sourcePath, listPath))
+                m_listPaths.append(listPath);
+            else
+                qWarning() << "Could not copy filter list " << sourcePath;
+        }
+        return;
+    }
+
+    const QString samplePath = QString("%1/benchmark_filters.txt").arg(tempPath);
+    if (QFile::copy(QStringLiteral(ADBLOCK_BENCHMARK_DATA_DIR "/benchmark_filters.txt"), samplePath))
+        m_listPaths.append(samplePath);
+
+    bool ok = false;
+    int numSyntheticRules = qEnvironmentVariableIntValue("VIPER_ADBLOCK_BENCHMARK_SYNTHETIC_RULES", &ok);
+    if (!ok)
+        numSyntheticRules = 50000;
+
+    if (numSyntheticRules > 0)
+    {
+        const QString syntheticPath = QString("%1/synthetic_filters.txt").arg(tempPath);
+        writeSyntheticList(syntheticPath, numSyntheticRules);
+        m_listPaths.append(syntheticPath);
+    }
+}
+
+void AdBlockBenchmark::writeSyntheticList(const QString &path, int numRules) const
+{
+    QFile file(path);
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Text))
+        return;
+
+    static const QStringList words = { "ad", "ads", "advert", "banner", "track", "pixel", "metrics", "stats", "promo", "sponsor",
+                                       "click", "beacon", "cdn", "static", "media", "img", "js", "video", "pop", "widget" };
+    static const QStringList tlds = { "com", "net", "org", "io", "example", "co.uk", "de", "fr" };
+    static const QStringList types = { "script", "image", "stylesheet", "xmlhttprequest", "subdocument", "ping", "media" };
+
+    std::mt19937 generator(1234);
+    auto pick = [&generator](const QStringList &list) -> const QString& {
+        return list.at(std::uniform_int_distribution<int>(0, list.size() - 1)(generator));
+    };
+    auto percent = [&generator]() {
+        return std::uniform_int_distribution<int>(0, 99)(generator);
+    };
+
+    QTextStream stream(&file);
+    stream << "[Adblock Plus 2.0]\n! Title: Generated benchmark rules\n";
+
+    for (int i = 0; i < numRules; ++i)
+    {
+        const QString domain = QString("%1%2-%3.%4").arg(pick(words)).arg(i).arg(pick(words), pick(tlds));
+        const int category = percent();
+
+        // The proportions of each kind of rule roughly follow those of EasyList and EasyPrivacy
+        if (category < 35)
+            stream << "||" << domain << "^";
+        else if (category < 45)
+            stream << "||" << domain << "^$" << pick(types) << ",third-party";
+        else if (category < 62)
+            stream << "/" << pick(words) << "-" << pick(words) << i << "/";
+        else if (category < 70)
+            stream << "||" << domain << "/" << pick(words) << "/*/" << pick(words) << "^";
+        else if (category < 74)
+            stream << "/" << pick(words) << "[0-9]{2}" << i << "\\." << pick(words) << "/";
+        else if (category < 78)
+            stream << "@@||" << domain << "/" << pick(words) << "/$" << pick(types);
+        else if (category < 82)
+            stream << "/" << pick(words) << i << "." << pick(words) << "$domain=" << pick(words) << i << "." << pick(tlds);
+        else if (category < 95)
+            stream << domain << "##." << pick(words) << "-" << pick(words) << "-" << i;
+        else
+            stream << "##." << pick(words) << "_" << pick(words) << "_" << i;
+
+        stream << "\n";
+    }
+}
+
+void AdBlockBenchmark::loadCorpus(const QString &path)
+{
+    QFile file(path);
+    if (!file.open(QIODevice::ReadOnly | QIODevice::Text))
+        return;
+
+    QTextStream stream(&file);
+    QString line;
+    while (stream.readLineInto(&line))
+    {
+        if (line.isEmpty() || line.startsWith(QLatin1Char('#')))
+            continue;
+
+        const QStringList parts = line.split(QLatin1Char('\t'));
+        if (parts.size() < 3)
+            continue;
+
+        CorpusRequest request;
+        request.FirstPartyUrl = QUrl(parts.at(0));
+        request.RequestUrl = QUrl(parts.at(1));
+        request.RequestUrlStr = request.RequestUrl.toString(QUrl::FullyEncoded).toLower();
+        request.SecondLevelDomain = URL(request.RequestUrl).getSecondLevelDomain();
+        request.BaseUrl = request.FirstPartyUrl.host().toLower();
+        request.ResourceType = getResourceType(parts.at(2).trimmed().toLower());
+        request.Type = RequestHandler::getRequestType(request.ResourceType, request.RequestUrl, request.RequestUrlStr,
+                                                      request.SecondLevelDomain, request.FirstPartyUrl);
+
+        if (request.RequestUrl.isValid())
+            m_corpus.push_back(std::move(request));
+    }
+}
+
+qint64 AdBlockBenchmark::loadSubscriptions()
+{
+    m_subscriptions.clear();
+
+    QElapsedTimer timer;
+    timer.start();
+
+    for (const QString &listPath : m_listPaths)
+    {
+        Subscription subscription(listPath);
+        subscription.load(nullptr);
+        m_subscriptions.push_back(std::move(subscription));
+    }
+
+    return timer.elapsed();
+}
+
+QWebEngineUrlRequestInfo::ResourceType AdBlockBenchmark::getResourceType(const QString &typeName)
+{
+    // Websocket requests are recognized by the scheme of their URL
+    if (typeName == QLatin1String("document"))
+        return QWebEngineUrlRequestInfo::ResourceTypeMainFrame;
+    if (typeName == QLatin1String("subdocument"))
+        return QWebEngineUrlRequestInfo::ResourceTypeSubFrame;
+    if (typeName == QLatin1String("script"))
+        return QWebEngineUrlRequestInfo::ResourceTypeScript;
+    if (typeName == QLatin1String("image"))
+        return QWebEngineUrlRequestInfo::ResourceTypeImage;
+    if (typeName == QLatin1String("stylesheet"))
+        return QWebEngineUrlRequestInfo::ResourceTypeStylesheet;
+    if (typeName == QLatin1String("object"))
+        return QWebEngineUrlRequestInfo::ResourceTypeObject;
+    if (typeName == QLatin1String("xmlhttprequest"))
+        return QWebEngineUrlRequestInfo::ResourceTypeXhr;
+    if (typeName == QLatin1String("ping"))
+        return QWebEngineUrlRequestInfo::ResourceTypePing;
+    return QWebEngineUrlRequestInfo::ResourceTypeUnknown;
+}
+
+void AdBlockBenchmark::reportReplay(const QString &name, std::vector<qint64> &latencies, quint64 allocations) const
+{
+    if (latencies.empty())
+        return;
+
+    std::sort(latencies.begin(), latencies.end());
+
+    auto getPercentile = [&latencies](double percentile) -> double {
+        const size_t index = std::min(latencies.size() - 1, static_cast<size_t>(percentile * static_cast<double>(latencies.size())));
+        return static_cast<double>(latencies.at(index)) / 1000.0;
+    };
+
+    qint64 total = 0;
+    for (qint64 latency : latencies)
+        total += latency;
+
+    const double mean = static_cast<double>(total) / static_cast<double>(latencies.size()) / 1000.0;
+    const double allocationsPerRequest = static_cast<double>(allocations) / static_cast<double>(latencies.size());
+
+    qInfo().noquote() << QString("%1: p50 %2 us, p99 %3 us, max %4 us, mean %5 us, %6 allocations per request")
+                         .arg(name)
+                         .arg(getPercentile(0.5), 0, 'f', 2)
+                         .arg(getPercentile(0.99), 0, 'f', 2)
+                         .arg(static_cast<double>(latencies.back()) / 1000.0, 0, 'f', 2)
+                         .arg(mean, 0, 'f', 2)
+                         .arg(allocationsPerRequest, 0, 'f', 1);
+}
+
+QTEST_GUILESS_MAIN(AdBlockBenchmark)
+
+#include "AdBlockBenchmark.moc"
@@ -1,8 +1,22 @@
 #include "AdBlockFilter.h"
 #include "AdBlockFilterParser.h"
-
+#include "AdBlockLog.h"
+#include "AdBlockSubscription.h"
+#include "CosmeticScriptTemplate.h"
+#include "DomainFilterIndex.h"
+#include "FilterListPatch.h"
+#include "FilterRegExp.h"
+#include "FilterStringArena.h"
+#include "FilterTokenIndex.h"
+
+#include <algorithm>
+#include <iterator>
 #include <memory>
+#include <QCryptographicHash>
+#include <QDataStream>
+#include <QFile>
 #include <QString>
+#include <QTemporaryDir>
 #include <QtTest>
 #include <QUrl>
 
@@ -21,6 +35,18 @@ private Q_SLOTS:
     void testCosmeticFilterMatch();
     void testFilterOptionMatches();
     void testRedirectFilterMatch();
+    void testTokenIndexMatch();
+    void testDomainFilterIndex();
+    void testCosmeticScriptTemplate();
+    void testSubscriptionLoad();
+    void testSubscriptionParallelLoad();
+    void testSubscriptionCache();
+    void testFilterListPatch();
+    void testSubscriptionPatchUpdate();
+    void testLogRingBuffer();
+    void testFilterStringArena();
+    void testRegExpRequiredLiteral();
+    void testRegExpFilterMatch();
 
 private:
     std::unique_ptr<Filter> domainCSSFilter;
@@ -128,6 +154,641 @@ void AdBlockFilterTest::testRedirectFilterMatch()
     QVERIFY2(redirectScriptRule->isMatch(baseUrl, requestUrlStr, domain, elemType), "Block rule should match the request");
 }
 
+void AdBlockFilterTest::testTokenIndexMatch()
+{
+    FilterParser parser(nullptr);
+    std::vector<std::unique_ptr<Filter>> filters;
+    filters.push_back(parser.makeFilter(QLatin1String("/banners/ad_")));
+    filters.push_back(parser.makeFilter(QLatin1String("|https://adserver.")));
+    filters.push_back(parser.makeFilter(QLatin1String("||cdn.example.com/tracker.js")));
+    filters.push_back(parser.makeFilter(QLatin1String("ads")));
+    filters.push_back(parser.makeFilter(QLatin1String("||tracking.example.net^*/pixel.")));
+    filters.push_back(parser.makeFilter(QLatin1String("promo*banner")));
+
+    std::deque<Filter*> filterPtrs;
+    for (auto &filter : filters)
+        filterPtrs.push_back(filter.get());
+
+    FilterTokenIndex index;
+    index.build(filterPtrs);
+    QCOMPARE(index.size(), filterPtrs.size());
+
+    // Filters with wildcards and separators are indexed by the complete tokens of their literal parts, while
+    // tokens next to a wildcard or an unanchored end may only be part of a token in the request URL
+    QCOMPARE(filters.at(4)->getCategory(), FilterCategory::RegExp);
+    QCOMPARE(filters.at(5)->getCategory(), FilterCategory::RegExp);
+    QCOMPARE(index.getNumUntokenizedFilters(), static_cast<size_t>(2));
+
+    auto findMatch = [&index](const QString &requestUrl, const QString &domain) -> Filter* {
+        return index.findMatch(FilterTokenIndex::tokenize(requestUrl), QLatin1String("somesite.com"),
+                               requestUrl, domain, ElementType::Image | ElementType::ThirdParty);
+    };
+
+    QString requestUrl = QLatin1String("https://images.somesite.com/banners/ad_300x250.png");
+    QCOMPARE(findMatch(requestUrl, QLatin1String("images.somesite.com")), filters.at(0).get());
+
+    requestUrl = QLatin1String("https://adserver.net/img.gif");
+    QCOMPARE(findMatch(requestUrl, QLatin1String("adserver.net")), filters.at(1).get());
+
+    requestUrl = QLatin1String("https://static.cdn.example.com/tracker.js?id=5");
+    QCOMPARE(findMatch(requestUrl, QLatin1String("static.cdn.example.com")), filters.at(2).get());
+
+    requestUrl = QLatin1String("https://tracking.example.net/v2/pixel.gif?u=1");
+    QCOMPARE(findMatch(requestUrl, QLatin1String("tracking.example.net")), filters.at(4).get());
+
+    requestUrl = QLatin1String("https://somesite.com/promotions/widebanners.png");
+    QCOMPARE(findMatch(requestUrl, QLatin1String("somesite.com")), filters.at(5).get());
+
+    // Filters without a complete token must still be evaluated against every request
+    requestUrl = QLatin1String("https://somesite.com/uploads/img.png");
+    QCOMPARE(findMatch(requestUrl, QLatin1String("somesite.com")), filters.at(3).get());
+
+    requestUrl = QLatin1String("https://somesite.com/img/banner.png");
+    QVERIFY(findMatch(requestUrl, QLatin1String("somesite.com")) == nullptr);
+
+    // When filters in different buckets match the same request, the one that comes first in the container wins,
+    // regardless of the order in which the buckets are probed
+    std::vector<std::unique_ptr<Filter>> overlappingFilters;
+    overlappingFilters.push_back(parser.makeFilter(QLatin1String("||widgets.example.org/embed.js$script,redirect=noopjs")));
+    overlappingFilters.push_back(parser.makeFilter(QLatin1String("/embed.js")));
+
+    for (int i = 0; i < 2; ++i)
+    {
+        std::deque<Filter*> overlappingPtrs;
+        for (auto &filter : overlappingFilters)
+            overlappingPtrs.push_back(filter.get());
+
+        FilterTokenIndex overlappingIndex;
+        overlappingIndex.build(overlappingPtrs);
+        QCOMPARE(overlappingIndex.getNumUntokenizedFilters(), static_cast<size_t>(0));
+
+        requestUrl = QLatin1String("https://widgets.example.org/embed.js");
+        Filter *match = overlappingIndex.findMatch(FilterTokenIndex::tokenize(requestUrl), QLatin1String("somesite.com"),
+                                                   requestUrl, QLatin1String("widgets.example.org"), ElementType::Script | ElementType::ThirdParty);
+        QCOMPARE(match, overlappingFilters.front().get());
+        QCOMPARE(match->isRedirect(), i == 0);
+
+        std::swap(overlappingFilters.front(), overlappingFilters.back());
+    }
+}
+
+void AdBlockFilterTest::testDomainFilterIndex()
+{
+    FilterParser parser(nullptr);
+    std::vector<std::unique_ptr<Filter>> filters;
+    filters.push_back(parser.makeFilter(QLatin1String("example.com##.ad-banner")));
+    filters.push_back(parser.makeFilter(QLatin1String("example.*##.entity-ad")));
+    filters.push_back(parser.makeFilter(QLatin1String("news.example.com,~sports.news.example.com##.sidebar-ad")));
+    filters.push_back(parser.makeFilter(QLatin1String("##.generic-ad")));
+    filters.push_back(parser.makeFilter(QLatin1String("other.org##.ad-banner")));
+    filters.push_back(parser.makeFilter(QLatin1String("example.com,a.example.com##.multi-domain-ad")));
+
+    std::vector<Filter*> filterPtrs;
+    for (auto &filter : filters)
+        filterPtrs.push_back(filter.get());
+
+    DomainFilterIndex index;
+    index.build(std::move(filterPtrs));
+    QCOMPARE(index.size(), filters.size());
+
+    auto findMatches = [&](const QString &domain) -> std::vector<int> {
+        std::vector<int> result;
+        for (Filter *filter : index.findMatches(domain))
+        {
+            auto it = std::find_if(filters.begin(), filters.end(), [filter](const std::unique_ptr<Filter> &f) { return f.get() == filter; });
+            result.push_back(static_cast<int>(std::distance(filters.begin(), it)));
+        }
+        return result;
+    };
+
+    // Matches are returned once each, in their original order
+    QCOMPARE(findMatches(QLatin1String("a.example.com")), std::vector<int>({ 0, 1, 3, 5 }));
+    QCOMPARE(findMatches(QLatin1String("news.example.com")), std::vector<int>({ 0, 1, 2, 3, 5 }));
+
+    // Excluded domains are still respected
+    QCOMPARE(findMatches(QLatin1String("sports.news.example.com")), std::vector<int>({ 0, 1, 3, 5 }));
+
+    // Entity filters apply to every top level domain
+    QCOMPARE(findMatches(QLatin1String("www.example.de")), std::vector<int>({ 1, 3 }));
+
+    QCOMPARE(findMatches(QLatin1String("other.org")), std::vector<int>({ 3, 4 }));
+    QVERIFY(findMatches(QString()).empty());
+}
+
+void AdBlockFilterTest::testCosmeticScriptTemplate()
+{
+    const CosmeticScriptTemplate scriptTemplate(QLatin1String("run({{A}}); hide([{{B}}]); again({{A}});"),
+                                                { QLatin1String("{{A}}"), QLatin1String("{{B}}") });
+    QVERIFY(!scriptTemplate.isEmpty());
+
+    const std::vector<QString> first { QLatin1String("x"), QLatin1String("y") };
+    const std::vector<QString> second { QLatin1String("'.ad'"), QLatin1String("'#banner'") };
+    QCOMPARE(scriptTemplate.render({ &first, &second }, QLatin1String(",")),
+             QLatin1String("run(x,y); hide(['.ad','#banner']); again(x,y);"));
+
+    // Placeholders without any fragments are removed
+    const std::vector<QString> empty;
+    QCOMPARE(scriptTemplate.render({ &empty, &second }), QLatin1String("run(); hide(['.ad''#banner']); again();"));
+    QCOMPARE(scriptTemplate.render({}), QLatin1String("run(); hide([]); again();"));
+
+    QVERIFY(CosmeticScriptTemplate().isEmpty());
+}
+
+void AdBlockFilterTest::testSubscriptionLoad()
+{
+    QTemporaryDir tempDir;
+    QVERIFY(tempDir.isValid());
+
+    const QString listPath = tempDir.path() + QLatin1String("/list.txt");
+    {
+        QFile listFile(listPath);
+        QVERIFY(listFile.open(QIODevice::WriteOnly));
+        listFile.write("\xEF\xBB\xBF[Adblock Plus 2.0]\r\n"
+                       "! Title: Test List\r\n"
+                       "! Expires: 4 days\r\n"
+                       "\r\n"
+                       "#\n"
+                       "# comment\n"
+                       "  ||ads.example.com^  \r\n"
+                       "example.com##.caf\xC3\xA9-ad\n"
+                       "@@||cdn.example.com/ads.js$script \\\n"
+                       "    ,domain=example.com\n"
+                       "/banner/*/ad_\n"
+                       "||tracker.example.org^ \\\n"
+                       "/pixel.gif");
+    }
+
+    Subscription subscription(listPath);
+    subscription.load(nullptr);
+
+    QCOMPARE(subscription.getName(), QLatin1String("Test List"));
+    QCOMPARE(subscription.getNumFilters(), static_cast<size_t>(6));
+
+    // The memory usage is measured when the filters are loaded, and carries over to the subscription that the
+    // metadata is copied to, which does not hold any filters itself
+    QCOMPARE(subscription.getMemoryUsage().NumFilters, static_cast<size_t>(6));
+    QVERIFY(subscription.getMemoryUsage().getTotal() > 0);
+
+    Subscription publishedSubscription = subscription.cloneWithoutFilters();
+    QCOMPARE(publishedSubscription.getMemoryUsage().NumFilters, static_cast<size_t>(0));
+    publishedSubscription.updateMetadata(subscription);
+    QCOMPARE(publishedSubscription.getNumFilters(), static_cast<size_t>(0));
+    QCOMPARE(publishedSubscription.getMemoryUsage().getTotal(), subscription.getMemoryUsage().getTotal());
+
+    QCOMPARE(subscription.getFilter(0)->getRule(), QLatin1String("||ads.example.com^"));
+    QCOMPARE(subscription.getFilter(0)->getCategory(), FilterCategory::Domain);
+
+    QCOMPARE(subscription.getFilter(1)->getRule(), QString::fromUtf8("example.com##.caf\xC3\xA9-ad"));
+    QCOMPARE(subscription.getFilter(1)->getCategory(), FilterCategory::Stylesheet);
+
+    // Continuation lines are joined to the rule they continue
+    QCOMPARE(subscription.getFilter(2)->getRule(), QLatin1String("@@||cdn.example.com/ads.js$script,domain=example.com"));
+    QVERIFY(subscription.getFilter(2)->isException());
+
+    QCOMPARE(subscription.getFilter(3)->getCategory(), FilterCategory::RegExp);
+
+    // A line that is not indented does not continue the previous rule
+    QCOMPARE(subscription.getFilter(4)->getRule(), QLatin1String("||tracker.example.org^ \\"));
+    QCOMPARE(subscription.getFilter(5)->getRule(), QLatin1String("/pixel.gif"));
+
+    // Rules in the string arena hash and log the same as the rules of filters that have not been stored in an arena
+    FilterParser parser(nullptr);
+    const Filter *arenaFilter = subscription.getFilter(1);
+    std::unique_ptr<Filter> parsedFilter = parser.makeFilter(QString::fromUtf8("example.com##.caf\xC3\xA9-ad"));
+    QVERIFY(arenaFilter->getRuleText().isValid());
+    QVERIFY(arenaFilter->isSameRule(*parsedFilter));
+    QCOMPARE(arenaFilter->getRuleHash(), parsedFilter->getRuleHash());
+    QVERIFY(arenaFilter->getRuleHash() != subscription.getFilter(0)->getRuleHash());
+
+    AdBlockLog log(nullptr, 4);
+    const QUrl pageUrl(QLatin1String("https://example.com/"));
+    log.addEntry(FilterAction::Block, pageUrl, QUrl(QLatin1String("https://ads.example.com/1.js")), ElementType::Script, *subscription.getFilter(0));
+    log.addEntry(FilterAction::Block, pageUrl, QUrl(QLatin1String("https://ads.example.com/2.js")), ElementType::Script, *arenaFilter);
+    log.addEntry(FilterAction::Block, pageUrl, QUrl(QLatin1String("https://ads.example.com/3.js")), ElementType::Script, *parsedFilter);
+
+    LogEntry entry;
+    QVERIFY(log.getEntry(0, entry));
+    QCOMPARE(entry.Action, FilterAction::Block);
+    QCOMPARE(entry.Rule, QLatin1String("||ads.example.com^"));
+    QVERIFY(log.getEntry(1, entry));
+    QCOMPARE(entry.Rule, QString::fromUtf8("example.com##.caf\xC3\xA9-ad"));
+    QVERIFY(log.getEntry(2, entry));
+    QCOMPARE(entry.Rule, QString::fromUtf8("example.com##.caf\xC3\xA9-ad"));
+}
+
+void AdBlockFilterTest::testSubscriptionParallelLoad()
+{
+    QTemporaryDir tempDir;
+    QVERIFY(tempDir.isValid());
+
+    // Large enough for the rules to be parsed in several chunks
+    const int numRules = 10000;
+    auto getRule = [](int i) -> QString {
+        switch (i % 3)
+        {
+            case 0: return QString("||ads%1.example.com^").arg(i);
+            case 1: return QString("example%1.com##.ad").arg(i);
+            default: return QString("@@||cdn%1.example.com^$script").arg(i);
+        }
+    };
+
+    const QString listPath = tempDir.path() + QLatin1String("/large.txt");
+    {
+        QFile listFile(listPath);
+        QVERIFY(listFile.open(QIODevice::WriteOnly));
+        listFile.write("! Title: Large List\n");
+        for (int i = 0; i < numRules; ++i)
+        {
+            listFile.write(getRule(i).toUtf8());
+            listFile.write("\n");
+        }
+    }
+
+    Subscription subscription(listPath);
+    subscription.load(nullptr);
+
+    // Filters must be in the same order as their rules, regardless of the order the chunks were parsed in
+    QCOMPARE(subscription.getNumFilters(), static_cast<size_t>(numRules));
+    for (int i = 0; i < numRules; ++i)
+    {
+        Filter *filter = subscription.getFilter(static_cast<size_t>(i));
+        QVERIFY(filter != nullptr);
+        QCOMPARE(filter->getRule(), getRule(i));
+    }
+
+    QCOMPARE(subscription.getFilter(0)->getCategory(), FilterCategory::Domain);
+    QCOMPARE(subscription.getFilter(1)->getCategory(), FilterCategory::Stylesheet);
+    QVERIFY(subscription.getFilter(2)->isException());
+}
+
+void AdBlockFilterTest::testSubscriptionCache()
+{
+    QTemporaryDir tempDir;
+    QVERIFY(tempDir.isValid());
+
+    const QString listPath = tempDir.path() + QLatin1String("/list.txt");
+    auto writeList = [&listPath](const QByteArray &contents) -> QByteArray {
+        QFile listFile(listPath);
+        if (!listFile.open(QIODevice::WriteOnly | QIODevice::Truncate))
+            return QByteArray();
+        listFile.write(contents);
+        return QCryptographicHash::hash(contents, QCryptographicHash::Sha1);
+    };
+
+    const QByteArray originalChecksum = writeList("! Title: Cached List\n"
+                                                  "! Diff-Path: ../patches/list.patch#list\n"
+                                                  "||ads.example.com^\n"
+                                                  "example.com##.ad\n"
+                                                  "@@||cdn.example.com^$script\n"
+                                                  "||tracker.example.net^*/pixel.\n");
+    QVERIFY(!originalChecksum.isEmpty());
+
+    Subscription original(listPath);
+    original.load(nullptr);
+    QCOMPARE(original.getNumFilters(), static_cast<size_t>(4));
+    QVERIFY(QFile::exists(original.getCacheFilePath()));
+
+    // The cache restores the filters and the metadata of the subscription
+    {
+        Subscription cached(listPath);
+        std::vector< std::shared_ptr<Filter> > staleFilters;
+        QVERIFY(cached.loadCache(originalChecksum, QByteArray(), staleFilters));
+        QVERIFY(staleFilters.empty());
+
+        QCOMPARE(cached.getName(), QLatin1String("Cached List"));
+        QCOMPARE(cached.getDiffPath(), QLatin1String("../patches/list.patch#list"));
+        QCOMPARE(cached.m_filters.size(), original.getNumFilters());
+        for (size_t i = 0; i < cached.m_filters.size(); ++i)
+        {
+            const Filter *cachedFilter = cached.m_filters.at(i).get();
+            const Filter *originalFilter = original.getFilter(i);
+            QCOMPARE(cachedFilter->getRule(), originalFilter->getRule());
+            QCOMPARE(cachedFilter->getCategory(), originalFilter->getCategory());
+            QCOMPARE(cachedFilter->getEvalString(), originalFilter->getEvalString());
+            QCOMPARE(cachedFilter->isException(), originalFilter->isException());
+        }
+
+        // Filters built with other resources are not taken from the cache
+        QVERIFY(!cached.loadCache(originalChecksum, QByteArray("resources"), staleFilters));
+        QVERIFY(staleFilters.empty());
+    }
+
+    // Changes to the list invalidate the cache, but its filters are handed back for reuse
+    const QByteArray updatedChecksum = writeList("! Title: Cached List\n"
+                                                 "||ads.example.com^\n"
+                                                 "example.com##.ad\n"
+                                                 "||pixel.example.org^\n");
+    {
+        Subscription updated(listPath);
+        std::vector< std::shared_ptr<Filter> > staleFilters;
+        QVERIFY(!updated.loadCache(updatedChecksum, QByteArray(), staleFilters));
+        QCOMPARE(staleFilters.size(), static_cast<size_t>(4));
+        QCOMPARE(staleFilters.at(0)->getRule(), QLatin1String("||ads.example.com^"));
+
+        updated.load(nullptr);
+        QCOMPARE(updated.getNumFilters(), static_cast<size_t>(3));
+        QCOMPARE(updated.getFilter(2)->getRule(), QLatin1String("||pixel.example.org^"));
+        QCOMPARE(updated.getFilter(2)->getCategory(), FilterCategory::Domain);
+        QVERIFY(updated.getDiffPath().isEmpty());
+    }
+
+    // A cache written by another version of the format is ignored entirely
+    {
+        QFile cacheFile(original.getCacheFilePath());
+        QVERIFY(cacheFile.open(QIODevice::ReadWrite));
+        QVERIFY(cacheFile.seek(4));
+        QDataStream stream(&cacheFile);
+        stream.setVersion(QDataStream::Qt_5_9);
+        stream << quint32(0xFFFFFFFFU);
+    }
+    {
+        Subscription mismatched(listPath);
+        std::vector< std::shared_ptr<Filter> > staleFilters;
+        QVERIFY(!mismatched.loadCache(updatedChecksum, QByteArray(), staleFilters));
+        QVERIFY(staleFilters.empty());
+    }
+
+    // As is a file that is not a filter cache
+    {
+        QFile cacheFile(original.getCacheFilePath());
+        QVERIFY(cacheFile.open(QIODevice::WriteOnly | QIODevice::Truncate));
+        cacheFile.write("not a filter cache");
+    }
+    {
+        Subscription invalid(listPath);
+        std::vector< std::shared_ptr<Filter> > staleFilters;
+        QVERIFY(!invalid.loadCache(updatedChecksum, QByteArray(), staleFilters));
+        QVERIFY(staleFilters.empty());
+
+        invalid.load(nullptr);
+        QCOMPARE(invalid.getNumFilters(), static_cast<size_t>(3));
+    }
+}
+
+void AdBlockFilterTest::testFilterListPatch()
+{
+    const QByteArray original("! Title: Test List\n"
+                              "||ads.example.com^\n"
+                              "||tracker.example.com^\n"
+                              "example.com##.ad\n"
+                              "/banner/*/ad_\n");
+    const QByteArray expected("! Title: Test List\n"
+                              "||ads.example.com^\n"
+                              "||pixel.example.com^\n"
+                              "example.com##.ad\n"
+                              "/banner/*/ad_\n"
+                              "example.org##.sponsored\n");
+
+    // Changes to a single list replace the third line, and add a line to the end of the list
+    QByteArray result;
+    const FilterListPatch singlePatch("d3 1\n"
+                                      "a3 1\n"
+                                      "||pixel.example.com^\n"
+                                      "a5 1\n"
+                                      "example.org##.sponsored\n");
+    QVERIFY(singlePatch.isValid());
+    QVERIFY(singlePatch.apply(QString(), original, result));
+    QCOMPARE(result, expected);
+
+    // Changes to several lists are selected by name, and verified with the checksum of the result
+    const QByteArray checksum = QCryptographicHash::hash(expected, QCryptographicHash::Sha1).toHex().left(10);
+    const FilterListPatch batchPatch(QByteArray("diff name:other lines:1 checksum:0123456789\n"
+                                                "d1 1\n"
+                                                "diff name:list lines:5 checksum:") + checksum + QByteArray("\n"
+                                                "d3 1\n"
+                                                "a3 1\n"
+                                                "||pixel.example.com^\n"
+                                                "a5 1\n"
+                                                "example.org##.sponsored\n"));
+    QVERIFY(batchPatch.isValid());
+    QVERIFY(batchPatch.apply(QLatin1String("list"), original, result));
+    QCOMPARE(result, expected);
+
+    // Patches must not apply to lists they have no changes for, or to lists whose contents do not match the checksum
+    QVERIFY(!batchPatch.apply(QLatin1String("missing"), original, result));
+    QVERIFY(!batchPatch.apply(QLatin1String("other"), original, result));
+
+    // Commands that refer to lines beyond the end of the list are rejected
+    const FilterListPatch invalidPatch("d9 1\n");
+    QVERIFY(invalidPatch.isValid());
+    QVERIFY(!invalidPatch.apply(QString(), original, result));
+
+    QVERIFY(!FilterListPatch("diff name:list lines:3\nd1 1\n").isValid());
+}
+
+void AdBlockFilterTest::testSubscriptionPatchUpdate()
+{
+    QTemporaryDir tempDir;
+    QVERIFY(tempDir.isValid());
+
+    const QString listPath = tempDir.path() + QLatin1String("/list.txt");
+    const QByteArray original("! Title: Patched List\n"
+                              "! Diff-Path: ../patches/2024-01-01.patch#list\n"
+                              "||ads.example.com^\n"
+                              "||tracker.example.com^\n"
+                              "example.com##.ad\n"
+                              "@@||cdn.example.com^$script\n");
+    {
+        QFile listFile(listPath);
+        QVERIFY(listFile.open(QIODevice::WriteOnly));
+        listFile.write(original);
+    }
+
+    Subscription subscription(listPath);
+    subscription.load(nullptr);
+    QCOMPARE(subscription.getNumFilters(), static_cast<size_t>(4));
+    QCOMPARE(subscription.m_numReusedFilters, static_cast<size_t>(0));
+
+    // The patch moves the list to the next differential update, and replaces one of its rules
+    const FilterListPatch patch("diff name:list lines:6\n"
+                                "d2 1\n"
+                                "a2 1\n"
+                                "! Diff-Path: ../patches/2024-01-02.patch#list\n"
+                                "d4 1\n"
+                                "a4 1\n"
+                                "||pixel.example.com^\n");
+    QVERIFY(patch.isValid());
+
+    QByteArray patched;
+    QVERIFY(patch.apply(QLatin1String("list"), original, patched));
+    {
+        QFile listFile(listPath);
+        QVERIFY(listFile.open(QIODevice::WriteOnly | QIODevice::Truncate));
+        listFile.write(patched);
+    }
+
+    // Only the rule that was added is parsed, while the filters of the unchanged rules are taken from the outdated cache
+    Subscription updated(listPath);
+    updated.load(nullptr);
+    QCOMPARE(updated.getNumFilters(), static_cast<size_t>(4));
+    QCOMPARE(updated.m_numReusedFilters, static_cast<size_t>(3));
+    QCOMPARE(updated.getDiffPath(), QLatin1String("../patches/2024-01-02.patch#list"));
+
+    QCOMPARE(updated.getFilter(0)->getRule(), QLatin1String("||ads.example.com^"));
+    QCOMPARE(updated.getFilter(1)->getRule(), QLatin1String("||pixel.example.com^"));
+    QCOMPARE(updated.getFilter(1)->getCategory(), FilterCategory::Domain);
+    QCOMPARE(updated.getFilter(2)->getCategory(), FilterCategory::Stylesheet);
+    QVERIFY(updated.getFilter(3)->isException());
+
+    // The updated list was written to the cache, so loading it again does not parse or reuse anything
+    Subscription reloaded(listPath);
+    reloaded.load(nullptr);
+    QCOMPARE(reloaded.getNumFilters(), static_cast<size_t>(4));
+    QCOMPARE(reloaded.m_numReusedFilters, static_cast<size_t>(0));
+    QCOMPARE(reloaded.getFilter(1)->getRule(), QLatin1String("||pixel.example.com^"));
+}
+
+void AdBlockFilterTest::testLogRingBuffer()
+{
+    AdBlockLog log(nullptr, 4);
+    QCOMPARE(log.getCapacity(), static_cast<quint32>(4));
+
+    const QUrl pageA(QLatin1String("https://a.example.com/")), pageB(QLatin1String("https://b.example.com/"));
+    log.addEntry(FilterAction::Block, pageA, QUrl(QLatin1String("https://ads.example.com/1.js")), ElementType::Script, QLatin1String("||ads.example.com^"));
+    log.addEntry(FilterAction::Allow, pageB, QUrl(QLatin1String("https://cdn.example.com/2.js")), ElementType::Script, QLatin1String("@@||cdn.example.com^"));
+    log.addEntry(FilterAction::Redirect, pageA, QUrl(QLatin1String("https://ads.example.com/3.gif")), ElementType::Image, QLatin1String("||ads.example.com^$redirect=1x1.gif"));
+
+    QCOMPARE(log.getWindow().size(), static_cast<size_t>(3));
+
+    PageLogSummary summary = log.getSummaryFor(pageA);
+    QCOMPARE(summary.NumBlocked, static_cast<quint32>(1));
+    QCOMPARE(summary.NumRedirected, static_cast<quint32>(1));
+    QCOMPARE(summary.getTotal(), static_cast<quint32>(2));
+
+    const LogWindow windowA = log.getWindowFor(pageA);
+    QCOMPARE(windowA.size(), static_cast<size_t>(2));
+
+    LogEntry entry;
+    QVERIFY(log.getEntry(windowA.getSequence(1), entry));
+    QCOMPARE(entry.Action, FilterAction::Redirect);
+    QCOMPARE(entry.FirstPartyUrl, pageA);
+    QCOMPARE(entry.RequestUrl, QUrl(QLatin1String("https://ads.example.com/3.gif")));
+    QCOMPARE(entry.ResourceType, ElementType::Image);
+    QCOMPARE(entry.Rule, QLatin1String("||ads.example.com^$redirect=1x1.gif"));
+
+    // Once the log is full, each new entry replaces the oldest one, along with its count in the page summary
+    log.addEntry(FilterAction::Block, pageB, QUrl(QLatin1String("https://ads.example.com/4.js")), ElementType::Script, QLatin1String("||ads.example.com^"));
+    log.addEntry(FilterAction::Block, pageB, QUrl(QLatin1String("https://ads.example.com/5.js")), ElementType::Script, QLatin1String("||ads.example.com^"));
+
+    QCOMPARE(log.getWindow().size(), static_cast<size_t>(4));
+    QVERIFY(!log.getEntry(windowA.getSequence(0), entry));
+    QVERIFY(log.getEntry(windowA.getSequence(1), entry));
+
+    summary = log.getSummaryFor(pageA);
+    QCOMPARE(summary.NumBlocked, static_cast<quint32>(0));
+    QCOMPARE(summary.getTotal(), static_cast<quint32>(1));
+    QCOMPARE(log.getSummaryFor(pageB).getTotal(), static_cast<quint32>(3));
+    QCOMPARE(log.getWindowFor(pageB).size(), static_cast<size_t>(3));
+
+    // Entries remain readable after many more URLs and rules have been interned than the log can hold
+    for (int i = 0; i < 1000; ++i)
+    {
+        log.addEntry(FilterAction::Block, QUrl(QString("https://page%1.example.com/").arg(i)),
+                     QUrl(QString("https://ads.example.com/%1.js").arg(i)), ElementType::Script, QString("/ads/%1.js").arg(i));
+    }
+    log.addEntry(FilterAction::Block, pageA, QUrl(QLatin1String("https://ads.example.com/6.js")), ElementType::Script, QLatin1String("||ads.example.com^"));
+
+    const LogWindow window = log.getWindow();
+    QCOMPARE(window.size(), static_cast<size_t>(4));
+    for (size_t i = 0; i < window.size(); ++i)
+        QVERIFY(log.getEntry(window.getSequence(i), entry));
+
+    QCOMPARE(entry.FirstPartyUrl, pageA);
+    QCOMPARE(entry.Rule, QLatin1String("||ads.example.com^"));
+    QCOMPARE(log.getSummaryFor(pageA).getTotal(), static_cast<quint32>(1));
+    QCOMPARE(log.getSummaryFor(pageB).getTotal(), static_cast<quint32>(0));
+}
+
+void AdBlockFilterTest::testFilterStringArena()
+{
+    FilterStringArena arena;
+
+    const QString asciiRule = QLatin1String("||cdn.example.com/tracker.js$script,third-party");
+    const QString latin1Rule = QString::fromUtf8("caf\xC3\xA9.example.com##.banner");
+    const QString unicodeRule = QString::fromUtf8("\xE4\xBE\x8B\xE3\x81\x88.jp##.ad");
+    const QString largeRule = QString(100000, QChar('a'));
+
+    const ArenaString ascii = arena.append(asciiRule);
+    const ArenaString latin1 = arena.append(latin1Rule);
+    const ArenaString unicode = arena.append(unicodeRule);
+    const ArenaString large = arena.append(largeRule);
+    const ArenaString empty = arena.append(QString());
+
+    QVERIFY(ascii.IsLatin1);
+    QCOMPARE(ascii.Size, static_cast<quint32>(asciiRule.size()));
+    QCOMPARE(ascii.toString(), asciiRule);
+
+    QVERIFY(latin1.IsLatin1);
+    QCOMPARE(latin1.toString(), latin1Rule);
+
+    QVERIFY(!unicode.IsLatin1);
+    QCOMPARE(unicode.toString(), unicodeRule);
+
+    QCOMPARE(large.toString(), largeRule);
+
+    QVERIFY(empty.isValid());
+    QVERIFY(empty.toString().isEmpty());
+
+    // Strings stored earlier must not be affected by later allocations
+    QCOMPARE(ascii.toString(), asciiRule);
+
+    QVERIFY(arena.append(asciiRule) == ascii);
+    QVERIFY(!(arena.append(latin1Rule) == ascii));
+    QVERIFY(arena.getSize() <= arena.getCapacity());
+
+    FilterParser parser(nullptr);
+    std::unique_ptr<Filter> filter = parser.makeFilter(asciiRule);
+    std::unique_ptr<Filter> sameFilter = parser.makeFilter(asciiRule);
+    QVERIFY(filter->isSameRule(*sameFilter));
+    QVERIFY(!filter->isSameRule(*blockDomainRule));
+
+    const FilterMemoryUsage usage = filter->getMemoryUsage();
+    QCOMPARE(usage.NumFilters, size_t(1));
+    QVERIFY(usage.FilterBytes >= sizeof(Filter));
+    QVERIFY(usage.StringBytes > 0);
+}
+
+void AdBlockFilterTest::testRegExpRequiredLiteral()
+{
+    QCOMPARE(FilterRegExp::extractRequiredLiteral(QLatin1String("^https?://[a-z]+\\.adserver\\.com/banner"), true), QLatin1String(".adserver.com/banner"));
+    QCOMPARE(FilterRegExp::extractRequiredLiteral(QLatin1String("/ads/[0-9]{3}/track(?:ing)?\\.js"), true), QLatin1String("/track"));
+    QCOMPARE(FilterRegExp::extractRequiredLiteral(QLatin1String("/AdFrame\\d+\\.html"), false), QLatin1String("/adframe"));
+
+    // The character before a quantifier is optional, and is not part of the literal
+    QCOMPARE(FilterRegExp::extractRequiredLiteral(QLatin1String("trackers?\\.net"), true), QLatin1String("tracker"));
+    QCOMPARE(FilterRegExp::extractRequiredLiteral(QLatin1String("abc{2}def"), true), QLatin1String("def"));
+
+    // Alternatives, inline options and literals that are too short cannot be used
+    QVERIFY(FilterRegExp::extractRequiredLiteral(QLatin1String("adserver|tracker"), true).isEmpty());
+    QVERIFY(FilterRegExp::extractRequiredLiteral(QLatin1String("(?i)adserver"), true).isEmpty());
+    QVERIFY(FilterRegExp::extractRequiredLiteral(QLatin1String("^ad[0-9]+x"), true).isEmpty());
+}
+
+void AdBlockFilterTest::testRegExpFilterMatch()
+{
+    FilterParser parser(nullptr);
+    std::unique_ptr<Filter> wildcardFilter = parser.makeFilter(QLatin1String("/banners/*/ad_"));
+    std::unique_ptr<Filter> regExpFilter = parser.makeFilter(QLatin1String("/^https?:\\/\\/cdn[0-9]*\\.tracker\\.com\\//"));
+
+    QCOMPARE(wildcardFilter->getCategory(), FilterCategory::RegExp);
+    QCOMPARE(regExpFilter->getCategory(), FilterCategory::RegExp);
+
+    const QString baseUrl = QLatin1String("somesite.com");
+    const ElementType elemType = ElementType::Image | ElementType::ThirdParty;
+
+    QVERIFY(wildcardFilter->isMatch(baseUrl, QLatin1String("https://somesite.com/banners/top/ad_300.png"), baseUrl, elemType));
+    QVERIFY(!wildcardFilter->isMatch(baseUrl, QLatin1String("https://somesite.com/banners/top/ads.png"), baseUrl, elemType));
+    QVERIFY(!wildcardFilter->isMatch(baseUrl, QLatin1String("https://somesite.com/images/top/ad_300.png"), baseUrl, elemType));
+
+    QVERIFY(regExpFilter->isMatch(baseUrl, QLatin1String("https://cdn2.tracker.com/pixel.gif"), QLatin1String("cdn2.tracker.com"), elemType));
+    QVERIFY(!regExpFilter->isMatch(baseUrl, QLatin1String("https://cdn2.tracker.org/pixel.gif"), QLatin1String("cdn2.tracker.org"), elemType));
+
+    // Equal expressions are shared
+    std::shared_ptr<FilterRegExp> regExp = FilterRegExp::create(QLatin1String("ad[sx]\\.js"), QRegularExpression::CaseInsensitiveOption);
+    QVERIFY(regExp == FilterRegExp::create(QLatin1String("ad[sx]\\.js"), QRegularExpression::CaseInsensitiveOption));
+    QVERIFY(regExp != FilterRegExp::create(QLatin1String("ad[sx]\\.js"), QRegularExpression::NoPatternOption));
+}
+
 QTEST_APPLESS_MAIN(AdBlockFilterTest)
 
 #include "AdBlockFilterTest.moc"
@@ -25,7 +25,10 @@ class AdBlockModel
 
 AdBlockManager::AdBlockManager(const ViperServiceLocator &, QObject *parent) :
     QObject(parent),
-    m_filterContainer(),
+    m_filterContainer(std::make_shared<FilterContainer>()),
+    m_filterLoadFuture(),
+    m_filterLoadGeneration(0),
+    m_filterReloadPending(false),
     m_downloadManager(nullptr),
     m_enabled(false),
     m_configFile("AdBlockStub.json"),
@@ -34,8 +37,10 @@ AdBlockManager::AdBlockManager(const ViperServiceLocator &, QObject *parent) :
     m_subscriptions(),
     m_resourceMap(),
     m_resourceContentTypeMap(),
+    m_resourceChecksum(),
     m_domainStylesheetCache(24),
     m_jsInjectionCache(24),
+    m_cosmeticScriptCache(48),
     m_emptyStr(),
     m_adBlockModel(nullptr),
     m_log(nullptr),
@@ -131,6 +136,11 @@ QString AdBlockManager::getResourceContentType(const QString &key) const
     return m_resourceContentTypeMap.value(key);
 }
 
+const QByteArray &AdBlockManager::getResourceChecksum() const
+{
+    return m_resourceChecksum;
+}
+
 int AdBlockManager::getNumSubscriptions() const
 {
     return static_cast<int>(m_subscriptions.size());
@@ -208,7 +218,8 @@ void AdBlockManager::loadDynamicTemplate()
     if (!templateFile.open(QIODevice::ReadOnly))
         return;
 
-    m_cosmeticJSTemplate = templateFile.readAll();
+    m_cosmeticJSTemplate = CosmeticScriptTemplate(QString::fromUtf8(templateFile.readAll()),
+                                                  { QStringLiteral("{{ADBLOCK_INTERNAL_SCRIPTLET}}"), QStringLiteral("{{ADBLOCK_INTERNAL_COSMETIC}}") });
     templateFile.close();
 }
 
@@ -333,7 +344,7 @@ void AdBlockManager::loadSubscriptions()
 
 void AdBlockManager::clearFilters()
 {
-    m_filterContainer.clearFilters();
+    m_filterContainer = std::make_shared<FilterContainer>();
 }
 
 void AdBlockManager::extractFilters()
@@ -343,7 +354,10 @@ void AdBlockManager::extractFilters()
         // calling load() does nothing if subscription is disabled
         s.load(this);
     }
-    m_filterContainer.extractFilters(m_subscriptions);
+
+    auto filterContainer = std::make_shared<FilterContainer>();
+    filterContainer->extractFilters(m_subscriptions);
+    m_filterContainer = filterContainer;
 }
 
 void AdBlockManager::save()
@@ -0,0 +1,166 @@
+#include "ShardedLRUCache.h"
+
+#include <atomic>
+#include <cstdint>
+#include <thread>
+#include <vector>
+
+#include <QObject>
+#include <QTest>
+
+/// Number of shards of the caches under test
+static constexpr std::size_t TestShardCount = 4;
+
+/// Returns a cache key that belongs to the given shard. Shards are selected by the high bits of a key
+static uint64_t makeKey(uint64_t shard, uint64_t id)
+{
+    return (shard << 48) | id;
+}
+
+/// Test cases for the \ref ShardedLRUCache class
+class ShardedLRUCacheTest : public QObject
+{
+    Q_OBJECT
+
+public:
+    ShardedLRUCacheTest() : QObject(nullptr) {}
+
+private slots:
+    /// Verifies that the least recently used value of a full shard is the one that gets evicted
+    void testEvictionOrder()
+    {
+        ShardedLRUCache<int, TestShardCount> cache(3 * TestShardCount);
+
+        cache.put(makeKey(0, 1), 1);
+        cache.put(makeKey(0, 2), 2);
+        cache.put(makeKey(0, 3), 3);
+
+        // Looking up the oldest value makes it the most recently used
+        int value = 0;
+        QVERIFY(cache.get(makeKey(0, 1), value));
+        QCOMPARE(value, 1);
+
+        cache.put(makeKey(0, 4), 4);
+        QVERIFY(!cache.get(makeKey(0, 2), value));
+        QVERIFY(cache.get(makeKey(0, 1), value));
+        QVERIFY(cache.get(makeKey(0, 3), value));
+        QVERIFY(cache.get(makeKey(0, 4), value));
+
+        // Replacing the value of a key also makes it the most recently used, without growing the shard
+        cache.put(makeKey(0, 3), 30);
+        cache.put(makeKey(0, 1), 10);
+        cache.put(makeKey(0, 5), 5);
+        QVERIFY(!cache.get(makeKey(0, 4), value));
+        QVERIFY(cache.get(makeKey(0, 3), value));
+        QCOMPARE(value, 30);
+        QVERIFY(cache.get(makeKey(0, 1), value));
+        QCOMPARE(value, 10);
+        QCOMPARE(cache.getStatistics().Size, static_cast<size_t>(3));
+    }
+
+    /// Verifies that the capacity of the cache is divided between its shards, and that a full shard does not evict from others
+    void testShardCapacity()
+    {
+        ShardedLRUCache<int, TestShardCount> cache(2 * TestShardCount);
+
+        for (uint64_t shard = 0; shard < TestShardCount; ++shard)
+        {
+            cache.put(makeKey(shard, 1), 1);
+            cache.put(makeKey(shard, 2), 2);
+        }
+        QCOMPARE(cache.getStatistics().Size, 2 * TestShardCount);
+
+        for (uint64_t id = 3; id < 10; ++id)
+            cache.put(makeKey(0, id), static_cast<int>(id));
+        QCOMPARE(cache.getStatistics().Size, 2 * TestShardCount);
+
+        int value = 0;
+        for (uint64_t shard = 1; shard < TestShardCount; ++shard)
+        {
+            QVERIFY(cache.get(makeKey(shard, 1), value));
+            QVERIFY(cache.get(makeKey(shard, 2), value));
+        }
+
+        // Each shard holds at least one value, even if the capacity is smaller than the number of shards
+        ShardedLRUCache<int, TestShardCount> tinyCache(1);
+        for (uint64_t shard = 0; shard < TestShardCount; ++shard)
+        {
+            tinyCache.put(makeKey(shard, 1), 1);
+            tinyCache.put(makeKey(shard, 2), 2);
+        }
+        QCOMPARE(tinyCache.getStatistics().Size, TestShardCount);
+        QVERIFY(tinyCache.get(makeKey(3, 2), value));
+        QVERIFY(!tinyCache.get(makeKey(3, 1), value));
+    }
+
+    /// Verifies the hit, miss and size counters of the cache
+    void testStatistics()
+    {
+        ShardedLRUCache<int, TestShardCount> cache(16);
+
+        CacheStatistics stats = cache.getStatistics();
+        QCOMPARE(stats.Hits, uint64_t(0));
+        QCOMPARE(stats.Misses, uint64_t(0));
+        QCOMPARE(stats.Size, static_cast<size_t>(0));
+        QCOMPARE(stats.getHitRate(), 0.0);
+
+        int value = 0;
+        cache.put(makeKey(0, 1), 1);
+        cache.put(makeKey(1, 1), 2);
+        QVERIFY(cache.get(makeKey(0, 1), value));
+        QVERIFY(cache.get(makeKey(1, 1), value));
+        QVERIFY(cache.get(makeKey(1, 1), value));
+        QVERIFY(!cache.get(makeKey(2, 1), value));
+
+        stats = cache.getStatistics();
+        QCOMPARE(stats.Hits, uint64_t(3));
+        QCOMPARE(stats.Misses, uint64_t(1));
+        QCOMPARE(stats.Size, static_cast<size_t>(2));
+        QCOMPARE(stats.getHitRate(), 0.75);
+
+        // Clearing the cache removes its values, but keeps the counters
+        cache.clear();
+        QVERIFY(!cache.get(makeKey(0, 1), value));
+
+        stats = cache.getStatistics();
+        QCOMPARE(stats.Hits, uint64_t(3));
+        QCOMPARE(stats.Misses, uint64_t(2));
+        QCOMPARE(stats.Size, static_cast<size_t>(0));
+    }
+
+    /// Verifies that every lookup is counted when the cache is used from several threads at once
+    void testConcurrentAccess()
+    {
+        ShardedLRUCache<uint64_t, TestShardCount> cache(64);
+
+        const int numThreads = 4, numLookups = 10000;
+        std::atomic_bool mismatch { false };
+        std::vector<std::thread> threads;
+        for (int i = 0; i < numThreads; ++i)
+        {
+            threads.emplace_back([&cache, &mismatch, i](){
+                for (uint64_t j = 0; j < static_cast<uint64_t>(numLookups); ++j)
+                {
+                    const uint64_t key = makeKey((j + static_cast<uint64_t>(i)) % TestShardCount, j % 32);
+                    uint64_t value = 0;
+                    if (cache.get(key, value) && value != key)
+                        mismatch = true;
+                    cache.put(key, key);
+                }
+            });
+        }
+
+        for (std::thread &thread : threads)
+            thread.join();
+
+        QVERIFY(!mismatch);
+
+        const CacheStatistics stats = cache.getStatistics();
+        QCOMPARE(stats.Hits + stats.Misses, static_cast<uint64_t>(numThreads * numLookups));
+        QVERIFY(stats.Size <= static_cast<size_t>(64));
+    }
+};
+
+QTEST_APPLESS_MAIN(ShardedLRUCacheTest)
+
+#include "ShardedLRUCacheTest.moc"
@@ -1,10 +1,15 @@
 #include "DatabaseFactory.h"
 #include "FakeDatabaseWorker.h"
+#include "bindings/QtSQLite.h"
 
 #include <algorithm>
+#include <thread>
+#include <QByteArray>
+#include <QDateTime>
 #include <QFile>
 #include <QString>
 #include <QTest>
+#include <QUrl>
 
 /// Tests an implementation of the DatabaseWorker and DatabaseFactory classes
 class DatabaseWorkerTest : public QObject
@@ -21,6 +26,16 @@ private slots:
 
     void testSaveAndRetrieveRecordsFromDatabase();
 
+    void testQtTypeBindings();
+
+    void testNestedTransactions();
+
+    void testStatementCache();
+
+    void testTuningProfile();
+
+    void testConnectionPool();
+
 private:
     QString m_dbFile;
 };
@@ -76,6 +91,231 @@ void DatabaseWorkerTest::testSaveAndRetrieveRecordsFromDatabase()
     }
 }
 
+void DatabaseWorkerTest::testQtTypeBindings()
+{
+    auto testDatabase = DatabaseFactory::createWorker<FakeDatabaseWorker>(m_dbFile);
+    auto &dbHandle = testDatabase->getHandle();
+
+    QVERIFY(dbHandle.execute(R"(CREATE TABLE QtTypes(Text TEXT, Link TEXT, Data BLOB, Time INTEGER))"));
+
+    const QString text = QStringLiteral("Gr\u00fc\u00dfe, \u4e16\u754c \U0001F600");
+    const QUrl url(QStringLiteral("https://example.com/p\u00e4th?q=a b"));
+    const QByteArray data("\x00\x01" "binary" "\x00\xff", 10);
+    const QDateTime time = QDateTime::fromMSecsSinceEpoch(1500000000123);
+
+    auto stmt = dbHandle.prepare(R"(INSERT INTO QtTypes(Text, Link, Data, Time) VALUES (?, ?, ?, ?))");
+
+    // Bind temporaries as well, which must be copied by SQLite before they are destroyed
+    stmt << text << url << data << time;
+    QVERIFY(stmt.execute());
+
+    stmt.reset();
+    stmt << text.mid(0, 5) << QUrl() << QByteArray() << time;
+    QVERIFY(stmt.execute());
+
+    QVERIFY(dbHandle.execute(R"(INSERT INTO QtTypes(Text, Link, Data, Time) VALUES (NULL, NULL, NULL, NULL))"));
+
+    auto query = dbHandle.prepare(R"(SELECT Text, Link, Data, Time FROM QtTypes ORDER BY rowid)");
+    QVERIFY(query.execute());
+
+    QString textOut;
+    QUrl urlOut;
+    QByteArray dataOut;
+    QDateTime timeOut;
+
+    QVERIFY(query.next());
+    query >> textOut >> urlOut >> dataOut >> timeOut;
+    QCOMPARE(textOut, text);
+    QCOMPARE(urlOut.toString(QUrl::FullyEncoded), url.toString(QUrl::FullyEncoded));
+    QCOMPARE(dataOut, data);
+    QCOMPARE(timeOut, time);
+
+    QVERIFY(query.next());
+    query >> textOut >> urlOut >> dataOut >> timeOut;
+    QCOMPARE(textOut, QStringLiteral("Gr\u00fc\u00dfe"));
+    QVERIFY(urlOut.isEmpty());
+    QVERIFY(dataOut.isEmpty());
+
+    // NULL values are read as empty strings and byte arrays
+    QVERIFY(query.next());
+    query >> textOut >> urlOut >> dataOut;
+    QVERIFY(textOut.isEmpty() && !textOut.isNull());
+    QVERIFY(urlOut.isEmpty());
+    QVERIFY(dataOut.isEmpty());
+
+    QVERIFY(!query.next());
+}
+
+void DatabaseWorkerTest::testNestedTransactions()
+{
+    auto testDatabase = DatabaseFactory::createWorker<FakeDatabaseWorker>(m_dbFile);
+    auto &dbHandle = testDatabase->getHandle();
+
+    auto countRecords = [&dbHandle](){
+        int count = -1;
+        auto query = dbHandle.prepare(R"(SELECT COUNT(id) FROM Information)");
+        if (query.next())
+            query >> count;
+        return count;
+    };
+
+    QVERIFY(!dbHandle.isInTransaction());
+    QVERIFY(dbHandle.beginTransaction());
+    QVERIFY(dbHandle.execute(R"(INSERT INTO Information(name) VALUES('Tom'))"));
+
+    // Reverting the nested transaction only undoes its own changes
+    QVERIFY(dbHandle.beginTransaction());
+    QVERIFY(dbHandle.execute(R"(INSERT INTO Information(name) VALUES('Dick'))"));
+    QVERIFY(dbHandle.rollbackTransaction());
+    QVERIFY(dbHandle.isInTransaction());
+
+    QVERIFY(dbHandle.beginTransaction());
+    QVERIFY(dbHandle.execute(R"(INSERT INTO Information(name) VALUES('Harry'))"));
+    QVERIFY(dbHandle.commitTransaction());
+    QVERIFY(dbHandle.isInTransaction());
+
+    QVERIFY(dbHandle.commitTransaction());
+    QVERIFY(!dbHandle.isInTransaction());
+    QCOMPARE(countRecords(), 2);
+
+    // Reverting the outermost transaction undoes the changes of the nested transactions as well
+    QVERIFY(dbHandle.beginTransaction());
+    QVERIFY(dbHandle.beginTransaction());
+    QVERIFY(dbHandle.execute(R"(INSERT INTO Information(name) VALUES('Dick'))"));
+    QVERIFY(dbHandle.commitTransaction());
+    QVERIFY(dbHandle.rollbackTransaction());
+    QVERIFY(!dbHandle.isInTransaction());
+    QCOMPARE(countRecords(), 2);
+}
+
+void DatabaseWorkerTest::testStatementCache()
+{
+    auto testDatabase = DatabaseFactory::createWorker<FakeDatabaseWorker>(m_dbFile);
+    auto &dbHandle = testDatabase->getHandle();
+
+    QVERIFY(dbHandle.execute(R"(INSERT INTO Information(name) VALUES('Tom'))"));
+    QVERIFY(dbHandle.execute(R"(INSERT INTO Information(name) VALUES('Dick'))"));
+    QVERIFY(dbHandle.execute(R"(INSERT INTO Information(name) VALUES('Harry'))"));
+
+    const std::string countSql = R"(SELECT COUNT(id) FROM Information WHERE name != ?)";
+    auto countRecords = [&](const QString &excludedName){
+        int count = -1;
+        auto query = dbHandle.prepareCached(countSql);
+        query << excludedName;
+        if (query.next())
+            query >> count;
+        return count;
+    };
+
+    // A statement that is fetched from the cache does not keep the bindings of its previous use
+    QCOMPARE(countRecords(QLatin1String("Tom")), 2);
+    QCOMPARE(countRecords(QLatin1String("Nobody")), 3);
+    {
+        int count = -1;
+        auto query = dbHandle.prepareCached(countSql);
+        QVERIFY(query.next());
+        query >> count;
+        QCOMPARE(count, 0);
+    }
+
+    // The same SQL can be used again while its cached statement is still in use
+    {
+        auto outerQuery = dbHandle.prepareCached(R"(SELECT name FROM Information ORDER BY id ASC)");
+        QVERIFY(outerQuery.next());
+        QCOMPARE(countRecords(QLatin1String("Dick")), 2);
+
+        auto innerQuery = dbHandle.prepareCached(R"(SELECT name FROM Information ORDER BY id ASC)");
+        QVERIFY(innerQuery.next());
+        QString outerName, innerName;
+        outerQuery >> outerName;
+        innerQuery >> innerName;
+        QCOMPARE(outerName, innerName);
+    }
+
+    // Statements returned to the cache in the middle of a result set are reset, and do not block schema changes
+    QVERIFY(dbHandle.execute(R"(CREATE TABLE Scratch(value INTEGER))"));
+    for (int i = 0; i < 64; ++i)
+    {
+        auto query = dbHandle.prepareCached(QString("SELECT name FROM Information WHERE id > %1").arg(i).toStdString());
+        query.next();
+    }
+    QVERIFY(dbHandle.execute(R"(DROP TABLE Scratch)"));
+    QCOMPARE(countRecords(QLatin1String("Harry")), 2);
+}
+
+void DatabaseWorkerTest::testTuningProfile()
+{
+    auto testDatabase = DatabaseFactory::createWorker<FakeDatabaseWorker>(m_dbFile);
+    auto &dbHandle = testDatabase->getHandle();
+
+    QString journalMode;
+    auto query = dbHandle.prepare(R"(PRAGMA journal_mode)");
+    QVERIFY(query.next());
+    query >> journalMode;
+    QCOMPARE(journalMode, QLatin1String("wal"));
+
+    // Synchronous mode NORMAL
+    int synchronous = -1;
+    query = dbHandle.prepare(R"(PRAGMA synchronous)");
+    QVERIFY(query.next());
+    query >> synchronous;
+    QCOMPARE(synchronous, 1);
+
+    // Temporary storage in memory
+    int tempStore = -1;
+    query = dbHandle.prepare(R"(PRAGMA temp_store)");
+    QVERIFY(query.next());
+    query >> tempStore;
+    QCOMPARE(tempStore, 2);
+
+    dbHandle.runMaintenance();
+    QVERIFY(dbHandle.isValid());
+}
+
+void DatabaseWorkerTest::testConnectionPool()
+{
+    auto testDatabase = DatabaseFactory::createWorker<FakeDatabaseWorker>(m_dbFile);
+    auto &dbHandle = testDatabase->getHandle();
+
+    QVERIFY(dbHandle.execute(R"(INSERT INTO Information(name) VALUES('Tom'))"));
+
+    auto pool = sqlite::ConnectionPool::forFile(m_dbFile.toStdString());
+    QVERIFY(pool == sqlite::ConnectionPool::forFile(m_dbFile.toStdString()));
+
+    auto countRecords = [&pool](){
+        int count = -1;
+        sqlite::ConnectionLease connection = pool->acquire();
+        if (!connection)
+            return count;
+
+        auto query = connection->prepareCached(R"(SELECT COUNT(id) FROM Information)");
+        if (query.next())
+            query >> count;
+        return count;
+    };
+
+    // Readers see the committed state of the database while the writer has a transaction open
+    QVERIFY(dbHandle.beginTransaction());
+    QVERIFY(dbHandle.execute(R"(INSERT INTO Information(name) VALUES('Dick'))"));
+
+    std::vector<int> counts(4, -1);
+    std::vector<std::thread> readers;
+    for (std::size_t i = 0; i < counts.size(); ++i)
+        readers.emplace_back([&counts, &countRecords, i](){ counts[i] = countRecords(); });
+    for (std::thread &reader : readers)
+        reader.join();
+
+    QVERIFY(std::all_of(counts.begin(), counts.end(), [](int count){ return count == 1; }));
+
+    QVERIFY(dbHandle.commitTransaction());
+    QCOMPARE(countRecords(), 2);
+
+    // Pooled connections cannot write to the database
+    sqlite::ConnectionLease connection = pool->acquire();
+    QVERIFY(connection);
+    QVERIFY(!connection->execute(R"(INSERT INTO Information(name) VALUES('Harry'))"));
+}
+
 QTEST_APPLESS_MAIN(DatabaseWorkerTest)
 
 #include "DatabaseWorkerTest.moc"
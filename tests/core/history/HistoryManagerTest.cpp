@@ -3,6 +3,8 @@
 #include "HistoryStore.h"
 #include "ServiceLocator.h"
 
+#include <limits>
+
 #include <QDateTime>
 #include <QFile>
 #include <QObject>
@@ -63,6 +65,7 @@ private slots:
 
         QUrl secondUrl { QUrl::fromUserInput("https://a.datacenter.website.net/landing") }, secondUrlRequested { QUrl::fromUserInput("website.net") };
         m_historyManager->addVisit(secondUrl, QLatin1String("Some Website"), QDateTime::currentDateTime(), secondUrlRequested, false);
+        m_historyManager->flushVisits();
 
         auto verifyTrueCB = [](bool result){
             QVERIFY(result);
@@ -104,6 +107,7 @@ private slots:
 
         QUrl firstUrl { QUrl::fromUserInput("https://a.datacenter.website.net/landing") }, firstUrlRequested { QUrl::fromUserInput("website.net") };
         m_historyManager->addVisit(firstUrl, QLatin1String("Some Website"), QDateTime::currentDateTime(), firstUrlRequested, true);
+        m_historyManager->flushVisits();
 
         m_historyManager->contains(firstUrl, verifyTrueCB);
         m_historyManager->contains(firstUrlRequested, verifyTrueCB);
@@ -121,6 +125,7 @@ private slots:
 
         m_historyManager->addVisit(firstUrl, QLatin1String("Some Website"), firstDate, firstUrlRequested, true);
         m_historyManager->addVisit(secondUrl, QLatin1String("Viper Browser"), secondDate, secondUrlRequested, true);
+        m_historyManager->flushVisits();
 
         m_historyManager->contains(firstUrl, verifyTrueCB);
         m_historyManager->contains(secondUrl, verifyTrueCB);
@@ -167,6 +172,7 @@ private slots:
         QUrl secondUrl { QUrl::fromUserInput("https://a.datacenter.website.net/landing") }, secondUrlRequested { QUrl::fromUserInput("website.net") };
         m_historyManager->addVisit(firstUrl, QLatin1String("Viper Browser"), QDateTime::currentDateTime(), firstUrlRequested, false);
         m_historyManager->addVisit(secondUrl, QLatin1String("Some Website"), QDateTime::currentDateTime(), secondUrlRequested, false);
+        m_historyManager->flushVisits();
 
         m_historyManager->getTimesVisitedHost(firstUrl, [](int count){
             QCOMPARE(count, 1);
@@ -202,6 +208,7 @@ private slots:
 
         QUrl secondUrl { QUrl::fromUserInput("https://a.datacenter.website.net/landing") }, secondUrlRequested { QUrl::fromUserInput("website.net") };
         m_historyManager->addVisit(secondUrl, QLatin1String("Some Website"), QDateTime::currentDateTime(), secondUrlRequested, true);
+        m_historyManager->flushVisits();
 
         m_historyManager->getHistoryFrom(firstDate, [=](std::vector<URLRecord> records){
             const URLRecord &firstRecord = records.at(0);
@@ -214,6 +221,47 @@ private slots:
         QTest::qWait(1500);
     }
 
+    /// Verifies that pages of the history and the most visited entries, which are read with pooled connections,
+    /// include the visits that were added before the read
+    void testPooledReads()
+    {
+        DatabaseTaskScheduler taskScheduler;
+        taskScheduler.addWorker("HistoryStore", std::bind(DatabaseFactory::createDBWorker<HistoryStore>, "HistoryManagerTest.db"));
+
+        ViperServiceLocator serviceLocator;
+
+        m_historyManager = new HistoryManager(serviceLocator, taskScheduler);
+        m_historyManager->setHistoryFile(m_dbFile);
+
+        taskScheduler.run();
+
+        const QUrl firstUrl { QUrl::fromUserInput("https://viper-browser.com") };
+        const QUrl secondUrl { QUrl::fromUserInput("https://a.datacenter.website.net/landing") };
+        const QDateTime visitTime = QDateTime::currentDateTime();
+        m_historyManager->addVisit(firstUrl, QLatin1String("Viper Browser"), visitTime.addSecs(-10), firstUrl, true);
+        m_historyManager->addVisit(secondUrl, QLatin1String("Some Website"), visitTime.addSecs(-5), secondUrl, false);
+        m_historyManager->addVisit(firstUrl, QLatin1String("Viper Browser"), visitTime, firstUrl, true);
+
+        bool hasPage = false;
+        const HistoryPosition position { visitTime.addDays(1), std::numeric_limits<int>::max() };
+        m_historyManager->getHistoryPage(visitTime.addDays(-1), position, 10, [&](std::vector<URLRecord> records, HistoryPosition nextPosition){
+            QCOMPARE(static_cast<int>(records.size()), 2);
+            QCOMPARE(records.at(0).getUrl(), firstUrl);
+            QCOMPARE(records.at(1).getUrl(), secondUrl);
+            QCOMPARE(nextPosition.VisitTime, visitTime.addSecs(-10));
+            hasPage = true;
+        });
+        QTRY_VERIFY(hasPage);
+
+        bool hasMostVisited = false;
+        m_historyManager->loadMostVisitedEntries(1, [&](std::vector<WebPageInformation> entries){
+            QCOMPARE(static_cast<int>(entries.size()), 1);
+            QCOMPARE(entries.at(0).URL, firstUrl);
+            hasMostVisited = true;
+        });
+        QTRY_VERIFY(hasMostVisited);
+    }
+
 private:
     /// Database file name used for tests
     QString m_dbFile;
@@ -1,6 +1,8 @@
 #include "DatabaseFactory.h"
 #include "HistoryStore.h"
 
+#include <limits>
+
 #include <QFile>
 #include <QObject>
 #include <QString>
@@ -132,6 +134,166 @@ private slots:
         QCOMPARE(records.at(1).getUrl(), secondUrlRequested);
     }
 
+    /// Tests that the history can be loaded one page at a time, from the most recent visit to the oldest
+    void testGetHistoryPage()
+    {
+        std::unique_ptr<HistoryStore> historyStore = DatabaseFactory::createWorker<HistoryStore>(m_dbFile);
+
+        // Two of the pages are visited at the same time, so that a page boundary falls between visits with equal dates
+        const QDateTime startDate = QDateTime::currentDateTime().addDays(-2);
+        const QUrl firstUrl { QLatin1String("https://viper-browser.com/") }, secondUrl { QLatin1String("https://viper-browser.com/about") },
+                   thirdUrl { QLatin1String("https://viper-browser.com/download") };
+        historyStore->addVisit(firstUrl, QLatin1String("Viper Browser"), startDate.addSecs(10), firstUrl, false);
+        historyStore->addVisit(secondUrl, QLatin1String("About"), startDate.addSecs(10), secondUrl, false);
+        historyStore->addVisit(thirdUrl, QLatin1String("Download"), startDate.addSecs(20), thirdUrl, false);
+        historyStore->addVisit(firstUrl, QLatin1String("Viper Browser"), startDate.addSecs(30), firstUrl, false);
+        historyStore->addVisit(secondUrl, QLatin1String("About"), startDate.addSecs(40), secondUrl, false);
+
+        HistoryPosition position { QDateTime::currentDateTime(), std::numeric_limits<int>::max() };
+        std::vector<QDateTime> visitTimes;
+        int numPages = 0;
+        while (true)
+        {
+            std::vector<URLRecord> records = historyStore->getHistoryPage(startDate, position, 2);
+            if (records.empty())
+                break;
+
+            ++numPages;
+
+            int numVisits = 0;
+            for (const URLRecord &record : records)
+            {
+                numVisits += record.getNumVisits();
+                visitTimes.insert(visitTimes.end(), record.getVisits().begin(), record.getVisits().end());
+            }
+            QVERIFY(numVisits <= 2);
+        }
+
+        QCOMPARE(numPages, 3);
+        QCOMPARE(static_cast<int>(visitTimes.size()), 5);
+        QCOMPARE(position.VisitTime, startDate.addSecs(10));
+
+        // Visits made before the start date are not loaded
+        position = { QDateTime::currentDateTime(), std::numeric_limits<int>::max() };
+        std::vector<URLRecord> records = historyStore->getHistoryPage(startDate.addSecs(25), position, 10);
+        QCOMPARE(static_cast<int>(records.size()), 2);
+        QCOMPARE(records.at(0).getUrl(), secondUrl);
+        QCOMPARE(records.at(1).getUrl(), firstUrl);
+        QCOMPARE(records.at(1).getNumVisits(), 1);
+    }
+
+    /// Tests that visits written in batches can be read back, both before and after a batch is full
+    void testBatchedVisits()
+    {
+        std::unique_ptr<HistoryStore> historyStore = DatabaseFactory::createWorker<HistoryStore>(m_dbFile);
+
+        const QDateTime startDate = QDateTime::currentDateTime().addDays(-1);
+        const int numVisits = static_cast<int>(HistoryStore::VisitBatchSize) * 2 + 3;
+        for (int i = 0; i < numVisits; ++i)
+        {
+            const QUrl url { QString("https://viper-browser.com/page%1").arg(i % 10) };
+            historyStore->addVisit(url, QLatin1String("Viper Browser"), startDate.addSecs(i), url, false);
+        }
+
+        const QUrl firstUrl { QLatin1String("https://viper-browser.com/page0") };
+        QVERIFY(historyStore->contains(firstUrl));
+        QCOMPARE(historyStore->getTimesVisited(firstUrl), (numVisits + 9) / 10);
+        QCOMPARE(historyStore->getTimesVisitedHost(firstUrl), 10);
+
+        // Each page is added to the search index once
+        {
+            sqlite::Database db(m_dbFile.toStdString());
+            auto stmt = db.prepare(R"(SELECT COUNT(*) FROM HistorySearch WHERE HistorySearch MATCH '"page0"')");
+            QVERIFY(stmt.next());
+
+            int numMatches = 0;
+            stmt >> numMatches;
+            QCOMPARE(numMatches, 1);
+        }
+
+        historyStore->addVisit(firstUrl, QLatin1String("Viper Browser"), QDateTime::currentDateTime(), firstUrl, false);
+        historyStore->flushVisits();
+        QCOMPARE(historyStore->getTimesVisited(firstUrl), (numVisits + 9) / 10 + 1);
+    }
+
+    /// Tests that visits written within a transaction that is later reverted are written again by the next flush
+    void testRevertedVisits()
+    {
+        std::unique_ptr<HistoryStore> historyStore = DatabaseFactory::createWorker<HistoryStore>(m_dbFile);
+
+        const uint64_t lastVisitId = historyStore->getLastVisitId();
+        const QUrl url { QLatin1String("https://viper-browser.com/reverted") };
+
+        QVERIFY(historyStore->beginTransaction());
+        historyStore->addVisit(url, QLatin1String("Viper Browser"), QDateTime::currentDateTime(), url, false);
+        historyStore->flushVisits();
+        QVERIFY(historyStore->rollbackTransaction());
+        historyStore->onGroupedTransactionEnded(false);
+
+        QCOMPARE(historyStore->getTimesVisited(url), 1);
+        QCOMPARE(historyStore->getLastVisitId(), lastVisitId + 1);
+
+        // Visits of a committed transaction are not written twice
+        QVERIFY(historyStore->beginTransaction());
+        historyStore->addVisit(url, QLatin1String("Viper Browser"), QDateTime::currentDateTime(), url, false);
+        historyStore->flushVisits();
+        QVERIFY(historyStore->commitTransaction());
+        historyStore->onGroupedTransactionEnded(true);
+
+        QCOMPARE(historyStore->getTimesVisited(url), 2);
+    }
+
+    /// Tests that the visit count and last visit columns, and the search index, are filled in when an older history
+    /// database is loaded
+    void testVisitCountMigration()
+    {
+        const QDateTime firstDate = QDateTime::currentDateTime().addDays(-2);
+        const QDateTime lastDate = QDateTime::currentDateTime().addDays(-1);
+        const QUrl url { QLatin1String("https://viper-browser.com/") };
+
+        {
+            sqlite::Database db(m_dbFile.toStdString());
+            QVERIFY(db.execute("CREATE TABLE History(VisitID INTEGER PRIMARY KEY AUTOINCREMENT, URL TEXT UNIQUE NOT NULL, Title TEXT, "
+                               "URLTypedCount INTEGER DEFAULT 0)"));
+            QVERIFY(db.execute("CREATE TABLE Visits(VisitID INTEGER NOT NULL, Date INTEGER NOT NULL, "
+                               "FOREIGN KEY(VisitID) REFERENCES History(VisitID) ON DELETE CASCADE, PRIMARY KEY(VisitID, Date))"));
+            QVERIFY(db.execute("CREATE TABLE Words(WordID INTEGER PRIMARY KEY AUTOINCREMENT, Word TEXT NOT NULL, UNIQUE (Word))"));
+            QVERIFY(db.execute("CREATE TABLE URLWords(HistoryID INTEGER NOT NULL, WordID INTEGER NOT NULL, PRIMARY KEY(HistoryID, WordID))"));
+
+            auto stmtHistory = db.prepare(R"(INSERT INTO History(VisitID, URL, Title, URLTypedCount) VALUES(1, ?, 'Viper Browser', 0))");
+            stmtHistory << url;
+            QVERIFY(stmtHistory.execute());
+
+            auto stmtVisit = db.prepare(R"(INSERT INTO Visits(VisitID, Date) VALUES(1, ?))");
+            for (const QDateTime &date : { firstDate, firstDate.addSecs(60), lastDate })
+            {
+                stmtVisit.reset();
+                stmtVisit << date;
+                QVERIFY(stmtVisit.execute());
+            }
+        }
+
+        std::unique_ptr<HistoryStore> historyStore = DatabaseFactory::createWorker<HistoryStore>(m_dbFile);
+
+        HistoryEntry entry = historyStore->getEntry(url);
+        QCOMPARE(entry.NumVisits, 3);
+        QCOMPARE(entry.LastVisit, lastDate);
+
+        // Existing entries are added to the search index
+        QCOMPARE(historyStore->getTimesVisitedHost(url), 1);
+
+        // The columns are kept up to date as visits are added and removed
+        const QDateTime newDate = QDateTime::currentDateTime();
+        historyStore->addVisit(url, QLatin1String("Viper Browser"), newDate, url, false);
+        QCOMPARE(historyStore->getTimesVisited(url), 4);
+        QCOMPARE(historyStore->getEntry(url).LastVisit, newDate);
+
+        historyStore->clearHistoryFrom(lastDate);
+        entry = historyStore->getEntry(url);
+        QCOMPARE(entry.NumVisits, 2);
+        QCOMPARE(entry.LastVisit, firstDate.addSecs(60));
+    }
+
     /*
      * todo: test cases for:
 
@@ -0,0 +1,381 @@
+#include "DatabaseFactory.h"
+#include "DatabaseTaskScheduler.h"
+#include "DatabaseWorker.h"
+
+#include <algorithm>
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include <QFile>
+#include <QObject>
+#include <QTest>
+#include <QThread>
+
+/// Database worker that counts the number of times it has been incremented
+class CounterStore final : public DatabaseWorker
+{
+    friend class DatabaseFactory;
+
+public:
+    /// Constructs the counter store with the given database file
+    explicit CounterStore(const QString &dbFile) : DatabaseWorker(dbFile) {}
+
+    /// Increments the counter, returning true if the statement was executed within a transaction
+    bool increment()
+    {
+        const bool inTransaction = m_database.isInTransaction();
+        m_database.execute("UPDATE Counter SET Value = Value + 1");
+        return inTransaction;
+    }
+
+    /// Increments the counter in a transaction of its own, which is then reverted
+    void incrementAndRollBack()
+    {
+        if (m_database.beginTransaction())
+        {
+            m_database.execute("UPDATE Counter SET Value = Value + 1");
+            m_database.rollbackTransaction();
+        }
+    }
+
+    /// Inserts a row that refers to a missing counter. The foreign key is only checked when the transaction is committed
+    void insertOrphan()
+    {
+        m_database.execute("INSERT INTO CounterReference(CounterID) VALUES (42)");
+    }
+
+    /// Rebuilds the database file, returning true on success. SQLite refuses to do this within a transaction
+    bool vacuum()
+    {
+        return m_database.execute("VACUUM");
+    }
+
+    /// Returns the value of the counter
+    int getValue()
+    {
+        int value = 0;
+        auto stmt = m_database.prepare("SELECT Value FROM Counter");
+        if (stmt.next())
+            stmt >> value;
+        return value;
+    }
+
+    /// Returns whether each of the grouped transactions of the counter store was committed, in order
+    std::vector<bool> getGroupedTransactionResults() const
+    {
+        return m_groupedTransactionResults;
+    }
+
+    /// Records whether the grouped transaction was committed
+    void onGroupedTransactionEnded(bool committed) override
+    {
+        m_groupedTransactionResults.push_back(committed);
+    }
+
+protected:
+    bool hasProperStructure() override { return hasTable(QLatin1String("Counter")); }
+
+    void setup() override
+    {
+        m_database.execute("CREATE TABLE IF NOT EXISTS Counter(ID INTEGER PRIMARY KEY, Value INTEGER NOT NULL)");
+        m_database.execute("INSERT INTO Counter(Value) VALUES (0)");
+        m_database.execute("CREATE TABLE IF NOT EXISTS CounterReference(CounterID INTEGER NOT NULL "
+                           "REFERENCES Counter(ID) DEFERRABLE INITIALLY DEFERRED)");
+    }
+
+    void load() override {}
+
+private:
+    /// Results of the grouped transactions
+    std::vector<bool> m_groupedTransactionResults;
+};
+
+/// Test cases for the \ref DatabaseTaskScheduler class
+class DatabaseTaskSchedulerTest : public QObject
+{
+    Q_OBJECT
+
+public:
+    DatabaseTaskSchedulerTest() : QObject(nullptr), m_dbFile(QLatin1String("DatabaseTaskSchedulerTest.db")) {}
+
+private slots:
+    /// Removes the database file used by the previous test
+    void cleanup()
+    {
+        if (QFile::exists(m_dbFile))
+            QFile::remove(m_dbFile);
+    }
+
+    /// Verifies that the tasks of one database are executed serially, in the order they were posted
+    void testSerialQueue()
+    {
+        DatabaseTaskScheduler taskScheduler(4);
+
+        std::atomic_int numRunning { 0 };
+        std::atomic_bool overlapped { false };
+        std::vector<int> order;
+
+        for (int i = 0; i < 50; ++i)
+        {
+            taskScheduler.post("Database", TaskPriority::Interactive, [&, i](){
+                if (++numRunning > 1)
+                    overlapped = true;
+
+                order.push_back(i);
+                --numRunning;
+            });
+        }
+
+        taskScheduler.run();
+        taskScheduler.stop();
+
+        QVERIFY(!overlapped);
+        QCOMPARE(static_cast<int>(order.size()), 50);
+        QVERIFY(std::is_sorted(order.begin(), order.end()));
+    }
+
+    /// Verifies that a long running task of one database does not hold up the tasks of another database
+    void testIndependentQueues()
+    {
+        DatabaseTaskScheduler taskScheduler(2);
+        taskScheduler.run();
+
+        std::atomic_bool release { false };
+        taskScheduler.post("History", TaskPriority::Background, [&release](){
+            while (!release)
+                std::this_thread::yield();
+        });
+
+        std::future<int> result = taskScheduler.postWithResult("Bookmarks", TaskPriority::Interactive, [](){
+            return 42;
+        });
+        QVERIFY(result.wait_for(std::chrono::seconds(5)) == std::future_status::ready);
+        QCOMPARE(result.get(), 42);
+
+        release = true;
+        taskScheduler.stop();
+    }
+
+    /// Verifies that pending interactive tasks are executed before pending background tasks
+    void testPriorityLanes()
+    {
+        DatabaseTaskScheduler taskScheduler(1);
+
+        std::vector<TaskPriority> order;
+        auto recordPriority = [&order](TaskPriority priority){
+            order.push_back(priority);
+        };
+
+        taskScheduler.post("Database", TaskPriority::Background, recordPriority, TaskPriority::Background);
+        taskScheduler.post("Database", TaskPriority::Interactive, recordPriority, TaskPriority::Interactive);
+        taskScheduler.post("Database", TaskPriority::Background, recordPriority, TaskPriority::Background);
+        taskScheduler.post("Database", TaskPriority::Interactive, recordPriority, TaskPriority::Interactive);
+
+        taskScheduler.run();
+        taskScheduler.stop();
+
+        const std::vector<TaskPriority> expected { TaskPriority::Interactive, TaskPriority::Interactive,
+                                                   TaskPriority::Background, TaskPriority::Background };
+        QVERIFY(order == expected);
+    }
+
+    /// Verifies that a keyed task cancels a pending task with the same key, and runs after the tasks posted before it
+    void testKeyedTasks()
+    {
+        DatabaseTaskScheduler taskScheduler;
+
+        std::vector<int> values;
+        auto recordValue = [&values](int value){
+            values.push_back(value);
+        };
+
+        taskScheduler.postKeyed("Database", TaskPriority::Interactive, "Record.1", recordValue, 1);
+        taskScheduler.post("Database", TaskPriority::Interactive, recordValue, 2);
+        taskScheduler.postKeyed("Database", TaskPriority::Interactive, "Record.1", recordValue, 3);
+        taskScheduler.postKeyed("Database", TaskPriority::Interactive, "Record.2", recordValue, 4);
+
+        taskScheduler.run();
+        taskScheduler.stop();
+
+        const std::vector<int> expected { 2, 3, 4 };
+        QVERIFY(values == expected);
+
+        // Once the task of a key has been executed, a new task with that key is queued again
+        taskScheduler.postKeyed("Database", TaskPriority::Interactive, "Record.1", recordValue, 5);
+        taskScheduler.run();
+        taskScheduler.stop();
+
+        QCOMPARE(values.back(), 5);
+
+        std::vector<DatabaseQueueStats> stats = taskScheduler.getQueueStats();
+        QCOMPARE(static_cast<int>(stats.at(0).TasksCoalesced), 1);
+        QCOMPARE(static_cast<int>(stats.at(0).TasksExecuted), 4);
+    }
+
+    /// Verifies that consecutive tasks of a database worker are executed within a single transaction
+    void testTransactionGrouping()
+    {
+        DatabaseTaskScheduler taskScheduler;
+        taskScheduler.addWorker("CounterStore", std::bind(DatabaseFactory::createDBWorker<CounterStore>, m_dbFile));
+
+        CounterStore *counterStore = nullptr;
+        taskScheduler.onInit("CounterStore", [&](){
+            counterStore = static_cast<CounterStore*>(taskScheduler.getWorker("CounterStore"));
+        });
+
+        std::atomic_int numInTransaction { 0 };
+        for (int i = 0; i < 10; ++i)
+        {
+            taskScheduler.post("CounterStore", TaskPriority::Interactive, [&](){
+                if (counterStore->increment())
+                    ++numInTransaction;
+            });
+        }
+
+        taskScheduler.run();
+        taskScheduler.stop();
+
+        QCOMPARE(numInTransaction.load(), 10);
+
+        std::future<int> value = taskScheduler.postWithResult("CounterStore", TaskPriority::Interactive, [&](){
+            return counterStore->getValue();
+        });
+        taskScheduler.run();
+        QCOMPARE(value.get(), 10);
+        taskScheduler.stop();
+    }
+
+    /// Verifies that the tasks of a transaction only revert their own changes, and that statements which can
+    /// not run within a transaction fail without affecting the other tasks
+    void testTransactionIsolation()
+    {
+        DatabaseTaskScheduler taskScheduler;
+        taskScheduler.addWorker("CounterStore", std::bind(DatabaseFactory::createDBWorker<CounterStore>, m_dbFile));
+
+        CounterStore *counterStore = nullptr;
+        taskScheduler.onInit("CounterStore", [&](){
+            counterStore = static_cast<CounterStore*>(taskScheduler.getWorker("CounterStore"));
+        });
+
+        std::atomic_int numInTransaction { 0 };
+        auto increment = [&](){
+            if (counterStore->increment())
+                ++numInTransaction;
+        };
+
+        std::atomic_bool vacuumed { true };
+        taskScheduler.post("CounterStore", TaskPriority::Interactive, increment);
+        taskScheduler.post("CounterStore", TaskPriority::Interactive, [&](){ counterStore->incrementAndRollBack(); });
+        taskScheduler.post("CounterStore", TaskPriority::Interactive, [&](){ vacuumed = counterStore->vacuum(); });
+        taskScheduler.post("CounterStore", TaskPriority::Interactive, increment);
+
+        taskScheduler.run();
+        taskScheduler.stop();
+
+        QVERIFY(!vacuumed.load());
+        QCOMPARE(numInTransaction.load(), 2);
+
+        std::future<int> value = taskScheduler.postWithResult("CounterStore", TaskPriority::Interactive, [&](){
+            return counterStore->getValue();
+        });
+        taskScheduler.run();
+        QCOMPARE(value.get(), 2);
+        taskScheduler.stop();
+    }
+
+    /// Verifies that a worker is told when the transaction of its tasks could not be committed, and that the
+    /// results of the tasks are only delivered after the transaction has ended
+    void testFailedTransactionCommit()
+    {
+        DatabaseTaskScheduler taskScheduler;
+        taskScheduler.addWorker("CounterStore", std::bind(DatabaseFactory::createDBWorker<CounterStore>, m_dbFile));
+
+        CounterStore *counterStore = nullptr;
+        taskScheduler.onInit("CounterStore", [&](){
+            counterStore = static_cast<CounterStore*>(taskScheduler.getWorker("CounterStore"));
+        });
+
+        taskScheduler.post("CounterStore", TaskPriority::Interactive, [&](){ counterStore->increment(); });
+        taskScheduler.post("CounterStore", TaskPriority::Interactive, [&](){ counterStore->insertOrphan(); });
+        std::future<int> value = taskScheduler.postWithResult("CounterStore", TaskPriority::Interactive, [&](){
+            counterStore->increment();
+            return counterStore->getValue();
+        });
+
+        taskScheduler.run();
+        QCOMPARE(value.get(), 2);
+
+        const std::vector<bool> expected { false };
+        QVERIFY(counterStore->getGroupedTransactionResults() == expected);
+        taskScheduler.stop();
+
+        std::future<int> committedValue = taskScheduler.postWithResult("CounterStore", TaskPriority::Interactive, [&](){
+            return counterStore->getValue();
+        });
+        taskScheduler.run();
+        QCOMPARE(committedValue.get(), 0);
+        taskScheduler.stop();
+    }
+
+    /// Verifies that the continuation of a task is invoked in the thread of its context object
+    void testContinuationThread()
+    {
+        DatabaseTaskScheduler taskScheduler;
+        taskScheduler.run();
+
+        QObject context;
+        QThread *taskThread = nullptr;
+        QThread *continuationThread = nullptr;
+        int value = 0;
+
+        taskScheduler.postAndThen("Database", TaskPriority::Interactive, [&taskThread](){
+            taskThread = QThread::currentThread();
+            return 7;
+        }, &context, [&](int result){
+            continuationThread = QThread::currentThread();
+            value = result;
+        });
+
+        QTRY_COMPARE(value, 7);
+        QVERIFY(taskThread != QThread::currentThread());
+        QCOMPARE(continuationThread, QThread::currentThread());
+
+        taskScheduler.stop();
+    }
+
+    /// Verifies that the queue metrics reflect the pending and executed tasks
+    void testQueueStats()
+    {
+        DatabaseTaskScheduler taskScheduler;
+
+        for (int i = 0; i < 3; ++i)
+            taskScheduler.post("Database", TaskPriority::Interactive, [](){});
+        taskScheduler.post("Database", TaskPriority::Background, [](){});
+
+        std::vector<DatabaseQueueStats> stats = taskScheduler.getQueueStats();
+        QCOMPARE(static_cast<int>(stats.size()), 1);
+        QCOMPARE(stats.at(0).Name, std::string("Database"));
+        QCOMPARE(static_cast<int>(stats.at(0).InteractiveDepth), 3);
+        QCOMPARE(static_cast<int>(stats.at(0).BackgroundDepth), 1);
+        QCOMPARE(static_cast<int>(stats.at(0).TasksExecuted), 0);
+
+        taskScheduler.run();
+        taskScheduler.stop();
+
+        stats = taskScheduler.getQueueStats();
+        QCOMPARE(static_cast<int>(stats.at(0).InteractiveDepth), 0);
+        QCOMPARE(static_cast<int>(stats.at(0).BackgroundDepth), 0);
+        QCOMPARE(static_cast<int>(stats.at(0).TasksExecuted), 4);
+        QVERIFY(stats.at(0).MaxWaitTime <= stats.at(0).TotalWaitTime);
+    }
+
+private:
+    /// Database file used by the tests of the database worker queues
+    QString m_dbFile;
+};
+
+QTEST_GUILESS_MAIN(DatabaseTaskSchedulerTest)
+
+#include "DatabaseTaskSchedulerTest.moc"
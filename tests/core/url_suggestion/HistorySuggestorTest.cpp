@@ -7,6 +7,7 @@
 #include "HistorySuggestor.h"
 #include "ServiceLocator.h"
 #include "Settings.h"
+#include "SQLiteWrapper.h"
 #include "URLSuggestion.h"
 
 #include <atomic>
@@ -17,6 +18,7 @@
 
 const static QString TEST_FAVICON_DB_FILE = QStringLiteral("HISTORY_SUGGESTOR_TEST_FAVICON.db");
 const static QString TEST_DB_FILE = QStringLiteral("HISTORY_SUGGESTOR_TEST.db");
+const static QString TEST_NO_INDEX_DB_FILE = QStringLiteral("HISTORY_SUGGESTOR_TEST_NO_INDEX.db");
 
 class HistorySuggestorTest : public QObject
 {
@@ -85,6 +87,7 @@ private Q_SLOTS:
 
         historyManager.addVisit(firstUrl, QLatin1String("Viper Browser"), QDateTime::currentDateTime(), firstUrl, true);
         historyManager.addVisit(secondUrl, QLatin1String("Other Webpage"), QDateTime::currentDateTime(), secondUrl, true);
+        historyManager.flushVisits();
 
         // Finally instantiate the history suggestor
         HistorySuggestor suggestor;
@@ -162,6 +165,7 @@ private Q_SLOTS:
 
         historyManager.addVisit(firstUrl, QLatin1String("Reliable News"), QDateTime::currentDateTime(), firstUrl, true);
         historyManager.addVisit(secondUrl, QLatin1String("Donate Today | FAQ"), QDateTime::currentDateTime().addDays(-1), secondUrl, false);
+        historyManager.flushVisits();
 
         // Finally instantiate the history suggestor
         HistorySuggestor suggestor;
@@ -210,6 +214,56 @@ private Q_SLOTS:
         t1.join();
     }
 
+    void testThatEntriesMatchWithoutSearchIndex()
+    {
+        std::thread t1([this](){
+        if (QFile::exists(TEST_NO_INDEX_DB_FILE))
+            QFile::remove(TEST_NO_INDEX_DB_FILE);
+
+        // A history database from before the search index was created, or whose index could not be created
+        {
+            sqlite::Database db(TEST_NO_INDEX_DB_FILE.toStdString());
+            QVERIFY(db.isValid());
+            QVERIFY(db.execute("CREATE TABLE History(VisitID INTEGER PRIMARY KEY AUTOINCREMENT, URL TEXT UNIQUE NOT NULL, Title TEXT, "
+                               "URLTypedCount INTEGER DEFAULT 0, VisitCount INTEGER NOT NULL DEFAULT 0, LastVisit INTEGER NOT NULL DEFAULT 0)"));
+
+            const std::string insertSql = "INSERT INTO History(VisitID, URL, Title, URLTypedCount, VisitCount, LastVisit) "
+                                          "VALUES(1, 'https://viper-browser.com', 'Viper Browser', 1, 1, "
+                                          + std::to_string(QDateTime::currentMSecsSinceEpoch()) + ")";
+            QVERIFY(db.execute(insertSql));
+        }
+
+        ViperServiceLocator serviceLocator;
+        FaviconManager faviconManager(TEST_FAVICON_DB_FILE);
+        QVERIFY(serviceLocator.addService(faviconManager.objectName().toStdString(), &faviconManager));
+
+        HistorySuggestor suggestor;
+        suggestor.setServiceLocator(serviceLocator);
+        suggestor.setHistoryFile(TEST_NO_INDEX_DB_FILE);
+
+        std::atomic_bool working { true };
+
+        // The whole input is matched with a LIKE pattern instead of the search index
+        QString searchTerm("VIPER BROWSER");
+        FastHashParameters hashParams = getHashParams(searchTerm);
+
+        std::vector<URLSuggestion> result =
+                suggestor.getSuggestions(working, searchTerm, CommonUtil::tokenizePossibleUrl(searchTerm), hashParams);
+
+        QVERIFY2(result.size() == 1, "Expected result set to have a single entry");
+        QVERIFY2(result[0].URL.compare(QLatin1String("https://viper-browser.com")) == 0, "URL Should match expectation");
+
+        searchTerm = QLatin1String("DOESNT MATCH");
+        hashParams = getHashParams(searchTerm);
+        result = suggestor.getSuggestions(working, searchTerm, CommonUtil::tokenizePossibleUrl(searchTerm), hashParams);
+
+        QVERIFY2(result.empty(), "Expected result set to be empty");
+        });
+        t1.join();
+
+        QFile::remove(TEST_NO_INDEX_DB_FILE);
+    }
+
     void testThatStaleEntriesDontMatch()
     {
         /*
@@ -1,5 +1,6 @@
 #include "FastHash.h"
 #include "CommonUtil.h"
+#include "MultiPatternMatcher.h"
 
 #include <algorithm>
 #include <random>
@@ -52,6 +53,26 @@ private Q_SLOTS:
     void testStringsShouldNotMatch_data();
 
     void testStringsShouldNotMatch();
+
+    void testMultiPatternMatch_data();
+
+    void testMultiPatternMatch();
+
+    void testManyNeedlesRabinKarp_data();
+
+    void testManyNeedlesRabinKarp();
+
+    void testManyNeedlesMultiPattern_data();
+
+    void testManyNeedlesMultiPattern();
+
+private:
+    /// Generates a set of random needles and a haystack that contains exactly one of them, using a fixed seed
+    /// so that the Rabin-Karp and multi-pattern benchmarks are comparable
+    void generateNeedleSet(int numNeedles, std::vector<std::string> &needles, std::string &haystack);
+
+    /// Populates the data of a benchmark that searches for many needles within a single haystack
+    void addManyNeedlesData();
 };
 
 FastHashTest::FastHashTest()
@@ -144,6 +165,154 @@ void FastHashTest::testStringsShouldNotMatch()
 	QVERIFY2(!isMatch, errMsgCStr);
 }
 
+void FastHashTest::testMultiPatternMatch_data()
+{
+    QTest::addColumn<QStringList>("needles");
+    QTest::addColumn<QString>("haystack");
+    QTest::addColumn<QStringList>("expected");
+
+    QTest::newRow("tag manager") << QStringList { "tagmanager.com/tag.js", "/ads/", "tag" }
+                                 << "https://target.ad.TagManager.com/tag.js"
+                                 << QStringList { "tagmanager.com/tag.js", "tag" };
+    QTest::newRow("overlapping") << QStringList { "he", "she", "his", "hers" }
+                                 << "ushers"
+                                 << QStringList { "he", "she", "hers" };
+    QTest::newRow("no match") << QStringList { "somecdn.com/img", ".example.com/ads/" }
+                              << "https://subdomain.somecnd.com/img/a/123/4/xyz.jpg"
+                              << QStringList();
+}
+
+void FastHashTest::testMultiPatternMatch()
+{
+    QFETCH(QStringList, needles);
+    QFETCH(QString, haystack);
+    QFETCH(QStringList, expected);
+
+    MultiPatternMatcher matcher;
+    for (int i = 0; i < needles.size(); ++i)
+        matcher.addPattern(needles.at(i).toStdString(), static_cast<uint32_t>(i));
+    matcher.build();
+
+    std::string text;
+    MultiPatternMatcher::toLowerLatin1(haystack, text);
+
+    QStringList found;
+    matcher.search(text.data(), text.size(), [&](uint32_t id) {
+        if (!found.contains(needles.at(static_cast<int>(id))))
+            found.append(needles.at(static_cast<int>(id)));
+        return false;
+    });
+
+    found.sort();
+    expected.sort();
+    QCOMPARE(found, expected);
+}
+
+void FastHashTest::testManyNeedlesRabinKarp_data()
+{
+    addManyNeedlesData();
+}
+
+void FastHashTest::testManyNeedlesRabinKarp()
+{
+    QFETCH(int, numNeedles);
+
+    std::vector<std::string> needles;
+    std::string haystack;
+    generateNeedleSet(numNeedles, needles, haystack);
+
+    struct HashedNeedle
+    {
+        std::wstring Needle;
+        quint64 NeedleHash;
+        quint64 DifferenceHash;
+    };
+
+    std::vector<HashedNeedle> hashedNeedles;
+    for (const std::string &needle : needles)
+    {
+        std::wstring needleWideStr = QString::fromStdString(needle).toStdWString();
+        hashedNeedles.push_back(HashedNeedle { needleWideStr, FastHash::getNeedleHash(needleWideStr),
+                                               FastHash::getDifferenceHash(static_cast<quint64>(needle.size())) });
+    }
+
+    const std::wstring haystackWideStr = QString::fromStdString(haystack).toStdWString();
+
+    int numMatches = 0;
+    QBENCHMARK {
+        numMatches = 0;
+        for (const HashedNeedle &needle : hashedNeedles)
+        {
+            if (FastHash::isMatch(needle.Needle, haystackWideStr, needle.NeedleHash, needle.DifferenceHash))
+                ++numMatches;
+        }
+    }
+
+    QVERIFY(numMatches >= 1);
+}
+
+void FastHashTest::testManyNeedlesMultiPattern_data()
+{
+    addManyNeedlesData();
+}
+
+void FastHashTest::testManyNeedlesMultiPattern()
+{
+    QFETCH(int, numNeedles);
+
+    std::vector<std::string> needles;
+    std::string haystack;
+    generateNeedleSet(numNeedles, needles, haystack);
+
+    MultiPatternMatcher matcher;
+    for (std::size_t i = 0; i < needles.size(); ++i)
+        matcher.addPattern(needles.at(i), static_cast<uint32_t>(i));
+    matcher.build();
+
+    const QString haystackStr = QString::fromStdString(haystack);
+    std::string text;
+
+    int numMatches = 0;
+    QBENCHMARK {
+        numMatches = 0;
+        MultiPatternMatcher::toLowerLatin1(haystackStr, text);
+        matcher.search(text.data(), text.size(), [&numMatches](uint32_t) {
+            ++numMatches;
+            return false;
+        });
+    }
+
+    QVERIFY(numMatches >= 1);
+}
+
+void FastHashTest::generateNeedleSet(int numNeedles, std::vector<std::string> &needles, std::string &haystack)
+{
+    // Lowercase characters only, as the multi-pattern matcher operates on lowercase text
+    const std::string charSet = "0123456789abcdefghijklmnopqrstuvwxyz";
+    std::default_random_engine rng(1234);
+    std::uniform_int_distribution<std::size_t> dist(0, charSet.size() - 1);
+    auto randchar = [&charSet, &dist, &rng]() {
+        return charSet[dist(rng)];
+    };
+
+    std::uniform_int_distribution<size_t> randNeedleLen(5, 40);
+    needles.clear();
+    for (int i = 0; i < numNeedles; ++i)
+        needles.push_back(random_string(randNeedleLen(rng), randchar));
+
+    haystack = random_string(150, randchar);
+    haystack.insert(haystack.size() / 2, needles.at(needles.size() / 2));
+}
+
+void FastHashTest::addManyNeedlesData()
+{
+    QTest::addColumn<int>("numNeedles");
+
+    QTest::newRow("100 needles") << 100;
+    QTest::newRow("1000 needles") << 1000;
+    QTest::newRow("10000 needles") << 10000;
+}
+
 QTEST_APPLESS_MAIN(FastHashTest)
 
 #include "FastHashTest.moc"